@@ -3,5 +3,5 @@
 
 namespace gfx {
 
-RendererT GPUObject::assignmentOperator = 0;
+std::atomic<RendererT> GPUObject::assignmentOperator(0);
 } // gfx
\ No newline at end of file
@@ -1,7 +1,9 @@
 //
 #pragma once
 
-#include "WinConfigs.h"
+#include "PlatformConfigs.h"
+
+#include <atomic>
 
 
 namespace gfx {
@@ -82,10 +84,13 @@ typedef U64 RendererT;
 */
 class GPUObject
 {
-    static RendererT assignmentOperator;
+    // Objects are created on job threads too, see BackendRenderer::isPipelineCreationThreadSafe().
+    static std::atomic<RendererT> assignmentOperator;
 public:
     GPUObject()
         : m_uuid(++assignmentOperator) { }
+    // Backends delete their objects through these base classes.
+    virtual ~GPUObject() { }
 
     RendererT getUUID() const { return m_uuid; }
 private:
@@ -979,9 +984,9 @@ public:
     virtual void setGraphicsRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) { }
     virtual void setComputeRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) { }
     virtual void setComputeRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset = 0ull) { }
-    virtual void setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView) { }
+    virtual void setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset = 0ull) { }
     virtual void setGraphicsRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset = 0ull) { }
-    virtual void setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView) { }
+    virtual void setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset = 0ull) { }
     virtual void setGraphicsRoot32BitConstant(U32 rootParameterIndex) { }
     virtual void close() { }
     virtual void setViewports(Viewport* pViewports, U32 viewportCount) { }
@@ -995,6 +1000,16 @@ public:
                                    U32 numRects,
                                    const RECT* rects) {}
     virtual void copyResource(Resource* pDst, Resource* pSrc) { }
+    // Copy szBytes between two buffers.
+    virtual void copyBufferRegion(Resource* pDst, U64 dstOffset, Resource* pSrc, U64 srcOffset, U64 szBytes) { }
+    // Copy a 2D image laid out in the pSrc buffer at srcOffset, rowPitch bytes per row, into mip 0 of pDst.
+    virtual void copyBufferToTexture2D(Resource* pDst, 
+                                       Resource* pSrc, 
+                                       U64 srcOffset, 
+                                       U32 width, 
+                                       U32 height, 
+                                       DXGI_FORMAT format, 
+                                       U32 rowPitch) { }
     virtual void setMarker(const char* tag = nullptr) { }
     B32 isRecording() const { return _isRecording; }
 
@@ -1030,8 +1045,12 @@ public:
 
     virtual void present() { }
 
+    // Every signal is a new value of the fence, so a completed fence can be signaled again.
     virtual void signalFence(RendererT queue, Fence* fence) { }
+    // Block until the gpu has passed the last signal of the fence.
     virtual void waitFence(Fence* fence) { }
+    // Non blocking check that the gpu has passed the last signal of the fence.
+    virtual B32 isFenceComplete(Fence* fence) { return true; }
 
     virtual void createBuffer(Resource** buffer,
                               ResourceUsage usage,
@@ -1061,6 +1080,9 @@ public:
                                              const GraphicsPipelineInfo* pInfo) { }
     virtual void createComputePipelineState(ComputePipeline** pipeline,
                                             const ComputePipelineInfo* pInfo) { }
+    // True if pipelines can be created from several threads at once. Their root signatures must
+    // already exist, root signatures are only ever created from the one thread.
+    virtual B32 isPipelineCreationThreadSafe() { return false; }
     virtual void createRayTracingPipelineState(RayTracingPipeline** ppPipeline, 
                                                const RayTracingPipelineInfo* pInfo) { }
 
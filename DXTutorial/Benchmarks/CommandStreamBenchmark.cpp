@@ -0,0 +1,127 @@
+// Benchmark for the recording command list. Records a GBuffer like sequence of draws, a few state
+// changes between instanced draws, into the no-op list of the null RHI and into a
+// RecordingCommandList, and reports the cost per draw of each and the bytes per draw of the
+// stream. Then replays the stream into a second recording list, on another thread, as a capture
+// would be replayed against a gpu list, and checks the replay recorded the same bytes.
+//
+// Usage: CommandStreamBenchmark [drawCount] [iterations]
+//
+#include "PlatformConfigs.h"
+#include "RecordingCommandList.h"
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+using namespace gfx;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const U32 kPipelineCount = 2;
+const U32 kVertexBufferCount = 64;
+const U32 kMaterialCount = 16;
+
+
+// Stand ins for the objects a frame binds, they are only ever compared by address.
+struct SceneObjects
+{
+    SceneObjects()
+        : _instances(RESOURCE_DIMENSION_BUFFER, RESOURCE_USAGE_CPU_TO_GPU, RESOURCE_BIND_SHADER_RESOURCE)
+        , _constants(RESOURCE_DIMENSION_BUFFER, RESOURCE_USAGE_CPU_TO_GPU, RESOURCE_BIND_CONSTANT_BUFFER) { }
+
+    GraphicsPipeline _pipelines[kPipelineCount];
+    TargetView _vertexBuffers[kVertexBufferCount];
+    TargetView _indexBuffer;
+    RenderPass _renderPass;
+    RootSignature _rootSignature;
+    DescriptorTable _descriptorTable;
+    Resource _instances;
+    Resource _constants;
+};
+
+
+void recordDraws(CommandList* pList, SceneObjects& scene, U32 drawCount)
+{
+    Viewport viewport = { 0.0f, 0.0f, 1920.0f, 1080.0f, 0.0f, 1.0f };
+    Scissor scissor = { 0, 0, 1920, 1080 };
+    DescriptorTable* pTable = &scene._descriptorTable;
+    pList->reset("GBuffer");
+    pList->setViewports(&viewport, 1);
+    pList->setScissors(&scissor, 1);
+    pList->setDescriptorTables(&pTable, 1);
+    pList->setRenderPass(&scene._renderPass);
+    pList->setGraphicsRootSignature(&scene._rootSignature);
+    pList->setGraphicsRootDescriptorTable(0, pTable);
+    pList->setIndexBuffer(&scene._indexBuffer);
+    for (U32 i = 0; i < drawCount; ++i) {
+        // Sorted by pipeline, then buffers, then material, as the render queue keys them.
+        if (i % (drawCount / kPipelineCount + 1) == 0)
+            pList->setGraphicsPipeline(&scene._pipelines[i * kPipelineCount / drawCount]);
+        if (i % 4 == 0) {
+            VertexBufferView* pView = &scene._vertexBuffers[(i / 4) % kVertexBufferCount];
+            pList->setVertexBuffers(0, &pView, 1);
+        }
+        if (i % 2 == 0)
+            pList->setGraphicsRootConstantBufferView(2, &scene._constants, ((i / 2) % kMaterialCount) * 256ull);
+        pList->setGraphicsRootShaderResourceView(1, &scene._instances, i * 64ull);
+        pList->drawIndexedInstanced(36 + i % 7, 1 + i % 3, (i % 5) * 36, 0, 0);
+    }
+    pList->close();
+}
+
+
+template<typename Fn>
+R64 measureNsPerDraw(U32 drawCount, U32 iterations, Fn fn)
+{
+    R64 best = 1e30;
+    for (U32 run = 0; run < iterations; ++run) {
+        Clock::time_point start = Clock::now();
+        fn();
+        R64 ns = (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count();
+        best = ns < best ? ns : best;
+    }
+    return best / (R64)drawCount;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 drawCount = argc > 1 ? (U32)atoi(argv[1]) : 16384u;
+    U32 iterations = argc > 2 ? (U32)atoi(argv[2]) : 20u;
+    drawCount = drawCount ? drawCount : 1u;
+    iterations = iterations ? iterations : 1u;
+
+    std::unique_ptr<SceneObjects> pScene(new SceneObjects());
+    CommandList nullList;
+    RecordingCommandList recorded;
+    RecordingCommandList replayed;
+
+    R64 nullNs = measureNsPerDraw(drawCount, iterations, [&] () { recordDraws(&nullList, *pScene, drawCount); });
+    R64 recordNs = measureNsPerDraw(drawCount, iterations, [&] () { recordDraws(&recorded, *pScene, drawCount); });
+    R64 replayNs = 0.0;
+    std::thread replayThread([&] () {
+        replayNs = measureNsPerDraw(drawCount, iterations, [&] () { recorded.replay(&replayed); });
+    });
+    replayThread.join();
+
+    B32 matches = recorded.getSizeBytes() == replayed.getSizeBytes()
+               && memcmp(recorded.getData(), replayed.getData(), recorded.getSizeBytes()) == 0
+               && recorded.hash() == replayed.hash();
+
+    printf("%u draws, %u commands, %u objects\n", recorded.getDrawCount(), recorded.getCommandCount(), recorded.getObjectCount());
+    printf("  no-op list   %7.2f ns per draw\n", nullNs);
+    printf("  recording    %7.2f ns per draw  %.1f bytes per draw  (%llu bytes)\n",
+           recordNs, (R64)recorded.getSizeBytes() / recorded.getDrawCount(),
+           (unsigned long long)recorded.getSizeBytes());
+    printf("  replay       %7.2f ns per draw, on another thread\n", replayNs);
+    printf("  round trip   %s, hash %016llx\n", matches ? "identical" : "MISMATCH", (unsigned long long)recorded.hash());
+    return matches ? 0 : 1;
+}
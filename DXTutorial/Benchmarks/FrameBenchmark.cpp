@@ -0,0 +1,251 @@
+// Scaling benchmark for the job system. Runs the front end over a synthetic scene of quads on a
+// grid with the null RHI, as DXTutorialHeadless does, once without workers and then with job
+// systems of growing worker counts, and reports update() and render() time per frame, render()
+// including the recording of every pass into its command lists. First reports the cost of the
+// scheduler itself, as a parallel for over empty pieces, and as a chain of batches that each
+// depend on the one before, which also checks they ran in order, and fails if they did not.
+//
+// Usage: FrameBenchmark [meshCount] [frameCount] [worker counts...]
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "JobSystem.h"
+#include "TransformBatch.h"
+
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+
+using namespace jcl;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+Vertex quad[6] = {
+  { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } }
+};
+
+U32 quadIndices[6] = {
+    0, 1, 2, 3, 4, 5
+};
+
+
+R64 elapsedMs(Clock::time_point start)
+{
+    return (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1e6;
+}
+
+
+struct FrameTimes
+{
+    R64 _updateMs;
+    R64 _renderMs;
+    U32 _drawCount;
+    U32 _listCount;
+    // State calls of the last frame, forwarded and filtered as redundant.
+    U32 _stateForwarded;
+    U32 _stateFiltered;
+};
+
+
+// Average update() and render() time over frameCount frames, after a few to warm up.
+FrameTimes runFrames(JobSystem* pJobs, U32 meshCount, U32 frameCount)
+{
+    FrontEndRenderer renderer;
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+    renderer.setJobSystem(pJobs);
+
+    Globals globals = { };
+    globals._targetSize[0] = 1920;
+    globals._targetSize[1] = 1080;
+    globals._near = 0.005f;
+    globals._far = 1000.0f;
+    renderer.setGlobals(&globals);
+
+    // A buffer per handful of meshes, so the opaque passes record many instanced draws.
+    const U32 kMeshesPerBuffer = 8;
+    std::vector<VertexBuffer> vertexBuffers((meshCount + kMeshesPerBuffer - 1) / kMeshesPerBuffer);
+    for (VertexBuffer& vertexBuffer : vertexBuffers) {
+        vertexBuffer = renderer.createVertexBuffer(quad, sizeof(Vertex), sizeof(quad));
+    }
+    IndexBuffer indexBuffer = renderer.createIndexBufferView(quadIndices, sizeof(quadIndices));
+    PerMaterialDescriptor material = { };
+    material._albedo = Vector4(1.0f, 1.0f, 1.0f);
+    RenderUUID materialId = renderer.createMaterialBuffer();
+
+    std::vector<PerMeshDescriptor> descriptors(meshCount);
+    std::vector<GeometryMesh> meshes(meshCount);
+    std::vector<GeometrySubMesh> submeshes(meshCount);
+    for (U32 i = 0; i < meshCount; ++i) {
+        GeometryMesh& mesh = meshes[i];
+        mesh._vertexBufferView = vertexBuffers[i / kMeshesPerBuffer].vertexBufferView;
+        mesh._indexBufferView = indexBuffer.indexBufferView;
+        mesh._meshTransform = renderer.createTransformBuffer();
+        mesh._meshDescriptor = &descriptors[i];
+        mesh._submeshCount = 1;
+        mesh._bounds = Bounds3D(Vector3(-1.0f, -1.0f, 0.0f), Vector3(1.0f, 1.0f, 0.0f));
+        mesh._vertexFormat = VERTEX_FORMAT_FLOAT;
+
+        GeometrySubMesh& submesh = submeshes[i];
+        submesh._materialDescriptor = materialId;
+        submesh._matData = &material;
+        submesh._indCount = 6;
+        submesh._vertInst = 1;
+    }
+
+    U32 gridWidth = (U32)sqrtf((R32)meshCount) + 1u;
+    Matrix44 P = Matrix44::perspectiveRH(ToRads(60.0f), 1920.0f / 1080.0f, globals._near, globals._far);
+    Matrix44 V = Matrix44::lookAtRH(Vector3(0.0f, 10.0f, 50.0f), Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f));
+    globals._cameraPos = Vector4(0.0f, 10.0f, 50.0f, 1.0f);
+    globals._worldToView = V;
+    globals._proj = P;
+    globals._viewToClip = V * P;
+
+    TransformBatch transforms;
+    transforms.resize(meshCount);
+
+    const U32 kWarmUpFrames = 4;
+    FrameTimes times = { };
+    for (U32 frame = 0; frame < frameCount + kWarmUpFrames; ++frame) {
+        Matrix44 R = Matrix44::rotate(Matrix44(), ToRads((R32)frame), Vector3(0.0f, 1.0f, 0.0f));
+        for (U32 i = 0; i < meshCount; ++i) {
+            R32 x = ((R32)(i % gridWidth) - gridWidth * 0.5f) * 3.0f;
+            R32 z = -((R32)(i / gridWidth)) * 3.0f;
+            transforms.setWorld(i, Matrix44::translate(R, Vector4(x, 0.0f, z)));
+        }
+        transforms.computeDescriptors(globals._viewToClip, descriptors.data());
+        for (U32 i = 0; i < meshCount; ++i) {
+            GeometrySubMesh* pSubmesh = &submeshes[i];
+            renderer.pushMesh(&meshes[i], &pSubmesh);
+        }
+
+        Clock::time_point start = Clock::now();
+        renderer.update(0.0f, globals);
+        R64 updateMs = elapsedMs(start);
+        start = Clock::now();
+        renderer.render();
+        R64 renderMs = elapsedMs(start);
+        if (frame >= kWarmUpFrames) {
+            times._updateMs += updateMs;
+            times._renderMs += renderMs;
+        }
+    }
+
+    R64 frames = frameCount ? (R64)frameCount : 1.0;
+    times._updateMs /= frames;
+    times._renderMs /= frames;
+    times._drawCount = renderer.getOpaqueDrawCount();
+    times._listCount = renderer.getCommandListCount();
+    times._stateForwarded = renderer.getStateFilterStats().getForwardedCount();
+    times._stateFiltered = renderer.getStateFilterStats().getFilteredCount();
+    renderer.cleanUp();
+    return times;
+}
+
+
+// Nanoseconds per piece of a parallel for over count empty pieces, best of several runs.
+R64 measureSchedulingNs(JobSystem* pJobs, U32 count)
+{
+    R64 best = 1e30;
+    for (U32 run = 0; run < 16; ++run) {
+        Clock::time_point start = Clock::now();
+        pJobs->parallelFor(count, 1, [] (U32 begin, U32 end) { });
+        R64 ns = elapsedMs(start) * 1e6 / (R64)count;
+        best = ns < best ? ns : best;
+    }
+    return best;
+}
+
+
+// Microseconds for a chain of batches, each run after the one before it, best of several runs.
+// Returns 0 if any piece of the chain ran early or not at all.
+R64 measureChainUs(JobSystem* pJobs, U32 batchCount, U32 batchSize)
+{
+    struct Link
+    {
+        std::atomic<U32>* _pDone;
+        U32 _expected;
+        B32 _inOrder;
+    };
+    auto runPiece = [] (void* pData, U32 begin, U32 end) {
+        Link* pLink = static_cast<Link*>(pData);
+        if (pLink->_pDone->load() < pLink->_expected) pLink->_inOrder = false;
+        pLink->_pDone->fetch_add(end - begin);
+    };
+
+    R64 best = 1e30;
+    for (U32 run = 0; run < 16; ++run) {
+        std::atomic<U32> done(0);
+        std::vector<Link> links(batchCount);
+        std::vector<JobCounter> counters(batchCount);
+        Clock::time_point start = Clock::now();
+        for (U32 i = 0; i < batchCount; ++i) {
+            links[i]._pDone = &done;
+            links[i]._expected = i * batchSize;
+            links[i]._inOrder = true;
+            pJobs->run(runPiece, &links[i], batchSize, 1, &counters[i], i ? &counters[i - 1] : nullptr);
+        }
+        pJobs->wait(&counters[batchCount - 1]);
+        R64 us = elapsedMs(start) * 1e3;
+        // Earlier counters are done too, but their last jobs may still be letting go of them.
+        for (U32 i = 0; i < batchCount; ++i) pJobs->wait(&counters[i]);
+        for (const Link& link : links) {
+            if (!link._inOrder) return 0.0;
+        }
+        if (done.load() != batchCount * batchSize) return 0.0;
+        best = us < best ? us : best;
+    }
+    return best;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 meshCount = argc > 1 ? (U32)atoi(argv[1]) : 16384u;
+    U32 frameCount = argc > 2 ? (U32)atoi(argv[2]) : 50u;
+    std::vector<U32> workerCounts;
+    for (int i = 3; i < argc; ++i) workerCounts.push_back((U32)atoi(argv[i]));
+    U32 hardwareThreads = std::thread::hardware_concurrency();
+    if (workerCounts.empty()) {
+        for (U32 workers = 1; workers < hardwareThreads; workers *= 2) workerCounts.push_back(workers);
+        workerCounts.push_back(hardwareThreads > 1 ? hardwareThreads - 1 : 1);
+    }
+
+    printf("%u meshes, %u frames, %u hardware threads\n", meshCount, frameCount, hardwareThreads);
+    FrameTimes serial = runFrames(nullptr, meshCount, frameCount);
+    printf("  no workers  update %8.3f ms  render %8.3f ms  (%u draws in %u lists, %u state calls, %u filtered)\n", 
+           serial._updateMs, serial._renderMs, serial._drawCount, serial._listCount, 
+           serial._stateForwarded, serial._stateFiltered);
+
+    B32 passed = true;
+    for (U32 workers : workerCounts) {
+        JobSystem jobs;
+        jobs.initialize(workers);
+        R64 schedulingNs = measureSchedulingNs(&jobs, 65536);
+        R64 chainUs = measureChainUs(&jobs, 64, 64);
+        FrameTimes times = runFrames(&jobs, meshCount, frameCount);
+        R64 total = times._updateMs + times._renderMs;
+        printf("  %2u workers  update %8.3f ms  render %8.3f ms  %.2fx  (%u lists, %.1f ns per empty job, %.1f us per 64x64 chain)\n",
+               workers, times._updateMs, times._renderMs,
+               total > 0.0 ? (serial._updateMs + serial._renderMs) / total : 0.0, 
+               times._listCount, schedulingNs, chainUs);
+        if (chainUs <= 0.0) {
+            printf("    a batch of the chain ran before the one it depends on, or never ran\n");
+            passed = false;
+        }
+        jobs.cleanUp();
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,201 @@
+// Benchmark for the glTF loader. Loads each file through Model, which maps the file and its
+// buffers and gathers accessors straight out of the mapping, or through the reference loader,
+// as Model::processGLTF was written before, which had tinygltf read every buffer and decode
+// every image, then copied vertices out one by one. Loads go through the null RHI.
+// Peak RSS is per process, so run each loader in a process of its own to compare them. Once RSS
+// is read, the mapped run loads every file through the reference loader too, and fails if the
+// vertex or index counts differ, or a file didn't load.
+//
+// Usage: GLTFBenchmark [mapped|reference] [iterations] [gltf/glb paths...]
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "Model/Model.h"
+
+#define TINYGLTF_NO_STB_IMAGE_WRITE
+#include "tiny_gltf.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <sys/resource.h>
+#endif
+
+using namespace jcl;
+
+namespace {
+
+
+// Reference, as Model::processGLTF and loadNode were written before mapped loading.
+U64 referenceGLTF(const std::string& path, std::vector<Vertex>& vertices, std::vector<U32>& indices)
+{
+    tinygltf::TinyGLTF loader;
+    tinygltf::Model model;
+    std::string err;
+    std::string warn;
+    vertices.clear();
+    indices.clear();
+    bool binary = path.size() > 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+    bool ret = binary ? loader.LoadBinaryFromFile(&model, &err, &warn, path)
+                      : loader.LoadASCIIFromFile(&model, &err, &warn, path);
+    if (!ret) return 0;
+
+    for (tinygltf::Mesh& mesh : model.meshes) {
+        for (tinygltf::Primitive& primitive : mesh.primitives) {
+            const R32* attribs[4] = { };
+            const char* names[4] = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD_0" };
+            U64 count = 0;
+            for (U32 a = 0; a < 4; ++a) {
+                if (primitive.attributes.find(names[a]) == primitive.attributes.end()) continue;
+                const tinygltf::Accessor& accessor = model.accessors[primitive.attributes[names[a]]];
+                const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+                attribs[a] = reinterpret_cast<const R32*>(&model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset]);
+                if (a == 0) count = accessor.count;
+            }
+            for (U64 i = 0; i < count; ++i) {
+                Vertex vert = { };
+                vert._position._x = attribs[0][i * 3 + 0];
+                vert._position._y = attribs[0][i * 3 + 1];
+                vert._position._z = attribs[0][i * 3 + 2];
+                vert._position._w = 1.0f;
+                if (attribs[1]) {
+                    vert._normal._x = attribs[1][i * 3 + 0];
+                    vert._normal._y = attribs[1][i * 3 + 1];
+                    vert._normal._z = attribs[1][i * 3 + 2];
+                }
+                vert._normal._w = 1.0f;
+                if (attribs[2]) {
+                    vert._tangent._x = attribs[2][i * 3 + 0];
+                    vert._tangent._y = attribs[2][i * 3 + 1];
+                    vert._tangent._z = attribs[2][i * 3 + 2];
+                }
+                vert._tangent._w = 1.0f;
+                if (attribs[3]) {
+                    vert._texcoords._x = attribs[3][i * 2 + 0];
+                    vert._texcoords._y = attribs[3][i * 2 + 1];
+                }
+                vertices.push_back(vert);
+            }
+
+            const tinygltf::Accessor& accessor = model.accessors[primitive.indices];
+            const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+            const U8* pData = &model.buffers[view.buffer].data[accessor.byteOffset + view.byteOffset];
+            for (U64 i = 0; i < accessor.count; ++i) {
+                switch (accessor.componentType) {
+                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: indices.push_back(reinterpret_cast<const U32*>(pData)[i]); break;
+                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: indices.push_back(reinterpret_cast<const U16*>(pData)[i]); break;
+                    case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: indices.push_back(pData[i]); break;
+                    default: break;
+                }
+            }
+        }
+    }
+    return vertices.size();
+}
+
+
+typedef std::chrono::steady_clock Clock;
+
+// Best of several runs, in milliseconds.
+template<typename Fn>
+R64 measureMs(U32 iterations, Fn fn)
+{
+    R64 best = 1e30;
+    for (U32 run = 0; run < iterations; ++run) {
+        Clock::time_point start = Clock::now();
+        fn();
+        R64 ms = (R64)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+
+// Peak resident set of the process so far, in MiB. 0 where it isn't supported.
+R64 peakRSSMiB()
+{
+#if !defined(_WIN32)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(__APPLE__)
+        return (R64)usage.ru_maxrss / (1024.0 * 1024.0);
+#else
+        return (R64)usage.ru_maxrss / 1024.0;
+#endif
+    }
+#endif
+    return 0.0;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    B32 reference = argc > 1 && strcmp(argv[1], "reference") == 0;
+    U32 iterations = argc > 2 ? (U32)atoi(argv[2]) : 3u;
+    std::vector<std::string> paths;
+    for (int i = 3; i < argc; ++i) paths.push_back(argv[i]);
+    if (paths.empty()) {
+        paths.push_back(TUTORIAL_ASSET_DIR "/DamagedHelmet/DamagedHelmet.gltf");
+        paths.push_back(TUTORIAL_ASSET_DIR "/Lantern/Lantern.gltf");
+    }
+    iterations = iterations ? iterations : 1u;
+
+    FrontEndRenderer renderer;
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+    R64 baseMiB = peakRSSMiB();
+
+    printf("%s loader\n", reference ? "reference" : "mapped");
+    std::vector<U64> vertexCounts;
+    std::vector<U64> indexCounts;
+    for (const std::string& path : paths) {
+        U64 vertices = 0;
+        U64 indices = 0;
+        R64 ms = 0.0;
+        if (reference) {
+            std::vector<Vertex> vertexData;
+            std::vector<U32> indexData;
+            ms = measureMs(iterations, [&] { referenceGLTF(path, vertexData, indexData); });
+            vertices = vertexData.size();
+            indices = indexData.size();
+        } else {
+            ms = measureMs(iterations, [&] {
+                Model model;
+                model.initialize(path, &renderer);
+                vertices = model.getTotalVertices();
+                indices = model.getTotalIndices();
+            });
+        }
+        printf("  %s\n    %8llu verts %8llu indices %9.2f ms\n", path.c_str(),
+               (unsigned long long)vertices, (unsigned long long)indices, ms);
+        vertexCounts.push_back(vertices);
+        indexCounts.push_back(indices);
+    }
+    printf("  peak RSS %.1f MiB, %.1f MiB over the renderer\n", peakRSSMiB(), peakRSSMiB() - baseMiB);
+
+    B32 passed = true;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        if (vertexCounts[i] == 0) {
+            printf("  %s did not load\n", paths[i].c_str());
+            passed = false;
+            continue;
+        }
+        if (reference) continue;
+        std::vector<Vertex> vertexData;
+        std::vector<U32> indexData;
+        referenceGLTF(paths[i], vertexData, indexData);
+        if (vertexData.size() != vertexCounts[i] || indexData.size() != indexCounts[i]) {
+            printf("  %s mismatch, the reference loader has %llu verts %llu indices\n", paths[i].c_str(),
+                   (unsigned long long)vertexData.size(), (unsigned long long)indexData.size());
+            passed = false;
+        }
+    }
+
+    renderer.cleanUp();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,244 @@
+// Benchmark for the clustered light assignment. Scatters point and spot lights through a city
+// block sized volume in front of a camera, culls them and assigns them to the froxel grid inline
+// and on job systems of a few sizes, and reports the time per assignment and how full the clusters are.
+// Every run must produce the same clusters. Then checks the grid is conservative: points sampled
+// across the view frustum must find every light that reaches them in their cluster, and every
+// light of a cluster must reach near that cluster's bounding box.
+//
+// Usage: LightClusterBenchmark [pointLightCount] [spotLightCount] [iterations]
+//
+#include "JobSystem.h"
+#include "LightClusters.h"
+#include "LightRenderer.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace jcl;
+using namespace jcl::Lights;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const R32 kPi = 3.14159265f;
+const R32 kNear = 0.1f;
+const R32 kFar = 500.0f;
+const U32 kSampleCount = 200000;
+
+
+// Deterministic, so every run of the benchmark assigns the same scene.
+struct Random
+{
+    U32 _state;
+
+    R32 next()
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return (_state >> 8) * (1.0f / 16777216.0f);
+    }
+    R32 range(R32 lo, R32 hi) { return lo + (hi - lo) * next(); }
+};
+
+
+void makeScene(std::vector<PointLight>& points, std::vector<SpotLight>& spots, Globals& globals)
+{
+    Random rng = { 1234567u };
+    for (PointLight& light : points) {
+        light = { };
+        light._position = Vector3(rng.range(-200.0f, 200.0f), rng.range(0.0f, 30.0f), rng.range(-400.0f, 20.0f));
+        light._radius = rng.range(1.0f, 12.0f);
+    }
+    for (SpotLight& light : spots) {
+        light = { };
+        light._position = Vector3(rng.range(-200.0f, 200.0f), rng.range(0.0f, 30.0f), rng.range(-400.0f, 20.0f));
+        light._direction = Vector3(rng.range(-1.0f, 1.0f), rng.range(-1.0f, 0.2f), rng.range(-1.0f, 1.0f));
+        // A few wider than a hemisphere, to cover the cones only bound by their sphere.
+        light._outer = rng.next() < 0.05f ? rng.range(kPi * 0.5f, kPi * 0.9f) : rng.range(0.1f, 1.2f);
+        light._inner = light._outer * 0.8f;
+        light._range = rng.range(2.0f, 25.0f);
+    }
+
+    globals = { };
+    globals._near = kNear;
+    globals._far = kFar;
+    globals._proj = Matrix44::perspectiveRH(60.0f * kPi / 180.0f, 16.0f / 9.0f, kNear, kFar);
+    globals._worldToView = Matrix44::lookAtRH(Vector3(5.0f, 12.0f, 10.0f), Vector3(-20.0f, 4.0f, -100.0f), Vector3(0.0f, 1.0f, 0.0f));
+    globals._viewToWorld = globals._worldToView.inverse();
+    globals._viewToClip = globals._worldToView * globals._proj;
+}
+
+
+B32 sameClusters(const LightClusters& a, const std::vector<LightCluster>& clusters, const std::vector<U32>& indices)
+{
+    return memcmp(a.getClusters(), clusters.data(), sizeof(LightCluster) * clusters.size()) == 0
+        && a.getStats()._indexCount == indices.size()
+        && memcmp(a.getLightIndices(), indices.data(), sizeof(U32) * indices.size()) == 0;
+}
+
+
+B32 isInCluster(const LightClusters& clusters, U32 cluster, U32 light, B32 isSpot)
+{
+    const LightCluster& c = clusters.getClusters()[cluster];
+    const U32* pIndices = clusters.getLightIndices() + c._offset + (isSpot ? c.getPointCount() : 0);
+    U32 count = isSpot ? c.getSpotCount() : c.getPointCount();
+    for (U32 i = 0; i < count; ++i) {
+        if (pIndices[i] == light) return true;
+    }
+    return false;
+}
+
+
+// Lights that reach a sample must be in its cluster. Samples a hair away from the light's edge,
+// or from a cluster boundary, are skipped so rounding can't decide them.
+U32 checkSamples(const LightClusters& clusters,
+                 const Globals& globals,
+                 const std::vector<PointLight>& points,
+                 const std::vector<SpotLight>& spots)
+{
+    Random rng = { 7654321u };
+    U32 missing = 0;
+    R32 p00 = globals._proj._[0][0];
+    R32 p11 = globals._proj._[1][1];
+    R32 logRange = logf(kFar / kNear);
+    for (U32 s = 0; s < kSampleCount; ++s) {
+        R32 ndcX = rng.range(-1.0f, 1.0f);
+        R32 ndcY = rng.range(-1.0f, 1.0f);
+        R32 sliceCoord = rng.range(0.0f, 1.0f) * LIGHT_CLUSTER_SLICES;
+        R32 tileX = (ndcX * 0.5f + 0.5f) * LIGHT_CLUSTER_TILES_X;
+        R32 tileY = (0.5f - ndcY * 0.5f) * LIGHT_CLUSTER_TILES_Y;
+        if (fabsf(tileX - roundf(tileX)) < 1e-3f || fabsf(tileY - roundf(tileY)) < 1e-3f
+            || fabsf(sliceCoord - roundf(sliceCoord)) < 1e-3f) continue;
+        R32 depth = kNear * expf(logRange * sliceCoord / LIGHT_CLUSTER_SLICES);
+        Vector4 view(ndcX * depth / p00, ndcY * depth / p11, -depth, 1.0f);
+        Vector4 world4 = view * globals._viewToWorld;
+        Vector3 world(world4._x, world4._y, world4._z);
+        U32 cluster = (static_cast<U32>(sliceCoord) * LIGHT_CLUSTER_TILES_Y + static_cast<U32>(tileY))
+                    * LIGHT_CLUSTER_TILES_X + static_cast<U32>(tileX);
+
+        for (U32 i = 0; i < points.size(); ++i) {
+            R32 distance = (world - points[i]._position).length();
+            if (distance < points[i]._radius * 0.999f && !isInCluster(clusters, cluster, i, false)) ++missing;
+        }
+        for (U32 i = 0; i < spots.size(); ++i) {
+            const SpotLight& light = spots[i];
+            Vector3 toSample = world - light._position;
+            R32 distance = toSample.length();
+            if (distance > light._range * 0.999f || distance < 1e-3f) continue;
+            R32 cosToAxis = toSample.dot(light._direction.normalize()) / distance;
+            if (cosToAxis > cosf(light._outer) + 1e-3f && !isInCluster(clusters, cluster, i, true)) ++missing;
+        }
+    }
+    return missing;
+}
+
+
+R32 distanceSqToBox(const Vector3& p, const Vector3& boxMin, const Vector3& boxMax)
+{
+    R32 dx = fmaxf(fmaxf(boxMin._x - p._x, p._x - boxMax._x), 0.0f);
+    R32 dy = fmaxf(fmaxf(boxMin._y - p._y, p._y - boxMax._y), 0.0f);
+    R32 dz = fmaxf(fmaxf(boxMin._z - p._z, p._z - boxMax._z), 0.0f);
+    return dx * dx + dy * dy + dz * dz;
+}
+
+
+// Every light of a cluster must at least reach its bounding box, by brute force over the clusters.
+// Spot lights are only held to reaching the sphere around it, as their cones are tested that way.
+U32 checkAssigned(const LightClusters& clusters,
+                  const Globals& globals,
+                  const std::vector<PointLight>& points,
+                  const std::vector<SpotLight>& spots)
+{
+    U32 extra = 0;
+    for (U32 cluster = 0; cluster < LightClusters::kClusterCount; ++cluster) {
+        Vector3 boxMin, boxMax;
+        clusters.getClusterBounds(cluster, &boxMin, &boxMax);
+        const LightCluster& c = clusters.getClusters()[cluster];
+        const U32* pIndices = clusters.getLightIndices() + c._offset;
+        for (U32 i = 0; i < c.getPointCount() + c.getSpotCount(); ++i) {
+            B32 isSpot = i >= c.getPointCount();
+            const Light& light = isSpot ? static_cast<const Light&>(spots[pIndices[i]])
+                                        : static_cast<const Light&>(points[pIndices[i]]);
+            R32 radius = isSpot ? spots[pIndices[i]]._range : points[pIndices[i]]._radius;
+            Vector4 view = Vector4(light._position, 1.0f) * globals._worldToView;
+            Vector3 center(view._x, view._y, -view._z);
+            if (isSpot) {
+                // Spots are tested from the sphere around the box, against the sphere they reach.
+                Vector3 extent = (boxMax - boxMin) * 0.5f;
+                Vector3 toBox = boxMin + extent - center;
+                R32 reach = radius + extent.length();
+                if (toBox.dot(toBox) > reach * reach * 1.0001f) ++extra;
+                continue;
+            }
+            if (distanceSqToBox(center, boxMin, boxMax) > radius * radius * 1.0001f) ++extra;
+        }
+    }
+    return extra;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 pointCount = argc > 1 ? (U32)atoi(argv[1]) : 4096u;
+    U32 spotCount = argc > 2 ? (U32)atoi(argv[2]) : 1024u;
+    U32 iterations = argc > 3 ? (U32)atoi(argv[3]) : 20u;
+    iterations = iterations ? iterations : 1u;
+
+    std::vector<PointLight> points(pointCount);
+    std::vector<SpotLight> spots(spotCount);
+    Globals globals;
+    makeScene(points, spots, globals);
+
+    // Lights go in in order, so their index in the light system is their index here.
+    LightSystem lights;
+    lights.initialize(nullptr, 0, pointCount, spotCount);
+    for (const PointLight& light : points) lights.addPointLight(light);
+    for (const SpotLight& light : spots) lights.addSpotLight(light);
+    Plane planes[6];
+    extractFrustumPlanes(globals._viewToClip, planes);
+    lights.cull(planes, 6);
+
+    LightClusters clusters;
+    clusters.initialize(nullptr, 0);
+    clusters.assign(globals, lights);
+    std::vector<LightCluster> reference(clusters.getClusters(), clusters.getClusters() + LightClusters::kClusterCount);
+    std::vector<U32> referenceIndices(clusters.getLightIndices(), clusters.getLightIndices() + clusters.getStats()._indexCount);
+
+    const LightClusterStats& stats = clusters.getStats();
+    printf("%u point lights, %u spot lights, %u clusters\n", pointCount, spotCount, LightClusters::kClusterCount);
+    printf("  %u point, %u spot lights in the frustum\n",
+           lights.getStats()._visiblePointLights, lights.getStats()._visibleSpotLights);
+    printf("  visible %u point, %u spot, %u clusters occupied, %u indices, at most %u lights a cluster\n",
+           stats._visiblePointLights, stats._visibleSpotLights, stats._occupiedClusters,
+           stats._indexCount, stats._maxClusterLights);
+
+    B32 deterministic = true;
+    U32 workerCounts[] = { 0, 1, 3, 7 };
+    for (U32 workers : workerCounts) {
+        JobSystem jobs;
+        jobs.initialize(workers);
+        R64 best = 1e30;
+        for (U32 run = 0; run < iterations; ++run) {
+            Clock::time_point start = Clock::now();
+            JobSystem* pJobs = workers ? &jobs : nullptr;
+            lights.cull(planes, 6, pJobs);
+            clusters.assign(globals, lights, pJobs);
+            R64 us = (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1000.0;
+            best = us < best ? us : best;
+            deterministic = deterministic && sameClusters(clusters, reference, referenceIndices);
+        }
+        printf("  %u workers %9.1f us per assignment\n", workers, best);
+    }
+
+    U32 missing = checkSamples(clusters, globals, points, spots);
+    U32 extra = checkAssigned(clusters, globals, points, spots);
+    printf("  deterministic %s, %u lights missing from sampled clusters, %u assigned out of reach\n",
+           deterministic ? "yes" : "NO", missing, extra);
+    return deterministic && missing == 0 && extra == 0 ? 0 : 1;
+}
@@ -0,0 +1,188 @@
+// Benchmark for the light system. Adds point and spot lights on the null backend, then runs
+// frames that move a share of them, cull them against a camera frustum and copy the changes to
+// the light buffers through an upload queue, and reports the time per frame and how much was written. Then removes and
+// adds lights at random, checking every handle still finds its own light.
+//
+// Usage: LightSystemBenchmark [lightCount] [frames]
+//
+#include "JobSystem.h"
+#include "LightRenderer.h"
+#include "Null/NullBackend.h"
+#include "UploadQueue.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace jcl;
+using namespace jcl::Lights;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const R32 kPi = 3.14159265f;
+
+
+struct Random
+{
+    U32 _state;
+
+    U32 nextU32()
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return _state;
+    }
+    R32 next() { return (nextU32() >> 8) * (1.0f / 16777216.0f); }
+    R32 range(R32 lo, R32 hi) { return lo + (hi - lo) * next(); }
+};
+
+
+Vector3 randomPosition(Random& rng)
+{
+    return Vector3(rng.range(-200.0f, 200.0f), rng.range(0.0f, 30.0f), rng.range(-400.0f, 20.0f));
+}
+
+
+PointLight randomPointLight(Random& rng)
+{
+    PointLight light = { };
+    light._position = randomPosition(rng);
+    light._radiance = Vector4(rng.range(0.5f, 4.0f), rng.range(0.5f, 4.0f), rng.range(0.5f, 4.0f), 1.0f);
+    light._transform = kNoLightTransform;
+    // Range from radiance.
+    light._radius = 0.0f;
+    return light;
+}
+
+
+SpotLight randomSpotLight(Random& rng)
+{
+    SpotLight light = { };
+    light._position = randomPosition(rng);
+    light._radiance = Vector4(rng.range(0.5f, 8.0f), rng.range(0.5f, 8.0f), rng.range(0.5f, 8.0f), 1.0f);
+    light._direction = Vector3(rng.range(-1.0f, 1.0f), -1.0f, rng.range(-1.0f, 1.0f));
+    light._outer = rng.range(0.2f, 1.0f);
+    light._inner = light._outer * 0.8f;
+    light._transform = kNoLightTransform;
+    light._range = 0.0f;
+    return light;
+}
+
+
+R64 elapsedUs(Clock::time_point start)
+{
+    return (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1000.0;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 lightCount = argc > 1 ? (U32)atoi(argv[1]) : 10000u;
+    U32 frameCount = argc > 2 ? (U32)atoi(argv[2]) : 50u;
+    frameCount = frameCount ? frameCount : 1u;
+    U32 pointCount = lightCount - lightCount / 4;
+    U32 spotCount = lightCount / 4;
+
+    Matrix44 worldToView = Matrix44::lookAtRH(Vector3(5.0f, 12.0f, 10.0f), Vector3(-20.0f, 4.0f, -100.0f), Vector3(0.0f, 1.0f, 0.0f));
+    Matrix44 viewToClip = worldToView * Matrix44::perspectiveRH(60.0f * kPi / 180.0f, 16.0f / 9.0f, 0.1f, 500.0f);
+    Plane planes[6];
+    extractFrustumPlanes(viewToClip, planes);
+
+    Random rng = { 1234567u };
+    LightSystem lights;
+    lights.initialize(gfx::getBackendNull(), 1);
+    UploadQueue uploads;
+    uploads.initialize(gfx::getBackendNull(), 16ull * 1024ull * 1024ull);
+    std::vector<LightHandle> pointHandles(pointCount);
+    std::vector<LightHandle> spotHandles(spotCount);
+    Clock::time_point start = Clock::now();
+    for (U32 i = 0; i < pointCount; ++i) pointHandles[i] = lights.addPointLight(randomPointLight(rng));
+    for (U32 i = 0; i < spotCount; ++i) spotHandles[i] = lights.addSpotLight(randomSpotLight(rng));
+    R64 addUs = elapsedUs(start);
+    // Frames the renderer would count, buffers outgrown are kept for two in flight.
+    U64 frameNumber = 0;
+    start = Clock::now();
+    lights.reserveBuffers(++frameNumber, 2);
+    lights.update();
+    lights.upload(&uploads);
+    uploads.flush();
+    R64 firstUploadUs = elapsedUs(start);
+    printf("%u point lights, %u spot lights\n", pointCount, spotCount);
+    printf("  add %8.1f us, first update %8.1f us, %u lights written\n", addUs, firstUploadUs, lights.getStats()._uploadedLights);
+
+    // Lights moved each frame, as a share of all of them.
+    const R32 movedShares[] = { 0.0f, 0.01f, 0.1f, 1.0f };
+    U32 workerCounts[] = { 0, 3 };
+    for (U32 workers : workerCounts) {
+        JobSystem jobs;
+        jobs.initialize(workers);
+        JobSystem* pJobs = workers ? &jobs : nullptr;
+        for (R32 share : movedShares) {
+            U32 moved = (U32)(share * lightCount);
+            R64 bestMove = 1e30, bestCull = 1e30, bestUpdate = 1e30;
+            U32 uploadedRanges = 0;
+            for (U32 frame = 0; frame < frameCount; ++frame) {
+                start = Clock::now();
+                for (U32 m = 0; m < moved; ++m) {
+                    U32 light = rng.nextU32() % lightCount;
+                    if (light < pointCount) {
+                        lights.movePointLight(pointHandles[light], randomPosition(rng));
+                    } else {
+                        lights.moveSpotLight(spotHandles[light - pointCount], randomPosition(rng), Vector3(0.0f, -1.0f, 0.5f));
+                    }
+                }
+                R64 moveUs = elapsedUs(start);
+                start = Clock::now();
+                lights.cull(planes, 6, pJobs);
+                R64 cullUs = elapsedUs(start);
+                start = Clock::now();
+                lights.reserveBuffers(++frameNumber, 2);
+                lights.update();
+                lights.upload(&uploads);
+                uploads.flush();
+                uploads.retire();
+                R64 updateUs = elapsedUs(start);
+                bestMove = moveUs < bestMove ? moveUs : bestMove;
+                bestCull = cullUs < bestCull ? cullUs : bestCull;
+                bestUpdate = updateUs < bestUpdate ? updateUs : bestUpdate;
+                uploadedRanges = lights.getStats()._uploadedRanges;
+            }
+            printf("  %u workers, %5.1f%% moved: move %8.1f us, cull %7.1f us, update %8.1f us, %u visible, %u runs written\n",
+                   workers, share * 100.0f, bestMove, bestCull, bestUpdate,
+                   lights.getStats()._visiblePointLights + lights.getStats()._visibleSpotLights, uploadedRanges);
+        }
+    }
+
+    // Churn: remove and add lights at random, every live handle must still find its light.
+    std::vector<Vector3> positions(pointCount);
+    for (U32 i = 0; i < pointCount; ++i) positions[i] = lights.findPointLight(pointHandles[i])->_position;
+    start = Clock::now();
+    U32 churn = pointCount / 2;
+    for (U32 i = 0; i < churn; ++i) {
+        U32 victim = rng.nextU32() % pointCount;
+        lights.removePointLight(pointHandles[victim]);
+        PointLight light = randomPointLight(rng);
+        pointHandles[victim] = lights.addPointLight(light);
+        positions[victim] = light._position;
+    }
+    lights.reserveBuffers(++frameNumber, 2);
+    lights.update();
+    lights.upload(&uploads);
+    uploads.flush();
+    R64 churnUs = elapsedUs(start);
+    U32 wrong = 0;
+    for (U32 i = 0; i < pointCount; ++i) {
+        const PointLight* pLight = lights.findPointLight(pointHandles[i]);
+        if (!pLight || (pLight->_position - positions[i]).length() > 0.0f) ++wrong;
+    }
+    printf("  %u removes and adds %8.1f us, %u lights written, %u handles wrong\n",
+           churn, churnUs, lights.getStats()._uploadedLights, wrong);
+    uploads.cleanUp();
+    lights.cleanUp();
+    return wrong == 0 ? 0 : 1;
+}
@@ -0,0 +1,118 @@
+// Benchmark for cold start model loading. Loads the bundled models one after another on the
+// main thread, as the application used to, then all at once through ModelLoader on job systems of
+// growing worker counts, and reports the wall time of each. Mesh caches are removed before every
+// run, so every load parses its source. Loads go through the null RHI. Fails if a parallel run
+// loads a different vertex total than the serial one.
+//
+// Usage: LoadBenchmark [iterations] [worker counts...]
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "Model/MeshCache.h"
+#include "Model/Model.h"
+#include "Model/ModelLoader.h"
+#include "JobSystem.h"
+
+#include <chrono>
+#include <memory>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace jcl;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const char* kModelPaths[] = {
+    TUTORIAL_ASSET_DIR "/SongWork/spartan.obj",
+    TUTORIAL_ASSET_DIR "/SongWork/OldCar.obj",
+    TUTORIAL_ASSET_DIR "/SongWork/RacingCar.obj",
+    TUTORIAL_ASSET_DIR "/DamagedHelmet/DamagedHelmet.gltf",
+    TUTORIAL_ASSET_DIR "/Lantern/Lantern.gltf",
+};
+const U32 kModelCount = sizeof(kModelPaths) / sizeof(kModelPaths[0]);
+
+
+void removeMeshCaches()
+{
+    for (U32 i = 0; i < kModelCount; ++i) {
+        remove(getMeshCachePath(kModelPaths[i]).c_str());
+    }
+}
+
+
+// Best of several cold runs, in milliseconds. Returns the vertices loaded, through pVertices.
+template<typename Fn>
+R64 measureColdMs(U32 iterations, U64* pVertices, Fn fn)
+{
+    R64 best = 1e30;
+    for (U32 run = 0; run < iterations; ++run) {
+        removeMeshCaches();
+        std::vector<std::unique_ptr<Model>> models;
+        for (U32 i = 0; i < kModelCount; ++i) models.emplace_back(new Model());
+
+        Clock::time_point start = Clock::now();
+        fn(models);
+        R64 ms = (R64)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+        best = ms < best ? ms : best;
+
+        *pVertices = 0;
+        for (std::unique_ptr<Model>& pModel : models) *pVertices += pModel->getTotalVertices();
+    }
+    return best;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 iterations = argc > 1 ? (U32)atoi(argv[1]) : 3u;
+    iterations = iterations ? iterations : 1u;
+    std::vector<U32> workerCounts;
+    for (int i = 2; i < argc; ++i) workerCounts.push_back((U32)atoi(argv[i]));
+    if (workerCounts.empty()) {
+        U32 hardwareThreads = std::thread::hardware_concurrency();
+        for (U32 workers = 1; workers < hardwareThreads; workers *= 2) workerCounts.push_back(workers);
+        workerCounts.push_back(hardwareThreads > 1 ? hardwareThreads - 1 : 1);
+    }
+
+    FrontEndRenderer renderer;
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+
+    printf("%u models, %u hardware threads\n", kModelCount, std::thread::hardware_concurrency());
+    U64 vertices = 0;
+    R64 serialMs = measureColdMs(iterations, &vertices, [&] (std::vector<std::unique_ptr<Model>>& models) {
+        for (U32 i = 0; i < kModelCount; ++i) models[i]->initialize(kModelPaths[i], &renderer);
+    });
+    printf("  serial      %9.2f ms  %8llu verts\n", serialMs, (unsigned long long)vertices);
+    U64 serialVertices = vertices;
+    B32 passed = true;
+
+    for (U32 workers : workerCounts) {
+        JobSystem jobs;
+        jobs.initialize(workers);
+        ModelLoader loader;
+        loader.initialize(&renderer, &jobs);
+        R64 ms = measureColdMs(iterations, &vertices, [&] (std::vector<std::unique_ptr<Model>>& models) {
+            for (U32 i = 0; i < kModelCount; ++i) loader.load(models[i].get(), kModelPaths[i]);
+            loader.waitAll();
+        });
+        printf("  %2u workers  %9.2f ms  %8llu verts  %.2fx\n",
+               workers, ms, (unsigned long long)vertices, serialMs / ms);
+        if (vertices != serialVertices) {
+            printf("    mismatch, the serial run loaded %llu verts\n", (unsigned long long)serialVertices);
+            passed = false;
+        }
+        loader.cleanUp();
+        jobs.cleanUp();
+    }
+    removeMeshCaches();
+
+    renderer.cleanUp();
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,287 @@
+// Benchmark for the OBJ loader. Compares the welded vertex/index buffers Model builds against
+// the old loader, which expanded every face corner into a vertex of its own, and reports
+// vertex count, buffer memory and load time for both. Loads go through the null RHI.
+// The welded load is timed cold, with its .jmesh cache removed first, and again warm, straight
+// out of the cache the cold load wrote.
+// Then reports the post-transform cache efficiency of the welded submeshes, in the order
+// the file had them and after the mesh optimizer, simulated with a 16 entry FIFO cache.
+// Last, packs the optimized vertices into VERTEX_FORMAT_PACKED and reports the vertex memory
+// saved, the encode time, and the largest decoding error of each attribute.
+//
+// Usage: ModelBenchmark [iterations] [obj paths...]
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "Model/MeshCache.h"
+#include "Model/MeshOptimizer.h"
+#include "Model/Model.h"
+#include "VertexFormat.h"
+
+#include "tiny_obj_loader.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <vector>
+
+using namespace jcl;
+
+namespace {
+
+
+struct MeshStats
+{
+    U64 _vertices;
+    U64 _indices;
+    R64 _ms;
+};
+
+
+// Reference, as Model::processOBJ was written before vertex welding.
+void referenceOBJ(const std::string& path, std::vector<Vertex>& vertices, std::vector<U32>& indices)
+{
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    tinyobj::attrib_t attrib;
+    std::string warn;
+    std::string err;
+    vertices.clear();
+    indices.clear();
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())) return;
+
+    Bounds3D bounds(Vector3(FLT_MAX, FLT_MAX, FLT_MAX), Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    for (size_t s = 0; s < shapes.size(); ++s) {
+        size_t index_offset = 0;
+        for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f) {
+            I32 fv = shapes[s].mesh.num_face_vertices[f];
+            for (I32 v = 0; v < fv; ++v) {
+                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
+                Vertex vert = { };
+                vert._position._x = attrib.vertices[3 * idx.vertex_index + 0];
+                vert._position._y = attrib.vertices[3 * idx.vertex_index + 1];
+                vert._position._z = attrib.vertices[3 * idx.vertex_index + 2];
+                vert._position._w = 1.0f;
+                if (idx.normal_index >= 0) {
+                    vert._normal._x = attrib.normals[3 * idx.normal_index + 0];
+                    vert._normal._y = attrib.normals[3 * idx.normal_index + 1];
+                    vert._normal._z = attrib.normals[3 * idx.normal_index + 2];
+                }
+                vert._normal._w = 1.0f;
+                if (idx.texcoord_index >= 0) {
+                    vert._texcoords._x = attrib.texcoords[2 * idx.texcoord_index + 0];
+                    vert._texcoords._y = attrib.texcoords[2 * idx.texcoord_index + 1];
+                }
+                vertices.push_back(vert);
+                indices.push_back(static_cast<U32>(indices.size()));
+
+                bounds._max = Vector3(fmaxf(bounds._max._x, vert._position._x),
+                                      fmaxf(bounds._max._y, vert._position._y),
+                                      fmaxf(bounds._max._z, vert._position._z));
+                bounds._min = Vector3(fminf(bounds._min._x, vert._position._x),
+                                      fminf(bounds._min._y, vert._position._y),
+                                      fminf(bounds._min._z, vert._position._z));
+            }
+            index_offset += fv;
+        }
+    }
+
+    Vector3 diff = -bounds.getCenter();
+    for (size_t v = 0; v < vertices.size(); ++v) {
+        vertices[v]._position._x += diff._x;
+        vertices[v]._position._y += diff._y;
+        vertices[v]._position._z += diff._z;
+    }
+}
+
+
+// Cache stats over every submesh, weighted by their triangle and vertex counts.
+VertexCacheStats analyzeMeshData(const MeshData& data)
+{
+    R64 misses = 0.0;
+    R64 triangles = 0.0;
+    R64 vertices = 0.0;
+    for (const SubMesh& submesh : data._submeshes) {
+        VertexCacheStats stats = analyzeVertexCache(&data._indices[submesh.m_indOffset],
+                                                    static_cast<U32>(submesh.m_indCount),
+                                                    static_cast<U32>(submesh.m_vertCount));
+        R64 submeshTriangles = (R64)(submesh.m_indCount / 3);
+        misses += stats._acmr * submeshTriangles;
+        triangles += submeshTriangles;
+        vertices += stats._acmr > 0.0f ? stats._acmr * submeshTriangles / stats._atvr : 0.0;
+    }
+    VertexCacheStats stats = { };
+    if (triangles > 0.0) stats._acmr = (R32)(misses / triangles);
+    if (vertices > 0.0) stats._atvr = (R32)(misses / vertices);
+    return stats;
+}
+
+
+struct PackingError
+{
+    R32 _position;
+    R32 _normal;
+    R32 _tangent;
+    R32 _texcoords;
+};
+
+
+R32 angleDegrees(R32 cosine)
+{
+    return acosf(fmaxf(fminf(cosine, 1.0f), -1.0f)) * (180.0f / static_cast<R32>(CONST_PI));
+}
+
+
+// Largest error of each attribute after a pack and unpack round trip. Position error is
+// relative to the largest bounds extent, normal and tangent error is in degrees.
+PackingError measurePackingError(const MeshData& data, const std::vector<PackedVertex>& packed)
+{
+    PackingError error = { };
+    Vector3 extent = data._bounds.getExtent();
+    R32 maxExtent = fmaxf(extent._x, fmaxf(extent._y, extent._z));
+    for (size_t v = 0; v < data._vertices.size(); ++v) {
+        const Vertex& original = data._vertices[v];
+        Vertex decoded = unpackVertex(packed[v], data._bounds);
+        R32 position = fmaxf(fabsf(decoded._position._x - original._position._x),
+                             fmaxf(fabsf(decoded._position._y - original._position._y),
+                                   fabsf(decoded._position._z - original._position._z)));
+        if (maxExtent > 0.0f) error._position = fmaxf(error._position, position / maxExtent);
+
+        Vector3 normal(original._normal._x, original._normal._y, original._normal._z);
+        if (normal.length() > 0.0f) {
+            R32 cosine = normal.normalize().dot(Vector3(decoded._normal._x, decoded._normal._y, decoded._normal._z));
+            error._normal = fmaxf(error._normal, angleDegrees(cosine));
+        }
+        Vector3 tangent(original._tangent._x, original._tangent._y, original._tangent._z);
+        if (tangent.length() > 0.0f) {
+            R32 cosine = tangent.normalize().dot(Vector3(decoded._tangent._x, decoded._tangent._y, decoded._tangent._z));
+            error._tangent = fmaxf(error._tangent, angleDegrees(cosine));
+        }
+        error._texcoords = fmaxf(error._texcoords, fmaxf(fabsf(decoded._texcoords._x - original._texcoords._x),
+                                                         fabsf(decoded._texcoords._y - original._texcoords._y)));
+    }
+    return error;
+}
+
+
+typedef std::chrono::steady_clock Clock;
+
+// Best of several runs, in milliseconds.
+template<typename Fn>
+R64 measureMs(U32 iterations, Fn fn)
+{
+    R64 best = 1e30;
+    for (U32 run = 0; run < iterations; ++run) {
+        Clock::time_point start = Clock::now();
+        fn();
+        R64 ms = (R64)std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count() / 1000.0;
+        best = ms < best ? ms : best;
+    }
+    return best;
+}
+
+
+R64 toMiB(const MeshStats& stats)
+{
+    return (R64)(stats._vertices * sizeof(Vertex) + stats._indices * sizeof(U32)) / (1024.0 * 1024.0);
+}
+
+
+void report(const char* name, const MeshStats& stats)
+{
+    printf("  %-10s %8llu verts %8llu indices %8.2f MiB %9.2f ms\n",
+           name, (unsigned long long)stats._vertices, (unsigned long long)stats._indices,
+           toMiB(stats), stats._ms);
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 iterations = argc > 1 ? (U32)atoi(argv[1]) : 3u;
+    std::vector<std::string> paths;
+    for (int i = 2; i < argc; ++i) paths.push_back(argv[i]);
+    if (paths.empty()) {
+        paths.push_back(TUTORIAL_ASSET_DIR "/SongWork/OldCar.obj");
+        paths.push_back(TUTORIAL_ASSET_DIR "/SongWork/RacingCar.obj");
+        paths.push_back(TUTORIAL_ASSET_DIR "/SongWork/spartan.obj");
+    }
+    iterations = iterations ? iterations : 1u;
+
+    FrontEndRenderer renderer;
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+
+    B32 passed = true;
+    for (const std::string& path : paths) {
+        printf("%s\n", path.c_str());
+
+        std::vector<Vertex> vertices;
+        std::vector<U32> indices;
+        MeshStats before = { };
+        before._ms = measureMs(iterations, [&] { referenceOBJ(path, vertices, indices); });
+        before._vertices = vertices.size();
+        before._indices = indices.size();
+
+        std::string cachePath = getMeshCachePath(path);
+        MeshStats after = { };
+        after._ms = measureMs(iterations, [&] {
+            remove(cachePath.c_str());
+            Model model;
+            model.initialize(path, &renderer);
+            after._vertices = model.getTotalVertices();
+            after._indices = model.getTotalIndices();
+        });
+
+        MeshStats cached = { };
+        cached._ms = measureMs(iterations, [&] {
+            Model model;
+            model.initialize(path, &renderer);
+            cached._vertices = model.getTotalVertices();
+            cached._indices = model.getTotalIndices();
+        });
+
+        report("expanded", before);
+        report("welded", after);
+        report("cached", cached);
+        if (after._vertices) {
+            printf("  %.2fx fewer vertices, %.2fx less memory, %.2fx load time\n",
+                   (R64)before._vertices / (R64)after._vertices, toMiB(before) / toMiB(after),
+                   before._ms / after._ms);
+        }
+        if (cached._vertices != after._vertices || cached._indices != after._indices) {
+            printf("  cache mismatch\n");
+            passed = false;
+        } else if (cached._ms > 0.0) {
+            printf("  %.2fx faster from the cache\n", after._ms / cached._ms);
+        }
+
+        MeshData data;
+        if (!Model::loadOBJ(path, &data)) continue;
+        VertexCacheStats exported = analyzeMeshData(data);
+        MeshData optimized;
+        R64 optimizeMs = measureMs(iterations, [&] {
+            optimized = data;
+            Model::optimizeMeshData(&optimized);
+        });
+        VertexCacheStats reordered = analyzeMeshData(optimized);
+        printf("  exported   ACMR %.3f  ATVR %.3f\n", exported._acmr, exported._atvr);
+        printf("  optimized  ACMR %.3f  ATVR %.3f  in %.2f ms\n", reordered._acmr, reordered._atvr, optimizeMs);
+
+        U32 vertexCount = static_cast<U32>(optimized._vertices.size());
+        std::vector<PackedVertex> packed(vertexCount);
+        R64 packMs = measureMs(iterations, [&] {
+            packVertices(optimized._vertices.data(), vertexCount, optimized._bounds, packed.data());
+        });
+        PackingError error = measurePackingError(optimized, packed);
+        R64 floatMiB = (R64)(vertexCount * sizeof(Vertex)) / (1024.0 * 1024.0);
+        R64 packedMiB = (R64)(vertexCount * sizeof(PackedVertex)) / (1024.0 * 1024.0);
+        printf("  packed     %.2f MiB -> %.2f MiB vertices, %.2fx less, in %.2f ms\n",
+               floatMiB, packedMiB, packedMiB > 0.0 ? floatMiB / packedMiB : 0.0, packMs);
+        printf("  max error  position %.2e of extent, normal %.3f deg, tangent %.3f deg, uv %.2e\n",
+               error._position, error._normal, error._tangent, error._texcoords);
+    }
+
+    renderer.cleanUp();
+    return passed ? 0 : 1;
+}
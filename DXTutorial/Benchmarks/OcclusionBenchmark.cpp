@@ -0,0 +1,399 @@
+// Benchmark for the cpu occlusion culler. Stands rows of walls in front of a camera, with boxes
+// of all sizes scattered between and behind them, and reports the time to rasterize the walls
+// inline and on job systems of a few sizes, and the time per box tested. Every run must draw the
+// same depth. Then checks the culler is conservative: rays cast over every box found hidden must
+// all hit a wall before the box, with walls given as boxes, and as triangle meshes. Last, runs
+// the front end with the null RHI over a dense field of meshes behind walls, with and without
+// the walls given as occluders, and reports how many meshes the passes are left to draw.
+//
+// Usage: OcclusionBenchmark [boxCount] [iterations]
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+
+#include <chrono>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace jcl;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const R32 kPi = 3.14159265f;
+const R32 kNear = 0.1f;
+const R32 kFar = 500.0f;
+// Rays cast over each side of a hidden box's screen rectangle.
+const U32 kRaysPerSide = 12;
+
+Vertex quad[6] = {
+  { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } }
+};
+
+U32 quadIndices[6] = {
+    0, 1, 2, 3, 4, 5
+};
+
+// Triangles of a box, counter clockwise seen from outside, over corners numbered by their max x, y and z bits.
+U32 boxIndices[36] = {
+    0, 4, 6,  0, 6, 2,
+    1, 3, 7,  1, 7, 5,
+    0, 1, 5,  0, 5, 4,
+    2, 6, 7,  2, 7, 3,
+    0, 2, 3,  0, 3, 1,
+    4, 5, 7,  4, 7, 6
+};
+
+
+// Deterministic, so every run of the benchmark culls the same scene.
+struct Random
+{
+    U32 _state;
+
+    R32 next()
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return (_state >> 8) * (1.0f / 16777216.0f);
+    }
+    R32 range(R32 lo, R32 hi) { return lo + (hi - lo) * next(); }
+};
+
+
+R64 elapsedMs(Clock::time_point start)
+{
+    return (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1e6;
+}
+
+
+Matrix44 makeViewToClip(const Vector3& eye, const Vector3& target)
+{
+    Matrix44 worldToView = Matrix44::lookAtRH(eye, target, Vector3(0.0f, 1.0f, 0.0f));
+    return worldToView * Matrix44::perspectiveRH(60.0f * kPi / 180.0f, 1920.0f / 1080.0f, kNear, kFar);
+}
+
+
+// Rows of walls across the view, with gaps between them, one row every rowSpacing down -z.
+void makeWalls(std::vector<Bounds3D>& walls, U32 rowCount, R32 rowSpacing)
+{
+    for (U32 row = 0; row < rowCount; ++row) {
+        R32 z = -10.0f - row * rowSpacing;
+        // Rows are staggered, so the gaps of one are behind the walls of the next.
+        R32 offset = (row & 1) ? 12.0f : 0.0f;
+        for (I32 w = -6; w <= 6; ++w) {
+            R32 x = w * 24.0f + offset;
+            walls.push_back(Bounds3D(Vector3(x - 10.0f, 0.0f, z - 0.5f), Vector3(x + 10.0f, 8.0f + row * 4.0f, z + 0.5f)));
+        }
+    }
+}
+
+
+// Entry and exit of the ray from origin along dir through the box, false if it misses.
+B32 intersectRay(const Vector3& origin, const Vector3& dir, const Bounds3D& box, R32& tEnter, R32& tExit)
+{
+    R32 o[3] = { origin._x, origin._y, origin._z };
+    R32 d[3] = { dir._x, dir._y, dir._z };
+    R32 lo[3] = { box._min._x, box._min._y, box._min._z };
+    R32 hi[3] = { box._max._x, box._max._y, box._max._z };
+    tEnter = 0.0f;
+    tExit = FLT_MAX;
+    for (U32 axis = 0; axis < 3; ++axis) {
+        if (fabsf(d[axis]) < 1e-12f) {
+            if (o[axis] < lo[axis] || o[axis] > hi[axis]) return false;
+            continue;
+        }
+        R32 t0 = (lo[axis] - o[axis]) / d[axis];
+        R32 t1 = (hi[axis] - o[axis]) / d[axis];
+        if (t0 > t1) { R32 t = t0; t0 = t1; t1 = t; }
+        tEnter = t0 > tEnter ? t0 : tEnter;
+        tExit = t1 < tExit ? t1 : tExit;
+    }
+    return tEnter <= tExit;
+}
+
+
+// True if a ray through the box's screen rectangle meets the box before every wall.
+B32 isSeenByRays(const Matrix44& viewToClip, const Matrix44& clipToWorld, const Bounds3D& box, const std::vector<Bounds3D>& walls)
+{
+    R32 minX = 1.0f, minY = 1.0f, maxX = -1.0f, maxY = -1.0f;
+    for (U32 i = 0; i < 8; ++i) {
+        Vector4 corner((i & 1) ? box._max._x : box._min._x,
+                       (i & 2) ? box._max._y : box._min._y,
+                       (i & 4) ? box._max._z : box._min._z, 1.0f);
+        Vector4 clip = corner * viewToClip;
+        if (clip._w <= 0.0f) return true;
+        R32 x = clip._x / clip._w;
+        R32 y = clip._y / clip._w;
+        minX = x < minX ? x : minX;
+        maxX = x > maxX ? x : maxX;
+        minY = y < minY ? y : minY;
+        maxY = y > maxY ? y : maxY;
+    }
+    minX = minX < -1.0f ? -1.0f : minX;
+    minY = minY < -1.0f ? -1.0f : minY;
+    maxX = maxX > 1.0f ? 1.0f : maxX;
+    maxY = maxY > 1.0f ? 1.0f : maxY;
+
+    for (U32 j = 0; j <= kRaysPerSide; ++j) {
+        for (U32 i = 0; i <= kRaysPerSide; ++i) {
+            R32 x = minX + (maxX - minX) * i / kRaysPerSide;
+            R32 y = minY + (maxY - minY) * j / kRaysPerSide;
+            // Reversed depth, the near plane is at 1.
+            Vector4 nearPoint = Vector4(x, y, 1.0f, 1.0f) * clipToWorld;
+            Vector4 farPoint = Vector4(x, y, 0.5f, 1.0f) * clipToWorld;
+            Vector3 origin(nearPoint._x / nearPoint._w, nearPoint._y / nearPoint._w, nearPoint._z / nearPoint._w);
+            Vector3 dir = Vector3(farPoint._x / farPoint._w, farPoint._y / farPoint._w, farPoint._z / farPoint._w) - origin;
+            R32 boxEnter, boxExit;
+            if (!intersectRay(origin, dir, box, boxEnter, boxExit)) continue;
+            B32 blocked = false;
+            for (const Bounds3D& wall : walls) {
+                R32 wallEnter, wallExit;
+                if (intersectRay(origin, dir, wall, wallEnter, wallExit) && wallEnter <= boxEnter) {
+                    blocked = true;
+                    break;
+                }
+            }
+            if (!blocked) return true;
+        }
+    }
+    return false;
+}
+
+
+struct CullResult
+{
+    R64 _rasterizeMs;
+    R64 _testNs;
+    U32 _hidden;
+    U32 _falselyHidden;
+    U64 _depthHash;
+};
+
+
+// With wallMeshes, walls are given as closed triangle meshes instead of boxes.
+CullResult runCuller(JobSystem* pJobs, U32 boxCount, U32 iterations, B32 checkRays, B32 wallMeshes)
+{
+    Vector3 eye(0.0f, 3.0f, 10.0f);
+    Matrix44 viewToClip = makeViewToClip(eye, Vector3(0.0f, 3.0f, -100.0f));
+    Matrix44 clipToWorld = viewToClip.inverse();
+
+    std::vector<Bounds3D> walls;
+    makeWalls(walls, 6, 20.0f);
+    std::vector<Vector3> centers(boxCount);
+    std::vector<Vector3> extents(boxCount);
+    Random rng = { 7654321u };
+    for (U32 i = 0; i < boxCount; ++i) {
+        R32 z = rng.range(-150.0f, 5.0f);
+        R32 halfWidth = (10.0f - z) * 0.7f;
+        centers[i] = Vector3(rng.range(-halfWidth, halfWidth), rng.range(0.0f, 20.0f), z);
+        R32 size = rng.next() < 0.9f ? rng.range(0.2f, 2.0f) : rng.range(2.0f, 12.0f);
+        extents[i] = Vector3(size, rng.range(0.2f, size), size);
+    }
+
+    OcclusionCuller culler;
+    culler.initialize();
+    CullResult result = { };
+    Clock::time_point start = Clock::now();
+    for (U32 it = 0; it < iterations; ++it) {
+        culler.clear();
+        for (const Bounds3D& wall : walls) {
+            if (!wallMeshes) {
+                culler.addOccluder(wall);
+                continue;
+            }
+            Vector3 corners[8];
+            for (U32 i = 0; i < 8; ++i) {
+                corners[i] = Vector3((i & 1) ? wall._max._x : wall._min._x,
+                                     (i & 2) ? wall._max._y : wall._min._y,
+                                     (i & 4) ? wall._max._z : wall._min._z);
+            }
+            culler.addOccluder(corners, 8, boxIndices, 36, Matrix44(), true);
+        }
+        culler.rasterize(viewToClip, pJobs);
+    }
+    result._rasterizeMs = elapsedMs(start) / iterations;
+
+    std::vector<U8> visible(boxCount);
+    start = Clock::now();
+    for (U32 it = 0; it < iterations; ++it) {
+        for (U32 i = 0; i < boxCount; ++i) {
+            visible[i] = culler.isVisible(centers[i], extents[i]) ? 1 : 0;
+        }
+    }
+    result._testNs = elapsedMs(start) * 1e6 / ((R64)iterations * boxCount);
+
+    for (U32 i = 0; i < boxCount; ++i) {
+        if (visible[i]) continue;
+        ++result._hidden;
+        if (checkRays && isSeenByRays(viewToClip, clipToWorld, Bounds3D(centers[i] - extents[i], centers[i] + extents[i]), walls)) {
+            ++result._falselyHidden;
+        }
+    }
+
+    // FNV-1a over the depth buffer, every run must draw it bit for bit the same.
+    result._depthHash = 1469598103934665603ull;
+    const U8* pBytes = reinterpret_cast<const U8*>(culler.getDepth());
+    for (U32 i = 0; i < culler.getWidth() * culler.getHeight() * sizeof(R32); ++i) {
+        result._depthHash = (result._depthHash ^ pBytes[i]) * 1099511628211ull;
+    }
+
+    const OcclusionStats& stats = culler.getStats();
+    if (checkRays) {
+        printf("%u walls, %u faces, %u drawn, %u binned, %u of %u tiles covered, %ux%u depth\n",
+               stats._occluders, stats._faces, stats._rasterizedFaces, stats._binnedFaces,
+               stats._coveredTiles, (culler.getWidth() / OcclusionCuller::kTileWidth) * (culler.getHeight() / OcclusionCuller::kTileHeight),
+               culler.getWidth(), culler.getHeight());
+    }
+    return result;
+}
+
+
+struct SceneResult
+{
+    R64 _renderMs;
+    U32 _visible;
+    U32 _culled;
+    U32 _occluded;
+};
+
+
+// Average render() time and camera cull counts over frameCount frames, of meshCount quads spread
+// over the ground behind rows of walls. With occluders, the walls are given as occluders too.
+SceneResult runScene(JobSystem* pJobs, U32 meshCount, U32 frameCount, B32 occluders)
+{
+    FrontEndRenderer renderer;
+    renderer.setJobSystem(pJobs);
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+
+    Globals globals = { };
+    globals._targetSize[0] = 1920;
+    globals._targetSize[1] = 1080;
+    globals._near = kNear;
+    globals._far = kFar;
+    renderer.setGlobals(&globals);
+
+    VertexBuffer vertexBuffer = renderer.createVertexBuffer(quad, sizeof(Vertex), sizeof(quad));
+    IndexBuffer indexBuffer = renderer.createIndexBufferView(quadIndices, sizeof(quadIndices));
+    PerMaterialDescriptor material = { };
+    material._albedo = Vector4(1.0f, 1.0f, 1.0f);
+    RenderUUID materialId = renderer.createMaterialBuffer();
+
+    std::vector<Bounds3D> walls;
+    makeWalls(walls, 4, 15.0f);
+
+    std::vector<PerMeshDescriptor> descriptors(meshCount);
+    std::vector<GeometryMesh> meshes(meshCount);
+    std::vector<GeometrySubMesh> submeshes(meshCount);
+    Random rng = { 13579u };
+    for (U32 i = 0; i < meshCount; ++i) {
+        GeometryMesh& mesh = meshes[i];
+        mesh._vertexBufferView = vertexBuffer.vertexBufferView;
+        mesh._indexBufferView = indexBuffer.indexBufferView;
+        mesh._meshTransform = renderer.createTransformBuffer();
+        mesh._meshDescriptor = &descriptors[i];
+        mesh._submeshCount = 1;
+        mesh._bounds = Bounds3D(Vector3(-1.0f, -1.0f, 0.0f), Vector3(1.0f, 1.0f, 0.0f));
+        mesh._vertexFormat = VERTEX_FORMAT_FLOAT;
+        R32 z = rng.range(-130.0f, -12.0f);
+        R32 halfWidth = (10.0f - z) * 0.7f;
+        descriptors[i]._world = Matrix44::translate(Matrix44(), Vector4(rng.range(-halfWidth, halfWidth), 1.0f, z));
+
+        GeometrySubMesh& submesh = submeshes[i];
+        submesh._materialDescriptor = materialId;
+        submesh._matData = &material;
+        submesh._indCount = 6;
+        submesh._vertInst = 1;
+    }
+
+    const U32 kWarmUpFrames = 4;
+    SceneResult result = { };
+    for (U32 frame = 0; frame < frameCount + kWarmUpFrames; ++frame) {
+        Vector3 eye(sinf(frame * 0.05f) * 4.0f, 3.0f, 10.0f);
+        Vector3 target = eye + Vector3(0.0f, 0.0f, -1.0f);
+        globals._cameraPos = Vector4(eye._x, eye._y, eye._z, 1.0f);
+        globals._proj = Matrix44::perspectiveRH(60.0f * kPi / 180.0f, 1920.0f / 1080.0f, kNear, kFar);
+        globals._worldToView = Matrix44::lookAtRH(eye, target, Vector3(0.0f, 1.0f, 0.0f));
+        globals._viewToWorld = globals._worldToView.inverse();
+        globals._viewToClip = globals._worldToView * globals._proj;
+
+        for (U32 i = 0; i < meshCount; ++i) {
+            GeometrySubMesh* pSubmesh = &submeshes[i];
+            renderer.pushMesh(&meshes[i], &pSubmesh);
+        }
+        if (occluders) {
+            for (const Bounds3D& wall : walls) {
+                renderer.pushOccluder(wall);
+            }
+        }
+        renderer.update(0.0f, globals);
+        Clock::time_point start = Clock::now();
+        renderer.render();
+        R64 renderMs = elapsedMs(start);
+        if (frame < kWarmUpFrames) continue;
+
+        const CullStats& stats = renderer.getCameraCullStats();
+        result._renderMs += renderMs;
+        result._visible = stats._visible;
+        result._culled = stats._culled;
+        result._occluded = stats._occluded;
+    }
+    result._renderMs /= frameCount ? (R64)frameCount : 1.0;
+    renderer.cleanUp();
+    return result;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 boxCount = argc > 1 ? (U32)atoi(argv[1]) : 100000u;
+    U32 iterations = argc > 2 ? (U32)atoi(argv[2]) : 20u;
+
+    CullResult serial = runCuller(nullptr, boxCount, iterations, true, false);
+    printf("%u boxes, %u iterations\n", boxCount, iterations);
+    printf("  no workers  rasterize %7.3f ms, %6.1f ns per box, %u hidden, %u hidden but seen by a ray\n",
+           serial._rasterizeMs, serial._testNs, serial._hidden, serial._falselyHidden);
+
+    B32 deterministic = true;
+    const U32 workerCounts[] = { 1, 2, 4 };
+    for (U32 workers : workerCounts) {
+        JobSystem jobs;
+        jobs.initialize(workers);
+        CullResult result = runCuller(&jobs, boxCount, iterations, false, false);
+        B32 same = result._depthHash == serial._depthHash && result._hidden == serial._hidden;
+        deterministic = deterministic && same;
+        printf("  %2u workers  rasterize %7.3f ms, %6.1f ns per box, %u hidden, depth %s\n",
+               workers, result._rasterizeMs, result._testNs, result._hidden, same ? "same" : "DIFFERS");
+        jobs.cleanUp();
+    }
+    CullResult meshes = runCuller(nullptr, boxCount, iterations, true, true);
+    printf("  wall meshes rasterize %7.3f ms, %6.1f ns per box, %u hidden, %u hidden but seen by a ray\n",
+           meshes._rasterizeMs, meshes._testNs, meshes._hidden, meshes._falselyHidden);
+
+    U32 meshCount = 8192;
+    U32 frameCount = 30;
+    printf("%u meshes behind 4 rows of walls, %u frames\n", meshCount, frameCount);
+    JobSystem jobs;
+    jobs.initialize(2);
+    SceneResult without = runScene(&jobs, meshCount, frameCount, false);
+    SceneResult with = runScene(&jobs, meshCount, frameCount, true);
+    printf("  no occluders    render %7.3f ms, %5u meshes drawn by each camera pass, %5u culled\n",
+           without._renderMs, without._visible, without._culled);
+    printf("  walls occluding render %7.3f ms, %5u meshes drawn by each camera pass, %5u culled, %5u of them occluded\n",
+           with._renderMs, with._visible, with._culled, with._occluded);
+    jobs.cleanUp();
+
+    return serial._falselyHidden == 0 && meshes._falselyHidden == 0 && deterministic ? 0 : 1;
+}
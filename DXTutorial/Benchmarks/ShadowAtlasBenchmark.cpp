@@ -0,0 +1,312 @@
+// Benchmark for the shadow atlas. First churns the tile allocator with allocations and frees of
+// random sizes, reporting the time per operation and how full and fragmented the atlas gets, and
+// checks no two tiles overlap, and that freeing every tile merges the atlas back whole. Then runs
+// the front end with the null RHI over a field of quads lit by shadowed point and spot lights:
+// a few lights that all move every frame, so every view of them renders every frame, then many
+// more lights, of which only a few move, along with one mesh, so the rest keep their tiles. Last,
+// more lights than the atlas holds at full size, with the camera turning, so tiles are evicted.
+//
+// Usage: ShadowAtlasBenchmark [meshCount] [frameCount]
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "ShadowAtlas.h"
+#include "ShadowRenderer.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+using namespace jcl;
+using namespace jcl::Shadows;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const R32 kPi = 3.14159265f;
+
+Vertex quad[6] = {
+  { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } }
+};
+
+U32 quadIndices[6] = {
+    0, 1, 2, 3, 4, 5
+};
+
+
+struct Random
+{
+    U32 _state;
+
+    U32 nextU32()
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return _state;
+    }
+    R32 next() { return (nextU32() >> 8) * (1.0f / 16777216.0f); }
+    R32 range(R32 lo, R32 hi) { return lo + (hi - lo) * next(); }
+};
+
+
+R64 elapsedMs(Clock::time_point start)
+{
+    return (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1e6;
+}
+
+
+// Tiles over each other, counted by cells of the smallest tile size.
+U32 countOverlaps(const ShadowAtlas& atlas, const std::vector<ShadowAtlas::Tile>& tiles)
+{
+    U32 cellsPerSide = atlas.getSize() / atlas.getMinTileSize();
+    std::vector<U8> cells(cellsPerSide * cellsPerSide, 0);
+    U32 overlaps = 0;
+    for (ShadowAtlas::Tile tile : tiles) {
+        ShadowAtlasRect rect = atlas.getRect(tile);
+        U32 cell = atlas.getMinTileSize();
+        for (U32 y = rect._y / cell; y < (rect._y + rect._size) / cell; ++y) {
+            for (U32 x = rect._x / cell; x < (rect._x + rect._size) / cell; ++x) {
+                overlaps += cells[y * cellsPerSide + x] ? 1 : 0;
+                cells[y * cellsPerSide + x] = 1;
+            }
+        }
+    }
+    return overlaps;
+}
+
+
+B32 benchmarkAllocator()
+{
+    const U32 kOperations = 200000;
+    ShadowAtlas atlas;
+    atlas.initialize(8192, 64);
+    Random rng = { 24681357u };
+    std::vector<ShadowAtlas::Tile> tiles;
+    U32 failed = 0;
+    U64 peakTexels = 0;
+    Clock::time_point start = Clock::now();
+    for (U32 i = 0; i < kOperations; ++i) {
+        // Slightly more allocations than frees, so the atlas fills up and stays full.
+        if (tiles.empty() || rng.next() < 0.55f) {
+            ShadowAtlas::Tile tile = atlas.allocate(64u << (rng.nextU32() % 5));
+            if (tile == ShadowAtlas::kInvalidTile) ++failed;
+            else tiles.push_back(tile);
+        } else {
+            U32 idx = rng.nextU32() % tiles.size();
+            atlas.free(tiles[idx]);
+            tiles[idx] = tiles.back();
+            tiles.pop_back();
+        }
+        peakTexels = atlas.getUsedTexels() > peakTexels ? atlas.getUsedTexels() : peakTexels;
+    }
+    R64 ns = elapsedMs(start) * 1e6 / kOperations;
+
+    U64 texels = 0;
+    for (ShadowAtlas::Tile tile : tiles) {
+        ShadowAtlasRect rect = atlas.getRect(tile);
+        texels += (U64)rect._size * rect._size;
+    }
+    U32 overlaps = countOverlaps(atlas, tiles);
+    B32 counted = texels == atlas.getUsedTexels();
+    R64 atlasTexels = (R64)atlas.getSize() * atlas.getSize();
+    printf("atlas of %u texels, tiles of 64 to 1024\n", atlas.getSize());
+    printf("  %.1f ns per allocate or free, %u allocations found no room\n", ns, failed);
+    printf("  %u tiles live, %.1f%% of the atlas used, %.1f%% at most, largest free tile %u\n",
+           (U32)tiles.size(), 100.0 * atlas.getUsedTexels() / atlasTexels, 100.0 * peakTexels / atlasTexels,
+           atlas.getLargestFreeSize());
+
+    for (ShadowAtlas::Tile tile : tiles) {
+        atlas.free(tile);
+    }
+    B32 merged = atlas.getLargestFreeSize() == atlas.getSize() && atlas.getUsedTexels() == 0;
+    printf("  %u overlapping cells, texels %s, %s after freeing every tile\n", overlaps,
+           counted ? "all counted" : "miscounted", merged ? "whole" : "fragmented");
+    return overlaps == 0 && counted && merged;
+}
+
+
+struct SceneResult
+{
+    R64 _renderMs;
+    R64 _renderedViews;
+    R64 _cachedViews;
+    R64 _casterDraws;
+    U32 _shadows;
+    U32 _unshadowed;
+    U32 _evictedTiles;
+    R64 _usedMB;
+};
+
+
+// Average render() time and shadow counts over frameCount frames, after a few to warm up.
+// lightCount lights are half point and half spot lights, the first movingCount of them move
+// every frame, and with a moving mesh, so does the first mesh. With a turning camera, it sweeps
+// around, over lights spread all around it.
+SceneResult runScene(U32 meshCount, U32 lightCount, U32 movingCount, B32 movingMesh, B32 turningCamera, U32 frameCount)
+{
+    FrontEndRenderer renderer;
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+
+    Globals globals = { };
+    globals._targetSize[0] = 1920;
+    globals._targetSize[1] = 1080;
+    globals._near = 0.1f;
+    globals._far = 1000.0f;
+    renderer.setGlobals(&globals);
+
+    VertexBuffer vertexBuffer = renderer.createVertexBuffer(quad, sizeof(Vertex), sizeof(quad));
+    IndexBuffer indexBuffer = renderer.createIndexBufferView(quadIndices, sizeof(quadIndices));
+    PerMaterialDescriptor material = { };
+    material._albedo = Vector4(1.0f, 1.0f, 1.0f);
+    RenderUUID materialId = renderer.createMaterialBuffer();
+
+    U32 gridWidth = (U32)sqrtf((R32)meshCount) + 1u;
+    std::vector<PerMeshDescriptor> descriptors(meshCount);
+    std::vector<GeometryMesh> meshes(meshCount);
+    std::vector<GeometrySubMesh> submeshes(meshCount);
+    for (U32 i = 0; i < meshCount; ++i) {
+        GeometryMesh& mesh = meshes[i];
+        mesh._vertexBufferView = vertexBuffer.vertexBufferView;
+        mesh._indexBufferView = indexBuffer.indexBufferView;
+        mesh._meshTransform = renderer.createTransformBuffer();
+        mesh._meshDescriptor = &descriptors[i];
+        mesh._submeshCount = 1;
+        mesh._bounds = Bounds3D(Vector3(-1.0f, -1.0f, 0.0f), Vector3(1.0f, 1.0f, 0.0f));
+        mesh._vertexFormat = VERTEX_FORMAT_FLOAT;
+        R32 x = ((R32)(i % gridWidth) - gridWidth * 0.5f) * 3.0f;
+        R32 z = ((R32)(i / gridWidth) - gridWidth * 0.5f) * 3.0f;
+        descriptors[i]._world = Matrix44::translate(Matrix44(), Vector4(x, 1.0f, z));
+
+        GeometrySubMesh& submesh = submeshes[i];
+        submesh._materialDescriptor = materialId;
+        submesh._matData = &material;
+        submesh._indCount = 6;
+        submesh._vertInst = 1;
+    }
+
+    // Shadows must stay where they are while registered.
+    Lights::LightSystem& lightSystem = renderer.getLightSystem();
+    std::vector<LightShadow> shadows(lightCount);
+    std::vector<Lights::LightHandle> handles(lightCount);
+    std::vector<Vector3> positions(lightCount);
+    Random rng = { 97531u };
+    R32 spread = gridWidth * 1.5f;
+    for (U32 i = 0; i < lightCount; ++i) {
+        B32 point = (i & 1) == 0;
+        shadows[i].initialize(point ? LightShadow::SHADOW_TYPE_OMNIDIRECTIONAL : LightShadow::SHADOW_TYPE_SPOT,
+                              point ? SHADOW_RESOLUTION_512_512 : SHADOW_RESOLUTION_1024_1024);
+        registerShadow(renderer.getBackendRenderer(), &shadows[i]);
+        positions[i] = turningCamera ? Vector3(rng.range(-spread, spread), 4.0f, rng.range(-spread, spread))
+                                     : Vector3(rng.range(-40.0f, 40.0f), 4.0f, rng.range(-100.0f, 0.0f));
+        if (point) {
+            Lights::PointLight light = { };
+            light._position = positions[i];
+            light._radiance = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
+            light._radius = 10.0f;
+            light._shadow = &shadows[i];
+            handles[i] = lightSystem.addPointLight(light);
+        } else {
+            Lights::SpotLight light = { };
+            light._position = positions[i];
+            light._radiance = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
+            light._direction = Vector3(0.2f, -1.0f, 0.1f);
+            light._inner = 0.4f;
+            light._outer = 0.6f;
+            light._range = 15.0f;
+            light._shadow = &shadows[i];
+            handles[i] = lightSystem.addSpotLight(light);
+        }
+    }
+
+    const U32 kWarmUpFrames = 4;
+    SceneResult result = { };
+    for (U32 frame = 0; frame < frameCount + kWarmUpFrames; ++frame) {
+        R32 t = (R32)frame;
+        for (U32 i = 0; i < movingCount && i < lightCount; ++i) {
+            Vector3 position = positions[i] + Vector3(sinf(t * 0.1f + i) * 2.0f, 0.0f, cosf(t * 0.1f + i) * 2.0f);
+            if ((i & 1) == 0) lightSystem.movePointLight(handles[i], position);
+            else lightSystem.moveSpotLight(handles[i], position, Vector3(0.2f, -1.0f, 0.1f));
+        }
+        if (movingMesh && meshCount) {
+            descriptors[0]._world = Matrix44::translate(Matrix44(), Vector4(sinf(t * 0.05f) * 20.0f, 1.0f, -50.0f));
+        }
+
+        Vector3 eye(0.0f, 10.0f, turningCamera ? 0.0f : 50.0f);
+        R32 yaw = turningCamera ? t * 2.0f * kPi / 120.0f : 0.0f;
+        Vector3 target = eye + Vector3(sinf(yaw), -0.25f, -cosf(yaw));
+        globals._cameraPos = Vector4(eye._x, eye._y, eye._z, 1.0f);
+        globals._proj = Matrix44::perspectiveRH(60.0f * kPi / 180.0f, 1920.0f / 1080.0f, globals._near, globals._far);
+        globals._worldToView = Matrix44::lookAtRH(eye, target, Vector3(0.0f, 1.0f, 0.0f));
+        globals._viewToWorld = globals._worldToView.inverse();
+        globals._viewToClip = globals._worldToView * globals._proj;
+
+        for (U32 i = 0; i < meshCount; ++i) {
+            GeometrySubMesh* pSubmesh = &submeshes[i];
+            renderer.pushMesh(&meshes[i], &pSubmesh);
+        }
+        renderer.update(0.0f, globals);
+        Clock::time_point start = Clock::now();
+        renderer.render();
+        R64 renderMs = elapsedMs(start);
+        if (frame < kWarmUpFrames) continue;
+
+        const ShadowStats& stats = getShadowStats();
+        result._renderMs += renderMs;
+        result._renderedViews += stats._renderedViews;
+        result._cachedViews += stats._cachedViews;
+        result._casterDraws += stats._casterDraws;
+        result._shadows = stats._shadows;
+        result._unshadowed = stats._unshadowed;
+        result._evictedTiles += stats._evictedTiles;
+        result._usedMB = stats._usedTexels * 2.0 / (1024.0 * 1024.0);
+    }
+
+    R64 frames = frameCount ? (R64)frameCount : 1.0;
+    result._renderMs /= frames;
+    result._renderedViews /= frames;
+    result._cachedViews /= frames;
+    result._casterDraws /= frames;
+    for (LightShadow& shadow : shadows) {
+        unregisterShadow(&shadow);
+    }
+    renderer.cleanUp();
+    return result;
+}
+
+
+void printScene(const char* name, const SceneResult& result)
+{
+    printf("  %-34s render %7.3f ms, views %6.1f rendered %6.1f cached, %8.1f caster draws, "
+           "%u shadows (%u unshadowed), %u tiles evicted, %.1f MB of tiles\n",
+           name, result._renderMs, result._renderedViews, result._cachedViews, result._casterDraws,
+           result._shadows, result._unshadowed, result._evictedTiles, result._usedMB);
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 meshCount = argc > 1 ? (U32)atoi(argv[1]) : 4096u;
+    U32 frameCount = argc > 2 ? (U32)atoi(argv[2]) : 60u;
+
+    B32 allocatorOk = benchmarkAllocator();
+
+    printf("%u meshes, %u frames, shadow views and draws per frame, sun cascades included\n", meshCount, frameCount);
+    SceneResult few = runScene(meshCount, 5, 5, false, false, frameCount);
+    printScene("5 lights, all moving", few);
+    SceneResult many = runScene(meshCount, 50, 2, true, false, frameCount);
+    printScene("50 lights, 2 moving, 1 moving mesh", many);
+    SceneResult still = runScene(meshCount, 50, 0, false, false, frameCount);
+    printScene("50 lights, none moving", still);
+    SceneResult crowd = runScene(meshCount, 400, 0, false, true, frameCount);
+    printScene("400 lights, camera turning", crowd);
+    return allocatorOk ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+// Benchmark for the direction shadow cascades. Fits the cascades of a sun to a camera, and
+// reports the time per update, how each cascade is split and how fine its texels are, and how
+// many of a field of casters each one draws. Then checks the cascades: points sampled across the
+// view, up to the shadow distance, must be inside the cascade their depth falls in, and as the
+// camera moves and turns, fixed points must stay on the same spot of their texels.
+//
+// Usage: ShadowCascadeBenchmark [cascades] [iterations]
+//
+#include "LightRenderer.h"
+#include "ShadowRenderer.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace jcl;
+using namespace jcl::Shadows;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const R32 kPi = 3.14159265f;
+const R32 kNear = 0.1f;
+const R32 kFar = 500.0f;
+const U32 kSampleCount = 200000;
+const U32 kStableFrames = 240;
+const U32 kStablePoints = 256;
+
+
+struct Random
+{
+    U32 _state;
+
+    R32 next()
+    {
+        _state = _state * 1664525u + 1013904223u;
+        return (_state >> 8) * (1.0f / 16777216.0f);
+    }
+    R32 range(R32 lo, R32 hi) { return lo + (hi - lo) * next(); }
+};
+
+
+Globals makeCamera(const Vector3& position, R32 yaw)
+{
+    Globals globals = { };
+    globals._near = kNear;
+    globals._far = kFar;
+    globals._proj = Matrix44::perspectiveRH(60.0f * kPi / 180.0f, 16.0f / 9.0f, kNear, kFar);
+    Vector3 forward(sinf(yaw), -0.2f, -cosf(yaw));
+    globals._worldToView = Matrix44::lookAtRH(position, position + forward, Vector3(0.0f, 1.0f, 0.0f));
+    globals._viewToWorld = globals._worldToView.inverse();
+    globals._viewToClip = globals._worldToView * globals._proj;
+    return globals;
+}
+
+
+Vector3 shadowClip(const ShadowView& cascade, const Vector3& world)
+{
+    Vector4 clip = Vector4(world, 1.0f) * cascade._viewToClip;
+    return Vector3(clip._x / clip._w, clip._y / clip._w, clip._z / clip._w);
+}
+
+
+B32 isInCascade(const ShadowView& cascade, const Vector3& world)
+{
+    Vector3 clip = shadowClip(cascade, world);
+    return fabsf(clip._x) <= 1.0f && fabsf(clip._y) <= 1.0f && clip._z >= 0.0f && clip._z <= 1.0f;
+}
+
+
+// Points of the view between near and the shadow distance must be in the cascade covering their depth.
+U32 checkCoverage(const LightShadow& shadow, const Globals& camera, R32 shadowDistance, std::vector<U32>& served)
+{
+    Random rng = { 7654321u };
+    U32 missing = 0;
+    R32 p00 = camera._proj._[0][0];
+    R32 p11 = camera._proj._[1][1];
+    served.assign(shadow.getCascadeCount(), 0);
+    for (U32 s = 0; s < kSampleCount; ++s) {
+        R32 depth = kNear * powf(shadowDistance / kNear, rng.next());
+        Vector4 view(rng.range(-1.0f, 1.0f) * depth / p00, rng.range(-1.0f, 1.0f) * depth / p11, -depth, 1.0f);
+        Vector4 world4 = view * camera._viewToWorld;
+        Vector3 world(world4._x, world4._y, world4._z);
+        U32 first = shadow.getCascadeCount();
+        for (U32 c = 0; c < shadow.getCascadeCount(); ++c) {
+            const ShadowView& cascade = shadow.getView(c);
+            if (first == shadow.getCascadeCount() && isInCascade(cascade, world)) first = c;
+            if (depth >= cascade._splitNear && depth <= cascade._splitFar && !isInCascade(cascade, world)) ++missing;
+        }
+        if (first < shadow.getCascadeCount()) ++served[first];
+    }
+    return missing;
+}
+
+
+// Distance of a texel coordinate to its texel's corner.
+R32 texelPhase(R32 clip, U32 mapSize)
+{
+    R32 texel = (clip * 0.5f + 0.5f) * mapSize;
+    return texel - floorf(texel);
+}
+
+
+// Moves and turns the camera a little each frame, fixed points in view must keep their texel
+// phase in every cascade that has them.
+U32 checkStability(LightShadow& shadow, Lights::DirectionLight& light, Lights::LightTransform* pTransforms, U32* pChecked)
+{
+    Random rng = { 1234567u };
+    std::vector<Vector3> points(kStablePoints);
+    for (Vector3& point : points) {
+        point = Vector3(rng.range(-20.0f, 20.0f), rng.range(0.0f, 5.0f), rng.range(-60.0f, -5.0f));
+    }
+    std::vector<R32> phases(kStablePoints * kMaxShadowCascades * 2, -1.0f);
+    U32 shimmering = 0;
+    U32 checked = 0;
+    for (U32 frame = 0; frame < kStableFrames; ++frame) {
+        R32 t = static_cast<R32>(frame);
+        Globals camera = makeCamera(Vector3(t * 0.0137f, 2.0f + t * 0.0031f, t * -0.0219f), t * 0.0011f);
+        shadow.update(&light, pTransforms, camera);
+        for (U32 c = 0; c < shadow.getCascadeCount(); ++c) {
+            const ShadowView& cascade = shadow.getView(c);
+            for (U32 p = 0; p < kStablePoints; ++p) {
+                if (!isInCascade(cascade, points[p])) continue;
+                Vector3 clip = shadowClip(cascade, points[p]);
+                R32 phaseX = texelPhase(clip._x, shadow.getMapSize());
+                R32 phaseY = texelPhase(clip._y, shadow.getMapSize());
+                R32* pPhase = &phases[(p * kMaxShadowCascades + c) * 2];
+                if (pPhase[0] >= 0.0f) {
+                    R32 dx = fabsf(phaseX - pPhase[0]);
+                    R32 dy = fabsf(phaseY - pPhase[1]);
+                    dx = dx > 0.5f ? 1.0f - dx : dx;
+                    dy = dy > 0.5f ? 1.0f - dy : dy;
+                    if (dx > 0.01f || dy > 0.01f) ++shimmering;
+                    ++checked;
+                }
+                pPhase[0] = phaseX;
+                pPhase[1] = phaseY;
+            }
+        }
+    }
+    *pChecked = checked;
+    return shimmering;
+}
+} // namespace
+
+
+int main(int argc, char* argv[])
+{
+    U32 cascadeCount = argc > 1 ? (U32)atoi(argv[1]) : kMaxShadowCascades;
+    U32 iterations = argc > 2 ? (U32)atoi(argv[2]) : 1000u;
+    iterations = iterations ? iterations : 1u;
+
+    Lights::DirectionLight light = { };
+    light._direction = Vector3(0.4f, -1.0f, 0.3f);
+    light._radiance = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
+    light._transform = 0;
+    Lights::LightTransform transforms[kMaxShadowCascades];
+
+    LightShadow shadow;
+    shadow.initialize(LightShadow::SHADOW_TYPE_DIRECTIONAL, SHADOW_RESOLUTION_2048_2048, cascadeCount);
+    light._shadow = &shadow;
+    Globals camera = makeCamera(Vector3(0.0f, 2.0f, 0.0f), 0.0f);
+
+    R64 best = 1e30;
+    for (U32 i = 0; i < iterations; ++i) {
+        Clock::time_point start = Clock::now();
+        shadow.update(&light, transforms, camera);
+        R64 us = (R64)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count() / 1000.0;
+        best = us < best ? us : best;
+    }
+
+    // A field of casters over the ground in front of the camera.
+    std::vector<Bounds3D> casters;
+    for (I32 z = -200; z < 10; z += 2) {
+        for (I32 x = -100; x < 100; x += 2) {
+            R32 height = 0.5f + 0.5f * ((x * 7 + z * 13) & 7);
+            casters.push_back(Bounds3D(Vector3((R32)x, 0.0f, (R32)z), Vector3(x + 1.0f, height, z + 1.0f)));
+        }
+    }
+
+    std::vector<U32> served;
+    U32 missing = checkCoverage(shadow, camera, LightShadow::kDefaultShadowDistance, served);
+    printf("%u cascades of %u texels, %.2f us per update\n", shadow.getCascadeCount(), shadow.getMapSize(), best);
+    U32 drawn = 0;
+    U32 written = 0;
+    for (U32 c = 0; c < shadow.getCascadeCount(); ++c) {
+        const ShadowView& cascade = shadow.getView(c);
+        U32 cascadeCasters = 0;
+        for (const Bounds3D& bounds : casters) {
+            cascadeCasters += shadow.intersects(bounds, c) ? 1 : 0;
+        }
+        drawn += cascadeCasters;
+        written += memcmp(&transforms[c]._viewToClip, &cascade._viewToClip, sizeof(Matrix44)) == 0 ? 1 : 0;
+        printf("  cascade %u: depth %7.2f to %7.2f, radius %7.2f, texel %.4f, %5.1f%% of samples, %u of %u casters\n",
+               c, cascade._splitNear, cascade._splitFar, cascade._radius, cascade._texelSize,
+               100.0 * served[c] / kSampleCount, cascadeCasters, (U32)casters.size());
+    }
+    printf("  %u caster draws over all cascades, transforms written for %u of %u cascades\n",
+           drawn, written, shadow.getCascadeCount());
+
+    U32 checked = 0;
+    U32 shimmering = checkStability(shadow, light, transforms, &checked);
+    printf("  %u samples outside the cascade of their depth, %u of %u texel phases moved\n",
+           missing, shimmering, checked);
+    return missing == 0 && shimmering == 0 && written == shadow.getCascadeCount() ? 0 : 1;
+}
@@ -0,0 +1,489 @@
+// Benchmark for the upload queue. Runs it on the null backend with a gpu that lags behind: fences
+// only complete after being polled a few times, or once waited on, and only then do their copies
+// land, read from whatever the staging memory holds at that point. Staging reused before its copies
+// ran shows up as wrong bytes in the destinations. Runs uploads that wrap the staging ring, that
+// fill it so the queue has to wait on the gpu, and that are bigger than the whole ring, checks
+// every destination byte and the order tickets complete in, and that fences are reused, and
+// reports the upload rate of each.
+//
+// Usage: UploadBenchmark [uploads]
+//
+#include "UploadQueue.h"
+#include "Null/NullBackend.h"
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace jcl;
+
+namespace {
+
+
+typedef std::chrono::steady_clock Clock;
+
+const U64 kRingBytes = 256ull * 1024ull;
+
+
+struct Random
+{
+    U32 _state;
+
+    U32 nextU32()
+    {
+        _state ^= _state << 13;
+        _state ^= _state >> 17;
+        _state ^= _state << 5;
+        return _state;
+    }
+};
+
+
+// Bytes of an upload, different for every upload and position.
+U8 patternByte(U32 upload, U64 i)
+{
+    return static_cast<U8>((upload * 131u) ^ (i * 7u) ^ (i >> 8));
+}
+
+
+struct Copy
+{
+    gfx::Resource* _pDst;
+    U64 _dstOffset;
+    gfx::Resource* _pSrc;
+    U64 _srcOffset;
+    U64 _szBytes;
+    // Texture copies only.
+    U32 _width;
+    U32 _height;
+    U32 _rowPitch;
+};
+
+
+// Keeps the copies it records, for the backend to run once their fence completes.
+class CopyList : public gfx::CommandList
+{
+public:
+    void reset(const char* debugTag) override { _copies.clear(); }
+
+    void copyBufferRegion(gfx::Resource* pDst, U64 dstOffset, gfx::Resource* pSrc, U64 srcOffset, U64 szBytes) override
+    {
+        Copy copy = { pDst, dstOffset, pSrc, srcOffset, szBytes, 0, 0, 0 };
+        _copies.push_back(copy);
+    }
+
+    void copyBufferToTexture2D(gfx::Resource* pDst,
+                               gfx::Resource* pSrc,
+                               U64 srcOffset,
+                               U32 width,
+                               U32 height,
+                               DXGI_FORMAT format,
+                               U32 rowPitch) override
+    {
+        Copy copy = { pDst, 0, pSrc, srcOffset, 0, width, height, rowPitch };
+        _copies.push_back(copy);
+    }
+
+    std::vector<Copy> _copies;
+};
+
+
+// Texels of a texture, the null backend keeps no memory for them.
+struct TextureTarget
+{
+    U32 _width;
+    U32 _height;
+    U32 _bytesPerPixel;
+    std::vector<U8> _texels;
+};
+
+
+/*
+    Null backend with a gpu queue that lags behind the cpu. Submitted copies wait for the next fence
+    signal, and run when that fence completes, after latency polls or when waited on. Fences complete
+    in signal order, like a queue. A latency of 0 never completes a fence by polling.
+*/
+class LaggingBackend : public gfx::NullBackend
+{
+public:
+    LaggingBackend()
+        : m_latency(2)
+        , m_waits(0)
+        , m_liveBuffers(0)
+        , m_ringWraps(0)
+        , m_dedicatedCopies(0)
+        , m_createdFences(0)
+        , m_lastRingOffset(0)
+        , m_pRing(nullptr)
+        , m_captureRing(false) { }
+
+    void setLatency(U32 latency) { m_latency = latency; }
+    // The next buffer created is the queue's staging ring.
+    void captureRing() { m_captureRing = true; }
+    std::map<gfx::Resource*, TextureTarget>& getTextures() { return m_textures; }
+
+    U64 getWaits() const { return m_waits; }
+    I64 getLiveBuffers() const { return m_liveBuffers; }
+    // Copies out of the ring that started below the copy before them.
+    U64 getRingWraps() const { return m_ringWraps; }
+    // Copies out of staging of their own, not the ring.
+    U64 getDedicatedCopies() const { return m_dedicatedCopies; }
+    U64 getCreatedFences() const { return m_createdFences; }
+
+    void createBuffer(gfx::Resource** buffer,
+                      gfx::ResourceUsage usage,
+                      gfx::ResourceBindFlags binds,
+                      U32 widthBytes,
+                      U32 structureByteStride,
+                      const TCHAR* debugName) override
+    {
+        gfx::NullBackend::createBuffer(buffer, usage, binds, widthBytes, structureByteStride, debugName);
+        m_buffers.push_back(*buffer);
+        ++m_liveBuffers;
+        if (m_captureRing) {
+            m_pRing = *buffer;
+            m_lastRingOffset = 0;
+            m_captureRing = false;
+        }
+    }
+
+    void destroyResource(gfx::Resource* resource) override
+    {
+        for (size_t i = 0; i < m_buffers.size(); ++i) {
+            if (m_buffers[i] != resource) continue;
+            m_buffers[i] = m_buffers.back();
+            m_buffers.pop_back();
+            --m_liveBuffers;
+            break;
+        }
+        if (resource == m_pRing) m_pRing = nullptr;
+        gfx::NullBackend::destroyResource(resource);
+    }
+
+    void createCommandList(gfx::CommandList** pList) override { *pList = new CopyList(); }
+
+    void submit(gfx::RendererT queue, gfx::CommandList** cmdLists, U32 numCmdLists) override
+    {
+        for (U32 i = 0; i < numCmdLists; ++i) {
+            const std::vector<Copy>& copies = static_cast<CopyList*>(cmdLists[i])->_copies;
+            m_submitted.insert(m_submitted.end(), copies.begin(), copies.end());
+        }
+    }
+
+    void signalFence(gfx::RendererT queue, gfx::Fence* fence) override
+    {
+        PendingFence pending = { fence, 0 };
+        pending._copies.swap(m_submitted);
+        m_pending.push_back(pending);
+    }
+
+    B32 isFenceComplete(gfx::Fence* fence) override
+    {
+        for (PendingFence& pending : m_pending) {
+            if (pending._pFence != fence) continue;
+            if (m_latency && ++pending._polls >= m_latency) completeThrough(fence);
+            break;
+        }
+        return !isPending(fence);
+    }
+
+    void waitFence(gfx::Fence* fence) override
+    {
+        if (!isPending(fence)) return;
+        ++m_waits;
+        completeThrough(fence);
+    }
+
+    void createFence(gfx::Fence** ppFence) override
+    {
+        gfx::NullBackend::createFence(ppFence);
+        ++m_createdFences;
+    }
+
+    void destroyFence(gfx::Fence* fence) override
+    {
+        // Destroying a fence still pending means its staging was given back too early.
+        if (isPending(fence)) {
+            printf("  fence destroyed before it completed\n");
+            exit(1);
+        }
+        gfx::NullBackend::destroyFence(fence);
+    }
+
+private:
+    struct PendingFence
+    {
+        gfx::Fence* _pFence;
+        U32 _polls;
+        std::vector<Copy> _copies;
+    };
+
+    B32 isPending(gfx::Fence* fence) const
+    {
+        for (const PendingFence& pending : m_pending) {
+            if (pending._pFence == fence) return true;
+        }
+        return false;
+    }
+
+    void completeThrough(gfx::Fence* fence)
+    {
+        while (!m_pending.empty()) {
+            PendingFence& front = m_pending.front();
+            for (const Copy& copy : front._copies) run(copy);
+            B32 last = front._pFence == fence;
+            m_pending.pop_front();
+            if (last) break;
+        }
+    }
+
+    void run(const Copy& copy)
+    {
+        const U8* pSrc = static_cast<gfx::ResourceNull*>(copy._pSrc)->_memory.data() + copy._srcOffset;
+        if (copy._pSrc == m_pRing) {
+            if (copy._srcOffset < m_lastRingOffset) ++m_ringWraps;
+            m_lastRingOffset = copy._srcOffset;
+        } else {
+            ++m_dedicatedCopies;
+        }
+        if (!copy._width) {
+            memcpy(static_cast<gfx::ResourceNull*>(copy._pDst)->_memory.data() + copy._dstOffset, pSrc, copy._szBytes);
+            return;
+        }
+        TextureTarget& texture = m_textures[copy._pDst];
+        U64 rowBytes = static_cast<U64>(texture._width) * texture._bytesPerPixel;
+        for (U32 row = 0; row < copy._height; ++row) {
+            memcpy(texture._texels.data() + row * rowBytes, pSrc + static_cast<U64>(row) * copy._rowPitch, rowBytes);
+        }
+    }
+
+    U32 m_latency;
+    U64 m_waits;
+    I64 m_liveBuffers;
+    U64 m_ringWraps;
+    U64 m_dedicatedCopies;
+    U64 m_createdFences;
+    U64 m_lastRingOffset;
+    gfx::Resource* m_pRing;
+    B32 m_captureRing;
+    std::vector<gfx::Resource*> m_buffers;
+    std::vector<Copy> m_submitted;
+    std::deque<PendingFence> m_pending;
+    std::map<gfx::Resource*, TextureTarget> m_textures;
+};
+
+
+struct Upload
+{
+    U32 _id;
+    UploadTicket _ticket;
+    // Buffer uploads land in the shared destination at _dstOffset, textures in one of their own.
+    gfx::Resource* _pTexture;
+    U64 _dstOffset;
+    U64 _szBytes;
+};
+
+
+struct RunResult
+{
+    R64 _ms;
+    U64 _bytes;
+    U64 _batches;
+    U32 _wrongBytes;
+    U32 _ticketErrors;
+};
+
+
+// Upload count buffers, and some textures, of sizes drawn by sizeFn, flushing and retiring every
+// uploadsPerFrame like the renderer's frames, then wait for all of it and check every byte.
+template<typename SizeFn>
+RunResult runUploads(LaggingBackend& backend, U32 count, U32 uploadsPerFrame, U32 latency, SizeFn sizeFn)
+{
+    backend.setLatency(latency);
+    UploadQueue queue;
+    backend.captureRing();
+    queue.initialize(&backend, kRingBytes);
+
+    Random rng = { 0x9e3779b9u };
+    std::vector<Upload> uploads(count);
+    U64 dstBytes = 0;
+    for (U32 i = 0; i < count; ++i) {
+        uploads[i]._id = i;
+        uploads[i]._szBytes = sizeFn(rng);
+        uploads[i]._pTexture = nullptr;
+        // One in eight is a texture, placed on the ring at a coarser alignment.
+        if (rng.nextU32() % 8 == 0) {
+            U32 width = 16u << (rng.nextU32() % 4);
+            U32 height = 1u + static_cast<U32>(uploads[i]._szBytes / (width * 4u));
+            backend.createTexture(&uploads[i]._pTexture, gfx::RESOURCE_DIMENSION_2D, gfx::RESOURCE_USAGE_DEFAULT,
+                                  gfx::RESOURCE_BIND_SHADER_RESOURCE, DXGI_FORMAT_R8G8B8A8_UNORM,
+                                  width, height, 1, 0, TEXT("UploadTexture"));
+            TextureTarget& texture = backend.getTextures()[uploads[i]._pTexture];
+            texture._width = width;
+            texture._height = height;
+            texture._bytesPerPixel = 4;
+            texture._texels.assign(static_cast<U64>(width) * height * 4u, 0);
+            uploads[i]._szBytes = texture._texels.size();
+        }
+        uploads[i]._dstOffset = dstBytes;
+        if (!uploads[i]._pTexture) dstBytes += uploads[i]._szBytes;
+    }
+    gfx::Resource* pDst = nullptr;
+    backend.createBuffer(&pDst, gfx::RESOURCE_USAGE_CPU_TO_GPU, gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                         static_cast<U32>(dstBytes ? dstBytes : 1), 0, TEXT("UploadDestination"));
+    std::vector<U8> data;
+
+    RunResult result = { };
+    const U8* pLanded = static_cast<gfx::ResourceNull*>(pDst)->_memory.data();
+    auto checkLanded = [&backend, &result, pLanded] (const Upload& upload) {
+        const U8* pBytes = upload._pTexture ? backend.getTextures()[upload._pTexture]._texels.data()
+                                            : pLanded + upload._dstOffset;
+        for (U64 b = 0; b < upload._szBytes; ++b) {
+            if (pBytes[b] != patternByte(upload._id, b)) ++result._wrongBytes;
+        }
+        result._bytes += upload._szBytes;
+    };
+
+    // Only the queue's own calls are timed, not writing the data or checking it.
+    Clock::duration queueTime(0);
+    UploadTicket lastTicket = 0;
+    UploadTicket lastCompleted = queue.getCompletedTicket();
+    U32 checked = 0;
+    for (U32 i = 0; i < count; ++i) {
+        Upload& upload = uploads[i];
+        data.resize(upload._szBytes);
+        for (U64 b = 0; b < upload._szBytes; ++b) data[b] = patternByte(upload._id, b);
+        Clock::time_point start = Clock::now();
+        if (upload._pTexture) {
+            const TextureTarget& texture = backend.getTextures()[upload._pTexture];
+            upload._ticket = queue.uploadTexture2D(upload._pTexture, data.data(), texture._width, texture._height,
+                                                   texture._bytesPerPixel, DXGI_FORMAT_R8G8B8A8_UNORM);
+        } else {
+            upload._ticket = queue.uploadBuffer(pDst, upload._dstOffset, data.data(), upload._szBytes);
+        }
+        if ((i + 1) % uploadsPerFrame == 0) {
+            queue.flush();
+            queue.retire();
+        }
+        queueTime += Clock::now() - start;
+
+        // Tickets never go back, and the queue never holds more staging than the ring.
+        if (upload._ticket < lastTicket || queue.getUsedBytes() > queue.getCapacity()) ++result._ticketErrors;
+        lastTicket = upload._ticket;
+        // Completed tickets only move forward, and every upload they cover has landed by then.
+        UploadTicket completed = queue.getCompletedTicket();
+        if (completed < lastCompleted) ++result._ticketErrors;
+        lastCompleted = completed;
+        for (; checked <= i && uploads[checked]._ticket <= completed; ++checked) {
+            checkLanded(uploads[checked]);
+        }
+        // The upload just made can't be done before its batch is even submitted.
+        if ((i + 1) % uploadsPerFrame != 0 && queue.isComplete(upload._ticket)) ++result._ticketErrors;
+    }
+    Clock::time_point start = Clock::now();
+    queue.waitIdle();
+    queueTime += Clock::now() - start;
+    result._ms = (R64)std::chrono::duration_cast<std::chrono::microseconds>(queueTime).count() / 1000.0;
+    for (; checked < count; ++checked) {
+        if (!queue.isComplete(uploads[checked]._ticket)) ++result._ticketErrors;
+        checkLanded(uploads[checked]);
+    }
+
+    for (const Upload& upload : uploads) {
+        if (!upload._pTexture) continue;
+        backend.getTextures().erase(upload._pTexture);
+        backend.destroyResource(upload._pTexture);
+    }
+    backend.destroyResource(pDst);
+    result._batches = queue.getBatchCount();
+    queue.cleanUp();
+    return result;
+}
+
+
+B32 report(const char* name, const RunResult& result, U64 waits, U64 wraps, U64 dedicated, U64 fences)
+{
+    printf("  %-22s %8.2f ms %8.1f MiB/s %6llu waits %6llu wraps %5llu dedicated %5llu fences for %5llu batches  "
+           "%u wrong bytes, %u ticket errors\n",
+           name, result._ms, result._ms > 0.0 ? (R64)result._bytes / (1024.0 * 1024.0) / (result._ms / 1000.0) : 0.0,
+           (unsigned long long)waits, (unsigned long long)wraps, (unsigned long long)dedicated,
+           (unsigned long long)fences, (unsigned long long)result._batches, result._wrongBytes, result._ticketErrors);
+    return result._wrongBytes == 0 && result._ticketErrors == 0;
+}
+} // namespace
+
+
+int main(int argc, char** argv)
+{
+    U32 count = argc > 1 ? (U32)atoi(argv[1]) : 2000u;
+    count = count ? count : 1u;
+    LaggingBackend backend;
+    printf("%u uploads, %llu KiB staging ring\n", count, (unsigned long long)(kRingBytes / 1024ull));
+
+    B32 passed = true;
+    struct Scenario
+    {
+        const char* _name;
+        U32 _uploadsPerFrame;
+        U32 _latency;
+        U64 _minBytes;
+        U64 _maxBytes;
+        // What the scenario has to run into, or it didn't test anything.
+        B32 _mustWait;
+        B32 _mustWrap;
+        B32 _mustDedicate;
+    };
+    const Scenario scenarios[] = {
+        // A few KiB each, well under a ring per frame, fences done within a couple of frames.
+        { "wrapping the ring", 16, 2, 256, 8 * 1024, false, true, false },
+        // Fences never complete on their own, every byte of room comes from waiting on the oldest batch.
+        { "filling the ring", 64, 0, 4 * 1024, 48 * 1024, true, true, false },
+        // Uploads bigger than the ring each get staging of their own, between ring sized ones.
+        { "bigger than the ring", 4, 3, kRingBytes / 2, kRingBytes * 3, false, false, true },
+    };
+    for (const Scenario& scenario : scenarios) {
+        U64 waits = backend.getWaits();
+        U64 wraps = backend.getRingWraps();
+        U64 dedicated = backend.getDedicatedCopies();
+        U64 fences = backend.getCreatedFences();
+        I64 liveBuffers = backend.getLiveBuffers();
+        U64 minBytes = scenario._minBytes;
+        U64 range = scenario._maxBytes - scenario._minBytes + 1;
+        U32 scenarioCount = scenario._minBytes > kRingBytes / 4 ? (count / 50 ? count / 50 : 1) : count;
+        RunResult result = runUploads(backend, scenarioCount, scenario._uploadsPerFrame, scenario._latency,
+                                      [minBytes, range] (Random& rng) { return minBytes + rng.nextU32() % range; });
+        waits = backend.getWaits() - waits;
+        wraps = backend.getRingWraps() - wraps;
+        dedicated = backend.getDedicatedCopies() - dedicated;
+        fences = backend.getCreatedFences() - fences;
+        B32 ok = report(scenario._name, result, waits, wraps, dedicated, fences);
+        // Every staging buffer, dedicated ones included, is gone once the queue is cleaned up.
+        if (backend.getLiveBuffers() != liveBuffers) {
+            printf("    %lld buffers leaked\n", (long long)(backend.getLiveBuffers() - liveBuffers));
+            ok = false;
+        }
+        if (scenario._mustWait && !waits) {
+            printf("    never waited on the gpu\n");
+            ok = false;
+        }
+        if (scenario._mustWrap && !wraps) {
+            printf("    never wrapped the ring\n");
+            ok = false;
+        }
+        if (scenario._mustDedicate && !dedicated) {
+            printf("    never staged outside of the ring\n");
+            ok = false;
+        }
+        // Fences of retired batches are signaled again, not created anew.
+        if (result._batches > 1 && fences >= result._batches) {
+            printf("    a new fence for every batch\n");
+            ok = false;
+        }
+        passed = passed && ok;
+    }
+    return passed ? 0 : 1;
+}
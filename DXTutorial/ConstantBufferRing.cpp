@@ -0,0 +1,94 @@
+//
+#include "ConstantBufferRing.h"
+
+namespace jcl {
+
+
+void ConstantBufferRing::initialize(gfx::BackendRenderer* pBackend, U64 regionBytes, U32 framesInFlight)
+{
+    m_pBackend = pBackend;
+    m_framesInFlight = framesInFlight ? framesInFlight : 1;
+    m_frameNumber = 0;
+    createBuffer(alignSize(regionBytes));
+}
+
+
+void ConstantBufferRing::cleanUp()
+{
+    releaseRetired(true);
+    if (m_pBuffer) {
+        m_pBuffer->unmap(nullptr);
+        m_pBackend->destroyResource(m_pBuffer);
+    }
+    m_pBuffer = nullptr;
+    m_pBase = nullptr;
+}
+
+
+void ConstantBufferRing::createBuffer(U64 regionBytes)
+{
+    if (m_pBuffer) {
+        // Frames still in flight may read the old buffer.
+        RetiredBuffer retired = { m_pBuffer, m_frameNumber + m_framesInFlight };
+        m_retired.push_back(retired);
+    }
+
+    m_regionBytes = regionBytes;
+    m_pBuffer = nullptr;
+    m_pBackend->createBuffer(&m_pBuffer,
+                             gfx::RESOURCE_USAGE_CPU_TO_GPU,
+                             gfx::RESOURCE_BIND_CONSTANT_BUFFER,
+                             static_cast<U32>(m_regionBytes * m_framesInFlight),
+                             0, TEXT("ConstantBufferRing"));
+    // Upload heap memory stays mapped for the lifetime of the buffer.
+    m_pBase = m_pBuffer ? static_cast<U8*>(m_pBuffer->map(nullptr)) : nullptr;
+    m_regionStart = 0;
+    m_head = 0;
+}
+
+
+void ConstantBufferRing::releaseRetired(B32 all)
+{
+    U32 kept = 0;
+    for (U32 i = 0; i < m_retired.size(); ++i) {
+        RetiredBuffer& retired = m_retired[i];
+        if (all || retired._lastFrame <= m_frameNumber) {
+            retired._pBuffer->unmap(nullptr);
+            m_pBackend->destroyResource(retired._pBuffer);
+        } else {
+            m_retired[kept++] = retired;
+        }
+    }
+    m_retired.resize(kept);
+}
+
+
+void ConstantBufferRing::beginFrame(U64 requiredBytes)
+{
+    ++m_frameNumber;
+    releaseRetired(false);
+
+    requiredBytes = alignSize(requiredBytes);
+    if (requiredBytes > m_regionBytes) {
+        U64 regionBytes = m_regionBytes ? m_regionBytes : kAlignment;
+        while (regionBytes < requiredBytes) regionBytes *= 2;
+        createBuffer(regionBytes);
+    }
+
+    m_regionStart = (m_frameNumber % m_framesInFlight) * m_regionBytes;
+    m_head = m_regionStart;
+}
+
+
+B32 ConstantBufferRing::allocate(U64 szBytes, ConstantAllocation* pAllocation)
+{
+    U64 alignedBytes = alignSize(szBytes);
+    if (!m_pBase || m_head + alignedBytes > m_regionStart + m_regionBytes) {
+        return false;
+    }
+    pAllocation->_pData = m_pBase + m_head;
+    pAllocation->_offset = m_head;
+    m_head += alignedBytes;
+    return true;
+}
+} // jcl
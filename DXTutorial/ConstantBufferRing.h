@@ -0,0 +1,88 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "BackendRenderer.h"
+
+#include <vector>
+
+namespace jcl {
+
+
+struct ConstantAllocation
+{
+    // Cpu write pointer, valid until this frame's region comes around again.
+    void* _pData;
+    // Byte offset into the ring buffer, to bind with setGraphicsRootConstantBufferView.
+    U64 _offset;
+};
+
+
+/*
+    Constant Buffer Ring is one persistently mapped upload buffer, split into a region per frame in flight.
+    Every frame linearly sub-allocates 256 byte aligned constants from its own region, which replaces
+    a committed buffer, and a map/unmap, per constant. A region is only reused once the frames in flight
+    have gone around, so the gpu is done reading it by then. When a frame needs more than a region holds,
+    the ring is recreated bigger, and the old buffer is kept alive until its frames have retired.
+*/
+class ConstantBufferRing
+{
+public:
+    // Constant buffer views must start on 256 byte boundaries.
+    static const U64 kAlignment = 256ull;
+    // Offset of no allocation, never a valid place to bind.
+    static const U64 kInvalidOffset = ~0ull;
+
+    ConstantBufferRing()
+        : m_pBackend(nullptr)
+        , m_pBuffer(nullptr)
+        , m_pBase(nullptr)
+        , m_regionBytes(0)
+        , m_framesInFlight(0)
+        , m_frameNumber(0)
+        , m_regionStart(0)
+        , m_head(0) { }
+
+    void initialize(gfx::BackendRenderer* pBackend, U64 regionBytes, U32 framesInFlight);
+    void cleanUp();
+
+    // Move on to the next frame's region, making sure it holds at least requiredBytes.
+    void beginFrame(U64 requiredBytes = 0ull);
+
+    // Sub-allocate szBytes, rounded up to kAlignment, from this frame's region.
+    // Returns false if the region is full.
+    B32 allocate(U64 szBytes, ConstantAllocation* pAllocation);
+
+    // Buffer that this frame's offsets point into.
+    gfx::Resource* getBuffer() const { return m_pBuffer; }
+
+    // Frames begun so far.
+    U64 getFrameNumber() const { return m_frameNumber; }
+    U64 getUsedBytes() const { return m_head - m_regionStart; }
+    U64 getRegionBytes() const { return m_regionBytes; }
+    U32 getFramesInFlight() const { return m_framesInFlight; }
+
+    static U64 alignSize(U64 szBytes) { return (szBytes + kAlignment - 1ull) & ~(kAlignment - 1ull); }
+
+private:
+    struct RetiredBuffer
+    {
+        gfx::Resource* _pBuffer;
+        // Frame number after which the gpu no longer reads the buffer.
+        U64 _lastFrame;
+    };
+
+    void createBuffer(U64 regionBytes);
+    void releaseRetired(B32 all);
+
+    gfx::BackendRenderer* m_pBackend;
+    gfx::Resource* m_pBuffer;
+    U8* m_pBase;
+    U64 m_regionBytes;
+    U32 m_framesInFlight;
+    U64 m_frameNumber;
+    U64 m_regionStart;
+    U64 m_head;
+    std::vector<RetiredBuffer> m_retired;
+};
+} // jcl
@@ -0,0 +1,203 @@
+//
+#include "Culling.h"
+#include "Math/SIMD.h"
+
+#include <string.h>
+
+namespace jcl {
+
+// Meshes per kernel step.
+static const U32 kLaneCount = 4;
+// Half extent given to meshes without bounds, large enough to never be rejected.
+static const R32 kUnboundedExtent = 1e30f;
+// Meshes per job of a parallel prepare or cull, a multiple of the lane count.
+static const U32 kCullChunkSize = 1024;
+
+
+void MeshCuller::prepare(GeometryMesh** pMeshes,
+                         U32 meshCount,
+                         GeometrySubMesh** pSubMeshes,
+                         U32 submeshCount,
+                         JobSystem* pJobs)
+{
+    m_pMeshes = pMeshes;
+    m_pSubMeshes = pSubMeshes;
+    m_meshCount = meshCount;
+    // Bounds are only compared to the last ones if they are of the same meshes.
+    m_meshesChanged = meshCount != m_previousMeshes.size() 
+                   || (meshCount && memcmp(m_previousMeshes.data(), pMeshes, sizeof(GeometryMesh*) * meshCount) != 0);
+    if (m_meshesChanged) {
+        m_previousMeshes.assign(pMeshes, pMeshes + meshCount);
+    }
+    m_moved.resize(meshCount);
+    m_previousBounds.resize(meshCount);
+
+    U32 padded = (meshCount + kLaneCount - 1) & ~(kLaneCount - 1);
+    m_submeshOffsets.resize(meshCount);
+    m_centerX.resize(padded);
+    m_centerY.resize(padded);
+    m_centerZ.resize(padded);
+    m_extentX.resize(padded);
+    m_extentY.resize(padded);
+    m_extentZ.resize(padded);
+
+    U32 submeshOffset = 0;
+    for (U32 i = 0; i < meshCount; ++i) {
+        m_submeshOffsets[i] = submeshOffset;
+        submeshOffset += pMeshes[i]->_submeshCount;
+    }
+
+    auto transformBounds = [this, pMeshes] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            GeometryMesh* pMesh = pMeshes[i];
+            Vector3 center;
+            Vector3 extent(kUnboundedExtent, kUnboundedExtent, kUnboundedExtent);
+            if (!pMesh->_bounds.isEmpty()) {
+                Bounds3D world = pMesh->_meshDescriptor ? pMesh->_bounds.transform(pMesh->_meshDescriptor->_world)
+                                                        : pMesh->_bounds;
+                center = world.getCenter();
+                extent = world.getExtent() * 0.5f;
+            }
+
+            // Same bounds come out bit for bit the same, no need for a tolerance.
+            B32 moved = !m_meshesChanged
+                     && (pMesh->_bounds.isEmpty()
+                         || m_centerX[i] != center._x || m_centerY[i] != center._y || m_centerZ[i] != center._z
+                         || m_extentX[i] != extent._x || m_extentY[i] != extent._y || m_extentZ[i] != extent._z);
+            m_moved[i] = moved ? 1 : 0;
+            if (moved) {
+                Vector3 previousCenter(m_centerX[i], m_centerY[i], m_centerZ[i]);
+                Vector3 previousExtent(m_extentX[i], m_extentY[i], m_extentZ[i]);
+                m_previousBounds[i] = Bounds3D(previousCenter - previousExtent, previousCenter + previousExtent);
+            }
+            m_centerX[i] = center._x;
+            m_centerY[i] = center._y;
+            m_centerZ[i] = center._z;
+            m_extentX[i] = extent._x;
+            m_extentY[i] = extent._y;
+            m_extentZ[i] = extent._z;
+        }
+    };
+    if (pJobs) {
+        pJobs->parallelFor(meshCount, kCullChunkSize, transformBounds);
+    } else {
+        transformBounds(0, meshCount);
+    }
+
+    // Padding lanes are tested along with the rest, but never read back.
+    for (U32 i = meshCount; i < padded; ++i) {
+        m_centerX[i] = m_centerY[i] = m_centerZ[i] = 0.0f;
+        m_extentX[i] = m_extentY[i] = m_extentZ[i] = 0.0f;
+    }
+
+    m_movedBounds.clear();
+    if (m_meshesChanged) return;
+    for (U32 i = 0; i < meshCount; ++i) {
+        if (!m_moved[i]) continue;
+        Vector3 center(m_centerX[i], m_centerY[i], m_centerZ[i]);
+        Vector3 extent(m_extentX[i], m_extentY[i], m_extentZ[i]);
+        m_movedBounds.push_back(m_previousBounds[i]);
+        m_movedBounds.push_back(Bounds3D(center - extent, center + extent));
+    }
+}
+
+
+U32 MeshCuller::cullRange(const Plane* pPlanes,
+                          U32 planeCount,
+                          U32 begin,
+                          U32 end,
+                          const OcclusionCuller* pOcclusion,
+                          std::vector<GeometryMesh*>& visibleMeshes,
+                          std::vector<GeometrySubMesh*>& visibleSubMeshes) const
+{
+    using namespace m::simd;
+
+    U32 occluded = 0;
+    for (U32 base = begin; base < end; base += kLaneCount) {
+        F4 cx = load(&m_centerX[base]);
+        F4 cy = load(&m_centerY[base]);
+        F4 cz = load(&m_centerZ[base]);
+        F4 ex = load(&m_extentX[base]);
+        F4 ey = load(&m_extentY[base]);
+        F4 ez = load(&m_extentZ[base]);
+
+        // Box is outside when its most positive corner, along the plane normal, is behind the plane.
+        F4 closest = splat(FLT_MAX);
+        for (U32 p = 0; p < planeCount; ++p) {
+            const Plane& plane = pPlanes[p];
+            F4 a = splat(plane._a);
+            F4 b = splat(plane._b);
+            F4 c = splat(plane._c);
+            F4 dist = madd(a, cx, madd(b, cy, madd(c, cz, splat(plane._d))));
+            F4 radius = madd(abs(a), ex, madd(abs(b), ey, mul(abs(c), ez)));
+            closest = min(closest, add(dist, radius));
+        }
+
+        R32 result[kLaneCount];
+        store(result, closest);
+        U32 lanes = (end - base) < kLaneCount ? (end - base) : kLaneCount;
+        for (U32 lane = 0; lane < lanes; ++lane) {
+            if (result[lane] < 0.0f) continue;
+            U32 meshIdx = base + lane;
+            if (pOcclusion) {
+                Vector3 center(m_centerX[meshIdx], m_centerY[meshIdx], m_centerZ[meshIdx]);
+                Vector3 extent(m_extentX[meshIdx], m_extentY[meshIdx], m_extentZ[meshIdx]);
+                if (!pOcclusion->isVisible(center, extent)) {
+                    ++occluded;
+                    continue;
+                }
+            }
+            GeometryMesh* pMesh = m_pMeshes[meshIdx];
+            visibleMeshes.push_back(pMesh);
+            GeometrySubMesh** ppSubMeshes = &m_pSubMeshes[m_submeshOffsets[meshIdx]];
+            visibleSubMeshes.insert(visibleSubMeshes.end(), ppSubMeshes, ppSubMeshes + pMesh->_submeshCount);
+        }
+    }
+    return occluded;
+}
+
+
+U32 MeshCuller::cull(const Plane* pPlanes,
+                     U32 planeCount,
+                     std::vector<GeometryMesh*>& visibleMeshes,
+                     std::vector<GeometrySubMesh*>& visibleSubMeshes,
+                     CullStats* pStats,
+                     JobSystem* pJobs,
+                     const OcclusionCuller* pOcclusion) const
+{
+    visibleMeshes.clear();
+    visibleSubMeshes.clear();
+
+    U32 occluded = 0;
+    U32 chunkCount = (m_meshCount + kCullChunkSize - 1) / kCullChunkSize;
+    if (!pJobs || pJobs->getWorkerCount() == 0 || chunkCount < 2) {
+        occluded = cullRange(pPlanes, planeCount, 0, m_meshCount, pOcclusion, visibleMeshes, visibleSubMeshes);
+    } else {
+        if (m_chunks.size() < chunkCount) m_chunks.resize(chunkCount);
+        pJobs->parallelFor(chunkCount, 1, [&] (U32 begin, U32 end) {
+            for (U32 chunk = begin; chunk < end; ++chunk) {
+                CullChunk& out = m_chunks[chunk];
+                out._meshes.clear();
+                out._submeshes.clear();
+                U32 first = chunk * kCullChunkSize;
+                U32 last = first + kCullChunkSize < m_meshCount ? first + kCullChunkSize : m_meshCount;
+                out._occluded = cullRange(pPlanes, planeCount, first, last, pOcclusion, out._meshes, out._submeshes);
+            }
+        });
+        for (U32 chunk = 0; chunk < chunkCount; ++chunk) {
+            const CullChunk& out = m_chunks[chunk];
+            visibleMeshes.insert(visibleMeshes.end(), out._meshes.begin(), out._meshes.end());
+            visibleSubMeshes.insert(visibleSubMeshes.end(), out._submeshes.begin(), out._submeshes.end());
+            occluded += out._occluded;
+        }
+    }
+
+    U32 visibleCount = static_cast<U32>(visibleMeshes.size());
+    if (pStats) {
+        pStats->_visible += visibleCount;
+        pStats->_culled += m_meshCount - visibleCount;
+        pStats->_occluded += occluded;
+    }
+    return visibleCount;
+}
+} // jcl
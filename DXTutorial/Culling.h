@@ -0,0 +1,105 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "Math/Plane.h"
+#include "JobSystem.h"
+#include "OcclusionCuller.h"
+
+#include <vector>
+
+namespace jcl {
+
+
+struct CullStats
+{
+    // Meshes that passed the test.
+    U32 _visible;
+    // Meshes rejected by the test.
+    U32 _culled;
+    // Of the culled meshes, the ones inside of the volume but behind occluders.
+    U32 _occluded;
+};
+
+
+/*
+    Mesh Culler tests mesh bounds against convex volumes, such as the camera frustum and the
+    shadow frustums. World space bounds are computed once per frame in prepare(), and kept as
+    structure of arrays so each cull() tests several meshes per vector register. A frame can
+    then cull the same meshes against as many frustums as it needs.
+*/
+class MeshCuller
+{
+public:
+    MeshCuller() : m_meshCount(0), m_pMeshes(nullptr), m_pSubMeshes(nullptr), m_meshesChanged(true) { }
+
+    // Transform each mesh's local _bounds by its descriptor world matrix. Meshes with empty
+    // bounds are never culled. The mesh and submesh arrays must stay alive until the last cull().
+    // With pJobs, bounds are transformed in parallel on it.
+    void prepare(GeometryMesh** pMeshes,
+                 U32 meshCount,
+                 GeometrySubMesh** pSubMeshes,
+                 U32 submeshCount,
+                 JobSystem* pJobs = nullptr);
+
+    // Cull the prepared meshes against planeCount planes, normals facing inwards. Visible meshes
+    // and their submeshes are written, in order, to the output lists. Counts are added to pStats if given.
+    // With pJobs, chunks of meshes are culled in parallel on it, into lists of their own that are
+    // joined in order after. Only one such cull may run on a culler at a time.
+    // With pOcclusion, meshes that pass the planes are also tested against its occluders, as
+    // last rasterized. Only give it for the view it was rasterized for.
+    U32 cull(const Plane* pPlanes,
+             U32 planeCount,
+             std::vector<GeometryMesh*>& visibleMeshes,
+             std::vector<GeometrySubMesh*>& visibleSubMeshes,
+             CullStats* pStats = nullptr,
+             JobSystem* pJobs = nullptr,
+             const OcclusionCuller* pOcclusion = nullptr) const;
+
+    U32 getMeshCount() const { return m_meshCount; }
+    // World bounds of the meshes that moved since the prepare() before the last, as they were and
+    // as they are now. What was drawn of the meshes, like a shadow map, is still good if none of
+    // these touch it. Meshes without bounds are always listed, unbounded.
+    const std::vector<Bounds3D>& getMovedBounds() const { return m_movedBounds; }
+    // True if the last prepare() was given other meshes than the one before, then nothing
+    // drawn of them before can be kept.
+    B32 haveMeshesChanged() const { return m_meshesChanged; }
+
+private:
+    // Cull meshes [begin, end), begin a multiple of the lane count, appending to the lists.
+    // Returns the meshes found occluded.
+    U32 cullRange(const Plane* pPlanes,
+                  U32 planeCount,
+                  U32 begin,
+                  U32 end,
+                  const OcclusionCuller* pOcclusion,
+                  std::vector<GeometryMesh*>& visibleMeshes,
+                  std::vector<GeometrySubMesh*>& visibleSubMeshes) const;
+
+    struct CullChunk
+    {
+        std::vector<GeometryMesh*> _meshes;
+        std::vector<GeometrySubMesh*> _submeshes;
+        U32 _occluded;
+    };
+
+    U32 m_meshCount;
+    GeometryMesh** m_pMeshes;
+    GeometrySubMesh** m_pSubMeshes;
+    // First submesh of each mesh.
+    std::vector<U32> m_submeshOffsets;
+    // World space center and half extent streams, padded to the lane count.
+    std::vector<R32> m_centerX, m_centerY, m_centerZ;
+    std::vector<R32> m_extentX, m_extentY, m_extentZ;
+    // Visible lists of each chunk of a parallel cull, kept between frames.
+    mutable std::vector<CullChunk> m_chunks;
+
+    // Meshes of the last prepare(), to tell when they change.
+    std::vector<GeometryMesh*> m_previousMeshes;
+    B32 m_meshesChanged;
+    // Set for meshes whose bounds moved, with the bounds they moved from.
+    std::vector<U8> m_moved;
+    std::vector<Bounds3D> m_previousBounds;
+    std::vector<Bounds3D> m_movedBounds;
+};
+} // jcl
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "../WinConfigs.h"
+
 #include <d3d11.h>
 #include <d3d11_4.h>
 
@@ -63,6 +63,8 @@ public:
     virtual void destroy() override {
         for (U32 i = 0; i < m_pCmdList.size(); ++i)
         m_pCmdList[i]->Release();
+        for (U32 i = 0; i < m_pAllocatorRef.size(); ++i)
+          m_pAllocatorRef[i]->Release();
     }
 
     virtual void reset(const char* debugTag) override {
@@ -72,6 +74,9 @@ public:
 
         if (!debugTag)
             tag = "";
+        // The list owns its allocators, and is reset once per use of the frame index, by which
+        // time present() waited for the gpu to finish with that frame.
+        DX12ASSERT(m_pAllocatorRef[frameIndex]->Reset());
         m_pCmdList[frameIndex]->Reset(m_pAllocatorRef[frameIndex], nullptr);
         PIXBeginEvent(m_pCmdList[frameIndex], 0, tag);
         _isRecording = true;
@@ -141,8 +146,9 @@ public:
         return;
       }
 
-      static D3D12_CPU_DESCRIPTOR_HANDLE rtvHandles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
-      static D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle;
+      // Lists record on several threads at once, scratch stays on the stack.
+      D3D12_CPU_DESCRIPTOR_HANDLE rtvHandles[D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT];
+      D3D12_CPU_DESCRIPTOR_HANDLE dsvHandle;
       RenderPassD3D12* nativePass = static_cast<RenderPassD3D12*>(pass);
       U32 rtvCount = static_cast<U32>(nativePass->_renderTargetViews.size());
 
@@ -177,7 +183,7 @@ public:
     virtual void setVertexBuffers(U32 startSlot,
                                   VertexBufferView** buffers,
                                   U32 vertexBufferCount) override {
-        static D3D12_VERTEX_BUFFER_VIEW kVertexBuffers[16];
+        D3D12_VERTEX_BUFFER_VIEW kVertexBuffers[16];
         //m_pCmdList->IASetVertexBuffers
         for (U32 i = 0; i < vertexBufferCount; ++i) {
           VertexBufferViewD3D12* pView = static_cast<VertexBufferViewD3D12*>(buffers[i]);
@@ -193,7 +199,7 @@ public:
 
     virtual void setIndexBuffer(IndexBufferView* buffer) override {
       if (!buffer) return;
-      static D3D12_INDEX_BUFFER_VIEW kIndexBuffer;
+      D3D12_INDEX_BUFFER_VIEW kIndexBuffer;
       IndexBufferViewD3D12* pView = static_cast<IndexBufferViewD3D12*>(buffer);
       kIndexBuffer.BufferLocation = getBackendD3D12()->getResource(pView->_buffer)->GetGPUVirtualAddress();
       kIndexBuffer.Format = pView->_format;
@@ -208,7 +214,7 @@ public:
     }
 
     virtual void setViewports(Viewport* pViewports, U32 viewportCount) override {  
-        static D3D12_VIEWPORT kNativeViewports[16];
+        D3D12_VIEWPORT kNativeViewports[16];
         for (U32 i = 0; i < viewportCount; ++i) {
             Viewport& vp = pViewports[i];
             kNativeViewports[i] = { vp.x, 
@@ -224,7 +230,7 @@ public:
     }
 
     virtual void setScissors(Scissor* pScissors, U32 scissorCount) override {
-        static D3D12_RECT kNativeScissors[32];
+        D3D12_RECT kNativeScissors[32];
         for (U32 i = 0; i < scissorCount; ++i) {
             Scissor& sr = pScissors[i];
             kNativeScissors[i] = {  static_cast<LONG>(sr.left),
@@ -289,7 +295,7 @@ public:
         m_pCmdList[frameIdx]->SetDescriptorHeaps(0, nullptr);
       }
 
-      static ID3D12DescriptorHeap* pHeaps[32];
+      ID3D12DescriptorHeap* pHeaps[32];
       for (U32 i = 0; i < tableCount; ++i)
         pHeaps[i] = getBackendD3D12()->getDescriptorHeap(tables[i]->getUUID());
 
@@ -326,6 +332,41 @@ public:
       m_pCmdList[getBackendD3D12()->getFrameIndex()]->CopyResource(pNativeDst, pNativeSrc);  
     }
 
+    void copyBufferRegion(Resource* pDst, U64 dstOffset, Resource* pSrc, U64 srcOffset, U64 szBytes) override {
+      if (!pSrc || !pDst) return;
+
+      ID3D12Resource* pNativeSrc = getBackendD3D12()->getResource(pSrc->getUUID());
+      ID3D12Resource* pNativeDst = getBackendD3D12()->getResource(pDst->getUUID());
+      m_pCmdList[getBackendD3D12()->getFrameIndex()]->CopyBufferRegion(pNativeDst, dstOffset, pNativeSrc, srcOffset, szBytes);
+    }
+
+    void copyBufferToTexture2D(Resource* pDst, 
+                               Resource* pSrc, 
+                               U64 srcOffset, 
+                               U32 width, 
+                               U32 height, 
+                               DXGI_FORMAT format, 
+                               U32 rowPitch) override {
+      if (!pSrc || !pDst) return;
+
+      D3D12_TEXTURE_COPY_LOCATION dstLocation = { };
+      dstLocation.pResource = getBackendD3D12()->getResource(pDst->getUUID());
+      dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+      dstLocation.SubresourceIndex = 0;
+
+      // srcOffset must be 512 byte aligned, and rowPitch 256 byte aligned.
+      D3D12_TEXTURE_COPY_LOCATION srcLocation = { };
+      srcLocation.pResource = getBackendD3D12()->getResource(pSrc->getUUID());
+      srcLocation.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
+      srcLocation.PlacedFootprint.Offset = srcOffset;
+      srcLocation.PlacedFootprint.Footprint.Format = format;
+      srcLocation.PlacedFootprint.Footprint.Width = width;
+      srcLocation.PlacedFootprint.Footprint.Height = height;
+      srcLocation.PlacedFootprint.Footprint.Depth = 1;
+      srcLocation.PlacedFootprint.Footprint.RowPitch = rowPitch;
+      m_pCmdList[getBackendD3D12()->getFrameIndex()]->CopyTextureRegion(&dstLocation, 0, 0, 0, &srcLocation, nullptr);
+    }
+
     void setGraphicsRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) override {
         if (!pTable) return;
         ID3D12DescriptorHeap* pHeap = getBackendD3D12()->getDescriptorHeap(pTable->getUUID());
@@ -353,16 +394,16 @@ public:
                                                                                         pResource->GetGPUVirtualAddress() + offset);
     }
 
-    void setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView) override {
+    void setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset) override {
         ID3D12Resource* pResource = getBackendD3D12()->getResource(pShaderResourceView->getUUID());
         m_pCmdList[getBackendD3D12()->getFrameIndex()]->SetGraphicsRootShaderResourceView(rootParameterIndex,
-                                                                                          pResource->GetGPUVirtualAddress());
+                                                                                          pResource->GetGPUVirtualAddress() + offset);
     }
 
-    void setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView) override {
+    void setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset) override {
         ID3D12Resource* pResource = getBackendD3D12()->getResource(pShaderResourceView->getUUID());
         m_pCmdList[getBackendD3D12()->getFrameIndex()]->SetComputeRootShaderResourceView(rootParameterIndex,
-                                                                                         pResource->GetGPUVirtualAddress());
+                                                                                         pResource->GetGPUVirtualAddress() + offset);
     }
 
 protected:
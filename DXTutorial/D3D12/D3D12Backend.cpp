@@ -1214,9 +1214,13 @@ void D3D12Backend::createDescriptorHeaps()
 
 void D3D12Backend::createCommandList(CommandList** pList) 
 {
+  // Every list gets allocators of its own, one per frame in flight, so that lists can record
+  // on different threads at once. Allocators aren't free threaded.
   std::vector<ID3D12CommandAllocator*> allocs(m_frameResources.size());
   for (U32 i = 0; i < m_frameResources.size(); ++i)
-    allocs[i] = m_frameResources[i]._pAllocator;
+    DX12ASSERT(m_pDevice->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, 
+                                                 __uuidof(ID3D12CommandAllocator), 
+                                                 (void**)&allocs[i]));
 
   CommandList* pNativeList = nullptr;
   pNativeList = new GraphicsCommandListD3D12(D3D12_COMMAND_LIST_TYPE_DIRECT, 
@@ -1238,17 +1242,20 @@ void D3D12Backend::destroyCommandList(CommandList* pList)
 void D3D12Backend::submit(RendererT queue, CommandList** cmdLists, U32 numCmdLists)
 {
   ID3D12CommandQueue* pQueue = m_pCommandQueues[queue];
-  static ID3D12CommandList* pNativeLists[64];
-
-  for (U32 i = 0; i < numCmdLists; ++i) {
-    GraphicsCommandListD3D12* pCmdList = static_cast<GraphicsCommandListD3D12*>(cmdLists[i]); 
-    pNativeLists[i] = pCmdList->getNativeList(m_frameIndex);
-    if (pCmdList->isRecording()) {
-      ASSERT(false && "Cmd list submitted for execution, when it is still in record mode!");
+  ID3D12CommandList* pNativeLists[64];
+
+  // Lists execute in the order given, batches of them at a time.
+  for (U32 first = 0; first < numCmdLists; first += 64) {
+    U32 count = numCmdLists - first < 64 ? numCmdLists - first : 64;
+    for (U32 i = 0; i < count; ++i) {
+      GraphicsCommandListD3D12* pCmdList = static_cast<GraphicsCommandListD3D12*>(cmdLists[first + i]); 
+      pNativeLists[i] = pCmdList->getNativeList(m_frameIndex);
+      if (pCmdList->isRecording()) {
+        ASSERT(false && "Cmd list submitted for execution, when it is still in record mode!");
+      }
     }
+    pQueue->ExecuteCommandLists(count, pNativeLists);
   }
-
-  pQueue->ExecuteCommandLists(numCmdLists, pNativeLists);
 }
 
 
@@ -1258,7 +1265,7 @@ void D3D12Backend::signalFence(RendererT queue, Fence* fence)
   ID3D12CommandQueue* pQueue = m_pCommandQueues[queue];
   ID3D12Fence* pFence = m_fences[f];
   
-  DX12ASSERT(pQueue->Signal(pFence, m_fenceValues[f]));
+  DX12ASSERT(pQueue->Signal(pFence, ++m_fenceValues[f]));
 }
 
 
@@ -1272,6 +1279,15 @@ void D3D12Backend::waitFence(Fence* fence)
 }
 
 
+B32 D3D12Backend::isFenceComplete(Fence* fence)
+{
+  RendererT f = fence->getUUID();
+  ID3D12Fence* pFence = m_fences[f];
+
+  return pFence->GetCompletedValue() >= m_fenceValues[f];
+}
+
+
 
 void D3D12Backend::createDescriptorTable(DescriptorTable** table)
 {
@@ -1324,7 +1340,8 @@ void D3D12Backend::createFence(Fence** ppFence)
   *ppFence = pFence;
   m_fences[pFence->getUUID()] = pNativeFence;
   m_fenceEvents[pFence->getUUID()] = CreateEvent(NULL, FALSE, FALSE, NULL);
-  m_fenceValues[pFence->getUUID()] = 1;
+  // Last value signaled, the first signal is 1.
+  m_fenceValues[pFence->getUUID()] = 0;
 }
 
 
@@ -1361,7 +1378,10 @@ void D3D12Backend::createGraphicsPipelineState(GraphicsPipeline** ppPipeline,
     desc.DSVFormat = pInfo->_dsvFormat;
     desc.NumRenderTargets = pInfo->_numRenderTargets;
     desc.NodeMask = 0;
-    desc.pRootSignature = getBackendD3D12()->getRootSignature(pInfo->_pRootSignature->getUUID());
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineStateMutex);
+        desc.pRootSignature = getRootSignature(pInfo->_pRootSignature->getUUID());
+    }
     
     processRasterizationState(desc, pInfo->_rasterizationState);
     processDepthStencilState(desc, pInfo->_depthStencilState);
@@ -1398,7 +1418,10 @@ void D3D12Backend::createGraphicsPipelineState(GraphicsPipeline** ppPipeline,
                                                       (void**)&pPipelineState));
     GraphicsPipelineStateD3D12* pPipe = new GraphicsPipelineStateD3D12(); 
     *ppPipeline = pPipe;
-    m_pPipelineStates[(*ppPipeline)->getUUID()] = pPipelineState;
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineStateMutex);
+        m_pPipelineStates[(*ppPipeline)->getUUID()] = pPipelineState;
+    }
     pPipe->_topology = getPrimitiveTopology(pInfo->_topology);
 }
 
@@ -1409,7 +1432,10 @@ void D3D12Backend::createComputePipelineState(ComputePipeline** ppPipeline,
     *ppPipeline = new ComputePipelineStateD3D12();
 
     D3D12_COMPUTE_PIPELINE_STATE_DESC compDesc = { };
-    compDesc.pRootSignature = getRootSignature(pInfo->_pRootSignature->getUUID());
+    {
+        std::lock_guard<std::mutex> lock(m_pipelineStateMutex);
+        compDesc.pRootSignature = getRootSignature(pInfo->_pRootSignature->getUUID());
+    }
     compDesc.CS.BytecodeLength = pInfo->_computeShader._szBytes;
     compDesc.CS.pShaderBytecode = pInfo->_computeShader._pByteCode;
 
@@ -1418,6 +1444,7 @@ void D3D12Backend::createComputePipelineState(ComputePipeline** ppPipeline,
   DX12ASSERT(m_pDevice->CreateComputePipelineState(&compDesc, 
                                                    __uuidof(ID3D12PipelineState), 
                                                    (void**)&pPipelineState));
+  std::lock_guard<std::mutex> lock(m_pipelineStateMutex);
   m_pPipelineStates[(*ppPipeline)->getUUID()] = pPipelineState;
 }
 
@@ -9,6 +9,7 @@
 
 #include <vector>
 #include <unordered_map>
+#include <mutex>
 
 namespace gfx 
 {
@@ -101,6 +102,7 @@ public:
     void submit(RendererT queue, CommandList** cmdLists, U32 numCmdLists) override;
     void signalFence(RendererT queue, Fence* fence) override;
     void waitFence(Fence* fence) override;
+    B32 isFenceComplete(Fence* fence) override;
 
     void createCommandList(CommandList** pList) override;
     
@@ -157,6 +159,7 @@ public:
                                      const GraphicsPipelineInfo* pInfo) override;
     void createComputePipelineState(ComputePipeline** ppPipeline,
                                     const ComputePipelineInfo* pInfo) override;
+    B32 isPipelineCreationThreadSafe() override { return true; }
     void createAccelerationStructure(Resource** ppResource,
                                      const AccelerationStructureGeometry* geometryInfos, 
                                      U32 geometryCount,
@@ -258,6 +261,8 @@ private:
     std::unordered_map<RendererT, ID3D12CommandQueue*> m_pCommandQueues;
     std::unordered_map<RendererT, ID3D12CommandAllocator*> m_pCommandAllocators;
     std::unordered_map<RendererT, ID3D12PipelineState*> m_pPipelineStates;
+    // Pipelines can be created from job threads, guards m_pPipelineStates and root signature lookups then.
+    std::mutex m_pipelineStateMutex;
     std::unordered_map<RendererT, ID3D12StateObject*> m_pStateObjects; 
     std::unordered_map<RendererT, ID3D12Fence*> m_fences;
     std::unordered_map<RendererT, HANDLE> m_fenceEvents;
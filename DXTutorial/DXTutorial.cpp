@@ -7,6 +7,9 @@
 #include "Math/Vector4.h"
 #include "FrontEndRenderer.h"
 #include "Model/Model.h"
+#include "Model/ModelLoader.h"
+#include "JobSystem.h"
+#include "TransformBatch.h"
 #include "Time.h"
 #include "KeyboardInput.h"
 #include "imgui.h"
@@ -97,16 +100,25 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
 
     HACCEL hAccelTable = LoadAccelerators(hInstance, MAKEINTRESOURCE(IDC_DXTUTORIAL));
 
+    // One set of workers for the frame's jobs and model loads, which run as background jobs.
+    // The loader creates their resources on this thread.
+    jcl::JobSystem jobs;
+    jobs.initialize();
+    pRenderer->setJobSystem(&jobs);
+    jcl::ModelLoader modelLoader;
+    modelLoader.initialize(pRenderer, &jobs);
+
     jcl::Model model;
     jcl::Model model1;
     jcl::Model model2;
 #if DO_SPONZA
     jcl::Model model3;    
-    model3.initialize("sponza/Sponza.gltf", pRenderer);
+    modelLoader.load(&model3, "sponza/Sponza.gltf");
 #endif
-    model.initialize("SongWork/spartan.obj", pRenderer);
-    model1.initialize("SongWork/OldCar.obj", pRenderer);
-    model2.initialize("SongWork/RacingCar.obj", pRenderer);
+    modelLoader.load(&model, "SongWork/spartan.obj");
+    modelLoader.load(&model1, "SongWork/OldCar.obj");
+    modelLoader.load(&model2, "SongWork/RacingCar.obj");
+    modelLoader.waitAll();
 
     jcl::Globals globals = { };
     pRenderer->setGlobals(&globals);
@@ -123,10 +135,10 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     RenderUUID transformId2 = pRenderer->createTransformBuffer();
     RenderUUID transformId3 = pRenderer->createTransformBuffer();
     RenderUUID materialId = pRenderer->createMaterialBuffer();
-    PerMeshDescriptor descriptor = { };
-    PerMeshDescriptor descriptor1 = { };
-    PerMeshDescriptor descriptor2 = { };
-    PerMeshDescriptor descriptor3 = { };
+    // One descriptor per mesh, written together by the transform batch each frame.
+    PerMeshDescriptor descriptors[4] = { };
+    TransformBatch transforms;
+    transforms.resize(4);
 
     PerMaterialDescriptor mat = { };
     mat._albedo = Vector4(1.0f, 0.0f, 0.0f);
@@ -138,7 +150,7 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     GeometryMesh mesh = { };
     mesh._vertexBufferView = model.getVertexBufferView();
     mesh._indexBufferView = model.getIndexBufferView();
-    mesh._meshDescriptor = &descriptor;
+    mesh._meshDescriptor = &descriptors[0];
     mesh._meshTransform = transformId;
     mesh._submeshCount = 1;
     mesh._bounds = model.getBounds();
@@ -146,22 +158,24 @@ int APIENTRY wWinMain(_In_ HINSTANCE hInstance,
     GeometryMesh mesh1 = { };
     mesh1._vertexBufferView = planeVertexBuffer.vertexBufferView;//model1.getVertexBufferView();
     mesh1._indexBufferView = planeIndexBuffer.indexBufferView;//model1.getIndexBufferView();
-    mesh1._meshDescriptor = &descriptor1;
+    mesh1._meshDescriptor = &descriptors[1];
     mesh1._meshTransform = transformId1;
     mesh1._submeshCount = 1;
+    mesh1._bounds = Bounds3D(Vector3(-1.0f, -1.0f, 0.0f), Vector3(1.0f, 1.0f, 0.0f));
 
     GeometryMesh mesh2 = { };
     mesh2._vertexBufferView = model2.getVertexBufferView();
     mesh2._indexBufferView = model2.getIndexBufferView();
-    mesh2._meshDescriptor = &descriptor2;
+    mesh2._meshDescriptor = &descriptors[2];
     mesh2._meshTransform = transformId2;
     mesh2._submeshCount = 1;
+    mesh2._bounds = model2.getBounds();
 #if DO_SPONZA
     GeometryMesh mesh3 = { };
     mesh3._vertexBufferView = model3.getVertexBufferView();
     mesh3._indexBufferView = model3.getIndexBufferView();
     mesh3._meshTransform = transformId3;
-    mesh3._meshDescriptor = &descriptor3;
+    mesh3._meshDescriptor = &descriptors[3];
     mesh3._submeshCount = model3.getTotalSubmeshes();
 #endif
     GeometrySubMesh submesh = { };
@@ -250,43 +264,12 @@ R32 damp = 0.0f;
                         Matrix44::translate(Matrix44(), Vector4(0.f, -15.0f, 0.0f));
         Matrix44 W2 = Matrix44::translate(Matrix44(), Vector4(20.f, 0.0f, 0.0f));
         Matrix44 W3 = Matrix44::scale(Matrix44(), Vector4(0.3f, 0.3f, 0.3f, 1.0f)) * Matrix44::translate(Matrix44(), Vector4(0.0f, -10.0f, 0.0f));
-                             
-        descriptor._previousWorldToViewClip = descriptor._worldToViewClip;
-        descriptor._worldToViewClip = W * globals._viewToClip;
-        descriptor._world = W;
-        descriptor._n = descriptor._world;
-        descriptor._n[3][0] = 0.0f;
-        descriptor._n[3][1] = 0.0f;
-        descriptor._n[3][2] = 0.0f;
-        descriptor._n[3][3] = 1.0f;
-        descriptor._n = descriptor._n.inverse().transpose();
-
-        descriptor1._previousWorldToViewClip = descriptor1._worldToViewClip;
-        descriptor1._worldToViewClip = W1 * globals._viewToClip;
-        descriptor1._world = W1;
-        descriptor1._n = descriptor1._world;
-        descriptor1._n[3][0] = 0.0f;
-        descriptor1._n[3][1] = 0.0f;
-        descriptor1._n[3][2] = 0.0f;
-        descriptor1._n = descriptor1._n.inverse().transpose();
-
-        descriptor2._previousWorldToViewClip = descriptor2._worldToViewClip;
-        descriptor2._worldToViewClip = W2 * globals._viewToClip;
-        descriptor2._world = W2;
-        descriptor2._n = descriptor2._world;
-        descriptor2._n[3][0] = 0.0f;
-        descriptor2._n[3][1] = 0.0f;
-        descriptor2._n[3][2] = 0.0f;
-        descriptor2._n = descriptor2._n.inverse().transpose();
-
-        descriptor3._previousWorldToViewClip = descriptor3._worldToViewClip;
-        descriptor3._worldToViewClip = W3 * globals._viewToClip;
-        descriptor3._world = W3;
-        descriptor3._n = descriptor3._world;
-        descriptor3._n[3][0] = 0.0f;
-        descriptor3._n[3][1] = 0.0f;
-        descriptor3._n[3][2] = 0.0f;
-        descriptor3._n = descriptor3._n.inverse().transpose();
+
+        transforms.setWorld(0, W);
+        transforms.setWorld(1, W1);
+        transforms.setWorld(2, W2);
+        transforms.setWorld(3, W3);
+        transforms.computeDescriptors(globals._viewToClip, descriptors);
 
         GeometrySubMesh* submeshes[] = { &submesh };
         GeometrySubMesh* submeshes1[] = { &submesh1 };
@@ -302,7 +285,10 @@ R32 damp = 0.0f;
         pRenderer->render();
     }
 
+    modelLoader.cleanUp();
+    // The renderer waits on its last jobs as it cleans up.
     cleanUpEngine();
+    jobs.cleanUp();
     return 0;
 }
 
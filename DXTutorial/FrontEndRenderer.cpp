@@ -1,36 +1,50 @@
 
 #include "FrontEndRenderer.h"
+#include "Null/NullBackend.h"
+#if JCL_PLATFORM_WINDOWS
 #include "D3D12/D3D12Backend.h"
 #include "D3D11/D3D11Backend.h"
+#include "DebugGUI.h"
+#endif
 #include "GlobalDef.h"
 #include "VelocityRenderer.h"
 #include "ShadowRenderer.h"
 #include "LightRenderer.h"
 #include "GraphicsResources.h"
-#include "DebugGUI.h"
+#include "VertexFormat.h"
 
 #include <fstream>
 
 namespace jcl {
 
+// Light indices the cluster buffers hold, about 64 lights in every cluster of the grid.
+static const U32 kMaxLightClusterIndices = 256 * 1024;
+// Point and spot lights the light buffers start with room for, they grow past it.
+static const U32 kInitialLightCapacity = 1024;
+
 
 void FrontEndRenderer::init(HWND handle, RendererRHI rhi)
 {
   {
     switch (rhi) {
+#if JCL_PLATFORM_WINDOWS
       case RENDERER_RHI_D3D_11:
         m_pBackend = gfx::getBackendD3D11();
         break;
       case RENDERER_RHI_D3D_12:
         m_pBackend = gfx::getBackendD3D12();
         break;
+#endif
       case RENDERER_RHI_NULL:
       default:
-        m_pBackend = new gfx::BackendRenderer();
+        m_pBackend = gfx::getBackendNull();
     }
   }
 
     m_pGlobals = nullptr;
+    m_cameraCullStats = { };
+    m_shadowCullStats = { };
+    m_occlusionCuller.initialize();
 
   gfx::GpuConfiguration config = { };
   config._desiredBuffers = 2;
@@ -39,10 +53,14 @@ void FrontEndRenderer::init(HWND handle, RendererRHI rhi)
   config._renderWidth = 1920;
   config._windowed = true;
   m_pBackend->initialize(handle, false, config);
+  m_pipelineCache.initialize(m_pBackend);
+  if (!m_pipelineCachePath.empty()) {
+    m_pipelineCache.prebuild(m_pipelineCachePath, m_pJobs);
+  }
 
-    if (m_pBackend->isHardwareRaytracingCompatible()) {
-    
-    }
+  if (m_pBackend->isHardwareRaytracingCompatible()) {
+  
+  }
 
   if (m_pBackend->isHardwareMachineLearningCompatible()) {
     
@@ -50,10 +68,18 @@ void FrontEndRenderer::init(HWND handle, RendererRHI rhi)
 
   m_pBackend->createCommandList(&m_pList);
 
+  // One region per swapchain buffer, grown to fit the scene on the first frames.
+  m_constantRing.initialize(m_pBackend, 1024 * 1024, config._desiredBuffers);
+  m_uploadQueue.initialize(m_pBackend, 64ull * 1024ull * 1024ull);
+
   if (m_pList)
     m_pList->init();
+  m_listFilter.setList(m_pList);
 
   pGlobalsBuffer = nullptr;
+  m_pInstanceBuffer = nullptr;
+  m_instanceCapacity = 0;
+  m_instanceRegionOffset = 0;
   m_gbuffer.pAlbedoTexture = nullptr;
     m_pBackend->createBuffer(&pGlobalsBuffer, 
                             gfx::RESOURCE_USAGE_CPU_TO_GPU,
@@ -134,27 +160,27 @@ void FrontEndRenderer::init(HWND handle, RendererRHI rhi)
   m_pResourceDescriptorTable->update();
 
   m_pRootSignature = nullptr;
-  m_pBackend->createRootSignature(&m_pRootSignature);
   std::vector<gfx::PipelineLayout> layouts(2);
   layouts[0]._numConstantBuffers = 1;
   layouts[0]._numSamplers = 0;
   layouts[0]._numShaderResourceViews = 0;
   layouts[0]._numUnorderedAcessViews = 0;
 
-  layouts[1]._type = gfx::PIPELINE_LAYOUT_TYPE_CBV;
-  layouts[1]._numConstantBuffers = 1;
+  // Per instance transforms, t0.
+  layouts[1]._type = gfx::PIPELINE_LAYOUT_TYPE_SRV;
+  layouts[1]._numConstantBuffers = 0;
   layouts[1]._numSamplers = 0;
-  layouts[1]._numShaderResourceViews = 0;
+  layouts[1]._numShaderResourceViews = 1;
   layouts[1]._numUnorderedAcessViews = 0;
 
-  m_pRootSignature->initialize(gfx::SHADER_VISIBILITY_PIXEL | gfx::SHADER_VISIBILITY_VERTEX, 
-                               layouts.data(), 
-                               2);
+  m_pRootSignature = m_pipelineCache.getRootSignature(gfx::SHADER_VISIBILITY_PIXEL | gfx::SHADER_VISIBILITY_VERTEX, 
+                                                      layouts.data(), 
+                                                      2);
 
   m_pBackend->createTexture(&m_pSceneDepth,
                             gfx::RESOURCE_DIMENSION_2D,
                             gfx::RESOURCE_USAGE_DEFAULT,
-                            gfx::RESOURCE_BIND_DEPTH_STENCIL,
+                            gfx::RESOURCE_BIND_DEPTH_STENCIL | gfx::RESOURCE_BIND_SHADER_RESOURCE,
                             DXGI_FORMAT_R24G8_TYPELESS,
                             1920,
                             1080, 1, 0, TEXT("SceneDepth"));
@@ -164,6 +190,16 @@ void FrontEndRenderer::init(HWND handle, RendererRHI rhi)
     dsvDesc._texture2D._mipSlice = 0;
     m_pBackend->createDepthStencilView(&m_pSceneDepthView, 
                                        m_pSceneDepth, dsvDesc);
+    // Read by the lighting stage.
+    gfx::ShaderResourceViewDesc depthSrvDesc = { };
+    depthSrvDesc._dimension = gfx::SRV_DIMENSION_TEXTURE_2D;
+    depthSrvDesc._format = DXGI_FORMAT_R24_UNORM_X8_TYPELESS;
+    depthSrvDesc._texture2D._mipLevels = 1;
+    depthSrvDesc._texture2D._mostDetailedMip = 0;
+    depthSrvDesc._texture2D._planeSlice = 0;
+    depthSrvDesc._texture2D._resourceMinLODClamp = 0.0f;
+    m_pBackend->createShaderResourceView(&m_pSceneDepthResourceView, 
+                                         m_pSceneDepth, depthSrvDesc);
 
     m_pBackend->createRenderPass(&m_pPreZPass, 0, true);
     m_pPreZPass->setDepthStencil(m_pSceneDepthView);
@@ -177,16 +213,23 @@ void FrontEndRenderer::init(HWND handle, RendererRHI rhi)
     m_gbuffer.pRenderPass->setRenderTargets(rtvs, 4);
     m_gbuffer.pRenderPass->setDepthStencil(m_pSceneDepthView);
     m_geometryPass.setGBuffer(&m_gbuffer);
-    m_geometryPass.initialize(m_pBackend);
-
-    initializeVelocityRenderer(m_pBackend, m_pSceneDepthView);
-    Shadows::initializeShadowRenderer(m_pBackend);
-    Lights::initializeLights(m_pBackend);
-    m_lightSystem.initialize(m_pBackend, 4, 32, 32);
-
-    dirShadow.initialize(Shadows::LightShadow::SHADOW_TYPE_DIRECTIONAL, Shadows::SHADOW_RESOLUTION_4096_4096);
-    Shadows::registerShadow(m_pBackend, &dirShadow);
-    Lights::updateLightRenderer(pGlobalsBuffer, &m_gbuffer, &m_lightSystem);
+    m_geometryPass.initialize(m_pBackend, &m_pipelineCache);
+
+    initializeVelocityRenderer(m_pBackend, &m_pipelineCache, m_pSceneDepthView);
+    Shadows::initializeShadowRenderer(m_pBackend, &m_pipelineCache);
+    Lights::initializeLights(m_pBackend, &m_pipelineCache);
+    m_lightSystem.initialize(m_pBackend, 4, kInitialLightCapacity, kInitialLightCapacity);
+    m_lightClusters.initialize(m_pBackend, kMaxLightClusterIndices);
+
+    dirShadow.initialize(Shadows::LightShadow::SHADOW_TYPE_DIRECTIONAL, 
+                         Shadows::SHADOW_RESOLUTION_2048_2048, 
+                         Shadows::kMaxShadowCascades);
+    if (Shadows::registerShadow(m_pBackend, &dirShadow)) {
+        m_lightSystem.getDirectionLight(0)->_shadow = &dirShadow;
+    }
+    Lights::updateLightRenderer(pGlobalsBuffer, &m_gbuffer, &m_lightSystem, &m_lightClusters,
+                                m_pSceneDepthResourceView);
+    m_lightViewsVersion = m_lightSystem.getViewsVersion();
     m_lightSystem.getDirectionLight(0)->_direction = Vector3(1.0f, 1.0f, 0.0f);
     m_lightSystem.getDirectionLight(0)->_position = Vector3(0.0f, 2.0f, 0.0f);
     m_lightSystem.getDirectionLight(0)->_radiance = Vector4(1.0f, 1.0f, 1.0f, 1.0f);
@@ -204,127 +247,346 @@ void FrontEndRenderer::render()
 
     // Begin rendering 
 
-    gfx::Viewport viewport = { };
-    viewport.x = 0.0f;
-    viewport.y = 0.0f;
-    viewport.w = (R32)m_pGlobals->_targetSize[0];
-    viewport.h = (R32)m_pGlobals->_targetSize[1];
-    viewport.mind = 0.0f;
-    viewport.maxd = 1.0f;
+    m_viewport = { };
+    m_viewport.x = 0.0f;
+    m_viewport.y = 0.0f;
+    m_viewport.w = (R32)m_pGlobals->_targetSize[0];
+    m_viewport.h = (R32)m_pGlobals->_targetSize[1];
+    m_viewport.mind = 0.0f;
+    m_viewport.maxd = 1.0f;
   
-    gfx::Scissor scissor = { };
-    scissor.top = 0;
-    scissor.right = 1920;
-    scissor.bottom = 1080;
-    scissor.left = 0;
-
-    static R32 t = 0.0f;
-    R32 v = sinf(t * 0.05f);
-    R32 s = -sinf(t * 0.05f);
-    ++t;
-    R32 rgba[] = {0.f, 0.f, 0.f, 0.f};
-    RECT rect = {};
-    rect.bottom = 1080;
-    rect.left = 0;
-    rect.right = 1920;
-    rect.top = 0;
-
-    m_pList->reset("Cool Comamand List");
-    m_pList->clearRenderTarget(m_pBackend->getSwapchainRenderTargetView(), rgba,
-                               1, &rect);
-    m_pList->clearRenderTarget(m_gbuffer.pAlbedoRTV, rgba, 1, &rect);
-    m_pList->clearRenderTarget(m_gbuffer.pNormalRTV, rgba, 1, &rect);
-    m_pList->clearRenderTarget(m_gbuffer.pMaterialRTV, rgba, 1, &rect);
-    m_pList->clearRenderTarget(m_gbuffer.pEmissiveRTV, rgba, 1, &rect);
-    m_pList->clearDepthStencil(m_pSceneDepthView, 
-                               gfx::CLEAR_FLAG_DEPTH,
-                               0.0f, 
-                               0, 1, &rect);
-
-    //m_pList->setComputePipeline(nullptr);
-    //m_pList->dispatch(16, 16, 1);
-
-    m_pList->setMarker("PreZPass");
-    m_pList->setViewports(&viewport, 1);
-    m_pList->setScissors(&scissor, 1);
-    m_pList->setDescriptorTables(&m_pResourceDescriptorTable, 1);
-    m_pList->setGraphicsRootSignature(m_pRootSignature);
-    m_pList->setGraphicsRootDescriptorTable(GLOBAL_CONST_SLOT, m_pResourceDescriptorTable);
-
-    m_pList->setRenderPass(m_pPreZPass);
-    m_pList->setGraphicsPipeline(m_pPreZPipeline);
-
-    U64 submeshIdx = 0;
-    for (U32 i = 0; i < m_opaqueBatches.size(); ++i) {
-        RenderUUID meshId = m_opaqueBatches[i]->_meshTransform;
-        RenderUUID vertId = m_opaqueBatches[i]->_vertexBufferView;
-        RenderUUID indId = m_opaqueBatches[i]->_indexBufferView;
-        gfx::Resource* pMeshDescriptor = getResource(meshId);
-        gfx::VertexBufferView* view = getVertexBufferView(vertId);
-
-        m_pList->setVertexBuffers(0, &view, 1);
-        m_pList->setGraphicsRootConstantBufferView(1, pMeshDescriptor);
-
-        if (indId != 0) 
-            m_pList->setIndexBuffer(getIndexBufferView(indId));
-
-        for (U64 j = 0; j < m_opaqueBatches[i]->_submeshCount; ++j, ++submeshIdx) {
-            if (indId != 0) {
-                m_pList->drawIndexedInstanced(  m_opaqueSubmeshes[submeshIdx]->_indCount, 
-                                                m_opaqueSubmeshes[submeshIdx]->_vertInst, 
-                                                m_opaqueSubmeshes[submeshIdx]->_indOffset, 
-                                                m_opaqueSubmeshes[submeshIdx]->_startVert, 0);
-            } else {
-                m_pList->drawInstanced(m_opaqueSubmeshes[submeshIdx]->_vertCount, 
-                                        m_opaqueSubmeshes[submeshIdx]->_vertInst, 
-                                        m_opaqueSubmeshes[submeshIdx]->_startVert, 0);
+    m_scissor = { };
+    m_scissor.top = 0;
+    m_scissor.right = 1920;
+    m_scissor.bottom = 1080;
+    m_scissor.left = 0;
+
+    // Cull once per frame, PreZ, GBuffer and velocity all draw the camera visible list.
+    Plane cameraPlanes[6];
+    extractFrustumPlanes(m_pGlobals->_viewToClip, cameraPlanes);
+    m_cameraCullStats = { };
+    m_shadowCullStats = { };
+    m_culler.prepare(m_opaqueBatches.data(), 
+                     m_opaqueBatches.size(), 
+                     m_opaqueSubmeshes.data(), 
+                     m_opaqueSubmeshes.size(),
+                     m_pJobs);
+    // Occluders are drawn ahead of the camera cull, so meshes behind them are never recorded.
+    // Shadows cull on their own, without them, as meshes hidden from the camera still cast.
+    const OcclusionCuller* pOcclusion = nullptr;
+    if (m_occlusionCuller.getOccluderCount()) {
+        m_occlusionCuller.rasterize(m_pGlobals->_viewToClip, m_pJobs);
+        pOcclusion = &m_occlusionCuller;
+    }
+    m_culler.cull(cameraPlanes, 6, m_visibleBatches, m_visibleSubmeshes, &m_cameraCullStats, m_pJobs, pOcclusion);
+
+    // Key and sort every draw of the frame. There is a single static mesh pipeline for now.
+    m_renderQueue.clear();
+    m_renderQueue.push(RENDER_LAYER_OPAQUE, 
+                       0, 
+                       m_pGlobals->_viewToClip, 
+                       m_visibleBatches.data(), 
+                       m_visibleBatches.size(), 
+                       m_visibleSubmeshes.data());
+    m_renderQueue.push(RENDER_LAYER_TRANSPARENT, 
+                       0, 
+                       m_pGlobals->_viewToClip, 
+                       m_transparentBatches.data(), 
+                       m_transparentBatches.size(), 
+                       m_transparentSubmeshes.data());
+    m_renderQueue.sort();
+    m_renderQueue.buildBatches(RENDER_LAYER_OPAQUE, m_opaqueDraws);
+    updateInstanceBuffer();
+
+    // Every pass range records into a list of its own, as jobs, while this thread records
+    // lighting and the final pass. Lists are created here, creation isn't thread safe.
+    buildPassRanges();
+    while (m_passLists.size() < m_passRanges.size()) {
+        gfx::CommandList* pList = nullptr;
+        m_pBackend->createCommandList(&pList);
+        pList->init();
+        m_passLists.push_back(pList);
+        m_passFilters.push_back(new gfx::StateFilterCommandList(pList));
+    }
+    m_pJobs->run(&FrontEndRenderer::recordPassesJob, 
+                 this, 
+                 static_cast<U32>(m_passRanges.size()), 
+                 1, 
+                 &m_passesRecorded);
+
+    m_listFilter.reset("Lights and Final");
+    m_listFilter.setMarker("Lights Deferred");
+    // Lighting reads what the light update writes, and the table it may have rebuilt.
+    m_pJobs->wait(&m_lightsUpdated);
+    // Light copies go out with the frame's other uploads, ahead of its lists.
+    m_lightSystem.upload(&m_uploadQueue);
+    Lights::generateDeferredLightsCommands(&m_listFilter, getGlobalsBuffer());
+#if JCL_PLATFORM_WINDOWS
+    m_listFilter.setMarker("Debug GUI");
+    populateCommandListGUI(m_pBackend, m_pList);
+    m_listFilter.invalidate();
+#endif
+    // Render the final pass.
+    m_listFilter.setMarker("Final Backbuffer Pass");
+    m_listFilter.setViewports(&m_viewport, 1);
+    m_listFilter.setScissors(&m_scissor, 1);
+    m_listFilter.setRenderPass(m_pBackend->getBackbufferRenderPass());
+    m_listFilter.setDescriptorTables(&m_pFinalDescriptorTable, 1);
+    m_listFilter.setGraphicsRootSignature(m_pFinalRootSig);
+    m_listFilter.setGraphicsRootDescriptorTable(0, m_pFinalDescriptorTable);
+    m_listFilter.setGraphicsPipeline(m_pFinalBackBufferPipeline);
+    m_listFilter.drawInstanced(3, 1, 0, 0);
+
+    m_listFilter.close();
+
+    m_pJobs->wait(&m_passesRecorded);
+    // Submitted in pass order, whichever thread recorded them.
+    m_submitLists.assign(m_passLists.begin(), m_passLists.begin() + m_passRanges.size());
+    m_submitLists.push_back(m_pList);
+    m_stateFilterStats = m_listFilter.getStats();
+    for (U32 i = 0; i < m_passRanges.size(); ++i) {
+        m_stateFilterStats.add(m_passFilters[i]->getStats());
+    }
+
+  endFrame();
+}
+
+
+void FrontEndRenderer::pushPassRanges(PassType type, U32 count, U32 splits, const GeometryMesh* const* ppMeshes)
+{
+    splits = splits < count ? splits : count;
+    splits = splits ? splits : 1u;
+    U32 submesh = 0;
+    U32 mesh = 0;
+    for (U32 i = 0; i < splits; ++i) {
+        PassRange range = { };
+        range._type = type;
+        range._begin = static_cast<U32>(static_cast<U64>(count) * i / splits);
+        range._end = static_cast<U32>(static_cast<U64>(count) * (i + 1) / splits);
+        if (ppMeshes) {
+            for (; mesh < range._begin; ++mesh) submesh += ppMeshes[mesh]->_submeshCount;
+            range._firstSubmesh = submesh;
+        }
+        m_passRanges.push_back(range);
+    }
+}
+
+
+void FrontEndRenderer::buildPassRanges()
+{
+    // Below this many draws a list isn't worth its own job, and its own state setup on the gpu.
+    const U32 kMinDrawsPerList = 128;
+    U32 threadCount = m_pJobs->getWorkerCount() + 1;
+    U32 drawCount = static_cast<U32>(m_opaqueDraws.size());
+    U32 meshCount = static_cast<U32>(m_visibleBatches.size());
+    U32 drawSplits = drawCount / kMinDrawsPerList < threadCount ? drawCount / kMinDrawsPerList : threadCount;
+    U32 meshSplits = meshCount / kMinDrawsPerList < threadCount ? meshCount / kMinDrawsPerList : threadCount;
+
+    m_passRanges.clear();
+    pushPassRanges(PASS_TYPE_PREZ, drawCount, drawSplits);
+    pushPassRanges(PASS_TYPE_SHADOWS, 1, 1);
+    pushPassRanges(PASS_TYPE_GBUFFER, drawCount, drawSplits);
+    pushPassRanges(PASS_TYPE_VELOCITY, meshCount, meshSplits, m_visibleBatches.data());
+}
+
+
+void FrontEndRenderer::recordPassesJob(void* pData, U32 begin, U32 end)
+{
+    FrontEndRenderer* pRenderer = static_cast<FrontEndRenderer*>(pData);
+    for (U32 i = begin; i < end; ++i) {
+        pRenderer->recordPass(i);
+    }
+}
+
+
+void FrontEndRenderer::beginPassList(gfx::CommandList* pList, const char* debugTag)
+{
+    pList->reset(debugTag);
+    pList->setViewports(&m_viewport, 1);
+    pList->setScissors(&m_scissor, 1);
+    pList->setDescriptorTables(&m_pResourceDescriptorTable, 1);
+}
+
+
+void FrontEndRenderer::recordPass(U32 rangeIdx)
+{
+    const PassRange& range = m_passRanges[rangeIdx];
+    gfx::CommandList* pList = m_passFilters[rangeIdx];
+    // The first list of a split pass does its clears.
+    B32 isFirst = rangeIdx == 0 || m_passRanges[rangeIdx - 1]._type != range._type;
+    switch (range._type) {
+        case PASS_TYPE_PREZ:
+        {
+            beginPassList(pList, "PreZPass");
+            if (isFirst) {
+                R32 rgba[] = {0.f, 0.f, 0.f, 0.f};
+                RECT rect = {};
+                rect.bottom = 1080;
+                rect.left = 0;
+                rect.right = 1920;
+                rect.top = 0;
+                pList->clearRenderTarget(m_pBackend->getSwapchainRenderTargetView(), rgba,
+                                         1, &rect);
+                pList->clearRenderTarget(m_gbuffer.pAlbedoRTV, rgba, 1, &rect);
+                pList->clearRenderTarget(m_gbuffer.pNormalRTV, rgba, 1, &rect);
+                pList->clearRenderTarget(m_gbuffer.pMaterialRTV, rgba, 1, &rect);
+                pList->clearRenderTarget(m_gbuffer.pEmissiveRTV, rgba, 1, &rect);
+                pList->clearDepthStencil(m_pSceneDepthView, 
+                                         gfx::CLEAR_FLAG_DEPTH,
+                                         0.0f, 
+                                         0, 1, &rect);
             }
+            recordPreZ(pList, range._begin, range._end);
+        } break;
+        case PASS_TYPE_SHADOWS:
+        {
+            beginPassList(pList, "ShadowMaps");
+            // Waiting runs other jobs, the light update among them if nobody picked it up yet.
+            m_pJobs->wait(&m_lightsUpdated);
+            Shadows::generateShadowCommands(pList, 
+                                            m_opaqueBatches.data(), 
+                                            m_opaqueBatches.size(), 
+                                            m_opaqueSubmeshes.data(), 
+                                            m_opaqueSubmeshes.size(),
+                                            getGlobalsBuffer(),
+                                            m_constantRing.getBuffer(),
+                                            &m_lightSystem,
+                                            &m_culler,
+                                            &m_shadowCullStats);
+            pList->setViewports(&m_viewport, 1);
+            pList->setScissors(&m_scissor, 1);
+            Shadows::generateShadowResolveCommand(pList);
+        } break;
+        case PASS_TYPE_GBUFFER:
+        {
+            beginPassList(pList, "GBuffer Pass");
+            m_geometryPass.generateCommands(this, 
+                                            pList, 
+                                            m_renderQueue.getItems(RENDER_LAYER_OPAQUE), 
+                                            m_opaqueDraws.data() + range._begin, 
+                                            range._end - range._begin);
+        } break;
+        case PASS_TYPE_VELOCITY:
+        {
+            beginPassList(pList, "Velocity");
+            submitVelocityCommands(m_pBackend, 
+                                   pGlobalsBuffer, 
+                                   m_constantRing.getBuffer(), 
+                                   pList, 
+                                   m_visibleBatches.data() + range._begin, 
+                                   range._end - range._begin,
+                                   m_visibleSubmeshes.data() + range._firstSubmesh,
+                                   static_cast<U32>(m_visibleSubmeshes.size()) - range._firstSubmesh,
+                                   isFirst);
+        } break;
+    }
+    pList->close();
+}
+
+
+void FrontEndRenderer::recordPreZ(gfx::CommandList* pList, U32 begin, U32 end)
+{
+    pList->setGraphicsRootSignature(m_pRootSignature);
+    pList->setGraphicsRootDescriptorTable(GLOBAL_CONST_SLOT, m_pResourceDescriptorTable);
+
+    pList->setRenderPass(m_pPreZPass);
+
+    // Opaques walk the sorted batches front to back, one instanced draw per batch,
+    // rebinding only the buffers that changed between draws.
+    const RenderItem* pOpaqueItems = m_renderQueue.getItems(RENDER_LAYER_OPAQUE);
+    U32 boundFormat = VERTEX_FORMAT_COUNT;
+    RenderUUID boundVertId = 0;
+    RenderUUID boundIndId = 0;
+    for (U32 i = begin; i < end; ++i) {
+        const RenderBatch& batch = m_opaqueDraws[i];
+        GeometryMesh* pMesh = pOpaqueItems[batch._firstItem]._pMesh;
+        GeometrySubMesh* pSubMesh = pOpaqueItems[batch._firstItem]._pSubMesh;
+        RenderUUID indId = pMesh->_indexBufferView;
+
+        if (pMesh->_vertexFormat != boundFormat) {
+            boundFormat = pMesh->_vertexFormat;
+            pList->setGraphicsPipeline(m_pPreZPipelines[boundFormat]);
+        }
+
+        if (pMesh->_vertexBufferView != boundVertId) {
+            boundVertId = pMesh->_vertexBufferView;
+            gfx::VertexBufferView* view = getVertexBufferView(boundVertId);
+            pList->setVertexBuffers(0, &view, 1);
+        }
+
+        if (indId != 0 && indId != boundIndId) {
+            boundIndId = indId;
+            pList->setIndexBuffer(getIndexBufferView(indId));
+        }
+
+        pList->setGraphicsRootShaderResourceView(MESH_TRANSFORM_SLOT, 
+                                                 m_pInstanceBuffer, 
+                                                 m_instanceRegionOffset + batch._firstItem * sizeof(PerMeshDescriptor));
+
+        if (indId != 0) {
+            pList->drawIndexedInstanced(pSubMesh->_indCount, 
+                                        batch._instanceCount, 
+                                        pSubMesh->_indOffset, 
+                                        pSubMesh->_startVert, 0);
+        } else {
+            pList->drawInstanced(pSubMesh->_vertCount, 
+                                 batch._instanceCount, 
+                                 pSubMesh->_startVert, 0);
         }
     }
+}
 
-    //m_pList->setGraphicsRootConstantBufferView(1, pOtherMeshBuffer);
-    //m_pList->drawInstanced(3, 1, 0, 0);
-    m_pList->setMarker("ShadowMaps");
-    Shadows::generateShadowCommands(m_pList, 
-                                    m_opaqueBatches.data(), 
-                                    m_opaqueBatches.size(), 
-                                    m_opaqueSubmeshes.data(), 
-                                    m_opaqueSubmeshes.size(),
-                                    getGlobalsBuffer(),
-                                    &m_lightSystem);
-    m_pList->setViewports(&viewport, 1);
-    m_pList->setScissors(&scissor, 1);
-    Shadows::generateShadowResolveCommand(m_pList);
-    m_pList->setMarker("GBuffer Pass");
-    m_geometryPass.generateCommands(this, 
-                                    m_pList, 
-                                    m_opaqueBatches.data(), 
-                                    m_opaqueBatches.size(),
-                                    m_opaqueSubmeshes.data(), 
-                                    m_opaqueSubmeshes.size());
-    submitVelocityCommands(m_pBackend, 
-                            pGlobalsBuffer, 
-                            m_pList, 
-                            m_opaqueBatches.data(), 
-                            m_opaqueBatches.size(),
-                            m_opaqueSubmeshes.data(),
-                            m_opaqueSubmeshes.size());
-    m_pList->setMarker("Lights Deferred");
-    Lights::generateDeferredLightsCommands(m_pList, getGlobalsBuffer());
-    m_pList->setMarker("Debug GUI");
-    populateCommandListGUI(m_pBackend, m_pList);
-    // Render the final pass.
-    m_pList->setMarker("Final Backbuffer Pass");
-    m_pList->setRenderPass(m_pBackend->getBackbufferRenderPass());
-    m_pList->setDescriptorTables(&m_pFinalDescriptorTable, 1);
-    m_pList->setGraphicsRootSignature(m_pFinalRootSig);
-    m_pList->setGraphicsRootDescriptorTable(0, m_pFinalDescriptorTable);
-    m_pList->setGraphicsPipeline(m_pFinalBackBufferPipeline);
-    m_pList->drawInstanced(3, 1, 0, 0);
 
-    m_pList->close();
+void FrontEndRenderer::updateInstanceBuffer()
+{
+    // Same frames as the constant ring, begun by update().
+    U64 frameNumber = m_constantRing.getFrameNumber();
+    U32 framesInFlight = m_constantRing.getFramesInFlight();
+    U32 kept = 0;
+    for (U32 i = 0; i < m_retiredInstanceBuffers.size(); ++i) {
+        if (m_retiredInstanceBuffers[i]._lastFrame <= frameNumber) {
+            m_pBackend->destroyResource(m_retiredInstanceBuffers[i]._pBuffer);
+        } else {
+            m_retiredInstanceBuffers[kept++] = m_retiredInstanceBuffers[i];
+        }
+    }
+    m_retiredInstanceBuffers.resize(kept);
+
+    U32 instanceCount = m_renderQueue.getItemCount(RENDER_LAYER_OPAQUE);
+    if (instanceCount > m_instanceCapacity) {
+        // Grow geometrically, so a growing scene only reallocates a handful of times.
+        U32 capacity = m_instanceCapacity ? m_instanceCapacity : 1024;
+        while (capacity < instanceCount) capacity *= 2;
+        if (m_pInstanceBuffer) {
+            // Frames still in flight may read the old buffer.
+            RetiredBuffer retired = { m_pInstanceBuffer, frameNumber + framesInFlight };
+            m_retiredInstanceBuffers.push_back(retired);
+            m_pInstanceBuffer = nullptr;
+        }
+        m_pBackend->createBuffer(&m_pInstanceBuffer, 
+                                 gfx::RESOURCE_USAGE_CPU_TO_GPU, 
+                                 gfx::RESOURCE_BIND_SHADER_RESOURCE, 
+                                 capacity * framesInFlight * sizeof(PerMeshDescriptor), 
+                                 sizeof(PerMeshDescriptor), 
+                                 TEXT("MeshInstances"));
+        m_instanceCapacity = capacity;
+    }
+    m_instanceRegionOffset = (frameNumber % framesInFlight) * m_instanceCapacity * sizeof(PerMeshDescriptor);
+    if (instanceCount == 0) return;
 
-  endFrame();
+    // Instances are written in sorted item order, so every batch reads a contiguous range.
+    const RenderItem* pItems = m_renderQueue.getItems(RENDER_LAYER_OPAQUE);
+    gfx::ResourceMappingRange range = { };
+    range._start = m_instanceRegionOffset;
+    range._sz = instanceCount * sizeof(PerMeshDescriptor);
+    U8* pBase = static_cast<U8*>(m_pInstanceBuffer->map(&range));
+    PerMeshDescriptor* pInstances = reinterpret_cast<PerMeshDescriptor*>(pBase + m_instanceRegionOffset);
+    m_pJobs->parallelFor(instanceCount, 256, [pInstances, pItems] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            memcpy(&pInstances[i], pItems[i]._pMesh->_meshDescriptor, sizeof(PerMeshDescriptor));
+        }
+    });
+    m_pInstanceBuffer->unmap(&range);
 }
 
 
@@ -335,18 +597,51 @@ void FrontEndRenderer::beginFrame()
 
 void FrontEndRenderer::endFrame()
 {
-    m_pBackend->submit(m_pBackend->getSwapchainQueue(), &m_pList, 1);
+    // Copies staged since last frame go out ahead of the frame that draws with them, on the same queue.
+    m_uploadQueue.flush();
+    m_uploadQueue.retire();
+    m_pBackend->submit(m_pBackend->getSwapchainQueue(), 
+                       m_submitLists.data(), 
+                       static_cast<U32>(m_submitLists.size()));
 
     m_pBackend->present();
     m_opaqueBatches.clear();
     m_transparentBatches.clear();
     m_opaqueSubmeshes.clear();
     m_transparentSubmeshes.clear();
+    m_visibleBatches.clear();
+    m_visibleSubmeshes.clear();
+    m_occlusionCuller.clear();
 }
 
 
 void FrontEndRenderer::cleanUp()
 {
+  m_pJobs->wait(&m_lightsUpdated);
+  m_pJobs->wait(&m_passesRecorded);
+  for (gfx::CommandList* pList : m_passLists) {
+    m_pBackend->destroyCommandList(pList);
+  }
+  for (gfx::StateFilterCommandList* pFilter : m_passFilters) {
+    delete pFilter;
+  }
+  m_passLists.clear();
+  m_passFilters.clear();
+  m_uploadQueue.cleanUp();
+  m_constantRing.cleanUp();
+  m_lightSystem.cleanUp();
+  for (const RetiredBuffer& retired : m_retiredInstanceBuffers) {
+    m_pBackend->destroyResource(retired._pBuffer);
+  }
+  m_retiredInstanceBuffers.clear();
+  if (m_pInstanceBuffer) {
+    m_pBackend->destroyResource(m_pInstanceBuffer);
+    m_pInstanceBuffer = nullptr;
+  }
+  if (!m_pipelineCachePath.empty())
+    m_pipelineCache.save(m_pipelineCachePath);
+  m_pipelineCache.cleanUp();
+  Shadows::cleanUpShadowRenderer(m_pBackend);
   m_pBackend->cleanUp();
 }
 
@@ -354,55 +649,96 @@ void FrontEndRenderer::cleanUp()
 void FrontEndRenderer::update(R32 dt, Globals& globals)
 {
     gfx::ResourceMappingRange range = { };
-    void* pMatPtr = nullptr;
     range._start = 0;
     range._sz = sizeof(Globals);
     void* pPtr = pGlobalsBuffer->map(&range);
     memcpy(pPtr, m_pGlobals, sizeof(Globals));
     pGlobalsBuffer->unmap(&range);
 
+    // A frame that never rendered may still have its light update in flight.
+    m_pJobs->wait(&m_lightsUpdated);
+
+    // Worst case every mesh and submesh writes its own constants.
+    m_constantRing.beginFrame(m_opaqueBatches.size() * ConstantBufferRing::alignSize(sizeof(PerMeshDescriptor)) 
+                              + m_opaqueSubmeshes.size() * ConstantBufferRing::alignSize(sizeof(PerMaterialDescriptor)));
+
+    // Light buffers are grown, and their views bound, here, creating resources isn't thread safe.
+    m_lightSystem.reserveBuffers(m_constantRing.getFrameNumber(), m_constantRing.getFramesInFlight());
+    if (m_lightSystem.getViewsVersion() != m_lightViewsVersion) {
+        m_lightViewsVersion = m_lightSystem.getViewsVersion();
+        Lights::updateLightRenderer(pGlobalsBuffer, &m_gbuffer, &m_lightSystem, &m_lightClusters,
+                                    m_pSceneDepthResourceView);
+    }
+    // Lights don't read anything the rest of the frame writes, they update while constants are
+    // copied, and meshes are culled and sorted, only writing into buffers that exist by now.
+    m_pJobs->run(&FrontEndRenderer::updateLightsJob, this, 1, 1, &m_lightsUpdated);
+
+    m_constantCopies.clear();
+    B32 allocated = true;
     for (U64 i = 0; i < m_opaqueBatches.size(); ++i) {
-        gfx::Resource* pDescriptor = getResource(m_opaqueBatches[i]->_meshTransform);
-        range._sz = sizeof(PerMeshDescriptor);
-        pPtr = pDescriptor->map(&range);    
-        memcpy(pPtr, m_opaqueBatches[i]->_meshDescriptor, sizeof(PerMeshDescriptor));
-        range._sz = sizeof(PerMeshDescriptor);
-        pDescriptor->unmap(&range);
+        GeometryMesh* pMesh = m_opaqueBatches[i];
+        pMesh->_meshDescriptorOffset = pushFrameConstant(pMesh->_meshTransform, 
+                                                         pMesh->_meshDescriptor, 
+                                                         sizeof(PerMeshDescriptor));
+        allocated = allocated && pMesh->_meshDescriptorOffset != ConstantBufferRing::kInvalidOffset;
     }
 
     for (U64 i = 0; i < m_opaqueSubmeshes.size(); ++i) {
-        gfx::Resource* pMatDescriptor = getResource(m_opaqueSubmeshes[i]->_materialDescriptor);
-        range._sz = sizeof(PerMaterialDescriptor);
-        pMatPtr = pMatDescriptor->map(&range);
-        memcpy(pMatPtr, m_opaqueSubmeshes[i]->_matData, sizeof(PerMaterialDescriptor));
-        pMatDescriptor->unmap(&range);   
+        GeometrySubMesh* pSubMesh = m_opaqueSubmeshes[i];
+        pSubMesh->_matDataOffset = pushFrameConstant(pSubMesh->_materialDescriptor, 
+                                                     pSubMesh->_matData, 
+                                                     sizeof(PerMaterialDescriptor));
+        allocated = allocated && pSubMesh->_matDataOffset != ConstantBufferRing::kInvalidOffset;
     }
 
-    Lights::DirectionLight* light = m_lightSystem.getDirectionLight(0);
-    Lights::LightTransform* transform = m_lightSystem.getTransform(light->_transform);
-    dirShadow.update(m_lightSystem.getDirectionLight(0), transform);
-    // Update lights.
-    m_lightSystem.update();
+    // Only if the ring couldn't be created, or meshes were pushed after beginFrame() sized it.
+    // Nothing is drawn this frame, rather than draws reading constants of others.
+    if (!allocated) {
+        DEBUG("Frame constants did not fit, the frame's meshes are dropped.");
+        m_opaqueBatches.clear();
+        m_opaqueSubmeshes.clear();
+        m_constantCopies.clear();
+    }
+
+    const ConstantCopy* pCopies = m_constantCopies.data();
+    m_pJobs->parallelFor(static_cast<U32>(m_constantCopies.size()), 256, [pCopies] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            memcpy(pCopies[i]._pDst, pCopies[i]._pSrc, pCopies[i]._szBytes);
+        }
+    });
+}
+
 
+void FrontEndRenderer::updateLightsJob(void* pData, U32 begin, U32 end)
+{
+    FrontEndRenderer* pRenderer = static_cast<FrontEndRenderer*>(pData);
+    Lights::LightSystem& lightSystem = pRenderer->m_lightSystem;
+    // Update lights.
+    Plane cameraPlanes[6];
+    extractFrustumPlanes(pRenderer->m_pGlobals->_viewToClip, cameraPlanes);
+    lightSystem.cull(cameraPlanes, 6, pRenderer->m_pJobs);
+    // Shadows of the lights in view take their tiles, and write their transforms.
+    Shadows::updateShadows(*pRenderer->m_pGlobals, &lightSystem);
+    lightSystem.update();
+    pRenderer->m_lightClusters.assign(*pRenderer->m_pGlobals, lightSystem, pRenderer->m_pJobs);
+    pRenderer->m_lightClusters.upload();
 }
 
 
 void FrontEndRenderer::createGraphicsPipelines()
 {
-  m_pPreZPipeline = nullptr;
+  for (U32 format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+    m_pPreZPipelines[format] = nullptr;
+  }
   gfx::GraphicsPipelineInfo info = { };
   gfx::ShaderByteCode vertBytecode;
   gfx::ShaderByteCode pixBytecode;
   vertBytecode._pByteCode = new I8[1024 * 1024 * 5];
   pixBytecode._pByteCode = new I8[1024 * 1024 * 5];
-  retrieveShader("PreZPass.vs.cso",
-                 &vertBytecode._pByteCode,
-                 vertBytecode._szBytes);
   retrieveShader("PreZPass.ps.cso",
                  &pixBytecode._pByteCode,
                  pixBytecode._szBytes);
 
-  info._vertexShader = vertBytecode;
   //info._pixelShader = pixBytecode;  
   info._numRenderTargets = 0;
   info._sampleMask = 0xffffffff;
@@ -443,24 +779,18 @@ void FrontEndRenderer::createGraphicsPipelines()
   info._blendState._renderTargets[0]._renderTargetWriteMask = gfx::COLOR_WRITE_ENABLE_ALL;
   
 
-  std::vector<gfx::InputElementInfo> elements(4);
-  std::vector<const CHAR*> semantics = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD" };
-  U32 offset = 0;
-  for (size_t i = 0; i < elements.size(); ++i) {
-    elements[i]._alignedByteOffset = offset;
-    elements[i]._classification = gfx::INPUT_CLASSIFICATION_PER_VERTEX;
-    elements[i]._format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-    elements[i]._instanceDataStepRate = 0;
-    elements[i]._semanticIndex = 0;
-    elements[i]._semanticName = semantics[i];
-    offset += sizeof(Vector4);
+  gfx::InputElementInfo elements[kVertexElementCount];
+  info._inputLayout._elementCount = kVertexElementCount;
+  info._inputLayout._pInputElements = elements;
+  for (U32 format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+    getVertexInputElements(VertexFormat(format), elements);
+    retrieveShader(getVertexShaderPath(VertexFormat(format), "PreZPass.vs.cso"),
+                   &vertBytecode._pByteCode,
+                   vertBytecode._szBytes);
+    info._vertexShader = vertBytecode;
+    m_pPreZPipelines[format] = m_pipelineCache.getGraphicsPipeline(info);
   }
 
-  info._inputLayout._elementCount = elements.size();
-  info._inputLayout._pInputElements = elements.data();
-
-  m_pBackend->createGraphicsPipelineState(&m_pPreZPipeline, &info);
-
   delete[] vertBytecode._pByteCode;
   delete[] pixBytecode._pByteCode;
 
@@ -529,7 +859,7 @@ RenderUUID FrontEndRenderer::createBuffer(gfx::ResourceUsage usage, gfx::Resourc
 }
 
 
-VertexBuffer FrontEndRenderer::createVertexBuffer(void* meshRaw, U64 vertexSzBytes, U64 meshSzBytes)
+VertexBuffer FrontEndRenderer::createVertexBuffer(const void* meshRaw, U64 vertexSzBytes, U64 meshSzBytes, UploadTicket* pTicket)
 {
     VertexBuffer vertexBuffer = { 0, 0 };
     gfx::Resource* vertexMesh = nullptr;
@@ -545,39 +875,8 @@ VertexBuffer FrontEndRenderer::createVertexBuffer(void* meshRaw, U64 vertexSzByt
                                          vertexMesh,
                                          vertexSzBytes,
                                          meshSzBytes);
-  {
-    gfx::Fence* pFence = nullptr;
-    gfx::Resource* pStaging = nullptr;
-    gfx::CommandList* pList = nullptr;
-    m_pBackend->createBuffer(&pStaging,
-                             gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                             gfx::RESOURCE_BIND_VERTEX_BUFFER,
-                             meshSzBytes,
-                             vertexSzBytes,
-                             TEXT("staging"));
-    gfx::ResourceMappingRange range = { };
-    range._start = 0;
-    range._sz = meshSzBytes;
-    void* ptr = pStaging->map(&range);
-    memcpy(ptr, meshRaw, meshSzBytes);
-    pStaging->unmap(&range);
-
-    m_pBackend->createFence(&pFence);
-    m_pBackend->createCommandList(&pList);
-    pList->init();
-    pList->reset();
-    pList->copyResource(vertexMesh, pStaging);
-    pList->close();
-    
-    m_pBackend->submit(m_pBackend->getSwapchainQueue(), &pList, 1);
-    m_pBackend->signalFence(m_pBackend->getSwapchainQueue(), pFence);
-
-    m_pBackend->waitFence(pFence);
-    m_pBackend->destroyResource(pStaging);
-    m_pBackend->destroyFence(pFence);
-    m_pBackend->destroyCommandList(pList);
-  }
-
+    UploadTicket ticket = m_uploadQueue.uploadBuffer(vertexMesh, 0, meshRaw, meshSzBytes);
+    if (pTicket) *pTicket = ticket;
 
     RenderUUID vertId = cacheResource(vertexMesh);
     RenderUUID viewId = cacheVertexBufferView(vertexBufferView);
@@ -591,31 +890,44 @@ VertexBuffer FrontEndRenderer::createVertexBuffer(void* meshRaw, U64 vertexSzByt
 
 RenderUUID FrontEndRenderer::createTransformBuffer()
 {
-    gfx::Resource* pResource = nullptr;
-    m_pBackend->createBuffer(&pResource,
-                               gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                               gfx::RESOURCE_BIND_CONSTANT_BUFFER,
-                               sizeof(PerMeshDescriptor), 
-                               0, TEXT("MeshTranform"));
-    return cacheResource(pResource);
+    FrameConstant constant = { 0ull, ~0ull };
+    return m_frameConstants.insert(constant);
 }
 
 
 RenderUUID FrontEndRenderer::createMaterialBuffer()
 {
-    gfx::Resource* pResource = nullptr;
-    m_pBackend->createBuffer(&pResource,
-                               gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                               gfx::RESOURCE_BIND_CONSTANT_BUFFER,
-                               sizeof(PerMaterialDescriptor), 
-                               0, TEXT("MaterialDescription"));
-    return cacheResource(pResource);
- }
+    FrameConstant constant = { 0ull, ~0ull };
+    return m_frameConstants.insert(constant);
+}
+
+
+U64 FrontEndRenderer::pushFrameConstant(RenderUUID id, const void* pData, U64 szBytes)
+{
+    // Already written this frame, under the same id.
+    FrameConstant* pConstant = m_frameConstants.find(id);
+    if (pConstant && pConstant->_frameNumber == m_constantRing.getFrameNumber()) {
+        return pConstant->_offset;
+    }
+
+    ConstantAllocation allocation = { };
+    if (!m_constantRing.allocate(szBytes, &allocation)) {
+        // beginFrame() makes room for every mesh and submesh pushed, this is a bug.
+        ASSERT(!"Frame constant buffer is out of memory.");
+        return ConstantBufferRing::kInvalidOffset;
+    }
+    ConstantCopy copy = { allocation._pData, pData, szBytes };
+    m_constantCopies.push_back(copy);
+    if (pConstant) {
+        pConstant->_offset = allocation._offset;
+        pConstant->_frameNumber = m_constantRing.getFrameNumber();
+    }
+    return allocation._offset;
+}
 
 
 void FrontEndRenderer::createComputePipelines()
 {
-    m_pBackend->createRootSignature(&m_pBitonicSortSig);
     gfx::PipelineLayout pLayouts[2] = { };
     pLayouts[0]._type = gfx::PIPELINE_LAYOUT_TYPE_UAV;
     pLayouts[0]._numUnorderedAcessViews = 1;
@@ -623,7 +935,7 @@ void FrontEndRenderer::createComputePipelines()
     pLayouts[1]._type = gfx::PIPELINE_LAYOUT_TYPE_CBV;
     pLayouts[1]._numConstantBuffers = 1;
 
-    m_pBitonicSortSig->initialize(gfx::SHADER_VISIBILITY_ALL, pLayouts, 2);
+    m_pBitonicSortSig = m_pipelineCache.getRootSignature(gfx::SHADER_VISIBILITY_ALL, pLayouts, 2);
 
     gfx::ShaderByteCode bytecode = { };
     bytecode._pByteCode = new U8[1024 * 1024 * 2];
@@ -631,7 +943,7 @@ void FrontEndRenderer::createComputePipelines()
     gfx::ComputePipelineInfo info = { };
     info._pRootSignature = m_pBitonicSortSig;
     info._computeShader = bytecode;
-    m_pBackend->createComputePipelineState(&m_bitonicSort, &info);
+    m_bitonicSort = m_pipelineCache.getComputePipeline(info);
     
     //retrieveShader("Reflection.cs.cso", &bytecode._pByteCode, bytecode._szBytes);
     //m_pBackend->createComputePipelineState(&m_pReflectionPipeline, &info);
@@ -643,7 +955,7 @@ void FrontEndRenderer::createComputePipelines()
 }
 
 
-IndexBuffer FrontEndRenderer::createIndexBufferView(void* raw, U64 szBytes)
+IndexBuffer FrontEndRenderer::createIndexBufferView(const void* raw, U64 szBytes, UploadTicket* pTicket)
 {
     IndexBuffer b = { };
     RenderUUID res = createBuffer(  gfx::RESOURCE_USAGE_DEFAULT,
@@ -652,38 +964,8 @@ IndexBuffer FrontEndRenderer::createIndexBufferView(void* raw, U64 szBytes)
                     0,
                     TEXT("SceneIndexBuffer"));
 
-    {
-        gfx::Fence* pFence = nullptr;
-        gfx::Resource* pStaging = nullptr;
-        gfx::CommandList* pList = nullptr;
-        m_pBackend->createBuffer(&pStaging,
-                                    gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                                    gfx::RESOURCE_BIND_INDEX_BUFFER,
-                                    szBytes,
-                                    sizeof(U32),
-                                    TEXT("staging"));
-        gfx::ResourceMappingRange range = { };
-        range._start = 0;
-        range._sz = szBytes;
-        void* ptr = pStaging->map(&range);
-        memcpy(ptr, raw, szBytes);
-        pStaging->unmap(&range);
-
-        m_pBackend->createFence(&pFence);
-        m_pBackend->createCommandList(&pList);
-        pList->init();
-        pList->reset();
-        pList->copyResource(getResource(res), pStaging);
-        pList->close();
-    
-        m_pBackend->submit(m_pBackend->getSwapchainQueue(), &pList, 1);
-        m_pBackend->signalFence(m_pBackend->getSwapchainQueue(), pFence);
-
-        m_pBackend->waitFence(pFence);
-        m_pBackend->destroyResource(pStaging);
-        m_pBackend->destroyFence(pFence);
-        m_pBackend->destroyCommandList(pList);
-    }
+    UploadTicket ticket = m_uploadQueue.uploadBuffer(getResource(res), 0, raw, szBytes);
+    if (pTicket) *pTicket = ticket;
 
     gfx::IndexBufferView* view = nullptr;
     m_pBackend->createIndexBufferView(&view, getResource(res), DXGI_FORMAT_R32_UINT, szBytes);
@@ -695,7 +977,7 @@ IndexBuffer FrontEndRenderer::createIndexBufferView(void* raw, U64 szBytes)
 }
 
 
-RenderUUID FrontEndRenderer::createTexture2D(U64 width, U64 height, void* pData, DXGI_FORMAT format)
+RenderUUID FrontEndRenderer::createTexture2D(U64 width, U64 height, void* pData, DXGI_FORMAT format, UploadTicket* pTicket)
 {
     gfx::Resource* pResource = nullptr;
     m_pBackend->createTexture(&pResource,
@@ -704,39 +986,8 @@ RenderUUID FrontEndRenderer::createTexture2D(U64 width, U64 height, void* pData,
                                 gfx::RESOURCE_BIND_SHADER_RESOURCE,
                                 format,
                                 width, height);
-    {
-        gfx::Fence* pFence = nullptr;
-        gfx::Resource* pStaging = nullptr;
-        gfx::CommandList* pList = nullptr;
-        U64 szBytes = width * height * 4;
-        m_pBackend->createBuffer(&pStaging,
-            gfx::RESOURCE_USAGE_CPU_TO_GPU,
-            gfx::RESOURCE_BIND_SHADER_RESOURCE,
-            szBytes,
-            0,
-            TEXT("staging"));
-        gfx::ResourceMappingRange range = { };
-        range._start = 0;
-        range._sz = szBytes;
-        void* ptr = pStaging->map(&range);
-        memcpy(ptr, pData, szBytes);
-        pStaging->unmap(&range);
-
-        m_pBackend->createFence(&pFence);
-        m_pBackend->createCommandList(&pList);
-        pList->init();
-        pList->reset();
-        pList->copyResource(pResource, pStaging);
-        pList->close();
-
-        m_pBackend->submit(m_pBackend->getSwapchainQueue(), &pList, 1);
-        m_pBackend->signalFence(m_pBackend->getSwapchainQueue(), pFence);
-
-        m_pBackend->waitFence(pFence);
-        m_pBackend->destroyResource(pStaging);
-        m_pBackend->destroyFence(pFence);
-        m_pBackend->destroyCommandList(pList);
-    }
+    UploadTicket ticket = m_uploadQueue.uploadTexture2D(pResource, pData, width, height, 4, format);
+    if (pTicket) *pTicket = ticket;
 
     gfx::ShaderResourceView* pView = nullptr;
     gfx::ShaderResourceViewDesc srvDesc = { };
@@ -770,9 +1021,8 @@ void FrontEndRenderer::createFinalRootSignature()
     staticSampler._maxLod = 8.0f;
     staticSampler._maxAnisotropy = 1.0f;
 
-    m_pBackend->createRootSignature(&m_pFinalRootSig);
-    m_pFinalRootSig->initialize(gfx::SHADER_VISIBILITY_VERTEX | gfx::SHADER_VISIBILITY_PIXEL,
-                                layouts, 1, &staticSampler, 1);
+    m_pFinalRootSig = m_pipelineCache.getRootSignature(gfx::SHADER_VISIBILITY_VERTEX | gfx::SHADER_VISIBILITY_PIXEL,
+                                                       layouts, 1, &staticSampler, 1);
 
     m_pBackend->createDescriptorTable(&m_pFinalDescriptorTable);
     m_pFinalDescriptorTable->setShaderResourceViews(&m_gbuffer.pNormalSRV, 1);
@@ -809,8 +1059,8 @@ void FrontEndRenderer::createFinalPipeline()
     gfx::ShaderByteCode vB = { };
     gfx::ShaderByteCode pB = { };
 
-    vB._pByteCode = new U8[KB_1 * 64];
-    pB._pByteCode = new U8[KB_1 * 64];
+    vB._pByteCode = new U8[1024 * 64];
+    pB._pByteCode = new U8[1024 * 64];
 
     retrieveShader("Composite.ps.cso", &pB._pByteCode, pB._szBytes);
     retrieveShader("Quad.vs.cso", &vB._pByteCode, vB._szBytes);
@@ -818,7 +1068,7 @@ void FrontEndRenderer::createFinalPipeline()
     gInfo._vertexShader = vB;
     gInfo._pixelShader = pB;
     
-    m_pBackend->createGraphicsPipelineState(&m_pFinalBackBufferPipeline, &gInfo);
+    m_pFinalBackBufferPipeline = m_pipelineCache.getGraphicsPipeline(gInfo);
 
     delete[] vB._pByteCode;
     delete[] pB._pByteCode;
@@ -5,7 +5,16 @@
 #include "GlobalDef.h"
 #include "VelocityRenderer.h"
 #include "LightRenderer.h"
+#include "LightClusters.h"
 #include "GeometryPass.h"
+#include "Culling.h"
+#include "RenderQueue.h"
+#include "ConstantBufferRing.h"
+#include "UploadQueue.h"
+#include "JobSystem.h"
+#include "SlotMap.h"
+#include "StateFilterCommandList.h"
+#include "PipelineCache.h"
 
 #include <unordered_map>
 
@@ -39,6 +48,9 @@ public:
     Globals* getGlobals() const { return m_pGlobals; }
     void setGlobals(Globals* pGlobals) { m_pGlobals = pGlobals; }
 
+    FrontEndRenderer()
+        : m_pJobs(&m_inlineJobs) { }
+
     void init(HWND winHandle, RendererRHI rhi);
 
     void cleanUp();
@@ -47,6 +59,21 @@ public:
     
     void update(R32 dt, Globals& globals);
 
+    // Jobs the cpu stages of the frame run on. Without one, they all run on the calling thread.
+    // Set before init(), pipelines saved in the pipeline cache are prebuilt on them too.
+    void setJobSystem(JobSystem* pJobs) { m_pJobs = pJobs ? pJobs : &m_inlineJobs; }
+    JobSystem* getJobSystem() const { return m_pJobs; }
+
+    // File the pipeline cache is prebuilt from in init(), and saved to in cleanUp(). Set before init(),
+    // empty keeps the cache to this run.
+    void setPipelineCachePath(const std::string& path) { m_pipelineCachePath = path; }
+    const PipelineCache& getPipelineCache() const { return m_pipelineCache; }
+
+    // Lights of the scene. Add, change and remove them between frames, outside of update() and render().
+    Lights::LightSystem& getLightSystem() { return m_lightSystem; }
+    // Light assignment of the last frame whose lights finished updating.
+    const Lights::LightClusterStats& getLightClusterStats() const { return m_lightClusters.getStats(); }
+
     void pushMesh(GeometryMesh* pMesh, GeometrySubMesh** submeshes) { 
         m_opaqueBatches.push_back(pMesh); 
         for (U32 i = 0; i < pMesh->_submeshCount; ++i) {
@@ -54,20 +81,70 @@ public:
         }
     }
 
+    // Occluders of this frame, given along with its meshes and dropped after it. Opaque meshes behind
+    // them, from the camera, are culled before any pass draws. Shadows still draw them.
+    // See OcclusionCuller::addOccluder().
+    void pushOccluder(const Bounds3D& worldBounds) { m_occlusionCuller.addOccluder(worldBounds); }
+    void pushOccluder(const Vector3* pPositions, 
+                      U32 vertexCount, 
+                      const U32* pIndices, 
+                      U32 indexCount, 
+                      const Matrix44& world, 
+                      B32 closed = false) {
+        m_occlusionCuller.addOccluder(pPositions, vertexCount, pIndices, indexCount, world, closed);
+    }
+
+    // Transparent meshes are not culled, and are queued back to front.
+    void pushTransparentMesh(GeometryMesh* pMesh, GeometrySubMesh** submeshes) { 
+        m_transparentBatches.push_back(pMesh); 
+        for (U32 i = 0; i < pMesh->_submeshCount; ++i) {
+            m_transparentSubmeshes.push_back(submeshes[i]);
+        }
+    }
+
+    // Submesh draws of last frame, sorted by state and depth.
+    const RenderQueue& getRenderQueue() const { return m_renderQueue; }
+    // Instanced opaque draws recorded per pass last frame.
+    U32 getOpaqueDrawCount() const { return static_cast<U32>(m_opaqueDraws.size()); }
+    // Command lists recorded, and submitted, last frame.
+    U32 getCommandListCount() const { return static_cast<U32>(m_submitLists.size()); }
+    // State calls of last frame's lists, forwarded and dropped as redundant.
+    const gfx::StateFilterStats& getStateFilterStats() const { return m_stateFilterStats; }
+
+    // Per instance mesh transforms of the sorted opaque items, for this frame, starting
+    // getInstanceOffset() bytes into the buffer.
+    gfx::Resource* getInstanceBuffer() { return m_pInstanceBuffer; }
+    U64 getInstanceOffset() const { return m_instanceRegionOffset; }
+
+    // Meshes that passed, and failed, the camera frustum test last frame.
+    const CullStats& getCameraCullStats() const { return m_cameraCullStats; }
+    // Same as above, summed over every shadow frustum rendered last frame.
+    const CullStats& getShadowCullStats() const { return m_shadowCullStats; }
+    // Occluders drawn for the last frame that gave any.
+    const OcclusionStats& getOcclusionStats() const { return m_occlusionCuller.getStats(); }
+    const OcclusionCuller& getOcclusionCuller() const { return m_occlusionCuller; }
+
     gfx::DepthStencilView* getSceneDepthView() { return m_pSceneDepthView; }
 
     gfx::ShaderResourceView* getSceneResourceView() { return m_pSceneDepthResourceView; }
 
     gfx::DescriptorTable* getResourceDescriptorTable() { return m_pResourceDescriptorTable; }
-    // Transform Buffer is the GPU buffer that is used to render the mesh. It is 
-    // written to by the given mesh descriptor.
+    // Transform Buffer identifies a mesh descriptor. Its data is copied from the mesh's _meshDescriptor 
+    // into the frame constant buffer every frame, at _meshDescriptorOffset. Meshes sharing the id share the copy.
     RenderUUID createTransformBuffer();
+    // Same as above, for a submesh's _matData, at _matDataOffset.
     RenderUUID createMaterialBuffer();
-    IndexBuffer createIndexBufferView(void* raw, U64 szBytes);
-    RenderUUID createTexture2D(U64 width, U64 height, void* pData, DXGI_FORMAT format);
+    // Per frame ring of mesh and material constants.
+    gfx::Resource* getConstantBuffer() { return m_constantRing.getBuffer(); }
+    // Buffer and texture data goes through the upload queue, and is copied by the gpu at the latest
+    // ahead of the next frame. pTicket, if given, receives the upload's ticket.
+    IndexBuffer createIndexBufferView(const void* raw, U64 szBytes, UploadTicket* pTicket = nullptr);
+    RenderUUID createTexture2D(U64 width, U64 height, void* pData, DXGI_FORMAT format, UploadTicket* pTicket = nullptr);
 
     RenderUUID createBuffer(gfx::ResourceUsage usage, gfx::ResourceBindFlags flags, U64 sz, U64 strideBytes, const TCHAR* debug);
-    VertexBuffer createVertexBuffer(void* meshRaw, U64 vertexSzBytes, U64 meshSzBytes);
+    VertexBuffer createVertexBuffer(const void* meshRaw, U64 vertexSzBytes, U64 meshSzBytes, UploadTicket* pTicket = nullptr);
+
+    UploadQueue& getUploadQueue() { return m_uploadQueue; }
     RenderUUID createTexture(   gfx::ResourceDimension dimension, 
                                 gfx::ResourceUsage usage, 
                                 gfx::ResourceBindFlags binds, 
@@ -92,6 +169,37 @@ private:
     void createFinalRootSignature();
     void createComputePipelines();
     void endFrame();
+    void updateInstanceBuffer();
+    // Allocate the id's constants for this frame, the copy is queued on m_constantCopies.
+    // Returns ConstantBufferRing::kInvalidOffset if the ring wasn't sized for it.
+    U64 pushFrameConstant(RenderUUID id, const void* pData, U64 szBytes);
+    static void updateLightsJob(void* pData, U32 begin, U32 end);
+
+    // Passes recorded as jobs, each range into a command list of its own.
+    enum PassType
+    {
+        PASS_TYPE_PREZ,
+        PASS_TYPE_SHADOWS,
+        PASS_TYPE_GBUFFER,
+        PASS_TYPE_VELOCITY
+    };
+    struct PassRange
+    {
+        PassType _type;
+        // Draws of the pass this list records, meshes for velocity.
+        U32 _begin;
+        U32 _end;
+        // Submesh of the first mesh in the range, for passes that walk meshes.
+        U32 _firstSubmesh;
+    };
+    // Split the passes of the frame into ranges, about one per thread for the big ones.
+    void buildPassRanges();
+    void pushPassRanges(PassType type, U32 count, U32 splits, const GeometryMesh* const* ppMeshes = nullptr);
+    // Reset pList and bind the state every pass expects, lists don't inherit it from each other.
+    void beginPassList(gfx::CommandList* pList, const char* debugTag);
+    void recordPass(U32 rangeIdx);
+    void recordPreZ(gfx::CommandList* pList, U32 begin, U32 end);
+    static void recordPassesJob(void* pData, U32 begin, U32 end);
 
     gfx::BackendRenderer* m_pBackend;
     gfx::CommandList* m_pList;
@@ -110,16 +218,20 @@ private:
     gfx::DepthStencilView* m_pSceneDepthView;
     gfx::ShaderResourceView* m_pSceneDepthResourceView;
 
-    gfx::GraphicsPipeline* m_pPreZPipeline;
+    // PreZ pipeline for each VertexFormat.
+    gfx::GraphicsPipeline* m_pPreZPipelines[VERTEX_FORMAT_COUNT];
     gfx::RenderPass* m_pPreZPass;
 
     GeometryPass m_geometryPass;
     Lights::LightSystem m_lightSystem;
     Shadows::LightShadow dirShadow;
 
+    // Point and spot lights by froxel, assigned with the lights update.
+    Lights::LightClusters m_lightClusters;
+    // Views of the light buffers bound to the lighting pass.
+    U32 m_lightViewsVersion;
+
     // To be run after PreZPass.
-    gfx::ComputePipeline* m_clusterAssignmentPipeline;
-    gfx::ComputePipeline* m_lightAssignmentPipeline;
     gfx::ComputePipeline* m_bitonicSort;
 
     // To be Run after Light assignement AND GBuffer pass.
@@ -144,6 +256,74 @@ private:
     std::vector<GeometryMesh*> m_opaqueBatches;
     std::vector<GeometrySubMesh*> m_opaqueSubmeshes; 
 
+    // Opaque meshes that survived camera culling this frame.
+    std::vector<GeometryMesh*> m_visibleBatches;
+    std::vector<GeometrySubMesh*> m_visibleSubmeshes;
+
+    // Visible opaque and transparent submeshes, sorted for submission.
+    RenderQueue m_renderQueue;
+
+    // Where each transform/material id's constants were written, and for which frame.
+    struct FrameConstant
+    {
+        U64 _offset;
+        U64 _frameNumber;
+    };
+    ConstantBufferRing m_constantRing;
+    UploadQueue m_uploadQueue;
+    SlotMap<FrameConstant> m_frameConstants;
+    // Constant writes of this frame. Offsets are handed out in order, the copies then run as jobs.
+    struct ConstantCopy
+    {
+        void* _pDst;
+        const void* _pSrc;
+        U64 _szBytes;
+    };
+    std::vector<ConstantCopy> m_constantCopies;
+    // Sorted opaque items merged into instanced draws.
+    std::vector<RenderBatch> m_opaqueDraws;
+    // A region of m_instanceCapacity instances per frame in flight, so a frame never writes
+    // instances the gpu may still read. This frame's starts at m_instanceRegionOffset.
+    gfx::Resource* m_pInstanceBuffer;
+    U32 m_instanceCapacity;
+    U64 m_instanceRegionOffset;
+    struct RetiredBuffer
+    {
+        gfx::Resource* _pBuffer;
+        // Frame number after which the gpu no longer reads the buffer.
+        U64 _lastFrame;
+    };
+    // Instance buffers outgrown, destroyed once their frames have retired.
+    std::vector<RetiredBuffer> m_retiredInstanceBuffers;
+
+    MeshCuller m_culler;
+    OcclusionCuller m_occlusionCuller;
+    CullStats m_cameraCullStats;
+    CullStats m_shadowCullStats;
+
+    // Cpu stages of the frame run as jobs on m_pJobs. m_inlineJobs has no workers, it runs
+    // every job on the thread that waits for it.
+    JobSystem* m_pJobs;
+    JobSystem m_inlineJobs;
+    // Lights update alongside culling and sorting, recording waits on this.
+    JobCounter m_lightsUpdated;
+
+    // Pass ranges of this frame, and the pooled lists they record into, by index. m_pList
+    // records lighting and the final pass on the calling thread, and goes last.
+    std::vector<PassRange> m_passRanges;
+    std::vector<gfx::CommandList*> m_passLists;
+    // Every list is recorded through a filter, dropping the state calls that bind what's bound.
+    std::vector<gfx::StateFilterCommandList*> m_passFilters;
+    gfx::StateFilterCommandList m_listFilter;
+    gfx::StateFilterStats m_stateFilterStats;
+    // Every root signature and pipeline state is requested through here, and shared.
+    PipelineCache m_pipelineCache;
+    std::string m_pipelineCachePath;
+    std::vector<gfx::CommandList*> m_submitLists;
+    JobCounter m_passesRecorded;
+    gfx::Viewport m_viewport;
+    gfx::Scissor m_scissor;
+
     // RenderGroups define the pass set for this particular set of calls.
     // Should only be setting resize on amortized time.
     std::vector<RenderGroup*> m_renderGroups;
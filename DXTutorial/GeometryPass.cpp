@@ -2,23 +2,25 @@
 #include "FrontEndRenderer.h"
 #include "GeometryPass.h"
 #include "GraphicsResources.h"
+#include "PipelineCache.h"
+#include "VertexFormat.h"
 
 namespace jcl {
 
 
 void GeometryPass::initialize
     (
-        gfx::BackendRenderer* pBackend
+        gfx::BackendRenderer* pBackend,
+        PipelineCache* pPipelineCache
     )
 {
-    pBackend->createRootSignature(&m_pRootSignature);
-
     gfx::PipelineLayout pLayouts[5] = { };
     pLayouts[0]._numConstantBuffers = 1;
     pLayouts[0]._type = gfx::PIPELINE_LAYOUT_TYPE_CBV;
 
-    pLayouts[1]._numConstantBuffers = 1;
-    pLayouts[1]._type = gfx::PIPELINE_LAYOUT_TYPE_CBV;
+    // Per instance transforms, t0.
+    pLayouts[1]._numShaderResourceViews = 1;
+    pLayouts[1]._type = gfx::PIPELINE_LAYOUT_TYPE_SRV;
 
     pLayouts[2]._numConstantBuffers = 1;
     pLayouts[2]._type = gfx::PIPELINE_LAYOUT_TYPE_CBV;
@@ -29,7 +31,7 @@ void GeometryPass::initialize
     pLayouts[4]._numShaderResourceViews = 4;
     pLayouts[4]._type = gfx::PIPELINE_LAYOUT_TYPE_DESCRIPTOR_TABLE;
 
-    m_pRootSignature->initialize(gfx::SHADER_VISIBILITY_PIXEL | gfx::SHADER_VISIBILITY_VERTEX, pLayouts, 5);
+    m_pRootSignature = pPipelineCache->getRootSignature(gfx::SHADER_VISIBILITY_PIXEL | gfx::SHADER_VISIBILITY_VERTEX, pLayouts, 5);
 
     gfx::GraphicsPipelineInfo pipeInfo = { };
     pipeInfo._pRootSignature = m_pRootSignature;
@@ -46,7 +48,6 @@ void GeometryPass::initialize
     
     pipeInfo._pixelShader._pByteCode = new I8[1024 * 1024 * 5];
     pipeInfo._vertexShader._pByteCode = new I8[1024 * 1024 * 5];
-    retrieveShader("GeometryTransform.vs.cso", &pipeInfo._vertexShader._pByteCode, pipeInfo._vertexShader._szBytes);
     retrieveShader("GPass.ps.cso", &pipeInfo._pixelShader._pByteCode, pipeInfo._pixelShader._szBytes);
 
     pipeInfo._topology = gfx::PRIMITIVE_TOPOLOGY_TRIANGLES;
@@ -80,23 +81,16 @@ void GeometryPass::initialize
     // 16bit index buffers passed?
     pipeInfo._ibCutValue = gfx::IB_CUT_VALUE_CUT_0xFFFF;
 
-    std::vector<gfx::InputElementInfo> elements(4);
-    std::vector<const CHAR*> semantics = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD" };
-    U32 offset = 0;
-    for (size_t i = 0; i < elements.size(); ++i) {
-        elements[i]._alignedByteOffset = offset;
-        elements[i]._classification = gfx::INPUT_CLASSIFICATION_PER_VERTEX;
-        elements[i]._format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-        elements[i]._instanceDataStepRate = 0;
-        elements[i]._semanticIndex = 0;
-        elements[i]._semanticName = semantics[i];
-        offset += sizeof(Vector4);
+    // One pipeline per vertex format, differing only in input layout and vertex shader.
+    gfx::InputElementInfo elements[kVertexElementCount];
+    pipeInfo._inputLayout._elementCount = kVertexElementCount;
+    pipeInfo._inputLayout._pInputElements = elements;
+    for (U32 format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+        getVertexInputElements(VertexFormat(format), elements);
+        retrieveShader(getVertexShaderPath(VertexFormat(format), "GeometryTransform.vs.cso"), 
+                       &pipeInfo._vertexShader._pByteCode, pipeInfo._vertexShader._szBytes);
+        m_pPSOs[format] = pPipelineCache->getGraphicsPipeline(pipeInfo);
     }
-    
-    pipeInfo._inputLayout._elementCount = elements.size();
-    pipeInfo._inputLayout._pInputElements = elements.data();
-
-    pBackend->createGraphicsPipelineState(&m_pPSO, &pipeInfo);
 
     delete[] pipeInfo._pixelShader._pByteCode;
     delete[] pipeInfo._vertexShader._pByteCode;
@@ -139,14 +133,12 @@ void GeometryPass::generateCommands
         FrontEndRenderer* pRenderer,
         // list to record our commands to. 
         gfx::CommandList* pList, 
-        // Meshes to render onto this gpass.
-        GeometryMesh** pMeshes, 
-        // Number of meshes in this mesh array.
-        U32 meshCount,
-        //
-        GeometrySubMesh** pSubMeshes,
-        //
-        U32 submeshCount
+        // Sorted submesh draws to render onto this gpass.
+        const RenderItem* pItems, 
+        // Instanced batches of the sorted items.
+        const RenderBatch* pBatches,
+        // Number of batches in the batch array.
+        U32 batchCount
     )
 {
     if (!_pGBuffer) { 
@@ -158,47 +150,65 @@ void GeometryPass::generateCommands
 
     gfx::DescriptorTable* ppTables[] = { pRenderer->getResourceDescriptorTable(), 
                                          m_pSamplerTable};
-    // Set the graphics pipeline, assuming we aren't doing any animation skinning, or dynamic mesh rendering,
-    // we can just have one pipeline state that is handling static meshes.
+    // Assuming we aren't doing any animation skinning, or dynamic mesh rendering, static meshes
+    // only need a pipeline state per vertex format, bound as the batches change format below.
     pList->setDescriptorTables(ppTables, 2);
-    pList->setGraphicsPipeline(m_pPSO);
     pList->setGraphicsRootSignature(m_pRootSignature);
+    pList->setGraphicsRootConstantBufferView(GLOBAL_CONST_SLOT, pRenderer->getGlobalsBuffer());
+    pList->setGraphicsRootDescriptorTable(3, m_pSamplerTable);
+
+    // Batches come sorted by state, so only rebind what changed from the previous draw.
+    gfx::Resource* pInstanceBuffer = pRenderer->getInstanceBuffer();
+    U64 instanceOffset = pRenderer->getInstanceOffset();
+    U32 boundFormat = VERTEX_FORMAT_COUNT;
+    RenderUUID boundVertUUID = 0;
+    RenderUUID boundIndUUID = 0;
+    RenderUUID boundMatUUID = 0;
+    for (U32 i = 0; i < batchCount; ++i) {
+        const RenderBatch& batch = pBatches[i];
+        GeometryMesh* pMesh = pItems[batch._firstItem]._pMesh;
+        GeometrySubMesh* pSubMesh = pItems[batch._firstItem]._pSubMesh;
+        RenderUUID indUUID = pMesh->_indexBufferView;
+
+        if (pMesh->_vertexFormat != boundFormat) {
+            boundFormat = pMesh->_vertexFormat;
+            pList->setGraphicsPipeline(m_pPSOs[boundFormat]);
+        }
 
-    U64 submeshIdx = 0;
-    for (U32 i = 0; i < meshCount; ++i) {
-        RenderUUID meshUUID = pMeshes[i]->_meshTransform;
-        RenderUUID vertUUID = pMeshes[i]->_vertexBufferView;
-        RenderUUID indUUID = pMeshes[i]->_indexBufferView;
-
-        gfx::Resource* pMeshDescriptor = getResource(meshUUID);
-
-        gfx::VertexBufferView* pView = getVertexBufferView(vertUUID);
-
-        pList->setGraphicsRootConstantBufferView(GLOBAL_CONST_SLOT, pRenderer->getGlobalsBuffer());
-        pList->setGraphicsRootConstantBufferView(MESH_TRANSFORM_SLOT, pMeshDescriptor);
-        pList->setGraphicsRootDescriptorTable(3, m_pSamplerTable);
-
-        pList->setVertexBuffers(0, &pView, 1);
+        if (pMesh->_vertexBufferView != boundVertUUID) {
+            boundVertUUID = pMesh->_vertexBufferView;
+            gfx::VertexBufferView* pView = getVertexBufferView(boundVertUUID);
+            pList->setVertexBuffers(0, &pView, 1);
+        }
 
-        if (indUUID != 0) 
+        if (indUUID != 0 && indUUID != boundIndUUID) {
+            boundIndUUID = indUUID;
             pList->setIndexBuffer(getIndexBufferView(indUUID));
+        }
+
+        RenderUUID matUUID = pSubMesh->_materialDescriptor;
+        if (matUUID != boundMatUUID) {
+            boundMatUUID = matUUID;
+            pList->setGraphicsRootConstantBufferView(MATERIAL_DEF_SLOT, 
+                                                     pRenderer->getConstantBuffer(), 
+                                                     pSubMesh->_matDataOffset);
+        }
 
-        for (U64 j = 0; j < pMeshes[i]->_submeshCount; ++j, ++submeshIdx) {
-            RenderUUID matUUID = pSubMeshes[submeshIdx]->_materialDescriptor;
-            gfx::Resource* pMatDescriptor = getResource(matUUID);
-            pList->setGraphicsRootConstantBufferView(MATERIAL_DEF_SLOT, pMatDescriptor);
-            if (pSubMeshes[submeshIdx]->_matData->_matrialFlags & MATERIAL_USE_ALBEDO_MAP) { }
-            if (indUUID != 0) {
-                pList->drawIndexedInstanced(pSubMeshes[submeshIdx]->_indCount, 
-                                            pSubMeshes[submeshIdx]->_vertInst, 
-                                            pSubMeshes[submeshIdx]->_indOffset, 
-                                            pSubMeshes[submeshIdx]->_startVert, 0);
-            } else {
-                pList->drawInstanced(pSubMeshes[submeshIdx]->_vertCount, 
-                                        pSubMeshes[submeshIdx]->_vertInst, 
-                                        pSubMeshes[submeshIdx]->_startVert, 0);
-            }
+        pList->setGraphicsRootShaderResourceView(MESH_TRANSFORM_SLOT, 
+                                                 pInstanceBuffer, 
+                                                 instanceOffset + batch._firstItem * sizeof(PerMeshDescriptor));
+
+        if (pSubMesh->_matData->_matrialFlags & MATERIAL_USE_ALBEDO_MAP) { }
+        if (indUUID != 0) {
+            pList->drawIndexedInstanced(pSubMesh->_indCount, 
+                                        batch._instanceCount, 
+                                        pSubMesh->_indOffset, 
+                                        pSubMesh->_startVert, 0);
+        } else {
+            pList->drawInstanced(pSubMesh->_vertCount, 
+                                    batch._instanceCount, 
+                                    pSubMesh->_startVert, 0);
         }
     }
 }
-} // jcl
\ No newline at end of file
+} // jcl
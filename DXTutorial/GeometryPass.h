@@ -3,25 +3,26 @@
 
 #include "BackendRenderer.h"
 #include "GlobalDef.h"
+#include "RenderQueue.h"
 
 namespace jcl {
     
 class GeometryMesh;
 class RenderGroup;
 class FrontEndRenderer;
+class PipelineCache;
 
 class GeometryPass
 {
 public:
-    void initialize(gfx::BackendRenderer* pBackend);
+    void initialize(gfx::BackendRenderer* pBackend, PipelineCache* pPipelineCache);
     void cleanUp(gfx::BackendRenderer* pBackend);
     
     void generateCommands(FrontEndRenderer* pRenderer, 
                             gfx::CommandList* pList, 
-                            GeometryMesh** pMeshes, 
-                            U32 meshCount,
-                            GeometrySubMesh** pSubMeshes,
-                            U32 submeshCount);
+                            const RenderItem* pItems, 
+                            const RenderBatch* pBatches,
+                            U32 batchCount);
 
     void setGBuffer(GBuffer* pass) { _pGBuffer = pass; }
 
@@ -30,7 +31,8 @@ private:
     GBuffer* _pGBuffer;
     gfx::Sampler* m_pSampler;
     gfx::DescriptorTable* m_pSamplerTable;
-    gfx::GraphicsPipeline* m_pPSO;  
+    // Pipeline for each VertexFormat.
+    gfx::GraphicsPipeline* m_pPSOs[VERTEX_FORMAT_COUNT];
     gfx::RootSignature* m_pRootSignature;
 };
 }
\ No newline at end of file
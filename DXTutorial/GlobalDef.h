@@ -11,6 +11,7 @@
 #include <vector>
 
 #define GLOBAL_CONST_SLOT 0
+// Per mesh constant buffer, or the per instance structured buffer in the instanced PreZ and GBuffer passes.
 #define MESH_TRANSFORM_SLOT 1
 #define MATERIAL_DEF_SLOT 2
 
@@ -27,6 +28,33 @@ struct Vertex
     struct { R32 _x, _y, _z, _w; } _texcoords;
 };
 
+
+// Vertex layouts a mesh can be drawn with. Every pass keeps a pipeline per format.
+enum VertexFormat
+{
+    // Vertex, four float4s.
+    VERTEX_FORMAT_FLOAT,
+    // PackedVertex, decoded in the vertex shader.
+    VERTEX_FORMAT_PACKED,
+    VERTEX_FORMAT_COUNT
+};
+
+
+// Compressed Vertex, 20 bytes against 64. Position is quantized to 16 bits within the mesh bounds,
+// dequantized with PerMeshDescriptor::_positionScale/_positionOffset, and its w holds the tangent sign.
+// Normal and tangent are octahedral encoded, texcoords are half floats.
+struct PackedVertex
+{
+    // R16G16B16A16_UNORM
+    U16 _position[4];
+    // R16G16_SNORM
+    I16 _normal[2];
+    // R16G16_SNORM
+    I16 _tangent[2];
+    // R16G16_FLOAT
+    U16 _texcoords[2];
+};
+
 typedef U64 RenderUUID;
 
 struct VertexBuffer
@@ -81,6 +109,9 @@ struct PerMeshDescriptor
     Matrix44 _previousWorldToViewClip;
     // Normal Correction 
     Matrix44 _n;
+    // Packed vertex position dequantization, position = packed * scale + offset. Unused by float vertices.
+    Vector4 _positionScale;
+    Vector4 _positionOffset;
 };
 
 struct PerMaterialDescriptor
@@ -140,10 +171,14 @@ struct GeometryMesh
     RenderUUID _vertexBufferView;
     RenderUUID _indexBufferView;
     PerMeshDescriptor* _meshDescriptor;
+    // Offset of this frame's copy of _meshDescriptor in the frame constant buffer, set by the front end.
+    U64 _meshDescriptorOffset;
     U32 _submeshCount;
     U32 _materialMapCount;
     GeometryMaterialMap* _materialMaps;
     Bounds3D _bounds;
+    // VertexFormat of the vertex buffer.
+    U32 _vertexFormat;
 };
 
 // Geometry Submesh describes only the partial vertices that make up a 
@@ -152,6 +187,8 @@ struct GeometrySubMesh
 {
     RenderUUID _materialDescriptor;
     PerMaterialDescriptor* _matData;
+    // Offset of this frame's copy of _matData in the frame constant buffer, set by the front end.
+    U64 _matDataOffset;
     U32 _materialMapIdx;
     U32 _vertCount;
     U32 _vertInst;
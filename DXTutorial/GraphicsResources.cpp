@@ -5,59 +5,78 @@
 namespace jcl {
 
 
-class GPUCache
-{
-public:
-    static RenderUUID cacheGPUResource(gfx::Resource* pResource);
-    static gfx::Resource* getGPUResource(RenderUUID uuid);
-};
+SlotMap<gfx::Resource*> m_pGraphicsResources;
+SlotMap<gfx::VertexBufferView*> m_pVertexBufferViews;
+SlotMap<gfx::IndexBufferView*> m_pIndexBufferViews;
 
 
-RenderUUID idd = 0;
+template<typename T>
+static T* lookup(const SlotMap<T*>& slotMap, RenderUUID uuid)
+{
+    T* const* ppValue = slotMap.find(uuid);
+    return ppValue ? *ppValue : nullptr;
+}
 
 
-std::unordered_map<RenderUUID, gfx::Resource*> m_pGraphicsResources;
-std::unordered_map<RenderUUID, gfx::VertexBufferView*> m_pVertexBufferViews;
-std::unordered_map<RenderUUID, gfx::IndexBufferView*> m_pIndexBufferViews;
+template<typename T>
+static T* release(SlotMap<T*>& slotMap, RenderUUID uuid)
+{
+    T* pValue = lookup(slotMap, uuid);
+    slotMap.erase(uuid);
+    return pValue;
+}
+
 
 RenderUUID cacheResource(gfx::Resource* pResource)
 {
-    RenderUUID id = idd++;
-    m_pGraphicsResources[id] = pResource;
-    return id;
+    return m_pGraphicsResources.insert(pResource);
 }
 
 
 RenderUUID cacheVertexBufferView(gfx::VertexBufferView* pView)
 {
-    RenderUUID id = idd++;
-    m_pVertexBufferViews[id] = pView;
-    return id;
+    return m_pVertexBufferViews.insert(pView);
 }
 
 
 RenderUUID cacheIndexBufferView(gfx::IndexBufferView* pView)
 {
-    RenderUUID id = idd++;
-    m_pIndexBufferViews[id] = pView;
-    return id;
+    return m_pIndexBufferViews.insert(pView);
 }
 
 
 gfx::Resource* getResource(RenderUUID uuid) 
 { 
-    return m_pGraphicsResources[uuid]; 
+    return lookup(m_pGraphicsResources, uuid); 
 }
 
 
 gfx::VertexBufferView* getVertexBufferView(RenderUUID uuid) 
 { 
-    return m_pVertexBufferViews[uuid]; 
+    return lookup(m_pVertexBufferViews, uuid); 
 }
 
 
 gfx::IndexBufferView* getIndexBufferView(RenderUUID uuid) 
 { 
-    return m_pIndexBufferViews[uuid]; 
+    return lookup(m_pIndexBufferViews, uuid); 
+}
+
+
+gfx::Resource* releaseResource(RenderUUID uuid)
+{
+    return release(m_pGraphicsResources, uuid);
+}
+
+
+gfx::VertexBufferView* releaseVertexBufferView(RenderUUID uuid)
+{
+    return release(m_pVertexBufferViews, uuid);
+}
+
+
+gfx::IndexBufferView* releaseIndexBufferView(RenderUUID uuid)
+{
+    return release(m_pIndexBufferViews, uuid);
 }
-} // jcl
\ No newline at end of file
+} // jcl
@@ -3,12 +3,13 @@
 
 #include "GlobalDef.h"
 #include "BackendRenderer.h"
-
-#include <unordered_map>
+#include "SlotMap.h"
 
 namespace jcl {
 
-
+// Resources and views are kept in slot maps, a RenderUUID is a generational handle into them.
+// Lookups are array indexing, and return null for a released or never cached id.
+// An id of 0 is never handed out, and can be used for "none".
 RenderUUID cacheResource(gfx::Resource* pResource);
 RenderUUID cacheVertexBufferView(gfx::VertexBufferView* pView);
 RenderUUID cacheIndexBufferView(gfx::IndexBufferView* pView);
@@ -17,4 +18,10 @@ gfx::Resource* getResource(RenderUUID uuid);
 gfx::VertexBufferView* getVertexBufferView(RenderUUID uuid);
 gfx::IndexBufferView* getIndexBufferView(RenderUUID uuid);
 
-} // jcl
\ No newline at end of file
+// Remove from the cache and return the cached pointer, which the caller is to destroy.
+// Every copy of uuid goes stale. Returns null if uuid was already stale.
+gfx::Resource* releaseResource(RenderUUID uuid);
+gfx::VertexBufferView* releaseVertexBufferView(RenderUUID uuid);
+gfx::IndexBufferView* releaseIndexBufferView(RenderUUID uuid);
+
+} // jcl
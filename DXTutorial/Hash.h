@@ -0,0 +1,46 @@
+//
+#pragma once
+
+#include "PlatformConfigs.h"
+
+namespace jcl {
+
+
+// 64 bit MurmurHash2 (MurmurHash64A), 8 bytes a step. Fast enough to key caches on whole
+// source files. Not for anything adversarial.
+inline U64 hashBytes(const void* pData, U64 szBytes, U64 seed = 0ull)
+{
+    const U64 m = 0xc6a4a7935bd1e995ull;
+    const U32 r = 47;
+    const U8* pBytes = static_cast<const U8*>(pData);
+    U64 h = seed ^ (szBytes * m);
+
+    U64 blocks = szBytes / 8;
+    for (U64 i = 0; i < blocks; ++i) {
+        U64 k;
+        memcpy(&k, pBytes + i * 8, sizeof(k));
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+        h ^= k;
+        h *= m;
+    }
+
+    const U8* pTail = pBytes + blocks * 8;
+    switch (szBytes & 7) {
+        case 7: h ^= static_cast<U64>(pTail[6]) << 48; // fall through
+        case 6: h ^= static_cast<U64>(pTail[5]) << 40; // fall through
+        case 5: h ^= static_cast<U64>(pTail[4]) << 32; // fall through
+        case 4: h ^= static_cast<U64>(pTail[3]) << 24; // fall through
+        case 3: h ^= static_cast<U64>(pTail[2]) << 16; // fall through
+        case 2: h ^= static_cast<U64>(pTail[1]) << 8;  // fall through
+        case 1: h ^= static_cast<U64>(pTail[0]);
+                h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+    return h;
+}
+} // jcl
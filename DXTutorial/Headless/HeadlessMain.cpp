@@ -0,0 +1,203 @@
+// Headless frame driver. Runs the front end renderer against the null RHI, with no window and no gpu,
+// so that the cpu cost of update() and render() can be measured on any platform.
+//
+// Usage: DXTutorialHeadless [meshCount] [frameCount] [model path] [packed] [capture path] [pipeline cache path]
+//
+// With a capture path, command lists record into a packed command stream, and the last frame's
+// stream is written to the path, so frames can be diffed, and their size per draw tracked.
+//
+// With a pipeline cache path, pipelines saved by the last run are prebuilt at init, and the ones
+// requested this run are saved back on exit. Pass "-" for any path to skip it.
+//
+#include "PlatformConfigs.h"
+#include "FrontEndRenderer.h"
+#include "Null/NullBackend.h"
+#include "Model/Model.h"
+#include "Time.h"
+#include "TransformBatch.h"
+#include "VertexFormat.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace jcl;
+
+Vertex quad[6] = {
+  { { -1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { {  1.0f,  1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } },
+  { { -1.0f, -1.0f, 0.0f, 1.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 0.0f }, { 1.0f, 1.0f, 1.0f, 1.0f } }
+};
+
+U32 quadIndices[6] = {
+    0, 1, 2, 3, 4, 5
+};
+
+
+int main(int argc, char* argv[])
+{
+    U32 meshCount = argc > 1 ? (U32)atoi(argv[1]) : 1024u;
+    U32 frameCount = argc > 2 ? (U32)atoi(argv[2]) : 100u;
+    const char* modelPath = (argc > 3 && strcmp(argv[3], "-") != 0) ? argv[3] : nullptr;
+    VertexFormat vertexFormat = (argc > 4 && strcmp(argv[4], "packed") == 0) ? VERTEX_FORMAT_PACKED 
+                                                                            : VERTEX_FORMAT_FLOAT;
+    const char* capturePath = (argc > 5 && strcmp(argv[5], "-") != 0) ? argv[5] : nullptr;
+    const char* pipelineCachePath = (argc > 6 && strcmp(argv[6], "-") != 0) ? argv[6] : nullptr;
+
+    // Lists are created with the renderer, recording has to be on before.
+    gfx::getBackendNull()->setCommandRecording(capturePath != nullptr);
+    FrontEndRenderer renderer;
+    if (pipelineCachePath) {
+        renderer.setPipelineCachePath(pipelineCachePath);
+    }
+    Time::initialize();
+    Time::update();
+    renderer.init(nullptr, FrontEndRenderer::RENDERER_RHI_NULL);
+    Time::update();
+    R64 initTime = Time().dt();
+
+    Globals globals = { };
+    globals._targetSize[0] = 1920;
+    globals._targetSize[1] = 1080;
+    globals._near = 0.005f;
+    globals._far = 1000.0f;
+    renderer.setGlobals(&globals);
+
+    VertexBuffer vertexBuffer = renderer.createVertexBuffer(quad, sizeof(Vertex), sizeof(quad));
+    IndexBuffer indexBuffer = renderer.createIndexBufferView(quadIndices, sizeof(quadIndices));
+    U32 indexCount = 6;
+    Bounds3D bounds(Vector3(-1.0f, -1.0f, 0.0f), Vector3(1.0f, 1.0f, 0.0f));
+
+    Model model;
+    Vector4 positionScale;
+    Vector4 positionOffset;
+    if (modelPath) {
+        Time::update();
+        model.initialize(modelPath, &renderer, vertexFormat);
+        Time::update();
+        printf("Loaded %s in %.3f ms, %u vertices, %u indices.\n",
+               modelPath, Time().dt() * 1000.0, model.getTotalVertices(), model.getTotalIndices());
+        vertexBuffer.vertexBufferView = model.getVertexBufferView();
+        indexBuffer.indexBufferView = model.getIndexBufferView();
+        indexCount = model.getTotalIndices();
+        bounds = model.getBounds();
+        getPositionDequantization(bounds, &positionScale, &positionOffset);
+    } else {
+        // The quad is only ever float vertices.
+        vertexFormat = VERTEX_FORMAT_FLOAT;
+    }
+
+    PerMaterialDescriptor material = { };
+    material._albedo = Vector4(1.0f, 1.0f, 1.0f);
+    RenderUUID materialId = renderer.createMaterialBuffer();
+
+    std::vector<PerMeshDescriptor> descriptors(meshCount);
+    std::vector<GeometryMesh> meshes(meshCount);
+    std::vector<GeometrySubMesh> submeshes(meshCount);
+    for (U32 i = 0; i < meshCount; ++i) {
+        GeometryMesh& mesh = meshes[i];
+        mesh._vertexBufferView = vertexBuffer.vertexBufferView;
+        mesh._indexBufferView = indexBuffer.indexBufferView;
+        mesh._meshTransform = renderer.createTransformBuffer();
+        mesh._meshDescriptor = &descriptors[i];
+        mesh._submeshCount = 1;
+        mesh._bounds = bounds;
+        mesh._vertexFormat = vertexFormat;
+        descriptors[i]._positionScale = positionScale;
+        descriptors[i]._positionOffset = positionOffset;
+
+        GeometrySubMesh& submesh = submeshes[i];
+        submesh._materialDescriptor = materialId;
+        submesh._matData = &material;
+        submesh._indCount = indexCount;
+        submesh._vertInst = 1;
+    }
+
+    // Scatter the meshes on a grid in front of the camera.
+    U32 gridWidth = (U32)sqrtf((R32)meshCount) + 1u;
+    Matrix44 P = Matrix44::perspectiveRH(ToRads(60.0f), 1920.0f / 1080.0f, globals._near, globals._far);
+    Matrix44 V = Matrix44::lookAtRH(Vector3(0.0f, 10.0f, 50.0f), Vector3(0.0f, 0.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f));
+    globals._cameraPos = Vector4(0.0f, 10.0f, 50.0f, 1.0f);
+    globals._worldToView = V;
+    globals._proj = P;
+    globals._viewToClip = V * P;
+
+    TransformBatch transforms;
+    transforms.resize(meshCount);
+
+    R64 updateTime = 0.0;
+    R64 renderTime = 0.0;
+    for (U32 frame = 0; frame < frameCount; ++frame) {
+        Time::update();
+        Matrix44 R = Matrix44::rotate(Matrix44(), ToRads((R32)frame), Vector3(0.0f, 1.0f, 0.0f));
+        for (U32 i = 0; i < meshCount; ++i) {
+            R32 x = ((R32)(i % gridWidth) - gridWidth * 0.5f) * 3.0f;
+            R32 z = -((R32)(i / gridWidth)) * 3.0f;
+            transforms.setWorld(i, Matrix44::translate(R, Vector4(x, 0.0f, z)));
+        }
+        transforms.computeDescriptors(globals._viewToClip, descriptors.data());
+        for (U32 i = 0; i < meshCount; ++i) {
+            GeometrySubMesh* pSubmesh = &submeshes[i];
+            renderer.pushMesh(&meshes[i], &pSubmesh);
+        }
+        renderer.update(0.0f, globals);
+        Time::update();
+        updateTime += Time().dt();
+        renderer.render();
+        Time::update();
+        renderTime += Time().dt();
+    }
+
+    R64 frames = frameCount ? (R64)frameCount : 1.0;
+    printf("%u meshes, %u frames.\n", meshCount, frameCount);
+    printf("  init: %.4f ms\n", initTime * 1000.0);
+    printf("  update: %.4f ms/frame\n", updateTime * 1000.0 / frames);
+    printf("  render: %.4f ms/frame\n", renderTime * 1000.0 / frames);
+    printf("  camera: %u visible, %u culled\n",
+           renderer.getCameraCullStats()._visible, renderer.getCameraCullStats()._culled);
+    printf("  shadow: %u visible, %u culled\n",
+           renderer.getShadowCullStats()._visible, renderer.getShadowCullStats()._culled);
+    printf("  uploads: %llu copies in %llu batches\n",
+           (unsigned long long)renderer.getUploadQueue().getCopyCount(),
+           (unsigned long long)renderer.getUploadQueue().getBatchCount());
+    printf("  opaque: %u submeshes in %u instanced draws\n",
+           renderer.getRenderQueue().getItemCount(RENDER_LAYER_OPAQUE), renderer.getOpaqueDrawCount());
+    printf("  lists: %u command lists submitted\n", renderer.getCommandListCount());
+    const gfx::StateFilterStats& stateStats = renderer.getStateFilterStats();
+    const char* stateCallNames[gfx::STATE_CALL_COUNT] = { "pipeline", "root signature", "root parameter", 
+                                                          "vertex buffers", "index buffer", "viewports", 
+                                                          "scissors", "descriptor tables" };
+    printf("  state: %u calls forwarded, %u filtered\n", 
+           stateStats.getForwardedCount(), stateStats.getFilteredCount());
+    for (U32 i = 0; i < gfx::STATE_CALL_COUNT; ++i) {
+        printf("    %-17s %6u forwarded %6u filtered\n", 
+               stateCallNames[i], stateStats._forwarded[i], stateStats._filtered[i]);
+    }
+
+    const PipelineCacheStats& pipelineStats = renderer.getPipelineCache().getStats();
+    printf("  pipelines: %u cached, %u prebuilt, %u hits, %u misses, root signatures %u hits, %u misses\n",
+           renderer.getPipelineCache().getPipelineCount(), pipelineStats._prebuilt, pipelineStats._hits, 
+           pipelineStats._misses, pipelineStats._rootSignatureHits, pipelineStats._rootSignatureMisses);
+
+    if (capturePath) {
+        const gfx::NullBackend::FrameCapture& capture = gfx::getBackendNull()->getLastFrameCapture();
+        printf("  capture: %llu bytes, %u commands, %u draws in %u lists, %.1f bytes per draw, hash %016llx\n",
+               (unsigned long long)capture._stream.size(), capture._commandCount, capture._drawCount, capture._listCount,
+               capture._drawCount ? (R64)capture._stream.size() / capture._drawCount : 0.0,
+               (unsigned long long)capture._hash);
+        FILE* pFile = fopen(capturePath, "wb");
+        if (pFile) {
+            fwrite(capture._stream.data(), 1, capture._stream.size(), pFile);
+            fclose(pFile);
+        } else {
+            printf("Failed to write capture to %s\n", capturePath);
+        }
+    }
+
+    renderer.cleanUp();
+    return 0;
+}
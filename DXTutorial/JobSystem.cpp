@@ -0,0 +1,339 @@
+//
+#include "JobSystem.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#define JCL_JOBS_PAUSE() _mm_pause()
+#else
+#define JCL_JOBS_PAUSE()
+#endif
+
+namespace jcl {
+
+
+// Spins an idle worker, or a waiter with nothing to run, goes through before it sleeps.
+static const U32 kIdleSpinCount = 2048;
+
+// Worker of the job system the calling thread belongs to, if any.
+static thread_local void* t_pWorker = nullptr;
+
+
+void SpinLock::cpuRelax()
+{
+    JCL_JOBS_PAUSE();
+}
+
+
+void JobSystem::JobQueue::pushBack(const Job* pJobs, U32 count)
+{
+    std::lock_guard<SpinLock> lock(m_lock);
+    U32 capacity = static_cast<U32>(m_jobs.size());
+    if (m_count + count > capacity) {
+        U32 newCapacity = capacity ? capacity : 64u;
+        while (newCapacity < m_count + count) newCapacity *= 2;
+        std::vector<Job> jobs(newCapacity);
+        for (U32 i = 0; i < m_count; ++i) {
+            jobs[i] = m_jobs[(m_head + i) & (capacity - 1)];
+        }
+        m_jobs.swap(jobs);
+        m_head = 0;
+        capacity = newCapacity;
+    }
+    for (U32 i = 0; i < count; ++i) {
+        m_jobs[(m_head + m_count + i) & (capacity - 1)] = pJobs[i];
+    }
+    m_count += count;
+}
+
+
+B32 JobSystem::JobQueue::popBack(Job* pJob)
+{
+    std::lock_guard<SpinLock> lock(m_lock);
+    if (m_count == 0) return false;
+    --m_count;
+    *pJob = m_jobs[(m_head + m_count) & (m_jobs.size() - 1)];
+    return true;
+}
+
+
+B32 JobSystem::JobQueue::popFront(Job* pJob)
+{
+    std::lock_guard<SpinLock> lock(m_lock);
+    if (m_count == 0) return false;
+    *pJob = m_jobs[m_head];
+    m_head = (m_head + 1) & static_cast<U32>(m_jobs.size() - 1);
+    --m_count;
+    return true;
+}
+
+
+void JobSystem::JobQueue::clear()
+{
+    std::lock_guard<SpinLock> lock(m_lock);
+    m_head = 0;
+    m_count = 0;
+}
+
+
+void JobSystem::initialize(U32 workerCount)
+{
+    cleanUp();
+    if (workerCount == 0) {
+        U32 hardwareThreads = std::thread::hardware_concurrency();
+        workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+    m_stopping = false;
+    // Every worker is created before any starts, they steal from each other right away.
+    m_workers.resize(workerCount);
+    for (U32 i = 0; i < workerCount; ++i) {
+        m_workers[i] = new Worker();
+        m_workers[i]->_pSystem = this;
+        m_workers[i]->_index = i;
+    }
+    for (Worker* pWorker : m_workers) {
+        pWorker->_thread = std::thread(&JobSystem::workerMain, this, pWorker);
+    }
+}
+
+
+void JobSystem::cleanUp()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+    for (Worker* pWorker : m_workers) {
+        pWorker->_thread.join();
+    }
+    for (Worker* pWorker : m_workers) {
+        delete pWorker;
+    }
+    m_workers.clear();
+    // Jobs nobody ran are dropped, the next initialize() starts empty.
+    m_injected.clear();
+    m_background.clear();
+    m_queuedCount = 0;
+    m_backgroundCount = 0;
+    m_stopping = false;
+}
+
+
+JobSystem::Worker* JobSystem::getCurrentWorker() const
+{
+    Worker* pWorker = static_cast<Worker*>(t_pWorker);
+    return (pWorker && pWorker->_pSystem == this) ? pWorker : nullptr;
+}
+
+
+void JobSystem::push(const Job* pJobs, U32 count)
+{
+    if (count == 0) return;
+    // Counted ahead of the push, so the count never drops below the jobs actually queued.
+    // Sleepers check it after announcing themselves, and this checks for sleepers after
+    // counting the jobs, so one of the two always sees the other.
+    m_queuedCount.fetch_add(count);
+    Worker* pWorker = getCurrentWorker();
+    if (pWorker) {
+        pWorker->_queue.pushBack(pJobs, count);
+    } else {
+        m_injected.pushBack(pJobs, count);
+    }
+
+    if (m_sleepingCount.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        if (count == 1) {
+            m_wake.notify_one();
+        } else {
+            m_wake.notify_all();
+        }
+    }
+}
+
+
+void JobSystem::run(const Job* pJobs, U32 count, JobCounter* pCounter, JobCounter* pDependency)
+{
+    if (count == 0) return;
+    if (pCounter) pCounter->m_value.fetch_add(count);
+
+    if (pDependency) {
+        std::lock_guard<SpinLock> lock(pDependency->m_lock);
+        // The last job of the dependency drops its count before it takes the lock to release
+        // continuations, so a dependency still counting here will see these.
+        if (pDependency->m_value.load() > 0) {
+            pDependency->m_continuations.insert(pDependency->m_continuations.end(), pJobs, pJobs + count);
+            return;
+        }
+    }
+    push(pJobs, count);
+}
+
+
+void JobSystem::run(JobFunction fn, void* pData, U32 count, U32 grain, JobCounter* pCounter, JobCounter* pDependency)
+{
+    if (count == 0) return;
+    Job job = { };
+    job._fn = fn;
+    job._pData = pData;
+    job._pCounter = pCounter;
+    job._begin = 0;
+    job._end = count;
+    job._grain = grain ? grain : 1u;
+    run(&job, 1, pCounter, pDependency);
+}
+
+
+void JobSystem::runBackground(JobFunction fn, void* pData, U32 count, JobCounter* pCounter)
+{
+    if (count == 0) return;
+    if (pCounter) pCounter->m_value.fetch_add(count);
+    std::vector<Job> jobs(count);
+    for (U32 i = 0; i < count; ++i) {
+        jobs[i]._fn = fn;
+        jobs[i]._pData = pData;
+        jobs[i]._pCounter = pCounter;
+        jobs[i]._begin = i;
+        jobs[i]._end = i + 1;
+        jobs[i]._grain = 1;
+    }
+    // Same ordering against sleepers as push(). Only workers take these, a waiter may be the
+    // one woken by notify_one(), so everyone is.
+    m_backgroundCount.fetch_add(count);
+    m_background.pushBack(jobs.data(), count);
+    if (m_sleepingCount.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_all();
+    }
+}
+
+
+B32 JobSystem::runBackgroundJob()
+{
+    if (m_backgroundCount.load(std::memory_order_relaxed) == 0) return false;
+    Job job;
+    if (!m_background.popFront(&job)) return false;
+    m_backgroundCount.fetch_sub(1);
+    execute(job);
+    return true;
+}
+
+
+B32 JobSystem::findJob(Worker* pWorker, Job* pJob)
+{
+    if (m_queuedCount.load(std::memory_order_relaxed) == 0) return false;
+
+    B32 found = (pWorker && pWorker->_queue.popBack(pJob)) || m_injected.popFront(pJob);
+    if (!found) {
+        // Steal, starting past ourselves so thieves spread over the victims.
+        U32 workerCount = static_cast<U32>(m_workers.size());
+        U32 start = pWorker ? pWorker->_index + 1 : 0;
+        for (U32 i = 0; i < workerCount && !found; ++i) {
+            Worker* pVictim = m_workers[(start + i) % workerCount];
+            if (pVictim != pWorker) found = pVictim->_queue.popFront(pJob);
+        }
+    }
+    if (found) m_queuedCount.fetch_sub(1);
+    return found;
+}
+
+
+void JobSystem::execute(Job job)
+{
+    // Hand the upper halves off until the rest is small enough to run here.
+    while (job._end - job._begin > job._grain) {
+        Job half = job;
+        half._begin = job._begin + (job._end - job._begin) / 2;
+        job._end = half._begin;
+        if (job._pCounter) job._pCounter->m_value.fetch_add(1);
+        push(&half, 1);
+    }
+    job._fn(job._pData, job._begin, job._end);
+    if (job._pCounter) finish(job._pCounter);
+}
+
+
+void JobSystem::finish(JobCounter* pCounter)
+{
+    U32 value = pCounter->m_value.load(std::memory_order_relaxed);
+    while (value > 1) {
+        if (pCounter->m_value.compare_exchange_weak(value, value - 1)) return;
+    }
+
+    // Maybe the last job. The count drops under the lock, and waiters take the lock once they
+    // see zero, so the counter outlives this. Continuations are pushed once it is let go.
+    std::vector<Job> continuations;
+    B32 done = false;
+    {
+        std::lock_guard<SpinLock> lock(pCounter->m_lock);
+        done = pCounter->m_value.fetch_sub(1) == 1;
+        if (done) continuations.swap(pCounter->m_continuations);
+    }
+    push(continuations.data(), static_cast<U32>(continuations.size()));
+    // Waiters asleep on a counter check it after announcing themselves, as sleepers do jobs.
+    if (done && m_sleepingCount.load() > 0) {
+        std::lock_guard<std::mutex> lock(m_sleepMutex);
+        m_wake.notify_all();
+    }
+}
+
+
+void JobSystem::wait(JobCounter* pCounter)
+{
+    Worker* pWorker = getCurrentWorker();
+    U32 spins = 0;
+    while (!pCounter->isDone()) {
+        Job job;
+        if (findJob(pWorker, &job)) {
+            execute(job);
+            spins = 0;
+        } else if (++spins < kIdleSpinCount) {
+            SpinLock::cpuRelax();
+        } else {
+            // Asleep until there is a job to run or the counter is done, both wake it.
+            std::unique_lock<std::mutex> lock(m_sleepMutex);
+            m_sleepingCount.fetch_add(1);
+            m_wake.wait(lock, [this, pCounter] {
+                return m_stopping || m_queuedCount.load() > 0 || pCounter->m_value.load() == 0;
+            });
+            m_sleepingCount.fetch_sub(1);
+            spins = 0;
+        }
+    }
+    // The last job may still be releasing continuations, hold on until it let go of the counter.
+    std::lock_guard<SpinLock> lock(pCounter->m_lock);
+}
+
+
+void JobSystem::workerMain(Worker* pWorker)
+{
+    t_pWorker = pWorker;
+    U32 spins = 0;
+    for (;;) {
+        Job job;
+        if (findJob(pWorker, &job)) {
+            execute(job);
+            spins = 0;
+            continue;
+        }
+        // Background jobs only once the rest are all taken.
+        if (runBackgroundJob()) {
+            spins = 0;
+            continue;
+        }
+        if (++spins < kIdleSpinCount) {
+            SpinLock::cpuRelax();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(m_sleepMutex);
+        m_sleepingCount.fetch_add(1);
+        m_wake.wait(lock, [this] {
+            return m_stopping || m_queuedCount.load() > 0 || m_backgroundCount.load() > 0;
+        });
+        m_sleepingCount.fetch_sub(1);
+        if (m_stopping) break;
+        spins = 0;
+    }
+    t_pWorker = nullptr;
+}
+} // jcl
@@ -0,0 +1,190 @@
+//
+#pragma once
+
+#include "PlatformConfigs.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace jcl {
+
+
+class JobSystem;
+class JobCounter;
+
+// Runs the job over [begin, end) of its range.
+typedef void (*JobFunction)(void* pData, U32 begin, U32 end);
+
+
+// A range of work. Jobs whose range is wider than _grain split off halves for other threads to
+// steal before they run, so one job is enough to spread a whole parallel for over the workers.
+struct Job
+{
+    JobFunction _fn;
+    void* _pData;
+    JobCounter* _pCounter;
+    U32 _begin;
+    U32 _end;
+    U32 _grain;
+};
+
+
+// Test and test and set lock, for queues that are held for a handful of instructions.
+class SpinLock
+{
+public:
+    SpinLock() : m_locked(false) { }
+
+    void lock()
+    {
+        for (;;) {
+            if (!m_locked.exchange(true, std::memory_order_acquire)) return;
+            while (m_locked.load(std::memory_order_relaxed)) cpuRelax();
+        }
+    }
+    void unlock() { m_locked.store(false, std::memory_order_release); }
+
+    static void cpuRelax();
+
+private:
+    std::atomic<bool> m_locked;
+};
+
+
+/*
+    Job Counter counts the jobs of a batch still to finish. Jobs can be run after a counter,
+    they are held back until it reaches zero, which is how batches depend on each other.
+    A counter must stay alive until wait() on it returned, and every job run after it was released.
+*/
+class JobCounter
+{
+public:
+    JobCounter() : m_value(0) { }
+
+    B32 isDone() const { return m_value.load(std::memory_order_acquire) == 0; }
+
+private:
+    JobCounter(const JobCounter&) = delete;
+    JobCounter& operator=(const JobCounter&) = delete;
+
+    friend class JobSystem;
+    std::atomic<U32> m_value;
+    SpinLock m_lock;
+    // Jobs waiting on this counter, and the counters they were run with.
+    std::vector<Job> m_continuations;
+};
+
+
+/*
+    Job System runs jobs on worker threads that steal from each other. Every worker owns a deque,
+    jobs a worker spawns go to the back of its own, it takes work from the back, and idle
+    workers steal the oldest, biggest, jobs from the front of the others'. Threads outside the
+    system submit through a shared queue. Waiting on a counter runs jobs instead of blocking,
+    so waiting from inside a job is fine, and a system without workers runs every job on the
+    thread that waits for it. Idle workers, and waiters with nothing to run, spin briefly
+    before they sleep.
+    Long blocking work, such as loading assets, goes on the background queue. Workers only take
+    from it when there is nothing else to do, and wait() never does, so a frame waiting on its
+    jobs is not held up behind a load.
+*/
+class JobSystem
+{
+public:
+    JobSystem()
+        : m_stopping(false)
+        , m_queuedCount(0)
+        , m_backgroundCount(0)
+        , m_sleepingCount(0) { }
+    ~JobSystem() { cleanUp(); }
+
+    // 0 workers picks one less than the hardware threads, the thread that waits being the last.
+    void initialize(U32 workerCount = 0);
+    // Jobs still queued are dropped, wait for their counters first.
+    void cleanUp();
+
+    // Queue count jobs, adding them to pCounter. With pDependency, they are held until it is done.
+    void run(const Job* pJobs, U32 count, JobCounter* pCounter, JobCounter* pDependency = nullptr);
+    // Queue fn over [0, count), in pieces of at most grain.
+    void run(JobFunction fn, void* pData, U32 count, U32 grain, JobCounter* pCounter, JobCounter* pDependency = nullptr);
+    // Queue count background jobs running fn over [i, i + 1), adding them to pCounter. They are
+    // never split. Without workers, only runBackgroundJob() runs them.
+    void runBackground(JobFunction fn, void* pData, U32 count, JobCounter* pCounter);
+    // Run jobs until the counter is done, background jobs aside.
+    void wait(JobCounter* pCounter);
+    // Run one background job on the calling thread. Returns false if none was queued.
+    B32 runBackgroundJob();
+
+    // Call fn(begin, end) over [0, count), in pieces of at most grain, and return once all are done.
+    template<typename Fn>
+    void parallelFor(U32 count, U32 grain, const Fn& fn)
+    {
+        if (count == 0) return;
+        if (m_workers.empty() || count <= grain) {
+            fn(0u, count);
+            return;
+        }
+        JobCounter counter;
+        run(&invokeRange<Fn>, const_cast<Fn*>(&fn), count, grain, &counter);
+        wait(&counter);
+    }
+
+    U32 getWorkerCount() const { return static_cast<U32>(m_workers.size()); }
+
+private:
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Ring buffer of jobs, grown when full. Its owner works at the back, everyone else the front.
+    class JobQueue
+    {
+    public:
+        JobQueue() : m_head(0), m_count(0) { }
+
+        void pushBack(const Job* pJobs, U32 count);
+        B32 popBack(Job* pJob);
+        B32 popFront(Job* pJob);
+        void clear();
+
+    private:
+        SpinLock m_lock;
+        std::vector<Job> m_jobs;
+        U32 m_head;
+        U32 m_count;
+    };
+
+    struct Worker
+    {
+        JobSystem* _pSystem;
+        JobQueue _queue;
+        std::thread _thread;
+        U32 _index;
+    };
+
+    template<typename Fn>
+    static void invokeRange(void* pData, U32 begin, U32 end) { (*static_cast<const Fn*>(pData))(begin, end); }
+
+    void push(const Job* pJobs, U32 count);
+    B32 findJob(Worker* pWorker, Job* pJob);
+    void execute(Job job);
+    void finish(JobCounter* pCounter);
+    void workerMain(Worker* pWorker);
+    Worker* getCurrentWorker() const;
+
+    std::vector<Worker*> m_workers;
+    // Jobs from threads outside the system.
+    JobQueue m_injected;
+    JobQueue m_background;
+
+    std::mutex m_sleepMutex;
+    std::condition_variable m_wake;
+    B32 m_stopping;
+    // Jobs sitting in any queue but the background one, background jobs, and threads asleep.
+    // Pushers, and the last job of a counter, only take the sleep lock when someone is asleep.
+    std::atomic<U32> m_queuedCount;
+    std::atomic<U32> m_backgroundCount;
+    std::atomic<U32> m_sleepingCount;
+};
+} // jcl
@@ -0,0 +1,463 @@
+//
+#include "LightClusters.h"
+#include "LightRenderer.h"
+#include "Math/SIMD.h"
+
+#include <math.h>
+#include <string.h>
+
+namespace jcl {
+namespace Lights {
+
+// Tiles per kernel step.
+static const U32 kLaneCount = 4;
+static const U32 kPaddedTilesX = (LIGHT_CLUSTER_TILES_X + kLaneCount - 1) & ~(kLaneCount - 1);
+static const U32 kMaxClusterCount = (1u << LIGHT_CLUSTER_COUNT_BITS) - 1u;
+// Lights per job when moving them to view space.
+static const U32 kLightChunkSize = 256;
+
+
+// Lights kept of a cluster, with room left for that many in the index buffer.
+static U32 clampCount(U32 count, U32 room)
+{
+    U32 kept = count < room ? count : room;
+    return kept < kMaxClusterCount ? kept : kMaxClusterCount;
+}
+
+
+static R32 maxf(R32 a, R32 b) { return a > b ? a : b; }
+static R32 minf(R32 a, R32 b) { return a < b ? a : b; }
+
+
+// Tile a coordinate in [0, 1) across count tiles falls in, clamped to the grid.
+static U32 getTile(R32 t, U32 count)
+{
+    R32 tile = floorf(t * count);
+    if (tile < 0.0f) return 0;
+    if (tile > count - 1.0f) return count - 1;
+    return static_cast<U32>(tile);
+}
+
+
+void LightClusters::initialize(gfx::BackendRenderer* pRenderer, U32 maxIndexCount)
+{
+    m_maxIndexCount = maxIndexCount;
+    m_clusters.resize(kClusterCount);
+    m_slices.resize(LIGHT_CLUSTER_SLICES);
+    m_columnMinX.resize(LIGHT_CLUSTER_SLICES * kPaddedTilesX);
+    m_columnMaxX.resize(LIGHT_CLUSTER_SLICES * kPaddedTilesX);
+    m_rowMinY.resize(LIGHT_CLUSTER_SLICES * LIGHT_CLUSTER_TILES_Y);
+    m_rowMaxY.resize(LIGHT_CLUSTER_SLICES * LIGHT_CLUSTER_TILES_Y);
+    if (!pRenderer) return;
+
+    pRenderer->createBuffer(&m_pClusterResource,
+                            gfx::RESOURCE_USAGE_CPU_TO_GPU,
+                            gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                            sizeof(LightCluster) * kClusterCount, 0, TEXT("LightClusters"));
+    pRenderer->createBuffer(&m_pIndexResource,
+                            gfx::RESOURCE_USAGE_CPU_TO_GPU,
+                            gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                            sizeof(U32) * (maxIndexCount ? maxIndexCount : 1), 0, TEXT("LightClusterIndices"));
+    gfx::ShaderResourceViewDesc srvDesc = { };
+    srvDesc._dimension = gfx::SRV_DIMENSION_BUFFER;
+    srvDesc._format = DXGI_FORMAT_UNKNOWN;
+    srvDesc._buffer._firstElement = 0;
+    srvDesc._buffer._numElements = kClusterCount;
+    srvDesc._buffer._structureByteStride = sizeof(LightCluster);
+    pRenderer->createShaderResourceView(&m_pClustersSRV, m_pClusterResource, srvDesc);
+    srvDesc._buffer._numElements = maxIndexCount ? maxIndexCount : 1;
+    srvDesc._buffer._structureByteStride = sizeof(U32);
+    pRenderer->createShaderResourceView(&m_pIndicesSRV, m_pIndexResource, srvDesc);
+}
+
+
+void LightClusters::computeClusterBounds(const Globals& globals)
+{
+    R32 zNear = globals._near > 0.0f ? globals._near : 1e-4f;
+    R32 zFar = globals._far > zNear ? globals._far : zNear * 2.0f;
+    m_projX = globals._proj._[0][0];
+    m_projY = globals._proj._[1][1];
+
+    R32 logRange = logf(zFar / zNear);
+    m_sliceScale = LIGHT_CLUSTER_SLICES / logRange;
+    m_sliceBias = -logf(zNear) * m_sliceScale;
+    for (U32 s = 0; s <= LIGHT_CLUSTER_SLICES; ++s) {
+        m_sliceDepths[s] = zNear * expf(logRange * s / LIGHT_CLUSTER_SLICES);
+    }
+    m_sliceDepths[0] = zNear;
+    m_sliceDepths[LIGHT_CLUSTER_SLICES] = zFar;
+
+    // A tile edge at ndc e is at view e * depth / proj, so its bounds over a slice are at either end.
+    for (U32 s = 0; s < LIGHT_CLUSTER_SLICES; ++s) {
+        R32 d0 = m_sliceDepths[s];
+        R32 d1 = m_sliceDepths[s + 1];
+        for (U32 x = 0; x < kPaddedTilesX; ++x) {
+            U32 idx = s * kPaddedTilesX + x;
+            if (x >= LIGHT_CLUSTER_TILES_X) {
+                m_columnMinX[idx] = m_columnMaxX[idx] = 0.0f;
+                continue;
+            }
+            R32 left = -1.0f + 2.0f * x / LIGHT_CLUSTER_TILES_X;
+            R32 right = -1.0f + 2.0f * (x + 1) / LIGHT_CLUSTER_TILES_X;
+            m_columnMinX[idx] = minf(left * d0, left * d1) / m_projX;
+            m_columnMaxX[idx] = maxf(right * d0, right * d1) / m_projX;
+        }
+        for (U32 y = 0; y < LIGHT_CLUSTER_TILES_Y; ++y) {
+            U32 idx = s * LIGHT_CLUSTER_TILES_Y + y;
+            R32 top = 1.0f - 2.0f * y / LIGHT_CLUSTER_TILES_Y;
+            R32 bottom = 1.0f - 2.0f * (y + 1) / LIGHT_CLUSTER_TILES_Y;
+            m_rowMinY[idx] = minf(bottom * d0, bottom * d1) / m_projY;
+            m_rowMaxY[idx] = maxf(top * d0, top * d1) / m_projY;
+        }
+    }
+}
+
+
+void LightClusters::getClusterBounds(U32 cluster, Vector3* pMin, Vector3* pMax) const
+{
+    U32 slice = cluster / kTileCount;
+    U32 tileY = (cluster % kTileCount) / LIGHT_CLUSTER_TILES_X;
+    U32 tileX = cluster % LIGHT_CLUSTER_TILES_X;
+    U32 column = slice * kPaddedTilesX + tileX;
+    U32 row = slice * LIGHT_CLUSTER_TILES_Y + tileY;
+    *pMin = Vector3(m_columnMinX[column], m_rowMinY[row], m_sliceDepths[slice]);
+    *pMax = Vector3(m_columnMaxX[column], m_rowMaxY[row], m_sliceDepths[slice + 1]);
+}
+
+
+void LightClusters::setSliceRange(LightStreams& streams, U32 light) const
+{
+    R32 depth = streams._depth[light];
+    R32 radius = streams._radius[light];
+    R32 zNear = m_sliceDepths[0];
+    R32 zFar = m_sliceDepths[LIGHT_CLUSTER_SLICES];
+    if (depth + radius < zNear || depth - radius > zFar || !(radius > 0.0f)) {
+        streams._firstSlice[light] = 1;
+        streams._lastSlice[light] = 0;
+        return;
+    }
+    R32 first = floorf(logf(maxf(depth - radius, zNear)) * m_sliceScale + m_sliceBias);
+    R32 last = floorf(logf(minf(depth + radius, zFar)) * m_sliceScale + m_sliceBias);
+    streams._firstSlice[light] = first < 0.0f ? 0 : static_cast<U32>(minf(first, LIGHT_CLUSTER_SLICES - 1.0f));
+    streams._lastSlice[light] = last < 0.0f ? 0 : static_cast<U32>(minf(last, LIGHT_CLUSTER_SLICES - 1.0f));
+}
+
+
+void LightClusters::resizeStreams(LightStreams& streams, U32 lightCount)
+{
+    streams._ids.resize(lightCount);
+    streams._x.resize(lightCount);
+    streams._y.resize(lightCount);
+    streams._depth.resize(lightCount);
+    streams._radius.resize(lightCount);
+    streams._firstSlice.resize(lightCount);
+    streams._lastSlice.resize(lightCount);
+}
+
+
+void LightClusters::prepareLights(const Globals& globals, const LightSystem& lights, JobSystem* pJobs)
+{
+    const std::vector<U32>& visiblePoints = lights.getVisiblePointLights();
+    const std::vector<U32>& visibleSpots = lights.getVisibleSpotLights();
+    U32 pointCount = static_cast<U32>(visiblePoints.size());
+    U32 spotCount = static_cast<U32>(visibleSpots.size());
+    resizeStreams(m_points, pointCount);
+    resizeStreams(m_spots, spotCount);
+    std::vector<R32>* spotCones[] = { &m_spotApexX, &m_spotApexY, &m_spotApexDepth,
+                                      &m_spotDirX, &m_spotDirY, &m_spotDirDepth,
+                                      &m_spotRange, &m_spotCos, &m_spotSin };
+    for (std::vector<R32>* pStream : spotCones) {
+        pStream->resize(spotCount);
+    }
+    m_pointLightCount = lights.getPointLightCount();
+    m_spotLightCount = lights.getSpotLightCount();
+
+    // Depth is -z, as the view looks down -z.
+    const Matrix44& worldToView = globals._worldToView;
+    const PointLightStreams& pointLights = lights.getPointLightStreams();
+    auto preparePoints = [&] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            U32 id = visiblePoints[i];
+            Vector4 view = Vector4(pointLights._x[id], pointLights._y[id], pointLights._z[id], 1.0f) * worldToView;
+            m_points._ids[i] = id;
+            m_points._x[i] = view._x;
+            m_points._y[i] = view._y;
+            m_points._depth[i] = -view._z;
+            m_points._radius[i] = pointLights._radius[id];
+            setSliceRange(m_points, i);
+        }
+    };
+
+    // Cones are bound by the smallest sphere around their apex and cap, see
+    // "Cull that cone!", Bart Wronski, 2017.
+    const SpotLightStreams& spotLights = lights.getSpotLightStreams();
+    auto prepareSpots = [&] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            U32 id = visibleSpots[i];
+            Vector4 apex = Vector4(spotLights._x[id], spotLights._y[id], spotLights._z[id], 1.0f) * worldToView;
+            Vector4 axis = Vector4(spotLights._dirX[id], spotLights._dirY[id], spotLights._dirZ[id], 0.0f) * worldToView;
+            R32 range = spotLights._range[id];
+            R32 cosAngle = spotLights._cosOuter[id];
+            R32 sinAngle = spotLights._sinOuter[id];
+            R32 center = 0.0f;
+            R32 radius = range;
+            if (cosAngle <= 0.0f) {
+                // A hemisphere or wider, bound the whole range.
+            } else if (cosAngle < 0.70710678f) {
+                center = range * cosAngle;
+                radius = range * sinAngle;
+            } else {
+                center = range / (2.0f * cosAngle);
+                radius = center;
+            }
+            m_spots._ids[i] = id;
+            m_spotApexX[i] = apex._x;
+            m_spotApexY[i] = apex._y;
+            m_spotApexDepth[i] = -apex._z;
+            m_spotDirX[i] = axis._x;
+            m_spotDirY[i] = axis._y;
+            m_spotDirDepth[i] = -axis._z;
+            m_spotRange[i] = range;
+            m_spotCos[i] = cosAngle;
+            m_spotSin[i] = sinAngle;
+            m_spots._x[i] = apex._x + axis._x * center;
+            m_spots._y[i] = apex._y + axis._y * center;
+            m_spots._depth[i] = -(apex._z + axis._z * center);
+            m_spots._radius[i] = radius;
+            setSliceRange(m_spots, i);
+        }
+    };
+
+    if (pJobs) {
+        pJobs->parallelFor(pointCount, kLightChunkSize, preparePoints);
+        pJobs->parallelFor(spotCount, kLightChunkSize, prepareSpots);
+    } else {
+        preparePoints(0, pointCount);
+        prepareSpots(0, spotCount);
+    }
+}
+
+
+B32 LightClusters::isConeInCluster(U32 spot, U32 slice, U32 tileX, U32 tileY) const
+{
+    // Past a hemisphere the cone is most of its sphere, which was tested already.
+    if (m_spotCos[spot] <= 0.0f) return true;
+    U32 column = slice * kPaddedTilesX + tileX;
+    U32 row = slice * LIGHT_CLUSTER_TILES_Y + tileY;
+    R32 extentX = (m_columnMaxX[column] - m_columnMinX[column]) * 0.5f;
+    R32 extentY = (m_rowMaxY[row] - m_rowMinY[row]) * 0.5f;
+    R32 extentDepth = (m_sliceDepths[slice + 1] - m_sliceDepths[slice]) * 0.5f;
+    R32 radius = sqrtf(extentX * extentX + extentY * extentY + extentDepth * extentDepth);
+
+    // Cluster bounding sphere against the cone, closest distance from the sphere center to the cone's side,
+    // and against the sphere the light reaches around its apex.
+    R32 vx = m_columnMinX[column] + extentX - m_spotApexX[spot];
+    R32 vy = m_rowMinY[row] + extentY - m_spotApexY[spot];
+    R32 vz = m_sliceDepths[slice] + extentDepth - m_spotApexDepth[spot];
+    R32 lengthSq = vx * vx + vy * vy + vz * vz;
+    R32 alongAxis = vx * m_spotDirX[spot] + vy * m_spotDirY[spot] + vz * m_spotDirDepth[spot];
+    R32 fromAxis = sqrtf(maxf(lengthSq - alongAxis * alongAxis, 0.0f));
+    R32 distance = m_spotCos[spot] * fromAxis - alongAxis * m_spotSin[spot];
+    R32 reach = radius + m_spotRange[spot];
+    return !(distance > radius || alongAxis > reach || alongAxis < -radius || lengthSq > reach * reach);
+}
+
+
+void LightClusters::assignLight(U32 slice,
+                                const LightStreams& streams,
+                                U32 light,
+                                B32 isSpot,
+                                SliceLights& out) const
+{
+    using namespace m::simd;
+
+    R32 cx = streams._x[light];
+    R32 cy = streams._y[light];
+    R32 depth = streams._depth[light];
+    R32 radius = streams._radius[light];
+    R32 sliceNear = m_sliceDepths[slice];
+    R32 sliceFar = m_sliceDepths[slice + 1];
+    R32 d0 = maxf(sliceNear, depth - radius);
+    R32 d1 = minf(sliceFar, depth + radius);
+    if (d0 > d1) return;
+
+    // Screen bounds of the part of the sphere in this slice. At any depth the sphere stays within
+    // x +- radius, whose ndc is largest, or smallest, at either end of the depth range.
+    R32 left = (cx - radius) * m_projX;
+    R32 right = (cx + radius) * m_projX;
+    R32 bottom = (cy - radius) * m_projY;
+    R32 top = (cy + radius) * m_projY;
+    R32 ndcMinX = minf(left / d0, left / d1);
+    R32 ndcMaxX = maxf(right / d0, right / d1);
+    R32 ndcMinY = minf(bottom / d0, bottom / d1);
+    R32 ndcMaxY = maxf(top / d0, top / d1);
+    if (ndcMaxX < -1.0f || ndcMinX > 1.0f || ndcMaxY < -1.0f || ndcMinY > 1.0f) return;
+    U32 x0 = getTile(ndcMinX * 0.5f + 0.5f, LIGHT_CLUSTER_TILES_X);
+    U32 x1 = getTile(ndcMaxX * 0.5f + 0.5f, LIGHT_CLUSTER_TILES_X);
+    U32 y0 = getTile(0.5f - ndcMaxY * 0.5f, LIGHT_CLUSTER_TILES_Y);
+    U32 y1 = getTile(0.5f - ndcMinY * 0.5f, LIGHT_CLUSTER_TILES_Y);
+
+    // Sphere against each cluster box: squared distance from the center to the box, per axis.
+    R32 radiusSq = radius * radius;
+    R32 dz = maxf(maxf(sliceNear - depth, depth - sliceFar), 0.0f);
+    F4 center = splat(cx);
+    F4 zero = splat(0.0f);
+    const R32* pMinX = &m_columnMinX[slice * kPaddedTilesX];
+    const R32* pMaxX = &m_columnMaxX[slice * kPaddedTilesX];
+    for (U32 y = y0; y <= y1; ++y) {
+        U32 row = slice * LIGHT_CLUSTER_TILES_Y + y;
+        R32 dy = maxf(maxf(m_rowMinY[row] - cy, cy - m_rowMaxY[row]), 0.0f);
+        R32 rowDistSq = dy * dy + dz * dz;
+        if (rowDistSq > radiusSq) continue;
+
+        F4 base = splat(rowDistSq);
+        for (U32 xb = x0 & ~(kLaneCount - 1); xb <= x1; xb += kLaneCount) {
+            F4 dx = max(max(sub(load(pMinX + xb), center), sub(center, load(pMaxX + xb))), zero);
+            R32 distSq[kLaneCount];
+            store(distSq, madd(dx, dx, base));
+            for (U32 lane = 0; lane < kLaneCount; ++lane) {
+                U32 x = xb + lane;
+                if (x < x0 || x > x1 || distSq[lane] > radiusSq) continue;
+                if (isSpot && !isConeInCluster(light, slice, x, y)) continue;
+                U32 local = y * LIGHT_CLUSTER_TILES_X + x;
+                if (isSpot) {
+                    out._spotCounts[local] += 1;
+                } else {
+                    out._pointCounts[local] += 1;
+                }
+                out._hitClusters.push_back(static_cast<U16>(local));
+                out._hitLights.push_back(streams._ids[light]);
+            }
+        }
+    }
+}
+
+
+void LightClusters::binLights()
+{
+    for (SliceLights& slice : m_slices) {
+        slice._pointLights.clear();
+        slice._spotLights.clear();
+    }
+    U32 pointCount = static_cast<U32>(m_points._x.size());
+    for (U32 i = 0; i < pointCount; ++i) {
+        for (U32 s = m_points._firstSlice[i]; s <= m_points._lastSlice[i]; ++s) {
+            m_slices[s]._pointLights.push_back(i);
+        }
+    }
+    U32 spotCount = static_cast<U32>(m_spots._x.size());
+    for (U32 i = 0; i < spotCount; ++i) {
+        for (U32 s = m_spots._firstSlice[i]; s <= m_spots._lastSlice[i]; ++s) {
+            m_slices[s]._spotLights.push_back(i);
+        }
+    }
+}
+
+
+void LightClusters::assignSlice(U32 slice)
+{
+    SliceLights& out = m_slices[slice];
+    memset(out._pointCounts, 0, sizeof(out._pointCounts));
+    memset(out._spotCounts, 0, sizeof(out._spotCounts));
+    out._hitClusters.clear();
+    out._hitLights.clear();
+
+    for (U32 light : out._pointLights) {
+        assignLight(slice, m_points, light, false, out);
+    }
+    for (U32 light : out._spotLights) {
+        assignLight(slice, m_spots, light, true, out);
+    }
+
+    // Counting sort by cluster. Hits keep their order, so point lights stay ahead of spot lights.
+    U32 offset = 0;
+    U32 cursors[kTileCount];
+    for (U32 c = 0; c < kTileCount; ++c) {
+        out._offsets[c] = offset;
+        cursors[c] = offset;
+        offset += out._pointCounts[c] + out._spotCounts[c];
+    }
+    out._indices.resize(offset);
+    for (size_t i = 0; i < out._hitClusters.size(); ++i) {
+        out._indices[cursors[out._hitClusters[i]]++] = out._hitLights[i];
+    }
+}
+
+
+void LightClusters::joinSlices()
+{
+    std::vector<U8> pointSeen(m_pointLightCount, 0);
+    std::vector<U8> spotSeen(m_spotLightCount, 0);
+
+    U32 base = 0;
+    for (U32 slice = 0; slice < LIGHT_CLUSTER_SLICES; ++slice) {
+        const SliceLights& lights = m_slices[slice];
+        for (U32 c = 0; c < kTileCount; ++c) {
+            U32 points = lights._pointCounts[c];
+            U32 spots = lights._spotCounts[c];
+            // Past the capacity, point lights are kept over spot lights.
+            U32 room = m_maxIndexCount ? m_maxIndexCount - base : ~0u;
+            U32 keptPoints = clampCount(points, room);
+            room -= keptPoints;
+            U32 keptSpots = clampCount(spots, room);
+            m_stats._droppedIndices += (points - keptPoints) + (spots - keptSpots);
+
+            LightCluster& cluster = m_clusters[slice * kTileCount + c];
+            cluster._offset = base;
+            cluster._counts = keptPoints | (keptSpots << LIGHT_CLUSTER_COUNT_BITS);
+            if (keptPoints + keptSpots) m_stats._occupiedClusters += 1;
+            if (keptPoints + keptSpots > m_stats._maxClusterLights) m_stats._maxClusterLights = keptPoints + keptSpots;
+
+            const U32* pIndices = lights._indices.data() + lights._offsets[c];
+            m_indices.insert(m_indices.end(), pIndices, pIndices + keptPoints);
+            m_indices.insert(m_indices.end(), pIndices + points, pIndices + points + keptSpots);
+            for (U32 i = 0; i < keptPoints; ++i) pointSeen[pIndices[i]] = 1;
+            for (U32 i = 0; i < keptSpots; ++i) spotSeen[pIndices[points + i]] = 1;
+            base += keptPoints + keptSpots;
+        }
+    }
+    m_stats._indexCount = base;
+    for (U8 seen : pointSeen) m_stats._visiblePointLights += seen;
+    for (U8 seen : spotSeen) m_stats._visibleSpotLights += seen;
+}
+
+
+void LightClusters::assign(const Globals& globals, const LightSystem& lights, JobSystem* pJobs)
+{
+    m_stats = { };
+    m_indices.clear();
+    computeClusterBounds(globals);
+    prepareLights(globals, lights, pJobs);
+    binLights();
+
+    // Slices only write to their own lights.
+    auto assignSlices = [this] (U32 begin, U32 end) {
+        for (U32 slice = begin; slice < end; ++slice) {
+            assignSlice(slice);
+        }
+    };
+    if (pJobs) {
+        pJobs->parallelFor(LIGHT_CLUSTER_SLICES, 1, assignSlices);
+    } else {
+        assignSlices(0, LIGHT_CLUSTER_SLICES);
+    }
+    joinSlices();
+}
+
+
+void LightClusters::upload()
+{
+    if (!m_pClusterResource || !m_pIndexResource) return;
+    void* pClusters = m_pClusterResource->map(nullptr);
+    if (pClusters) {
+        memcpy(pClusters, m_clusters.data(), sizeof(LightCluster) * m_clusters.size());
+    }
+    m_pClusterResource->unmap(nullptr);
+    void* pIndices = m_pIndexResource->map(nullptr);
+    if (pIndices && !m_indices.empty()) {
+        memcpy(pIndices, m_indices.data(), sizeof(U32) * m_indices.size());
+    }
+    m_pIndexResource->unmap(nullptr);
+}
+} // Lights
+} // jcl
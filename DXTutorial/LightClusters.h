@@ -0,0 +1,167 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "BackendRenderer.h"
+#include "JobSystem.h"
+
+#include <vector>
+
+namespace jcl {
+namespace Lights {
+
+class LightSystem;
+
+
+// Lights of one froxel, as read by the lighting shader. Point light indices come first at
+// _offset, then spot light indices.
+struct LightCluster
+{
+    U32 _offset;
+    // Point light count in the low LIGHT_CLUSTER_COUNT_BITS, spot light count in the high.
+    U32 _counts;
+
+    U32 getPointCount() const { return _counts & ((1u << LIGHT_CLUSTER_COUNT_BITS) - 1u); }
+    U32 getSpotCount() const { return _counts >> LIGHT_CLUSTER_COUNT_BITS; }
+};
+
+
+struct LightClusterStats
+{
+    // Lights that touched at least one cluster.
+    U32 _visiblePointLights;
+    U32 _visibleSpotLights;
+    // Clusters with any light in them.
+    U32 _occupiedClusters;
+    // Light indices written, and the most any one cluster holds.
+    U32 _indexCount;
+    U32 _maxClusterLights;
+    // Indices past the index buffer capacity, the lights they would have added are not shaded.
+    U32 _droppedIndices;
+};
+
+
+/*
+    Light Clusters assign point and spot lights to a froxel grid: LIGHT_CLUSTER_TILES_X by
+    LIGHT_CLUSTER_TILES_Y tiles across the screen, LIGHT_CLUSTER_SLICES slices in view depth,
+    spaced exponentially between the near and far planes. Each light's bounding sphere is tested
+    against the view space bounds of the clusters it can reach, four tiles of a row at a time,
+    and spot lights are then tested as cones. Slices are assigned in parallel, and joined into
+    one compact list of clusters and light indices, so the lighting shader loops over the lights
+    of the pixel's cluster instead of every light in the scene.
+
+    Clusters are numbered (slice * LIGHT_CLUSTER_TILES_Y + tileY) * LIGHT_CLUSTER_TILES_X + tileX,
+    tile rows going down the screen. View space bounds use the depth in front of the camera, not z.
+*/
+class LightClusters
+{
+public:
+    static const U32 kTileCount = LIGHT_CLUSTER_TILES_X * LIGHT_CLUSTER_TILES_Y;
+    static const U32 kClusterCount = kTileCount * LIGHT_CLUSTER_SLICES;
+
+    LightClusters()
+        : m_pClusterResource(nullptr)
+        , m_pIndexResource(nullptr)
+        , m_pClustersSRV(nullptr)
+        , m_pIndicesSRV(nullptr)
+        , m_maxIndexCount(0)
+        , m_pointLightCount(0)
+        , m_spotLightCount(0)
+        , m_stats() { }
+
+    // Gpu buffers hold at most maxIndexCount light indices, 0 for no limit without a renderer.
+    // With no renderer, assign() still works, upload() does nothing.
+    void initialize(gfx::BackendRenderer* pRenderer, U32 maxIndexCount);
+
+    // Assign the visible lights of the last LightSystem::cull() to the clusters of the view in globals:
+    // _worldToView, _proj, _near and _far. Projection must be a perspectiveRH(). Light indices are
+    // those of the light system's buffers. With pJobs, slices are assigned in parallel on it.
+    void assign(const Globals& globals, const LightSystem& lights, JobSystem* pJobs = nullptr);
+    // Copy the last assignment to the gpu buffers.
+    void upload();
+
+    const LightCluster* getClusters() const { return m_clusters.data(); }
+    const U32* getLightIndices() const { return m_indices.data(); }
+    const LightClusterStats& getStats() const { return m_stats; }
+    // View space bounds of a cluster, from the last assign(), with z the depth in front of the camera.
+    void getClusterBounds(U32 cluster, Vector3* pMin, Vector3* pMax) const;
+
+    gfx::ShaderResourceView* getClustersSRV() const { return m_pClustersSRV; }
+    gfx::ShaderResourceView* getIndicesSRV() const { return m_pIndicesSRV; }
+
+private:
+    // Visible lights in view space, as streams.
+    struct LightStreams
+    {
+        // Index of each light in the light system.
+        std::vector<U32> _ids;
+        std::vector<R32> _x, _y, _depth, _radius;
+        // First and last slice the bounding sphere reaches, first > last when it is out of view.
+        std::vector<U32> _firstSlice, _lastSlice;
+    };
+    // Lights of one slice, by cluster of the slice. Kept between frames.
+    struct SliceLights
+    {
+        U32 _pointCounts[kTileCount];
+        U32 _spotCounts[kTileCount];
+        U32 _offsets[kTileCount];
+        // Lights whose bounding sphere reaches the slice.
+        std::vector<U32> _pointLights;
+        std::vector<U32> _spotLights;
+        // Cluster and light of each hit, in the order found: all point lights, then spot lights.
+        std::vector<U16> _hitClusters;
+        std::vector<U32> _hitLights;
+        // Hits sorted by cluster.
+        std::vector<U32> _indices;
+    };
+
+    void computeClusterBounds(const Globals& globals);
+    void prepareLights(const Globals& globals, const LightSystem& lights, JobSystem* pJobs);
+    static void resizeStreams(LightStreams& streams, U32 lightCount);
+    // Slices the sphere reaches.
+    void setSliceRange(LightStreams& streams, U32 light) const;
+    // Add each light to the slices it reaches.
+    void binLights();
+    void assignSlice(U32 slice);
+    // Test one light against the tiles of slice it can reach, appending hits.
+    void assignLight(U32 slice, const LightStreams& streams, U32 light, B32 isSpot, SliceLights& out) const;
+    B32 isConeInCluster(U32 spot, U32 slice, U32 tileX, U32 tileY) const;
+    void joinSlices();
+
+    gfx::Resource* m_pClusterResource;
+    gfx::Resource* m_pIndexResource;
+    gfx::ShaderResourceView* m_pClustersSRV;
+    gfx::ShaderResourceView* m_pIndicesSRV;
+    U32 m_maxIndexCount;
+
+    // Projection scale, view space to ndc at depth 1.
+    R32 m_projX;
+    R32 m_projY;
+    // Depth of each slice boundary, slice s spans [m_sliceDepths[s], m_sliceDepths[s + 1]].
+    R32 m_sliceDepths[LIGHT_CLUSTER_SLICES + 1];
+    // slice = log(depth) * m_sliceScale + m_sliceBias
+    R32 m_sliceScale;
+    R32 m_sliceBias;
+    // View space x bounds of each tile column, and y bounds of each tile row, by slice. Columns
+    // are padded to a multiple of the lane count.
+    std::vector<R32> m_columnMinX, m_columnMaxX;
+    std::vector<R32> m_rowMinY, m_rowMaxY;
+
+    // Bounding spheres of the point lights, and of the spot light cones.
+    LightStreams m_points;
+    LightStreams m_spots;
+    // Lights in the light system, visible or not.
+    U32 m_pointLightCount;
+    U32 m_spotLightCount;
+    // Spot light apex and axis in view space, and its cone.
+    std::vector<R32> m_spotApexX, m_spotApexY, m_spotApexDepth;
+    std::vector<R32> m_spotDirX, m_spotDirY, m_spotDirDepth;
+    std::vector<R32> m_spotRange, m_spotCos, m_spotSin;
+
+    std::vector<SliceLights> m_slices;
+    std::vector<LightCluster> m_clusters;
+    std::vector<U32> m_indices;
+    LightClusterStats m_stats;
+};
+} // Lights
+} // jcl
@@ -1,7 +1,16 @@
 //
 #include "LightRenderer.h"
+#include "LightClusters.h"
 #include "BackendRenderer.h"
 #include "ShadowRenderer.h"
+#include "PipelineCache.h"
+#include "UploadQueue.h"
+#include "Math/SIMD.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <string.h>
 
 namespace jcl {
 namespace Lights {
@@ -19,98 +28,435 @@ gfx::RootSignature* lightDeferredRootSignature = nullptr;
 LightSystem* pLightSystemUse = nullptr;
 gfx::DescriptorTable* lightDeferredDescriptorTable = nullptr;
 
+// Gpu layouts of the lights, see LightingEquations.hlsli.
+static const U32 kDirectionLightStride = 64;
+static const U32 kPointLightStride = 48;
+static const U32 kSpotLightStride = 64;
+static const U32 kLightTransformStride = 256;
+// Lights per job of a parallel cull.
+static const U32 kLightCullChunkSize = 1024;
+static const U32 kLaneCount = 4;
+
+const R32 LightSystem::kDefaultRadianceCutoff = 1.0f / 256.0f;
+
+
+static U32 padToLanes(U32 count)
+{
+    return (count + kLaneCount - 1) & ~(kLaneCount - 1);
+}
+
+
+LightSystem::LightSystem()
+    : m_pRenderer(nullptr)
+    , m_directionLightBuffer({ nullptr, nullptr, 0, kDirectionLightStride, TEXT("DirectionLightBuffer") })
+    , m_pointLightBuffer({ nullptr, nullptr, 0, kPointLightStride, TEXT("PointLightBuffer") })
+    , m_spotLightBuffer({ nullptr, nullptr, 0, kSpotLightStride, TEXT("SpotLightBuffer") })
+    , m_transformBuffer({ nullptr, nullptr, 0, kLightTransformStride, TEXT("LightTransforms") })
+    , m_viewsVersion(0)
+    , m_stats() { }
+
+
 void LightSystem::initialize(gfx::BackendRenderer* pRenderer, 
                             U32 directionLightCount, 
-                            U32 pointLightCount, 
-                            U32 spotLightCount)
-{
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-        int _3[4];
-    } DirLight;
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-        float _3[4];
-    } RSpotLight;
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-    } RPointLight;
-    pRenderer->createBuffer(&m_pDirectionLightResource, 
-                            gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                            gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                            sizeof(DirLight) * directionLightCount, 0, TEXT("DirectionLightBuffer"));
-    pRenderer->createBuffer(&m_pSpotLightResource, 
-                            gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                            gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                            sizeof(DirLight) * spotLightCount, 0, TEXT("SpotLightBuffer"));
-    pRenderer->createBuffer(&m_pPointLightResource, 
-                            gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                            gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                            sizeof(DirLight) * pointLightCount, 0, TEXT("PointLightBuffer"));
-    pRenderer->createBuffer(&m_lightTransformsResource,
-                            gfx::RESOURCE_USAGE_CPU_TO_GPU,
-                            gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                            256 * (directionLightCount + pointLightCount + spotLightCount), 
-                            0, TEXT("LightTransforms"));
+                            U32 pointLightCapacity, 
+                            U32 spotLightCapacity)
+{
+    m_pRenderer = pRenderer;
+    m_directionLights.resize(directionLightCount);
+    // Each direction light has a transform for every cascade its shadow may split into.
+    m_lightTransformations.resize(directionLightCount * Shadows::kMaxShadowCascades);
+    for (U32 i = 0; i < directionLightCount; ++i)
+        m_directionLights[i]._transform = i * Shadows::kMaxShadowCascades;
+
+    m_pointLights.reserve(pointLightCapacity);
+    m_pointHandles.reserve(pointLightCapacity);
+    m_pointIndices.reserve(pointLightCapacity);
+    m_spotLights.reserve(spotLightCapacity);
+    m_spotHandles.reserve(spotLightCapacity);
+    m_spotIndices.reserve(spotLightCapacity);
+
+    // Buffers are never empty, so their views always exist.
+    reserveBuffer(m_directionLightBuffer, directionLightCount ? directionLightCount : 1, 0);
+    reserveBuffer(m_pointLightBuffer, pointLightCapacity ? pointLightCapacity : 1, 0);
+    reserveBuffer(m_spotLightBuffer, spotLightCapacity ? spotLightCapacity : 1, 0);
+    reserveBuffer(m_transformBuffer, directionLightCount ? directionLightCount * Shadows::kMaxShadowCascades : 1, 0);
+}
+
+
+B32 LightSystem::reserveBuffer(LightBuffer& buffer, U32 count, U64 lastFrame)
+{
+    if (count <= buffer._capacity) return false;
+    // Grow geometrically, lights added one at a time shouldn't recreate the buffer each frame.
+    U32 capacity = buffer._capacity * 2 > count ? buffer._capacity * 2 : count;
+    buffer._capacity = capacity;
+    if (!m_pRenderer) return false;
+
+    gfx::Resource* pOld = buffer._pResource;
+    m_pRenderer->createBuffer(&buffer._pResource, 
+                              gfx::RESOURCE_USAGE_DEFAULT,
+                              gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                              buffer._stride * capacity, 0, buffer._debugName);
     gfx::ShaderResourceViewDesc srvDesc = { };
     srvDesc._dimension = gfx::SRV_DIMENSION_BUFFER;
     srvDesc._format = DXGI_FORMAT_UNKNOWN;
     srvDesc._buffer._firstElement = 0;
-    srvDesc._buffer._numElements = directionLightCount;
-    srvDesc._buffer._structureByteStride = sizeof(DirLight);
-    pRenderer->createShaderResourceView(&m_pDirectionLightsSRV, m_pDirectionLightResource, srvDesc);
-    srvDesc._buffer._numElements = pointLightCount;
-    srvDesc._buffer._structureByteStride = sizeof(RPointLight);
-    pRenderer->createShaderResourceView(&m_pPointLighstSRV, m_pPointLightResource, srvDesc);
-    srvDesc._buffer._numElements = spotLightCount;
-    srvDesc._buffer._structureByteStride = sizeof(RSpotLight);
-    pRenderer->createShaderResourceView(&m_pSpotLightsSRV, m_pSpotLightResource, srvDesc);
-    srvDesc._buffer._numElements = directionLightCount + pointLightCount + spotLightCount;
-    srvDesc._buffer._structureByteStride = 256;
-    pRenderer->createShaderResourceView(&m_pLightTransformSRV, m_lightTransformsResource, srvDesc);
+    srvDesc._buffer._numElements = capacity;
+    srvDesc._buffer._structureByteStride = buffer._stride;
+    m_pRenderer->createShaderResourceView(&buffer._pSRV, buffer._pResource, srvDesc);
+    if (pOld) {
+        // Frames still in flight may read the old buffer.
+        RetiredBuffer retired = { pOld, lastFrame };
+        m_retiredBuffers.push_back(retired);
+    }
+    // Whatever was staged for the old buffer is staged again, whole, for the new one.
+    buffer._staged.clear();
+    buffer._ranges.clear();
+    ++m_viewsVersion;
+    return true;
+}
 
-    m_directionLights.resize(directionLightCount);
-    m_pointLights.resize(pointLightCount);
-    m_spotLights.resize(spotLightCount);
-    m_lightTransformations.resize(directionLightCount + pointLightCount + spotLightCount);
 
-    U64 idx = 0;
-    for (U32 i = 0; i < directionLightCount; ++i)
-        m_directionLights[i]._transform = idx++;
-    for (U32 i = 0; i < pointLightCount; ++i)
-        m_pointLights[i]._transform = idx++;
-    for (U32 i = 0; i < spotLightCount; ++i)
-        m_spotLights[i]._transform = idx++;
+R32 LightSystem::computeInfluenceRange(const Vector4& radiance, R32 cutoff)
+{
+    // Falloff is radiance / (d^2 + 1), the window only brings it down sooner.
+    R32 peak = radiance._x > radiance._y ? radiance._x : radiance._y;
+    peak = peak > radiance._z ? peak : radiance._z;
+    R32 ratio = peak / cutoff;
+    return ratio > 1.0f ? sqrtf(ratio - 1.0f) : 0.0f;
+}
+
+
+void LightSystem::DirtyLights::mark(U32 idx)
+{
+    if (idx >= _flags.size()) _flags.resize(idx + 1, 0);
+    if (_flags[idx]) return;
+    _flags[idx] = 1;
+    _indices.push_back(idx);
+}
+
+
+U32 LightSystem::allocateTransform(const Light& light, U32 count)
+{
+    if (!light._shadow) return kNoLightTransform;
+    std::vector<U32>& freeTransforms = count > 1 ? m_freeFaceTransforms : m_freeTransforms;
+    if (!freeTransforms.empty()) {
+        U32 transform = freeTransforms.back();
+        freeTransforms.pop_back();
+        return transform;
+    }
+    m_lightTransformations.resize(m_lightTransformations.size() + count, LightTransform());
+    return static_cast<U32>(m_lightTransformations.size() - count);
 }
 
 
-void createRootDescriptor(gfx::BackendRenderer* pRenderer)
+void LightSystem::freeTransform(U32 transform, U32 count)
+{
+    if (transform == kNoLightTransform) return;
+    // No longer written, the lighting must not find a tile there.
+    for (U32 i = 0; i < count; ++i) {
+        m_lightTransformations[transform + i]._atlasRect = Vector4(0.0f, 0.0f, 0.0f, 0.0f);
+    }
+    (count > 1 ? m_freeFaceTransforms : m_freeTransforms).push_back(transform);
+}
+
+
+void LightSystem::setPointStreams(U32 idx)
+{
+    PointLightStreams& streams = m_pointStreams;
+    if (idx >= streams._x.size()) {
+        U32 size = padToLanes(idx + 1);
+        streams._x.resize(size, 0.0f);
+        streams._y.resize(size, 0.0f);
+        streams._z.resize(size, 0.0f);
+        streams._radius.resize(size, 0.0f);
+    }
+    const PointLight& light = m_pointLights[idx];
+    streams._x[idx] = light._position._x;
+    streams._y[idx] = light._position._y;
+    streams._z[idx] = light._position._z;
+    streams._radius[idx] = light._radius;
+    m_dirtyPoints.mark(idx);
+}
+
+
+void LightSystem::setSpotStreams(U32 idx)
+{
+    SpotLightStreams& streams = m_spotStreams;
+    if (idx >= streams._x.size()) {
+        U32 size = padToLanes(idx + 1);
+        std::vector<R32>* pStreams[] = { &streams._x, &streams._y, &streams._z, &streams._range,
+                                         &streams._dirX, &streams._dirY, &streams._dirZ,
+                                         &streams._cosOuter, &streams._sinOuter };
+        for (std::vector<R32>* pStream : pStreams) {
+            pStream->resize(size, 0.0f);
+        }
+    }
+    const SpotLight& light = m_spotLights[idx];
+    streams._x[idx] = light._position._x;
+    streams._y[idx] = light._position._y;
+    streams._z[idx] = light._position._z;
+    streams._range[idx] = light._range;
+    streams._dirX[idx] = light._direction._x;
+    streams._dirY[idx] = light._direction._y;
+    streams._dirZ[idx] = light._direction._z;
+    streams._cosOuter[idx] = cosf(light._outer);
+    streams._sinOuter[idx] = sinf(light._outer);
+    m_dirtySpots.mark(idx);
+}
+
+
+LightHandle LightSystem::addPointLight(const PointLight& light)
+{
+    U32 idx = static_cast<U32>(m_pointLights.size());
+    LightHandle handle = m_pointIndices.insert(idx);
+    m_pointLights.push_back(light);
+    m_pointHandles.push_back(handle);
+    PointLight& added = m_pointLights.back();
+    if (added._radius <= 0.0f) added._radius = computeInfluenceRange(added._radiance);
+    added._transform = allocateTransform(added, Shadows::kShadowCubeFaces);
+    setPointStreams(idx);
+    return handle;
+}
+
+
+LightHandle LightSystem::addSpotLight(const SpotLight& light)
+{
+    U32 idx = static_cast<U32>(m_spotLights.size());
+    LightHandle handle = m_spotIndices.insert(idx);
+    m_spotLights.push_back(light);
+    m_spotHandles.push_back(handle);
+    SpotLight& added = m_spotLights.back();
+    if (added._range <= 0.0f) added._range = computeInfluenceRange(added._radiance);
+    added._direction = added._direction.normalize();
+    added._transform = allocateTransform(added, 1);
+    setSpotStreams(idx);
+    return handle;
+}
+
+
+B32 LightSystem::removePointLight(LightHandle handle)
+{
+    U32* pIdx = m_pointIndices.find(handle);
+    if (!pIdx) return false;
+    U32 idx = *pIdx;
+    U32 last = static_cast<U32>(m_pointLights.size() - 1);
+    freeTransform(m_pointLights[idx]._transform, Shadows::kShadowCubeFaces);
+    if (idx != last) {
+        m_pointLights[idx] = m_pointLights[last];
+        m_pointHandles[idx] = m_pointHandles[last];
+        *m_pointIndices.find(m_pointHandles[idx]) = idx;
+        setPointStreams(idx);
+    }
+    m_pointLights.pop_back();
+    m_pointHandles.pop_back();
+    m_pointIndices.erase(handle);
+    return true;
+}
+
+
+B32 LightSystem::removeSpotLight(LightHandle handle)
+{
+    U32* pIdx = m_spotIndices.find(handle);
+    if (!pIdx) return false;
+    U32 idx = *pIdx;
+    U32 last = static_cast<U32>(m_spotLights.size() - 1);
+    freeTransform(m_spotLights[idx]._transform, 1);
+    if (idx != last) {
+        m_spotLights[idx] = m_spotLights[last];
+        m_spotHandles[idx] = m_spotHandles[last];
+        *m_spotIndices.find(m_spotHandles[idx]) = idx;
+        setSpotStreams(idx);
+    }
+    m_spotLights.pop_back();
+    m_spotHandles.pop_back();
+    m_spotIndices.erase(handle);
+    return true;
+}
+
+
+B32 LightSystem::setPointLight(LightHandle handle, const PointLight& light)
+{
+    U32* pIdx = m_pointIndices.find(handle);
+    if (!pIdx) return false;
+    PointLight& current = m_pointLights[*pIdx];
+    U32 transform = current._transform;
+    current = light;
+    if (current._radius <= 0.0f) current._radius = computeInfluenceRange(current._radiance);
+    // Shadows coming and going take and give back a transform.
+    if ((transform != kNoLightTransform) != (light._shadow != nullptr)) {
+        freeTransform(transform, Shadows::kShadowCubeFaces);
+        transform = allocateTransform(current, Shadows::kShadowCubeFaces);
+    }
+    current._transform = transform;
+    setPointStreams(*pIdx);
+    return true;
+}
+
+
+B32 LightSystem::setSpotLight(LightHandle handle, const SpotLight& light)
+{
+    U32* pIdx = m_spotIndices.find(handle);
+    if (!pIdx) return false;
+    SpotLight& current = m_spotLights[*pIdx];
+    U32 transform = current._transform;
+    current = light;
+    if (current._range <= 0.0f) current._range = computeInfluenceRange(current._radiance);
+    current._direction = current._direction.normalize();
+    if ((transform != kNoLightTransform) != (light._shadow != nullptr)) {
+        freeTransform(transform, 1);
+        transform = allocateTransform(current, 1);
+    }
+    current._transform = transform;
+    setSpotStreams(*pIdx);
+    return true;
+}
+
+
+B32 LightSystem::movePointLight(LightHandle handle, const Vector3& position)
+{
+    U32* pIdx = m_pointIndices.find(handle);
+    if (!pIdx) return false;
+    U32 idx = *pIdx;
+    m_pointLights[idx]._position = position;
+    m_pointStreams._x[idx] = position._x;
+    m_pointStreams._y[idx] = position._y;
+    m_pointStreams._z[idx] = position._z;
+    m_dirtyPoints.mark(idx);
+    return true;
+}
+
+
+B32 LightSystem::moveSpotLight(LightHandle handle, const Vector3& position, const Vector3& direction)
+{
+    U32* pIdx = m_spotIndices.find(handle);
+    if (!pIdx) return false;
+    U32 idx = *pIdx;
+    Vector3 axis = direction.normalize();
+    m_spotLights[idx]._position = position;
+    m_spotLights[idx]._direction = axis;
+    m_spotStreams._x[idx] = position._x;
+    m_spotStreams._y[idx] = position._y;
+    m_spotStreams._z[idx] = position._z;
+    m_spotStreams._dirX[idx] = axis._x;
+    m_spotStreams._dirY[idx] = axis._y;
+    m_spotStreams._dirZ[idx] = axis._z;
+    m_dirtySpots.mark(idx);
+    return true;
+}
+
+
+const PointLight* LightSystem::findPointLight(LightHandle handle) const
+{
+    const U32* pIdx = m_pointIndices.find(handle);
+    return pIdx ? &m_pointLights[*pIdx] : nullptr;
+}
+
+
+const SpotLight* LightSystem::findSpotLight(LightHandle handle) const
+{
+    const U32* pIdx = m_spotIndices.find(handle);
+    return pIdx ? &m_spotLights[*pIdx] : nullptr;
+}
+
+
+void LightSystem::cullRange(const Plane* pPlanes,
+                            U32 planeCount,
+                            const R32* pX,
+                            const R32* pY,
+                            const R32* pZ,
+                            const R32* pRadius,
+                            U32 begin,
+                            U32 end,
+                            std::vector<U32>& visible)
+{
+    using namespace m::simd;
+
+    for (U32 base = begin; base < end; base += kLaneCount) {
+        F4 x = load(pX + base);
+        F4 y = load(pY + base);
+        F4 z = load(pZ + base);
+        F4 radius = load(pRadius + base);
+
+        // Sphere is outside when its center is further than its radius behind any plane.
+        F4 closest = splat(FLT_MAX);
+        for (U32 p = 0; p < planeCount; ++p) {
+            const Plane& plane = pPlanes[p];
+            F4 dist = madd(splat(plane._a), x, madd(splat(plane._b), y, madd(splat(plane._c), z, splat(plane._d))));
+            closest = min(closest, add(dist, radius));
+        }
+
+        R32 result[kLaneCount];
+        store(result, closest);
+        U32 lanes = (end - base) < kLaneCount ? (end - base) : kLaneCount;
+        for (U32 lane = 0; lane < lanes; ++lane) {
+            if (result[lane] >= 0.0f) visible.push_back(base + lane);
+        }
+    }
+}
+
+
+void LightSystem::cullLights(const Plane* pPlanes,
+                             U32 planeCount,
+                             const R32* pX,
+                             const R32* pY,
+                             const R32* pZ,
+                             const R32* pRadius,
+                             U32 count,
+                             std::vector<U32>& visible,
+                             JobSystem* pJobs)
+{
+    visible.clear();
+    U32 chunkCount = (count + kLightCullChunkSize - 1) / kLightCullChunkSize;
+    if (!pJobs || pJobs->getWorkerCount() == 0 || chunkCount < 2) {
+        cullRange(pPlanes, planeCount, pX, pY, pZ, pRadius, 0, count, visible);
+        return;
+    }
+    if (m_cullChunks.size() < chunkCount) m_cullChunks.resize(chunkCount);
+    pJobs->parallelFor(chunkCount, 1, [&] (U32 begin, U32 end) {
+        for (U32 chunk = begin; chunk < end; ++chunk) {
+            std::vector<U32>& out = m_cullChunks[chunk];
+            out.clear();
+            U32 first = chunk * kLightCullChunkSize;
+            U32 last = first + kLightCullChunkSize < count ? first + kLightCullChunkSize : count;
+            cullRange(pPlanes, planeCount, pX, pY, pZ, pRadius, first, last, out);
+        }
+    });
+    for (U32 chunk = 0; chunk < chunkCount; ++chunk) {
+        visible.insert(visible.end(), m_cullChunks[chunk].begin(), m_cullChunks[chunk].end());
+    }
+}
+
+
+void LightSystem::cull(const Plane* pPlanes, U32 planeCount, JobSystem* pJobs)
+{
+    cullLights(pPlanes, planeCount, m_pointStreams._x.data(), m_pointStreams._y.data(), m_pointStreams._z.data(),
+               m_pointStreams._radius.data(), getPointLightCount(), m_visiblePointLights, pJobs);
+    cullLights(pPlanes, planeCount, m_spotStreams._x.data(), m_spotStreams._y.data(), m_spotStreams._z.data(),
+               m_spotStreams._range.data(), getSpotLightCount(), m_visibleSpotLights, pJobs);
+    m_stats._visiblePointLights = static_cast<U32>(m_visiblePointLights.size());
+    m_stats._visibleSpotLights = static_cast<U32>(m_visibleSpotLights.size());
+}
+
+
+void createRootDescriptor(PipelineCache* pPipelineCache)
 {
     gfx::PipelineLayout layouts[1];
     layouts[0] = { };
     layouts[0]._type = gfx::PIPELINE_LAYOUT_TYPE_DESCRIPTOR_TABLE; 
-    layouts[0]._numShaderResourceViews = 13;
+    layouts[0]._numShaderResourceViews = 15;
     layouts[0]._numUnorderedAcessViews = 1;
     layouts[0]._numConstantBuffers = 1;
-    pRenderer->createRootSignature(&lightDeferredRootSignature);
-    lightDeferredRootSignature->initialize(gfx::SHADER_VISIBILITY_ALL,
-                                           layouts, 1);
+    lightDeferredRootSignature = pPipelineCache->getRootSignature(gfx::SHADER_VISIBILITY_ALL, layouts, 1);
 }
 
 
-void createComputePipeline(gfx::BackendRenderer* pRenderer)
+void createComputePipeline(PipelineCache* pPipelineCache)
 {
     gfx::ComputePipelineInfo info = { };
     info._computeShader._pByteCode = new U8[5 * 1024 * 1024];
     info._pRootSignature = lightDeferredRootSignature;
     retrieveShader("ComputeLighting.cs.cso", &info._computeShader._pByteCode, info._computeShader._szBytes);
-    pRenderer->createComputePipelineState(&lightDeferredPipeline, &info);
+    lightDeferredPipeline = pPipelineCache->getComputePipeline(info);
     delete[] info._computeShader._pByteCode;
 }
 
@@ -123,11 +469,11 @@ gfx::ShaderResourceView* getLightOutputSRV()
 void createDescriptorTables(gfx::BackendRenderer* pRenderer)
 {
     pRenderer->createDescriptorTable(&lightDeferredDescriptorTable);
-    lightDeferredDescriptorTable->initialize(gfx::DescriptorTable::DESCRIPTOR_TABLE_SRV_UAV_CBV, 15);
+    lightDeferredDescriptorTable->initialize(gfx::DescriptorTable::DESCRIPTOR_TABLE_SRV_UAV_CBV, 17);
 }
 
 
-void initializeLights(gfx::BackendRenderer* pRenderer)
+void initializeLights(gfx::BackendRenderer* pRenderer, PipelineCache* pPipelineCache)
 {
     pRenderer->createTexture(&lightOutputResource,
                              gfx::RESOURCE_DIMENSION_2D,
@@ -160,8 +506,8 @@ void initializeLights(gfx::BackendRenderer* pRenderer)
     pRenderer->createUnorderedAccessView(&lightOutputUAV, 
                                          lightOutputResource, 
                                          uavDesc);
-    createRootDescriptor(pRenderer);
-    createComputePipeline(pRenderer);
+    createRootDescriptor(pPipelineCache);
+    createComputePipeline(pPipelineCache);
     createDescriptorTables(pRenderer);
 }
 
@@ -173,26 +519,33 @@ void updateLightRenderer
         // Deferred GBuffer descriptor table.
         GBuffer* gpass,
         // Light system to use.
-        LightSystem* pLightSystem
+        LightSystem* pLightSystem,
+        // Point and spot lights of each cluster.
+        LightClusters* pLightClusters,
+        // Scene depth, read to place each pixel in the world.
+        gfx::ShaderResourceView* pDepthSRV
     )
 {
-    gfx::ShaderResourceView* pointLightSRV = getPointLightsSRV(pLightSystem);
-    gfx::ShaderResourceView* spotLightSRV = getSpotLightsSRV(pLightSystem);
-    gfx::ShaderResourceView* directionLightSRV = getDirectionLightsSRV(pLightSystem);
+    // In register order, see ComputeLighting.cs.hlsl.
     gfx::ShaderResourceView* srvs[] = { 
         gpass->pAlbedoSRV,
         gpass->pNormalSRV,
         gpass->pMaterialSRV,
         gpass->pEmissiveSRV,
-        // Missing Light Transformations!
-        pointLightSRV, 
-        spotLightSRV, 
-        directionLightSRV
-        // Missing Shadows!
+        getDirectionLightsSRV(pLightSystem),
+        getPointLightsSRV(pLightSystem), 
+        getSpotLightsSRV(pLightSystem), 
+        getLightTransformsSRV(pLightSystem),
+        pLightClusters->getClustersSRV(),
+        pLightClusters->getIndicesSRV(),
+        pDepthSRV,
+        // The sun's resolve isn't drawn yet, its slot holds the atlas to keep the registers in order.
+        Shadows::getShadowAtlasSRV(),
+        Shadows::getShadowAtlasSRV()
     };
     lightDeferredDescriptorTable->setConstantBuffers(&pGlobalConstBuffer, 1);
     lightDeferredDescriptorTable->setUnorderedAccessViews(&lightOutputUAV, 1);
-    lightDeferredDescriptorTable->setShaderResourceViews(srvs, 4);
+    lightDeferredDescriptorTable->setShaderResourceViews(srvs, sizeof(srvs) / sizeof(srvs[0]));
     lightDeferredDescriptorTable->update(gfx::DESCRIPTOR_TABLE_FLAG_RESET);
 }
 
@@ -214,109 +567,221 @@ void generateDeferredLightsCommands
 
 gfx::ShaderResourceView* getPointLightsSRV(LightSystem* pLightSystem)
 {
-    return pLightSystem->m_pPointLighstSRV;
+    return pLightSystem->m_pointLightBuffer._pSRV;
 }
 
 
 gfx::ShaderResourceView* getSpotLightsSRV(LightSystem* pLightSystem)
 {
-    return pLightSystem->m_pSpotLightsSRV;
+    return pLightSystem->m_spotLightBuffer._pSRV;
 }
 
 
 gfx::ShaderResourceView* getDirectionLightsSRV(LightSystem* pLightSystem)
 {
-    return pLightSystem->m_pDirectionLightsSRV;
+    return pLightSystem->m_directionLightBuffer._pSRV;
+}
+
+
+gfx::ShaderResourceView* getLightTransformsSRV(LightSystem* pLightSystem)
+{
+    return pLightSystem->m_transformBuffer._pSRV;
+}
+
+
+template<typename WriteFn>
+void LightSystem::stageDirty(LightBuffer& buffer, DirtyLights& dirty, U32 count, WriteFn write)
+{
+    // Lights past the buffer go in whole once reserveBuffers() creates it again.
+    ASSERT(!buffer._pResource || count <= buffer._capacity);
+    count = count < buffer._capacity ? count : buffer._capacity;
+    // Lights removed since, past the end, have nothing to write.
+    std::vector<U32>& indices = dirty._indices;
+    for (U32 idx : indices) dirty._flags[idx] = 0;
+    indices.erase(std::remove_if(indices.begin(), indices.end(), [count] (U32 idx) { return idx >= count; }), 
+                  indices.end());
+    if (indices.empty() || !buffer._pResource) {
+        indices.clear();
+        return;
+    }
+    std::sort(indices.begin(), indices.end());
+
+    for (size_t i = 0; i < indices.size(); ) {
+        size_t end = i + 1;
+        while (end < indices.size() && indices[end] == indices[end - 1] + 1) ++end;
+        U8* pData = buffer.stage(indices[i], static_cast<U32>(end - i));
+        for (size_t j = i; j < end; ++j) {
+            write(pData + (j - i) * buffer._stride, indices[j]);
+        }
+        m_stats._uploadedRanges += 1;
+        i = end;
+    }
+    m_stats._uploadedLights += static_cast<U32>(indices.size());
+    indices.clear();
+}
+
+
+U8* LightSystem::LightBuffer::stage(U32 idx, U32 count)
+{
+    StagedRange range = { static_cast<U64>(idx) * _stride, _staged.size(), static_cast<U64>(count) * _stride };
+    _ranges.push_back(range);
+    _staged.resize(_staged.size() + range._sz);
+    return _staged.data() + range._srcOffset;
+}
+
+
+void LightSystem::upload(UploadQueue* pQueue)
+{
+    LightBuffer* buffers[] = { &m_directionLightBuffer, &m_pointLightBuffer, &m_spotLightBuffer, &m_transformBuffer };
+    for (LightBuffer* pBuffer : buffers) {
+        for (const StagedRange& range : pBuffer->_ranges) {
+            pQueue->uploadBuffer(pBuffer->_pResource, 
+                                 range._dstOffset, 
+                                 pBuffer->_staged.data() + range._srcOffset, 
+                                 range._sz);
+        }
+        pBuffer->_staged.clear();
+        pBuffer->_ranges.clear();
+    }
 }
 
 
-void LightSystem::mapLightSystem(void** dirPtr, void** pointPtr, void** spotPtr, void** transformPtr)
+void LightSystem::reserveBuffers(U64 frameNumber, U32 framesInFlight)
 {
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-        int _3[4];
-    } DirLight;
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-        float _3[4];
-    } RSpotLight;
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-    } RPointLight;
+    U32 kept = 0;
+    for (U32 i = 0; i < m_retiredBuffers.size(); ++i) {
+        if (m_retiredBuffers[i]._lastFrame <= frameNumber) {
+            m_pRenderer->destroyResource(m_retiredBuffers[i]._pResource);
+        } else {
+            m_retiredBuffers[kept++] = m_retiredBuffers[i];
+        }
+    }
+    m_retiredBuffers.resize(kept);
 
-    
-    *dirPtr = m_pDirectionLightResource->map(nullptr);
-    *pointPtr = m_pPointLightResource->map(nullptr);
-    *spotPtr = m_pSpotLightResource->map(nullptr);
-    *transformPtr = m_lightTransformsResource->map(nullptr);
+    // Buffers created again start empty, every light goes in.
+    U64 lastFrame = frameNumber + framesInFlight;
+    if (reserveBuffer(m_pointLightBuffer, getPointLightCount(), lastFrame)) {
+        for (U32 i = 0; i < getPointLightCount(); ++i) m_dirtyPoints.mark(i);
+    }
+    if (reserveBuffer(m_spotLightBuffer, getSpotLightCount(), lastFrame)) {
+        for (U32 i = 0; i < getSpotLightCount(); ++i) m_dirtySpots.mark(i);
+    }
+    reserveBuffer(m_transformBuffer, static_cast<U32>(m_lightTransformations.size()), lastFrame);
 }
 
 
-void LightSystem::unmapLightSystem()
+void LightSystem::cleanUp()
 {
-    m_pDirectionLightResource->unmap(nullptr);
-    m_pSpotLightResource->unmap(nullptr);
-    m_pPointLightResource->unmap(nullptr);
+    if (!m_pRenderer) return;
+    for (const RetiredBuffer& retired : m_retiredBuffers) {
+        m_pRenderer->destroyResource(retired._pResource);
+    }
+    m_retiredBuffers.clear();
+    LightBuffer* buffers[] = { &m_directionLightBuffer, &m_pointLightBuffer, &m_spotLightBuffer, &m_transformBuffer };
+    for (LightBuffer* pBuffer : buffers) {
+        if (pBuffer->_pResource) m_pRenderer->destroyResource(pBuffer->_pResource);
+        pBuffer->_pResource = nullptr;
+        pBuffer->_pSRV = nullptr;
+        pBuffer->_capacity = 0;
+        pBuffer->_staged.clear();
+        pBuffer->_ranges.clear();
+    }
 }
 
 
 void LightSystem::update()
 { 
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-        int _3[4];
-    } DirLight;
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-        float _3[4];
-    } RSpotLight;
-    struct {
-        float _0[4];
-        float _1[4];
-        float _2[4];
-    } RPointLight;
-
-    void* dirPtr = nullptr;
-    void* pointPtr = nullptr;
-    void* spotDir = nullptr;
-    void* transformPtr = nullptr; 
-    mapLightSystem(&dirPtr, &pointPtr, &spotDir, &transformPtr);
-
-    for (U32 i = 0; i < m_directionLights.size(); ++i) {
-        *(R32*)((U8*)dirPtr + sizeof(DirLight) * i) = m_directionLights[i]._direction[0]; 
-        *(R32*)((U8*)dirPtr + sizeof(DirLight) * i + 32) = m_directionLights[i]._direction[1];
-        *(R32*)((U8*)dirPtr + sizeof(DirLight) * i + 64) = m_directionLights[i]._direction[2];
-        *(R32*)((U8*)dirPtr + sizeof(DirLight) * i + 96) = 1.0f;
+    m_stats._uploadedLights = 0;
+    m_stats._uploadedRanges = 0;
+
+    // Keep in sync with PointLight in LightingEquations.hlsli.
+    stageDirty(m_pointLightBuffer, m_dirtyPoints, getPointLightCount(), [this] (U8* pDst, U32 idx) {
+        const PointLight& light = m_pointLights[idx];
+        R32* pLight = reinterpret_cast<R32*>(pDst);
+        pLight[0] = light._position._x;
+        pLight[1] = light._position._y;
+        pLight[2] = light._position._z;
+        pLight[3] = 1.0f;
+        pLight[4] = light._radiance._x;
+        pLight[5] = light._radiance._y;
+        pLight[6] = light._radiance._z;
+        pLight[7] = light._radius;
+        I32* pIndices = reinterpret_cast<I32*>(pLight + 8);
+        pIndices[0] = light._shadow ? (I32)light._shadow->getShadowIndex() : -1;
+        pIndices[1] = (I32)light._transform;
+        pIndices[2] = 0;
+        pIndices[3] = 0;
+    });
+
+    // Keep in sync with SpotLight in LightingEquations.hlsli.
+    stageDirty(m_spotLightBuffer, m_dirtySpots, getSpotLightCount(), [this] (U8* pDst, U32 idx) {
+        const SpotLight& light = m_spotLights[idx];
+        R32* pLight = reinterpret_cast<R32*>(pDst);
+        pLight[0] = light._position._x;
+        pLight[1] = light._position._y;
+        pLight[2] = light._position._z;
+        pLight[3] = 1.0f;
+        pLight[4] = light._radiance._x;
+        pLight[5] = light._radiance._y;
+        pLight[6] = light._radiance._z;
+        pLight[7] = light._radiance._w;
+        pLight[8] = light._direction._x;
+        pLight[9] = light._direction._y;
+        pLight[10] = light._direction._z;
+        pLight[11] = light._range;
+        pLight[12] = cosf(light._inner);
+        pLight[13] = m_spotStreams._cosOuter[idx];
+        I32* pIndices = reinterpret_cast<I32*>(pLight + 14);
+        pIndices[0] = light._shadow ? (I32)light._shadow->getShadowIndex() : -1;
+        pIndices[1] = (I32)light._transform;
+    });
+
+    if (!m_pRenderer) return;
+
+    // Direction lights and transforms are few, and move with the camera, so they are staged whole every
+    // frame. A frame not yet uploaded is replaced.
+    m_directionLightBuffer._staged.clear();
+    m_directionLightBuffer._ranges.clear();
+    U32 directionCount = static_cast<U32>(m_directionLights.size());
+    directionCount = directionCount < m_directionLightBuffer._capacity ? directionCount : m_directionLightBuffer._capacity;
+    // Keep in sync with DirectionLight in LightingEquations.hlsli.
+    U8* pDirections = directionCount ? m_directionLightBuffer.stage(0, directionCount) : nullptr;
+    for (U32 i = 0; i < directionCount; ++i) {
+        DirectionLight& light = m_directionLights[i];
+        R32* pLight = (R32*)(pDirections + kDirectionLightStride * i);
+        pLight[0] = light._position._x;
+        pLight[1] = light._position._y;
+        pLight[2] = light._position._z;
+        pLight[3] = 1.0f;
+        pLight[4] = light._direction._x;
+        pLight[5] = light._direction._y;
+        pLight[6] = light._direction._z;
+        pLight[7] = 0.0f;
+        pLight[8] = light._radiance._x;
+        pLight[9] = light._radiance._y;
+        pLight[10] = light._radiance._z;
+        pLight[11] = light._radiance._w;
+        I32* pIndices = (I32*)(pLight + 12);
+        pIndices[0] = light._shadow ? (I32)light._shadow->getShadowIndex() : -1;
+        pIndices[1] = (I32)light._transform;
+        pIndices[2] = light._shadow ? (I32)light._shadow->getCascadeCount() : 0;
+        pIndices[3] = 0;
     }
 
-    U32 idx = 0;
-    for (U32 i = 0; i < m_directionLights.size() + m_spotLights.size() + m_pointLights.size(); ++i) {
-        struct TransformGPU {
-            Matrix44 _viewToClip;
-            Matrix44 _clipToView;
-        };
-        TransformGPU* t = (TransformGPU*)((U8*)transformPtr + 256 * i);
-        t->_clipToView = m_lightTransformations[idx]._clipToView;
-        t->_viewToClip = m_lightTransformations[idx++]._viewToClip;
+    m_transformBuffer._staged.clear();
+    m_transformBuffer._ranges.clear();
+    U32 transformCount = static_cast<U32>(m_lightTransformations.size());
+    transformCount = transformCount < m_transformBuffer._capacity ? transformCount : m_transformBuffer._capacity;
+    U8* pTransforms = transformCount ? m_transformBuffer.stage(0, transformCount) : nullptr;
+    for (U32 i = 0; i < transformCount; ++i) {
+        memcpy(pTransforms + kLightTransformStride * i, &m_lightTransformations[i], sizeof(LightTransform));
     }
-    
-    unmapLightSystem();
 }
 
 
 gfx::Resource* getLightTransforms(LightSystem* system)
 {
-    return system->m_lightTransformsResource;
+    return system->m_transformBuffer._pResource;
 }
 } // Lights
 } // jcl
\ No newline at end of file
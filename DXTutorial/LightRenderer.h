@@ -2,16 +2,29 @@
 
 #include "BackendRenderer.h"
 #include "ShadowRenderer.h"
+#include "JobSystem.h"
+#include "SlotMap.h"
+
+#include <vector>
 
 using namespace m;
 
 namespace jcl {
+
+class PipelineCache;
+class UploadQueue;
+
 namespace Lights {
 
+class LightClusters;
+
 struct LightTransform
 {
     Matrix44 _viewToClip;
     Matrix44 _clipToView;
+    // Tile of the shadow atlas the view is rendered to, uv scale in xy and offset in zw. Zero if
+    // the view has no tile, and is unshadowed.
+    Vector4 _atlasRect;
 };
 
 struct Light
@@ -20,9 +33,14 @@ struct Light
     Vector4 _radiance;
     // Shadow info, otherwise this is left null.
     Shadows::LightShadow* _shadow;
+    // Index of the light's transform, kNoLightTransform for point and spot lights without a shadow.
+    // Direction lights have kMaxShadowCascades of them from there, one for each cascade, and
+    // point lights kShadowCubeFaces, one for each face.
     U32 _transform;
 };
 
+static const U32 kNoLightTransform = 0xffffffffu;
+
 
 struct DirectionLight : public Light 
 {
@@ -32,6 +50,7 @@ struct DirectionLight : public Light
 
 struct PointLight : public Light 
 {
+    // Distance the light reaches. 0 computes it from the radiance when added.
     R32 _radius;
 };
 
@@ -39,53 +58,228 @@ struct PointLight : public Light
 struct SpotLight : public Light
 {
     Vector3 _direction;
+    // Half angles of the cone, in radians, full intensity inside _inner, none outside _outer.
     R32 _inner;
     R32 _outer;
+    // Distance from the apex the light reaches. 0 computes it from the radiance when added.
+    R32 _range;
+};
+
+
+// Handle to a point or spot light of a LightSystem, valid until the light is removed.
+typedef SlotMap<U32>::Handle LightHandle;
+
+
+// Point lights as culled and clustered every frame, by index in the gpu buffer.
+// Streams are padded to a multiple of 4 lights.
+struct PointLightStreams
+{
+    std::vector<R32> _x, _y, _z, _radius;
+};
+
+
+struct SpotLightStreams
+{
+    // Apex, and the distance the light reaches from it.
+    std::vector<R32> _x, _y, _z, _range;
+    // Unit axis of the cone.
+    std::vector<R32> _dirX, _dirY, _dirZ;
+    // Outer half angle of the cone.
+    std::vector<R32> _cosOuter, _sinOuter;
+};
+
+
+struct LightSystemStats
+{
+    // Lights that passed the last cull.
+    U32 _visiblePointLights;
+    U32 _visibleSpotLights;
+    // Lights written to the gpu by the last update, and the runs of the buffers they took.
+    U32 _uploadedLights;
+    U32 _uploadedRanges;
 };
 
 
+/*
+    Light System stores the scene's lights, and their gpu buffers. Point and spot lights are
+    added and removed at any time, through handles that stay valid until removed. They are kept
+    dense, the last light moving into the hole a removal leaves, with the data culled and
+    clustered every frame split into streams, and the rest kept by light. Lights are only
+    written to the gpu when they change, in as few runs of the buffers as they take, and the
+    buffers grow as lights are added. Direction lights are a fixed set, read back and written
+    every frame.
+
+    Lights change between frames only, never while a renderer updates them. Buffers are grown by
+    reserveBuffers() on the render thread, update() only writes into them and may run on a job.
+*/
 class LightSystem
 {
 public:
+    // Cutoff of the light radiance where the influence range ends, if not given.
+    static const R32 kDefaultRadianceCutoff;
 
+    LightSystem();
+
+    // Buffers start with room for the given point and spot light counts. With no renderer,
+    // lights can still be added, culled and clustered, update() only forgets the changes.
     void initialize(gfx::BackendRenderer* pRenderer, 
                     U32 directionLightCount, 
-                    U32 pointLightCount, 
-                    U32 spotLightCount);
+                    U32 pointLightCapacity = 0, 
+                    U32 spotLightCapacity = 0);
 
     DirectionLight* getDirectionLight(U32 idx) { return &m_directionLights[idx]; }
-    PointLight* getPointLight(U32 idx) { return &m_pointLights[idx]; }
-    SpotLight* getSpotLight(U32 idx) { return &m_spotLights[idx]; }
+    U32 getDirectionLightCount() const { return static_cast<U32>(m_directionLights.size()); }
+
+    LightHandle addPointLight(const PointLight& light);
+    LightHandle addSpotLight(const SpotLight& light);
+    // Returns false if the handle is stale.
+    B32 removePointLight(LightHandle handle);
+    B32 removeSpotLight(LightHandle handle);
+    // Change every parameter of a light, its range is computed again if 0.
+    B32 setPointLight(LightHandle handle, const PointLight& light);
+    B32 setSpotLight(LightHandle handle, const SpotLight& light);
+    // Move a light, keeping the rest.
+    B32 movePointLight(LightHandle handle, const Vector3& position);
+    B32 moveSpotLight(LightHandle handle, const Vector3& position, const Vector3& direction);
+    // Null if the handle is stale.
+    const PointLight* findPointLight(LightHandle handle) const;
+    const SpotLight* findSpotLight(LightHandle handle) const;
+    // Lights by index in the gpu buffers, as culled.
+    const PointLight& getPointLight(U32 idx) const { return m_pointLights[idx]; }
+    const SpotLight& getSpotLight(U32 idx) const { return m_spotLights[idx]; }
+
+    U32 getPointLightCount() const { return static_cast<U32>(m_pointLights.size()); }
+    U32 getSpotLightCount() const { return static_cast<U32>(m_spotLights.size()); }
+    const PointLightStreams& getPointLightStreams() const { return m_pointStreams; }
+    const SpotLightStreams& getSpotLightStreams() const { return m_spotStreams; }
+
+    // Cull point and spot lights by the sphere they reach, against planeCount planes with normals
+    // facing inwards. With pJobs, chunks of lights are culled in parallel on it.
+    void cull(const Plane* pPlanes, U32 planeCount, JobSystem* pJobs = nullptr);
+    // Lights of the last cull, by index in the gpu buffers, in order.
+    const std::vector<U32>& getVisiblePointLights() const { return m_visiblePointLights; }
+    const std::vector<U32>& getVisibleSpotLights() const { return m_visibleSpotLights; }
     
     LightTransform* getTransform(U32 idxFromLight) { return &m_lightTransformations[idxFromLight]; }
+    // Grow the gpu buffers to fit the lights, ahead of update(). Creates resources, so only on the
+    // render thread. Outgrown buffers are destroyed once the framesInFlight after frameNumber are done.
+    void reserveBuffers(U64 frameNumber, U32 framesInFlight);
+    // Stage direction lights, transforms, and the point and spot lights changed since the last update.
+    // Lights past what reserveBuffers() made room for wait for it.
     void update();
+    // Copy what update() staged into the gpu buffers, on the render thread once update() is done.
+    // The copies go on the queue the frames render on, after the frames still reading the buffers.
+    void upload(UploadQueue* pQueue);
+    // Destroy the gpu buffers, once the gpu is idle.
+    void cleanUp();
+
+    // Changes whenever the gpu buffers are created again, their views then need binding again.
+    U32 getViewsVersion() const { return m_viewsVersion; }
+    const LightSystemStats& getStats() const { return m_stats; }
+
+    // Distance at which a light of this radiance falls below the cutoff, for the windowed
+    // inverse square falloff of LightingEquations.hlsli.
+    static R32 computeInfluenceRange(const Vector4& radiance, R32 cutoff = kDefaultRadianceCutoff);
 
 private:
+    // Bytes of a light buffer staged by update(), from _staged at _srcOffset to _dstOffset.
+    struct StagedRange
+    {
+        U64 _dstOffset;
+        U64 _srcOffset;
+        U64 _sz;
+    };
+    // A structured buffer of lights in gpu memory, recreated larger when they outgrow it.
+    // Lights are staged on the cpu, and copied in with the frame, never written in place.
+    struct LightBuffer
+    {
+        gfx::Resource* _pResource;
+        gfx::ShaderResourceView* _pSRV;
+        U32 _capacity;
+        U32 _stride;
+        const TCHAR* _debugName;
+        std::vector<U8> _staged;
+        std::vector<StagedRange> _ranges;
+
+        // Room for count lights at index idx, copied in by the next upload().
+        U8* stage(U32 idx, U32 count);
+    };
+    // Lights to write on the next update, each listed once.
+    struct DirtyLights
+    {
+        std::vector<U32> _indices;
+        std::vector<U8> _flags;
+
+        void mark(U32 idx);
+    };
+
+    struct RetiredBuffer
+    {
+        gfx::Resource* _pResource;
+        // Frame number after which the gpu no longer reads the buffer.
+        U64 _lastFrame;
+    };
+
+    // Returns true if the buffer was created again, empty. The old one is retired until lastFrame.
+    B32 reserveBuffer(LightBuffer& buffer, U32 count, U64 lastFrame);
+    // Stage the dirty lights in runs of consecutive indices, then clear them.
+    template<typename WriteFn>
+    void stageDirty(LightBuffer& buffer, DirtyLights& dirty, U32 count, WriteFn write);
+    // Consecutive transforms, count of them, for a shadowed light.
+    U32 allocateTransform(const Light& light, U32 count);
+    void freeTransform(U32 transform, U32 count);
+    void setPointStreams(U32 idx);
+    void setSpotStreams(U32 idx);
+    // Cull lights [begin, end) of the streams, begin a multiple of the lane count.
+    static void cullRange(const Plane* pPlanes, U32 planeCount, const R32* pX, const R32* pY, const R32* pZ,
+                          const R32* pRadius, U32 begin, U32 end, std::vector<U32>& visible);
+    void cullLights(const Plane* pPlanes, U32 planeCount, const R32* pX, const R32* pY, const R32* pZ,
+                    const R32* pRadius, U32 count, std::vector<U32>& visible, JobSystem* pJobs);
+
+    gfx::BackendRenderer* m_pRenderer;
     std::vector<DirectionLight> m_directionLights;
+
+    // Dense lights, the index of each in its buffer, with the handle it was added with.
     std::vector<PointLight> m_pointLights;
+    std::vector<LightHandle> m_pointHandles;
+    PointLightStreams m_pointStreams;
+    SlotMap<U32> m_pointIndices;
+    DirtyLights m_dirtyPoints;
+
     std::vector<SpotLight> m_spotLights;
+    std::vector<LightHandle> m_spotHandles;
+    SpotLightStreams m_spotStreams;
+    SlotMap<U32> m_spotIndices;
+    DirtyLights m_dirtySpots;
+
+    // Direction lights' cascade transforms first, then those of shadowed point and spot lights.
     std::vector<LightTransform> m_lightTransformations;
+    // Freed transforms of spot lights, and first transforms of freed point light faces.
+    std::vector<U32> m_freeTransforms;
+    std::vector<U32> m_freeFaceTransforms;
 
-    gfx::Resource* m_pDirectionLightResource;
-    gfx::Resource* m_pPointLightResource;
-    gfx::Resource* m_pSpotLightResource;
-    gfx::Resource* m_lightTransformsResource;
-    gfx::ShaderResourceView* m_pDirectionLightsSRV;
-    gfx::ShaderResourceView* m_pSpotLightsSRV;
-    gfx::ShaderResourceView* m_pPointLighstSRV;
-    gfx::ShaderResourceView* m_pLightTransformSRV;
+    std::vector<U32> m_visiblePointLights;
+    std::vector<U32> m_visibleSpotLights;
+    // Visible lights of each chunk of a parallel cull, kept between frames.
+    std::vector<std::vector<U32>> m_cullChunks;
 
-    void mapLightSystem(void** dirPtr, void** pointPtr, void** spotPtr, void** transformPtr);
-    void unmapLightSystem();
+    LightBuffer m_directionLightBuffer;
+    LightBuffer m_pointLightBuffer;
+    LightBuffer m_spotLightBuffer;
+    LightBuffer m_transformBuffer;
+    std::vector<RetiredBuffer> m_retiredBuffers;
+    U32 m_viewsVersion;
+    LightSystemStats m_stats;
 
     friend gfx::Resource* getLightTransforms(LightSystem*);
+    friend gfx::ShaderResourceView* getLightTransformsSRV(LightSystem*);
     friend gfx::ShaderResourceView* getPointLightsSRV(LightSystem*);
     friend gfx::ShaderResourceView* getSpotLightsSRV(LightSystem*);
     friend gfx::ShaderResourceView* getDirectionLightsSRV(LightSystem*);
 };
 
 
-void initializeLights(gfx::BackendRenderer* pRenderer);
+void initializeLights(gfx::BackendRenderer* pRenderer, PipelineCache* pPipelineCache);
 
 void updateLightRenderer
     (
@@ -94,7 +288,11 @@ void updateLightRenderer
         // Deferred GBuffer descriptor table.
         GBuffer* gpass,
         // Light system to use.
-        LightSystem* pLightSystem
+        LightSystem* pLightSystem,
+        // Point and spot lights of each cluster.
+        LightClusters* pLightClusters,
+        // Scene depth, read to place each pixel in the world.
+        gfx::ShaderResourceView* pDepthSRV
     );
 
 gfx::ShaderResourceView* getLightOutputSRV();
@@ -0,0 +1,93 @@
+//
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#if !JCL_PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace jcl {
+
+
+#if defined(_WIN32)
+B32 MappedFile::open(const std::string& path)
+{
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    m_file = file;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart == 0) {
+        close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!m_mapping) {
+        close();
+        return false;
+    }
+
+    m_pData = static_cast<const U8*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (!m_pData) {
+        close();
+        return false;
+    }
+    m_size = static_cast<U64>(size.QuadPart);
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (m_pData) UnmapViewOfFile(m_pData);
+    if (m_mapping) CloseHandle(m_mapping);
+    if (m_file) CloseHandle(m_file);
+    m_pData = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+    m_file = nullptr;
+}
+#else
+B32 MappedFile::open(const std::string& path)
+{
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // The mapping keeps its own reference to the file, the descriptor is not needed past this.
+    void* pData = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (pData == MAP_FAILED) return false;
+
+    // Loaders read front to back, let the kernel read ahead.
+    madvise(pData, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);
+    m_pData = static_cast<const U8*>(pData);
+    m_size = static_cast<U64>(info.st_size);
+    return true;
+}
+
+
+void MappedFile::close()
+{
+    if (m_pData) munmap(const_cast<U8*>(m_pData), static_cast<size_t>(m_size));
+    m_pData = nullptr;
+    m_size = 0;
+}
+#endif
+} // jcl
@@ -0,0 +1,48 @@
+//
+#pragma once
+
+#include "PlatformConfigs.h"
+
+namespace jcl {
+
+
+/*
+    Mapped File maps a whole file read only into memory. Pages are faulted in from the file
+    cache as they are touched, so nothing is copied up front, and the mapping costs no heap.
+    Data stays valid until close() or destruction.
+*/
+class MappedFile
+{
+public:
+    MappedFile()
+        : m_pData(nullptr)
+        , m_size(0)
+#if defined(_WIN32)
+        , m_file(nullptr)
+        , m_mapping(nullptr)
+#endif
+        { }
+
+    ~MappedFile() { close(); }
+
+    // Returns false if the file could not be opened or mapped. Empty files fail too.
+    B32 open(const std::string& path);
+    void close();
+
+    const U8* getData() const { return m_pData; }
+    U64 getSize() const { return m_size; }
+    B32 isOpen() const { return m_pData != nullptr; }
+
+private:
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const U8* m_pData;
+    U64 m_size;
+#if defined(_WIN32)
+    // File and file mapping HANDLEs, kept opaque so that the header doesn't need Windows.h.
+    void* m_file;
+    void* m_mapping;
+#endif
+};
+} // jcl
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "Vector4.h"
+#include "Matrix44.h"
 
 namespace m {
 
@@ -20,8 +21,26 @@ struct Bounds3D
         return _min + extentHalf;
     }
 
+    // Empty bounds have no volume, meshes without bounds are left this way.
+    B32 isEmpty() const {
+        return _min == _max;
+    }
+
     B32 intersects(const Bounds3D& other) const {
-        return false;
+        return (_min._x <= other._max._x) && (_max._x >= other._min._x) &&
+               (_min._y <= other._max._y) && (_max._y >= other._min._y) &&
+               (_min._z <= other._max._z) && (_max._z >= other._min._z);
+    }
+
+    // Bounds enclosing these bounds after the given affine transform.
+    Bounds3D transform(const Matrix44& mat) const {
+        Vector4 center = Vector4(getCenter(), 1.0f) * mat;
+        Vector3 e = getExtent() * 0.5f;
+        Vector4 extent = Vector4(simd::abs(mat.row(0))) * e._x +
+                         Vector4(simd::abs(mat.row(1))) * e._y +
+                         Vector4(simd::abs(mat.row(2))) * e._z;
+        return Bounds3D(Vector3(center._x - extent._x, center._y - extent._y, center._z - extent._z),
+                        Vector3(center._x + extent._x, center._y + extent._y, center._z + extent._z));
     }
 };
 }
\ No newline at end of file
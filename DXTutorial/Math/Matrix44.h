@@ -1,7 +1,8 @@
 #pragma once
 
-#include "../WinConfigs.h"
+#include "../PlatformConfigs.h"
 #include "Vector4.h"
+#include "SIMD.h"
 
 
 namespace m {
@@ -20,7 +21,9 @@ struct Matrix33 {
 };
 
 
-struct Matrix44 {
+// Row major, row vector convention (v * M), translation lives in row 3.
+// Aligned to 16 bytes so every row can be loaded as a single vector register.
+struct alignas(16) Matrix44 {
     R32 _[4][4];
     Matrix44(R32 a00 = 1.0f, R32 a01 = 0.0f, R32 a02 = 0.0f, R32 a03 = 0.0f,
              R32 a10 = 0.0f, R32 a11 = 1.0f, R32 a12 = 0.0f, R32 a13 = 0.0f,
@@ -33,60 +36,51 @@ struct Matrix44 {
       _[3][0] = a30; _[3][1] = a31; _[3][2] = a32; _[3][3] = a33;
     }
 
+    // Row i as one vector register.
+    simd::F4 row(U32 i) const { return simd::loadAligned(_[i]); }
+
     Matrix44 operator*(const Matrix44& other) const {
-      R32 m00 = _[0][0];
-      R32 m01 = _[0][1];
-      R32 m02 = _[0][2];
-      R32 m03 = _[0][3];
-      R32 m10 = _[1][0];
-      R32 m11 = _[1][1];
-      R32 m12 = _[1][2];
-      R32 m13 = _[1][3];
-      R32 m20 = _[2][0];
-      R32 m21 = _[2][1];
-      R32 m22 = _[2][2];
-      R32 m23 = _[2][3];
-      R32 m30 = _[3][0];
-      R32 m31 = _[3][1];
-      R32 m32 = _[3][2];
-      R32 m33 = _[3][3];
-      R32 om00 = other._[0][0];
-      R32 om01 = other._[0][1];
-      R32 om02 = other._[0][2];
-      R32 om03 = other._[0][3];
-      R32 om10 = other._[1][0];
-      R32 om11 = other._[1][1];
-      R32 om12 = other._[1][2];
-      R32 om13 = other._[1][3];
-      R32 om20 = other._[2][0];
-      R32 om21 = other._[2][1];
-      R32 om22 = other._[2][2];
-      R32 om23 = other._[2][3];
-      R32 om30 = other._[3][0];
-      R32 om31 = other._[3][1];
-      R32 om32 = other._[3][2];
-      R32 om33 = other._[3][3]; 
-      return Matrix44( 
-        m00 * om00 + m01 * om10 + m02 * om20 + m03 * om30,
-        m00 * om01 + m01 * om11 + m02 * om21 + m03 * om31,
-        m00 * om02 + m01 * om12 + m02 * om22 + m03 * om32,
-        m00 * om03 + m01 * om13 + m02 * om23 + m03 * om33,
-
-        m10 * om00 + m11 * om10 + m12 * om20 + m13 * om30,
-        m10 * om01 + m11 * om11 + m12 * om21 + m13 * om31,
-        m10 * om02 + m11 * om12 + m12 * om22 + m13 * om32,
-        m10 * om03 + m11 * om13 + m12 * om23 + m13 * om33,
-
-        m20 * om00 + m21 * om10 + m22 * om20 + m23 * om30,
-        m20 * om01 + m21 * om11 + m22 * om21 + m23 * om31,
-        m20 * om02 + m21 * om12 + m22 * om22 + m23 * om32,
-        m20 * om03 + m21 * om13 + m22 * om23 + m23 * om33,
-
-        m30 * om00 + m31 * om10 + m32 * om20 + m33 * om30,
-        m30 * om01 + m31 * om11 + m32 * om21 + m33 * om31,
-        m30 * om02 + m31 * om12 + m32 * om22 + m33 * om32,
-        m30 * om03 + m31 * om13 + m32 * om23 + m33 * om33
-      );
+      Matrix44 r(kUninitialized);
+      mul(r, *this, other);
+      return r;
+    }
+
+    // Result row i is the linear combination of the rows of b, weighted by row i of a.
+    // Both operands are fully read before anything is stored, so out may alias either.
+    static void mul(Matrix44& out, const Matrix44& a, const Matrix44& b) {
+#if M_SIMD_AVX
+      // Two rows of a per register, each row of b duplicated into both 128 bit halves.
+      __m256 a01 = _mm256_loadu_ps(a._[0]);
+      __m256 a23 = _mm256_loadu_ps(a._[2]);
+      __m256 b0 = _mm256_broadcast_ps((const __m128*)b._[0]);
+      __m256 b1 = _mm256_broadcast_ps((const __m128*)b._[1]);
+      __m256 b2 = _mm256_broadcast_ps((const __m128*)b._[2]);
+      __m256 b3 = _mm256_broadcast_ps((const __m128*)b._[3]);
+      __m256 r01 = _mm256_mul_ps(_mm256_permute_ps(a01, 0x00), b0);
+      __m256 r23 = _mm256_mul_ps(_mm256_permute_ps(a23, 0x00), b0);
+      r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0x55), b1, r01);
+      r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0x55), b1, r23);
+      r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xAA), b2, r01);
+      r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xAA), b2, r23);
+      r01 = _mm256_fmadd_ps(_mm256_permute_ps(a01, 0xFF), b3, r01);
+      r23 = _mm256_fmadd_ps(_mm256_permute_ps(a23, 0xFF), b3, r23);
+      _mm256_storeu_ps(out._[0], r01);
+      _mm256_storeu_ps(out._[2], r23);
+#else
+      simd::F4 b0 = simd::loadAligned(b._[0]);
+      simd::F4 b1 = simd::loadAligned(b._[1]);
+      simd::F4 b2 = simd::loadAligned(b._[2]);
+      simd::F4 b3 = simd::loadAligned(b._[3]);
+      // Lanes of a are broadcast in registers, splatting them one by one from memory measured slower.
+      simd::F4 r0 = simd::transform(simd::loadAligned(a._[0]), b0, b1, b2, b3);
+      simd::F4 r1 = simd::transform(simd::loadAligned(a._[1]), b0, b1, b2, b3);
+      simd::F4 r2 = simd::transform(simd::loadAligned(a._[2]), b0, b1, b2, b3);
+      simd::F4 r3 = simd::transform(simd::loadAligned(a._[3]), b0, b1, b2, b3);
+      simd::storeAligned(out._[0], r0);
+      simd::storeAligned(out._[1], r1);
+      simd::storeAligned(out._[2], r2);
+      simd::storeAligned(out._[3], r3);
+#endif
     }
 
     Matrix44 operator*(R32 scalar) const {
@@ -157,13 +151,100 @@ struct Matrix44 {
         return minor;
     }
 
+    // General inverse, through 2x2 block matrices:
+    //  M = | A B |    inverse(M) = 1/|M| * | X# Y# |
+    //      | C D |                         | Z# W# |
+    // Returns identity if the matrix is singular.
     Matrix44 inverse() const {
-      R32 detA = determinant();
-      if (detA == 0.0f) {
+      simd::F4 r0 = simd::loadAligned(_[0]);
+      simd::F4 r1 = simd::loadAligned(_[1]);
+      simd::F4 r2 = simd::loadAligned(_[2]);
+      simd::F4 r3 = simd::loadAligned(_[3]);
+
+      // 2x2 sub matrices, stored as (m00, m01, m10, m11).
+      simd::F4 A = simd::shuffle<0, 1, 0, 1>(r0, r1);
+      simd::F4 B = simd::shuffle<2, 3, 2, 3>(r0, r1);
+      simd::F4 C = simd::shuffle<0, 1, 0, 1>(r2, r3);
+      simd::F4 D = simd::shuffle<2, 3, 2, 3>(r2, r3);
+
+      // (|A|, |B|, |C|, |D|)
+      simd::F4 detSub = simd::sub(
+        simd::mul(simd::shuffle<0, 2, 0, 2>(r0, r2), simd::shuffle<1, 3, 1, 3>(r1, r3)),
+        simd::mul(simd::shuffle<1, 3, 1, 3>(r0, r2), simd::shuffle<0, 2, 0, 2>(r1, r3)));
+      simd::F4 detA = simd::swizzle<0, 0, 0, 0>(detSub);
+      simd::F4 detB = simd::swizzle<1, 1, 1, 1>(detSub);
+      simd::F4 detC = simd::swizzle<2, 2, 2, 2>(detSub);
+      simd::F4 detD = simd::swizzle<3, 3, 3, 3>(detSub);
+
+      simd::F4 D_C = mat2AdjMul(D, C);
+      simd::F4 A_B = mat2AdjMul(A, B);
+      // X# = |D|A - B(D#C)
+      simd::F4 X_ = simd::sub(simd::mul(detD, A), mat2Mul(B, D_C));
+      // W# = |A|D - C(A#B)
+      simd::F4 W_ = simd::sub(simd::mul(detA, D), mat2Mul(C, A_B));
+      // Y# = |B|C - D(A#B)#
+      simd::F4 Y_ = simd::sub(simd::mul(detB, C), mat2MulAdj(D, A_B));
+      // Z# = |C|B - A(D#C)#
+      simd::F4 Z_ = simd::sub(simd::mul(detC, B), mat2MulAdj(A, D_C));
+
+      // |M| = |A||D| + |B||C| - tr((A#B)(D#C))
+      simd::F4 detM = simd::add(simd::mul(detA, detD), simd::mul(detB, detC));
+      simd::F4 tr = simd::hsum(simd::mul(A_B, simd::swizzle<0, 2, 1, 3>(D_C)));
+      detM = simd::sub(detM, tr);
+      if (simd::first(detM) == 0.0f) {
+        return Matrix44();
+      }
+
+      simd::F4 rDetM = simd::div(simd::set(1.0f, -1.0f, -1.0f, 1.0f), detM);
+      X_ = simd::mul(X_, rDetM);
+      Y_ = simd::mul(Y_, rDetM);
+      Z_ = simd::mul(Z_, rDetM);
+      W_ = simd::mul(W_, rDetM);
+
+      // Adjugate the blocks while storing them back as rows.
+      Matrix44 r(kUninitialized);
+      simd::storeAligned(r._[0], simd::shuffle<3, 1, 3, 1>(X_, Y_));
+      simd::storeAligned(r._[1], simd::shuffle<2, 0, 2, 0>(X_, Y_));
+      simd::storeAligned(r._[2], simd::shuffle<3, 1, 3, 1>(Z_, W_));
+      simd::storeAligned(r._[3], simd::shuffle<2, 0, 2, 0>(Z_, W_));
+      return r;
+    }
+
+    // Inverse of an affine transform (column 3 is (0, 0, 0, 1)). The upper 3x3 may hold any
+    // rotation, scale or shear. Much cheaper than inverse() for world and view matrices.
+    Matrix44 inverseAffine() const {
+      simd::F4 r0 = simd::loadAligned(_[0]);
+      simd::F4 r1 = simd::loadAligned(_[1]);
+      simd::F4 r2 = simd::loadAligned(_[2]);
+      simd::F4 t = simd::loadAligned(_[3]);
+
+      // Columns of the 3x3 inverse are the cross products of the rows, over the determinant.
+      simd::F4 c0 = simd::cross3(r1, r2);
+      simd::F4 c1 = simd::cross3(r2, r0);
+      simd::F4 c2 = simd::cross3(r0, r1);
+      simd::F4 det = simd::dot4(r0, c0);
+      if (simd::first(det) == 0.0f) {
         return Matrix44();
       }
-      Matrix44 inverse = adjugate() * (1.0f / detA);
-      return inverse;
+      simd::F4 rDet = simd::div(simd::splat(1.0f), det);
+      c0 = simd::mul(c0, rDet);
+      c1 = simd::mul(c1, rDet);
+      c2 = simd::mul(c2, rDet);
+      simd::F4 c3 = simd::set(0.0f, 0.0f, 0.0f, 1.0f);
+      simd::transpose(c0, c1, c2, c3);
+
+      // c3 is now zero after the transpose, translation is -t * inverse(R).
+      simd::F4 it = simd::mul(simd::swizzle<0, 0, 0, 0>(t), c0);
+      it = simd::madd(simd::swizzle<1, 1, 1, 1>(t), c1, it);
+      it = simd::madd(simd::swizzle<2, 2, 2, 2>(t), c2, it);
+      it = simd::sub(simd::set(0.0f, 0.0f, 0.0f, 1.0f), it);
+
+      Matrix44 r(kUninitialized);
+      simd::storeAligned(r._[0], c0);
+      simd::storeAligned(r._[1], c1);
+      simd::storeAligned(r._[2], c2);
+      simd::storeAligned(r._[3], it);
+      return r;
     }
 
 
@@ -184,12 +265,17 @@ struct Matrix44 {
     }
 
     Matrix44 transpose() const {
-      return Matrix44(
-        _[0][0], _[1][0], _[2][0], _[3][0],
-        _[0][1], _[1][1], _[2][1], _[3][1],
-        _[0][2], _[1][2], _[2][2], _[3][2],
-        _[0][3], _[1][3], _[2][3], _[3][3]
-      );
+      simd::F4 r0 = simd::loadAligned(_[0]);
+      simd::F4 r1 = simd::loadAligned(_[1]);
+      simd::F4 r2 = simd::loadAligned(_[2]);
+      simd::F4 r3 = simd::loadAligned(_[3]);
+      simd::transpose(r0, r1, r2, r3);
+      Matrix44 r(kUninitialized);
+      simd::storeAligned(r._[0], r0);
+      simd::storeAligned(r._[1], r1);
+      simd::storeAligned(r._[2], r2);
+      simd::storeAligned(r._[3], r3);
+      return r;
     }
 
 
@@ -263,5 +349,40 @@ struct Matrix44 {
 
       return view;
     }
+
+private:
+    // Leaves the elements unset, for kernels that store every row. The identity the default
+    // constructor writes is not removed by the compiler once rows are stored as vectors, and
+    // the result then goes through memory before it is copied out.
+    enum UninitializedTag { kUninitialized };
+    explicit Matrix44(UninitializedTag) { }
+
+    // 2x2 helpers for inverse(), each operand packed as (m00, m01, m10, m11).
+    // A * B
+    static simd::F4 mat2Mul(simd::F4 a, simd::F4 b) {
+      return simd::add(simd::mul(a, simd::swizzle<0, 3, 0, 3>(b)),
+                       simd::mul(simd::swizzle<1, 0, 3, 2>(a), simd::swizzle<2, 1, 2, 1>(b)));
+    }
+    // A# * B
+    static simd::F4 mat2AdjMul(simd::F4 a, simd::F4 b) {
+      return simd::sub(simd::mul(simd::swizzle<3, 3, 0, 0>(a), b),
+                       simd::mul(simd::swizzle<1, 1, 2, 2>(a), simd::swizzle<2, 3, 0, 1>(b)));
+    }
+    // A * B#
+    static simd::F4 mat2MulAdj(simd::F4 a, simd::F4 b) {
+      return simd::sub(simd::mul(a, simd::swizzle<3, 0, 3, 0>(b)),
+                       simd::mul(simd::swizzle<1, 0, 3, 2>(a), simd::swizzle<2, 1, 2, 1>(b)));
+    }
 };
+
+
+// Row vector times matrix. Scalar on purpose, compilers vectorize it as well as simd::transform
+// does, and a hand written kernel measured no faster.
+inline Vector4 operator*(const Vector4& v, const Matrix44& mat) {
+  return Vector4(
+      v._x * mat._[0][0] + v._y * mat._[1][0] + v._z * mat._[2][0] + v._w * mat._[3][0],
+      v._x * mat._[0][1] + v._y * mat._[1][1] + v._z * mat._[2][1] + v._w * mat._[3][1],
+      v._x * mat._[0][2] + v._y * mat._[1][2] + v._z * mat._[2][2] + v._w * mat._[3][2],
+      v._x * mat._[0][3] + v._y * mat._[1][3] + v._z * mat._[2][3] + v._w * mat._[3][3]);
+}
 } // m
\ No newline at end of file
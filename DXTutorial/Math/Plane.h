@@ -2,6 +2,7 @@
 #pragma once
 
 #include "Vector4.h"
+#include "Matrix44.h"
 
 namespace m {
 
@@ -9,6 +10,34 @@ namespace m {
 struct Plane {
 
     R32 _a, _b, _c, _d;
-    
+
+    // Signed distance from the plane, positive on the side the normal points to.
+    R32 distance(const Vector3& p) const {
+        return _a * p._x + _b * p._y + _c * p._z + _d;
+    }
+
+    Plane normalize() const {
+        R32 invLength = 1.0f / sqrtf(_a * _a + _b * _b + _c * _c);
+        Plane plane = { _a * invLength, _b * invLength, _c * invLength, _d * invLength };
+        return plane;
+    }
 };
-} // m
\ No newline at end of file
+
+
+// Extracts the 6 planes of the frustum from a view to clip matrix, normals facing inwards.
+// Order is left, right, bottom, top, near, far. Expects row vectors and a [0, 1] clip depth,
+// which works the same for reversed depth, since it only bounds 0 <= z <= w.
+inline void extractFrustumPlanes(const Matrix44& viewToClip, Plane* pPlanes)
+{
+    const R32 (*m)[4] = viewToClip._;
+    for (U32 i = 0; i < 3; ++i) {
+        Plane positive = { m[0][3] + m[0][i], m[1][3] + m[1][i], m[2][3] + m[2][i], m[3][3] + m[3][i] };
+        Plane negative = { m[0][3] - m[0][i], m[1][3] - m[1][i], m[2][3] - m[2][i], m[3][3] - m[3][i] };
+        pPlanes[i * 2 + 0] = positive.normalize();
+        pPlanes[i * 2 + 1] = negative.normalize();
+    }
+    // Near is z >= 0 rather than z >= -w.
+    Plane nearPlane = { m[0][2], m[1][2], m[2][2], m[3][2] };
+    pPlanes[4] = nearPlane.normalize();
+}
+} // m
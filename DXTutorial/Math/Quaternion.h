@@ -1,6 +1,6 @@
 #pragma once
 
-#include "../WinConfigs.h"
+#include "../PlatformConfigs.h"
 #include "Matrix44.h"
 #include "Vector4.h"
 
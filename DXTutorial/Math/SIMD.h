@@ -0,0 +1,240 @@
+//
+#pragma once
+
+#include "../PlatformConfigs.h"
+
+// Instruction set is chosen at compile time. Define JCL_MATH_SCALAR to force the
+// plain C++ path on any target, which is also used when no vector unit is known.
+// AVX builds (which also assume FMA) use 256 bit kernels where two rows fit in one register.
+#if defined(JCL_MATH_SCALAR)
+  #define M_SIMD_SCALAR 1
+#elif defined(__AVX2__) && defined(__FMA__)
+  #define M_SIMD_SSE 1
+  #define M_SIMD_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define M_SIMD_SSE 1
+#elif defined(__ARM_NEON) || defined(_M_ARM64)
+  #define M_SIMD_NEON 1
+#else
+  #define M_SIMD_SCALAR 1
+#endif
+
+#if M_SIMD_AVX
+  #include <immintrin.h>
+#elif M_SIMD_SSE
+  #include <emmintrin.h>
+#elif M_SIMD_NEON
+  #include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER)
+  #define M_INLINE __forceinline
+#else
+  #define M_INLINE inline __attribute__((always_inline))
+#endif
+
+namespace m {
+namespace simd {
+
+
+#if M_SIMD_SSE
+
+typedef __m128 F4;
+
+M_INLINE F4 load(const R32* p) { return _mm_loadu_ps(p); }
+M_INLINE void store(R32* p, F4 a) { _mm_storeu_ps(p, a); }
+// p on a 16 byte boundary, as in Vector4 and Matrix44. Lets the load fold into the arithmetic using it.
+M_INLINE F4 loadAligned(const R32* p) { return _mm_load_ps(p); }
+M_INLINE void storeAligned(R32* p, F4 a) { _mm_store_ps(p, a); }
+M_INLINE F4 set(R32 x, R32 y, R32 z, R32 w) { return _mm_setr_ps(x, y, z, w); }
+M_INLINE F4 splat(R32 s) { return _mm_set1_ps(s); }
+M_INLINE F4 add(F4 a, F4 b) { return _mm_add_ps(a, b); }
+M_INLINE F4 sub(F4 a, F4 b) { return _mm_sub_ps(a, b); }
+M_INLINE F4 mul(F4 a, F4 b) { return _mm_mul_ps(a, b); }
+M_INLINE F4 div(F4 a, F4 b) { return _mm_div_ps(a, b); }
+M_INLINE F4 min(F4 a, F4 b) { return _mm_min_ps(a, b); }
+M_INLINE F4 max(F4 a, F4 b) { return _mm_max_ps(a, b); }
+// a * b + c
+#if defined(__FMA__)
+M_INLINE F4 madd(F4 a, F4 b, F4 c) { return _mm_fmadd_ps(a, b, c); }
+#else
+M_INLINE F4 madd(F4 a, F4 b, F4 c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+#endif
+M_INLINE R32 first(F4 a) { return _mm_cvtss_f32(a); }
+M_INLINE F4 abs(F4 a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+// Magnitude of a with the sign of b.
+M_INLINE F4 copysign(F4 a, F4 b) {
+  F4 signMask = _mm_set1_ps(-0.0f);
+  return _mm_or_ps(_mm_andnot_ps(signMask, a), _mm_and_ps(signMask, b));
+}
+// All bits set in the lanes where a < b, for select().
+M_INLINE F4 cmplt(F4 a, F4 b) { return _mm_cmplt_ps(a, b); }
+// mask ? a : b, per lane.
+M_INLINE F4 select(F4 mask, F4 a, F4 b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+// Round to the nearest integer, and store as 32 bit ints.
+M_INLINE void storeRounded(I32* p, F4 a) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), _mm_cvtps_epi32(a)); }
+
+// (a[x], a[y], a[z], a[w])
+template<int x, int y, int z, int w>
+M_INLINE F4 swizzle(F4 a) {
+  return _mm_shuffle_ps(a, a, _MM_SHUFFLE(w, z, y, x));
+}
+
+// (a[x], a[y], b[z], b[w])
+template<int x, int y, int z, int w>
+M_INLINE F4 shuffle(F4 a, F4 b) {
+  return _mm_shuffle_ps(a, b, _MM_SHUFFLE(w, z, y, x));
+}
+
+M_INLINE void transpose(F4& r0, F4& r1, F4& r2, F4& r3) {
+  _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+
+#elif M_SIMD_NEON
+
+typedef float32x4_t F4;
+
+M_INLINE F4 load(const R32* p) { return vld1q_f32(p); }
+M_INLINE void store(R32* p, F4 a) { vst1q_f32(p, a); }
+M_INLINE F4 loadAligned(const R32* p) { return vld1q_f32(p); }
+M_INLINE void storeAligned(R32* p, F4 a) { vst1q_f32(p, a); }
+M_INLINE F4 set(R32 x, R32 y, R32 z, R32 w) { R32 v[4] = { x, y, z, w }; return vld1q_f32(v); }
+M_INLINE F4 splat(R32 s) { return vdupq_n_f32(s); }
+M_INLINE F4 add(F4 a, F4 b) { return vaddq_f32(a, b); }
+M_INLINE F4 sub(F4 a, F4 b) { return vsubq_f32(a, b); }
+M_INLINE F4 mul(F4 a, F4 b) { return vmulq_f32(a, b); }
+M_INLINE F4 min(F4 a, F4 b) { return vminq_f32(a, b); }
+M_INLINE F4 max(F4 a, F4 b) { return vmaxq_f32(a, b); }
+M_INLINE F4 madd(F4 a, F4 b, F4 c) { return vmlaq_f32(c, a, b); }
+M_INLINE R32 first(F4 a) { return vgetq_lane_f32(a, 0); }
+M_INLINE F4 abs(F4 a) { return vabsq_f32(a); }
+M_INLINE F4 copysign(F4 a, F4 b) {
+  uint32x4_t signMask = vdupq_n_u32(0x80000000u);
+  return vbslq_f32(signMask, b, a);
+}
+M_INLINE F4 cmplt(F4 a, F4 b) { return vreinterpretq_f32_u32(vcltq_f32(a, b)); }
+M_INLINE F4 select(F4 mask, F4 a, F4 b) { return vbslq_f32(vreinterpretq_u32_f32(mask), a, b); }
+M_INLINE void storeRounded(I32* p, F4 a) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+  vst1q_s32(p, vcvtnq_s32_f32(a));
+#else
+  // Only truncating conversion here, round half away from zero first.
+  F4 half = vbslq_f32(vdupq_n_u32(0x80000000u), a, vdupq_n_f32(0.5f));
+  vst1q_s32(p, vcvtq_s32_f32(vaddq_f32(a, half)));
+#endif
+}
+M_INLINE F4 div(F4 a, F4 b) {
+#if defined(__aarch64__) || defined(_M_ARM64)
+  return vdivq_f32(a, b);
+#else
+  // Two newton raphson steps on the reciprocal estimate.
+  F4 r = vrecpeq_f32(b);
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  r = vmulq_f32(vrecpsq_f32(b, r), r);
+  return vmulq_f32(a, r);
+#endif
+}
+
+template<int x, int y, int z, int w>
+M_INLINE F4 swizzle(F4 a) {
+  F4 r = vmovq_n_f32(vgetq_lane_f32(a, x));
+  r = vsetq_lane_f32(vgetq_lane_f32(a, y), r, 1);
+  r = vsetq_lane_f32(vgetq_lane_f32(a, z), r, 2);
+  return vsetq_lane_f32(vgetq_lane_f32(a, w), r, 3);
+}
+
+template<int x, int y, int z, int w>
+M_INLINE F4 shuffle(F4 a, F4 b) {
+  F4 r = vmovq_n_f32(vgetq_lane_f32(a, x));
+  r = vsetq_lane_f32(vgetq_lane_f32(a, y), r, 1);
+  r = vsetq_lane_f32(vgetq_lane_f32(b, z), r, 2);
+  return vsetq_lane_f32(vgetq_lane_f32(b, w), r, 3);
+}
+
+M_INLINE void transpose(F4& r0, F4& r1, F4& r2, F4& r3) {
+  float32x4x2_t t01 = vtrnq_f32(r0, r1);
+  float32x4x2_t t23 = vtrnq_f32(r2, r3);
+  r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+  r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+  r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+  r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+
+#else
+
+struct F4 { R32 _[4]; };
+
+M_INLINE F4 load(const R32* p) { F4 r = { { p[0], p[1], p[2], p[3] } }; return r; }
+M_INLINE void store(R32* p, F4 a) { p[0] = a._[0]; p[1] = a._[1]; p[2] = a._[2]; p[3] = a._[3]; }
+M_INLINE F4 loadAligned(const R32* p) { return load(p); }
+M_INLINE void storeAligned(R32* p, F4 a) { store(p, a); }
+M_INLINE F4 set(R32 x, R32 y, R32 z, R32 w) { F4 r = { { x, y, z, w } }; return r; }
+M_INLINE F4 splat(R32 s) { F4 r = { { s, s, s, s } }; return r; }
+M_INLINE F4 add(F4 a, F4 b) { return set(a._[0] + b._[0], a._[1] + b._[1], a._[2] + b._[2], a._[3] + b._[3]); }
+M_INLINE F4 sub(F4 a, F4 b) { return set(a._[0] - b._[0], a._[1] - b._[1], a._[2] - b._[2], a._[3] - b._[3]); }
+M_INLINE F4 mul(F4 a, F4 b) { return set(a._[0] * b._[0], a._[1] * b._[1], a._[2] * b._[2], a._[3] * b._[3]); }
+M_INLINE F4 div(F4 a, F4 b) { return set(a._[0] / b._[0], a._[1] / b._[1], a._[2] / b._[2], a._[3] / b._[3]); }
+M_INLINE F4 min(F4 a, F4 b) { return set(fminf(a._[0], b._[0]), fminf(a._[1], b._[1]), fminf(a._[2], b._[2]), fminf(a._[3], b._[3])); }
+M_INLINE F4 max(F4 a, F4 b) { return set(fmaxf(a._[0], b._[0]), fmaxf(a._[1], b._[1]), fmaxf(a._[2], b._[2]), fmaxf(a._[3], b._[3])); }
+M_INLINE F4 madd(F4 a, F4 b, F4 c) { return add(mul(a, b), c); }
+M_INLINE R32 first(F4 a) { return a._[0]; }
+M_INLINE F4 abs(F4 a) { return set(fabsf(a._[0]), fabsf(a._[1]), fabsf(a._[2]), fabsf(a._[3])); }
+M_INLINE F4 copysign(F4 a, F4 b) {
+  return set(copysignf(a._[0], b._[0]), copysignf(a._[1], b._[1]), copysignf(a._[2], b._[2]), copysignf(a._[3], b._[3]));
+}
+// Lanes are 1 where a < b, 0 otherwise.
+M_INLINE F4 cmplt(F4 a, F4 b) {
+  return set(a._[0] < b._[0] ? 1.0f : 0.0f, a._[1] < b._[1] ? 1.0f : 0.0f,
+             a._[2] < b._[2] ? 1.0f : 0.0f, a._[3] < b._[3] ? 1.0f : 0.0f);
+}
+M_INLINE F4 select(F4 mask, F4 a, F4 b) {
+  return set(mask._[0] != 0.0f ? a._[0] : b._[0], mask._[1] != 0.0f ? a._[1] : b._[1],
+             mask._[2] != 0.0f ? a._[2] : b._[2], mask._[3] != 0.0f ? a._[3] : b._[3]);
+}
+M_INLINE void storeRounded(I32* p, F4 a) {
+  p[0] = (I32)lrintf(a._[0]); p[1] = (I32)lrintf(a._[1]); p[2] = (I32)lrintf(a._[2]); p[3] = (I32)lrintf(a._[3]);
+}
+
+template<int x, int y, int z, int w>
+M_INLINE F4 swizzle(F4 a) { return set(a._[x], a._[y], a._[z], a._[w]); }
+
+template<int x, int y, int z, int w>
+M_INLINE F4 shuffle(F4 a, F4 b) { return set(a._[x], a._[y], b._[z], b._[w]); }
+
+M_INLINE void transpose(F4& r0, F4& r1, F4& r2, F4& r3) {
+  F4 t0 = set(r0._[0], r1._[0], r2._[0], r3._[0]);
+  F4 t1 = set(r0._[1], r1._[1], r2._[1], r3._[1]);
+  F4 t2 = set(r0._[2], r1._[2], r2._[2], r3._[2]);
+  F4 t3 = set(r0._[3], r1._[3], r2._[3], r3._[3]);
+  r0 = t0; r1 = t1; r2 = t2; r3 = t3;
+}
+
+#endif
+
+// Shared helpers, built only on the primitives above.
+
+M_INLINE F4 neg(F4 a) { return sub(splat(0.0f), a); }
+
+// Sum of all four lanes, broadcast to every lane.
+M_INLINE F4 hsum(F4 a) {
+  F4 t = add(a, swizzle<1, 0, 3, 2>(a));
+  return add(t, swizzle<2, 3, 0, 1>(t));
+}
+
+M_INLINE F4 dot4(F4 a, F4 b) { return hsum(mul(a, b)); }
+
+// Cross product of the xyz lanes, w is left as 0.
+M_INLINE F4 cross3(F4 a, F4 b) {
+  F4 r = sub(mul(a, swizzle<1, 2, 0, 3>(b)), mul(swizzle<1, 2, 0, 3>(a), b));
+  return swizzle<1, 2, 0, 3>(r);
+}
+
+// Row vector times matrix rows: v.x * r0 + v.y * r1 + v.z * r2 + v.w * r3
+M_INLINE F4 transform(F4 v, F4 r0, F4 r1, F4 r2, F4 r3) {
+  F4 r = mul(swizzle<0, 0, 0, 0>(v), r0);
+  r = madd(swizzle<1, 1, 1, 1>(v), r1, r);
+  r = madd(swizzle<2, 2, 2, 2>(v), r2, r);
+  return madd(swizzle<3, 3, 3, 3>(v), r3, r);
+}
+} // simd
+} // m
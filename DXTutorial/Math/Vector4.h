@@ -1,6 +1,7 @@
 #pragma once
 
-#include "../WinConfigs.h"
+#include "../PlatformConfigs.h"
+#include "SIMD.h"
 
 
 namespace m {
@@ -75,7 +76,7 @@ struct Vector3 {
 };
 
 
-struct Vector4 {
+struct alignas(16) Vector4 {
   union { struct { R32 _x, _y, _z, _w; };
           struct { R32 _r, _g, _b, _a; }; };
   Vector4(R32 x = 0.0f, R32 y = 0.0f, R32 z = 0.0f, R32 w = 1.0f)
@@ -84,6 +85,76 @@ struct Vector4 {
   Vector4(const Vector3& v, R32 w = 1.0f)
     : _x(v._x), _y(v._y), _z(v._z), _w(w) { }
 
+  explicit Vector4(simd::F4 v) { simd::storeAligned(&_x, v); }
+
+  simd::F4 load() const { return simd::loadAligned(&_x); }
+
+  Vector4 operator+(const Vector4& other) const {
+    return Vector4(simd::add(load(), other.load()));
+  }
+
+  Vector4 operator-(const Vector4& other) const {
+    return Vector4(simd::sub(load(), other.load()));
+  }
+
+  Vector4 operator*(const Vector4& other) const {
+    return Vector4(simd::mul(load(), other.load()));
+  }
+
+  Vector4 operator*(R32 scalar) const {
+    return Vector4(simd::mul(load(), simd::splat(scalar)));
+  }
+
+  Vector4 operator/(const Vector4& other) const {
+    return Vector4(simd::div(load(), other.load()));
+  }
+
+  Vector4 operator/(R32 scalar) const {
+    return Vector4(simd::mul(load(), simd::splat(1.0f / scalar)));
+  }
+
+  Vector4 operator-() const {
+    return Vector4(simd::neg(load()));
+  }
+
+  void operator+=(const Vector4& other) { simd::storeAligned(&_x, simd::add(load(), other.load())); }
+  void operator-=(const Vector4& other) { simd::storeAligned(&_x, simd::sub(load(), other.load())); }
+  void operator*=(R32 scalar) { simd::storeAligned(&_x, simd::mul(load(), simd::splat(scalar))); }
+
+  // Four component dot product.
+  R32 dot(const Vector4& other) const {
+    return simd::first(simd::dot4(load(), other.load()));
+  }
+
+  // Cross product of the xyz components, w is set to 0.
+  Vector4 cross(const Vector4& other) const {
+    return Vector4(simd::cross3(load(), other.load()));
+  }
+
+  R32 length() const {
+    return sqrtf(dot(*this));
+  }
+
+  Vector4 normalize() const {
+    return (*this) / length();
+  }
+
+  static Vector4 min(const Vector4& a, const Vector4& b) {
+    return Vector4(simd::min(a.load(), b.load()));
+  }
+
+  static Vector4 max(const Vector4& a, const Vector4& b) {
+    return Vector4(simd::max(a.load(), b.load()));
+  }
+
+  B32 operator==(const Vector4& other) const {
+    return (_x == other._x) && (_y == other._y) && (_z == other._z) && (_w == other._w);
+  }
+
+  B32 operator!=(const Vector4& other) const {
+    return !(*this == other);
+  }
+
   R32& operator[](U32 i) { return (&_x)[ i ]; }
 
 
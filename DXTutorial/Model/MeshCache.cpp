@@ -0,0 +1,165 @@
+//
+#include "MeshCache.h"
+#include "../VertexFormat.h"
+
+#include <atomic>
+#include <stdio.h>
+#if defined(_WIN32)
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace jcl {
+
+
+static_assert(sizeof(MeshCacheHeader) == 112, "MeshCacheHeader layout is part of the file format.");
+static_assert(sizeof(MeshCacheSubMesh) == 40, "MeshCacheSubMesh layout is part of the file format.");
+
+static const U64 kStreamAlignment = 16ull;
+
+
+static U64 alignUp(U64 value, U64 alignment)
+{
+    return (value + alignment - 1ull) & ~(alignment - 1ull);
+}
+
+
+std::string getMeshCachePath(const std::string& sourcePath)
+{
+    return sourcePath + ".jmesh";
+}
+
+
+B32 MeshCache::open(const std::string& path, U64 sourceHash, VertexFormat format)
+{
+    close();
+    if (!m_file.open(path)) return false;
+    if (m_file.getSize() < sizeof(MeshCacheHeader)) {
+        close();
+        return false;
+    }
+
+    const MeshCacheHeader* pHeader = reinterpret_cast<const MeshCacheHeader*>(m_file.getData());
+    B32 valid = pHeader->_magic == kMeshCacheMagic
+        && pHeader->_version == kMeshCacheVersion
+        && pHeader->_sourceHash == sourceHash
+        && pHeader->_vertexFormat == static_cast<U32>(format)
+        && pHeader->_vertexStride == jcl::getVertexStride(format)
+        && pHeader->_fileSize == m_file.getSize()
+        // Counts are bounded first, so the sizes below can't overflow.
+        && pHeader->_vertexCount <= pHeader->_fileSize
+        && pHeader->_indexCount <= pHeader->_fileSize
+        && pHeader->_vertexOffset % kStreamAlignment == 0
+        && pHeader->_indexOffset % sizeof(U32) == 0
+        && pHeader->_submeshOffset % sizeof(U64) == 0
+        && pHeader->_vertexOffset + pHeader->_vertexCount * pHeader->_vertexStride <= pHeader->_fileSize
+        && pHeader->_indexOffset + pHeader->_indexCount * sizeof(U32) <= pHeader->_fileSize
+        && pHeader->_submeshOffset + pHeader->_submeshCount * sizeof(MeshCacheSubMesh) <= pHeader->_fileSize;
+    // Submeshes must stay inside of the streams, written as differences so they can't overflow.
+    const MeshCacheSubMesh* pSubMeshes = valid
+        ? reinterpret_cast<const MeshCacheSubMesh*>(m_file.getData() + pHeader->_submeshOffset) : nullptr;
+    for (U32 i = 0; valid && i < pHeader->_submeshCount; ++i) {
+        const MeshCacheSubMesh& submesh = pSubMeshes[i];
+        valid = submesh._vertOffset <= pHeader->_vertexCount
+            && submesh._vertCount <= pHeader->_vertexCount - submesh._vertOffset
+            && submesh._indOffset <= pHeader->_indexCount
+            && submesh._indCount <= pHeader->_indexCount - submesh._indOffset;
+    }
+    if (!valid) {
+        close();
+        return false;
+    }
+    m_pHeader = pHeader;
+    return true;
+}
+
+
+void MeshCache::close()
+{
+    m_file.close();
+    m_pHeader = nullptr;
+}
+
+
+Bounds3D MeshCache::getBounds() const
+{
+    return Bounds3D(Vector3(m_pHeader->_boundsMin[0], m_pHeader->_boundsMin[1], m_pHeader->_boundsMin[2]),
+                    Vector3(m_pHeader->_boundsMax[0], m_pHeader->_boundsMax[1], m_pHeader->_boundsMax[2]));
+}
+
+
+static B32 writePadded(FILE* pFile, const void* pData, U64 szBytes, U64 paddedBytes)
+{
+    static const U8 kZeros[kStreamAlignment] = { };
+    if (szBytes && fwrite(pData, 1, static_cast<size_t>(szBytes), pFile) != szBytes) return false;
+    U64 padding = paddedBytes - szBytes;
+    return padding == 0 || fwrite(kZeros, 1, static_cast<size_t>(padding), pFile) == padding;
+}
+
+
+B32 MeshCache::write(const std::string& path,
+                     U64 sourceHash,
+                     VertexFormat format,
+                     const void* pVertices,
+                     U64 vertexCount,
+                     const U32* pIndices,
+                     U64 indexCount,
+                     const MeshCacheSubMesh* pSubMeshes,
+                     U32 submeshCount,
+                     const Bounds3D& bounds)
+{
+    MeshCacheHeader header = { };
+    header._magic = kMeshCacheMagic;
+    header._version = kMeshCacheVersion;
+    header._sourceHash = sourceHash;
+    header._vertexFormat = static_cast<U32>(format);
+    header._vertexStride = jcl::getVertexStride(format);
+    header._submeshCount = submeshCount;
+    header._vertexCount = vertexCount;
+    header._indexCount = indexCount;
+    header._boundsMin[0] = bounds._min._x;
+    header._boundsMin[1] = bounds._min._y;
+    header._boundsMin[2] = bounds._min._z;
+    header._boundsMax[0] = bounds._max._x;
+    header._boundsMax[1] = bounds._max._y;
+    header._boundsMax[2] = bounds._max._z;
+
+    U64 vertexBytes = vertexCount * header._vertexStride;
+    U64 indexBytes = indexCount * sizeof(U32);
+    U64 submeshBytes = submeshCount * sizeof(MeshCacheSubMesh);
+    header._vertexOffset = alignUp(sizeof(MeshCacheHeader), kStreamAlignment);
+    header._indexOffset = alignUp(header._vertexOffset + vertexBytes, kStreamAlignment);
+    header._submeshOffset = alignUp(header._indexOffset + indexBytes, kStreamAlignment);
+    header._fileSize = header._submeshOffset + submeshBytes;
+
+    // Loads of the same model can race to write its cache, in this process or another, each
+    // writes a temp file of its own.
+#if defined(_WIN32)
+    U32 processId = static_cast<U32>(_getpid());
+#else
+    U32 processId = static_cast<U32>(getpid());
+#endif
+    static std::atomic<U32> s_tempCounter(0);
+    std::string tempPath = path + ".tmp" + std::to_string(processId) + "." + std::to_string(s_tempCounter++);
+    FILE* pFile = fopen(tempPath.c_str(), "wb");
+    if (!pFile) return false;
+    B32 written = writePadded(pFile, &header, sizeof(header), header._vertexOffset)
+        && writePadded(pFile, pVertices, vertexBytes, header._indexOffset - header._vertexOffset)
+        && writePadded(pFile, pIndices, indexBytes, header._submeshOffset - header._indexOffset)
+        && writePadded(pFile, pSubMeshes, submeshBytes, submeshBytes);
+    written = (fclose(pFile) == 0) && written;
+    if (!written) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    // rename() won't replace an existing file everywhere, so a stale cache is removed first.
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+} // jcl
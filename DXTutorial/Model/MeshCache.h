@@ -0,0 +1,103 @@
+//
+#pragma once
+
+#include "../GlobalDef.h"
+#include "../MappedFile.h"
+#include "../Math/Bounds3D.h"
+
+#include <string>
+
+namespace jcl {
+
+
+// Bump whenever the layout below, or what the importers produce, changes. Older caches are rebuilt.
+static const U32 kMeshCacheVersion = 1;
+static const U32 kMeshCacheMagic = 0x48534d4a; // "JMSH"
+
+
+/*
+    .jmesh file layout, native endian. Streams are stored exactly as they are uploaded, so they
+    can be handed to the renderer straight out of the mapping:
+        MeshCacheHeader
+        vertex stream, _vertexCount * _vertexStride bytes, at _vertexOffset (16 byte aligned)
+        index stream, _indexCount U32s, at _indexOffset
+        MeshCacheSubMesh table, _submeshCount entries, at _submeshOffset
+*/
+struct MeshCacheHeader
+{
+    U32 _magic;
+    U32 _version;
+    // hashBytes of the source file the cache was built from.
+    U64 _sourceHash;
+    U32 _vertexFormat;
+    U32 _vertexStride;
+    U32 _submeshCount;
+    U32 _reserved;
+    U64 _vertexCount;
+    U64 _indexCount;
+    R32 _boundsMin[4];
+    R32 _boundsMax[4];
+    U64 _vertexOffset;
+    U64 _indexOffset;
+    U64 _submeshOffset;
+    U64 _fileSize;
+};
+
+
+struct MeshCacheSubMesh
+{
+    U64 _vertOffset;
+    U64 _vertCount;
+    U64 _indOffset;
+    U64 _indCount;
+    // Index into the model's materials, -1 for none.
+    I32 _material;
+    U32 _reserved;
+};
+
+
+// Cache path for a source model, next to it.
+std::string getMeshCachePath(const std::string& sourcePath);
+
+
+/*
+    Mesh Cache maps a .jmesh file and validates it against the source it should have been built
+    from. Pointers it hands out point into the mapping, and stay valid until close().
+*/
+class MeshCache
+{
+public:
+    MeshCache() : m_pHeader(nullptr) { }
+
+    // Fails if the file is missing, truncated, of another version or vertex format, has a submesh
+    // reaching past its streams, or was built from a source that hashed differently.
+    B32 open(const std::string& path, U64 sourceHash, VertexFormat format);
+    void close();
+
+    const void* getVertices() const { return m_file.getData() + m_pHeader->_vertexOffset; }
+    U64 getVertexCount() const { return m_pHeader->_vertexCount; }
+    U32 getVertexStride() const { return m_pHeader->_vertexStride; }
+    const U32* getIndices() const { return reinterpret_cast<const U32*>(m_file.getData() + m_pHeader->_indexOffset); }
+    U64 getIndexCount() const { return m_pHeader->_indexCount; }
+    const MeshCacheSubMesh* getSubMeshes() const { return reinterpret_cast<const MeshCacheSubMesh*>(m_file.getData() + m_pHeader->_submeshOffset); }
+    U32 getSubMeshCount() const { return m_pHeader->_submeshCount; }
+    Bounds3D getBounds() const;
+
+    // Write a cache, through a temporary file that is renamed into place, so readers never
+    // see a partial one. Returns false if it could not be written, which is not an error.
+    static B32 write(const std::string& path,
+                     U64 sourceHash,
+                     VertexFormat format,
+                     const void* pVertices,
+                     U64 vertexCount,
+                     const U32* pIndices,
+                     U64 indexCount,
+                     const MeshCacheSubMesh* pSubMeshes,
+                     U32 submeshCount,
+                     const Bounds3D& bounds);
+
+private:
+    MappedFile m_file;
+    const MeshCacheHeader* m_pHeader;
+};
+} // jcl
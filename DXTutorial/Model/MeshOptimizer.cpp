@@ -0,0 +1,306 @@
+//
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+namespace jcl {
+
+
+// FIFO cache simulated with timestamps. A vertex is cached while fewer than cacheSize
+// misses have happened since it was put in.
+class CacheSimulator
+{
+public:
+    CacheSimulator(U32 vertexCount, U32 cacheSize)
+        : m_times(vertexCount, 0)
+        , m_cacheSize(cacheSize)
+        , m_time(cacheSize + 1) { }
+
+    // Returns 1 on a miss, and puts the vertex in the cache.
+    U32 access(U32 v)
+    {
+        if (m_time - m_times[v] <= m_cacheSize) return 0;
+        m_times[v] = m_time++;
+        return 1;
+    }
+
+    U32 accessTriangle(const U32* pTriangle)
+    {
+        return access(pTriangle[0]) + access(pTriangle[1]) + access(pTriangle[2]);
+    }
+
+    void flush() { m_time += m_cacheSize + 1; }
+
+private:
+    std::vector<U32> m_times;
+    U32 m_cacheSize;
+    U32 m_time;
+};
+
+
+U32 optimizeVertexCache(U32* pIndices,
+                        U32 indexCount,
+                        U32 vertexCount,
+                        U32* pClusters)
+{
+    U32 triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0) return 0;
+#if _DEBUG
+    // Every pass after this indexes per vertex arrays, loaders check indices from files first.
+    for (U32 i = 0; i < triCount * 3; ++i) {
+        ASSERT(pIndices[i] < vertexCount);
+    }
+#endif
+
+    // Triangles around every vertex, and how many of them are still to be emitted.
+    std::vector<U32> liveCount(vertexCount, 0);
+    for (U32 i = 0; i < triCount * 3; ++i) {
+        ++liveCount[pIndices[i]];
+    }
+    std::vector<U32> adjacencyOffsets(vertexCount + 1, 0);
+    for (U32 v = 0; v < vertexCount; ++v) {
+        adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveCount[v];
+    }
+    std::vector<U32> adjacency(triCount * 3);
+    {
+        std::vector<U32> cursor(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+        for (U32 i = 0; i < triCount * 3; ++i) {
+            adjacency[cursor[pIndices[i]]++] = i / 3;
+        }
+    }
+
+    std::vector<U32> cacheTimes(vertexCount, 0);
+    std::vector<U8> emitted(triCount, 0);
+    std::vector<U32> deadEnd;
+    std::vector<U32> candidates;
+    std::vector<U32> output(triCount * 3);
+    deadEnd.reserve(triCount * 3);
+
+    const I32 cacheSize = static_cast<I32>(kVertexCacheSize);
+    U32 timestamp = kVertexCacheSize + 1;
+    U32 cursor = 0;
+    U32 outTri = 0;
+    U32 clusterCount = 0;
+    B32 restart = true;
+    I32 fanning = 0;
+
+    while (fanning >= 0) {
+        // Emit every remaining triangle around the fanning vertex.
+        candidates.clear();
+        for (U32 a = adjacencyOffsets[fanning]; a < adjacencyOffsets[fanning + 1]; ++a) {
+            U32 t = adjacency[a];
+            if (emitted[t]) continue;
+            emitted[t] = 1;
+            if (restart && pClusters) pClusters[clusterCount++] = outTri;
+            restart = false;
+            for (U32 j = 0; j < 3; ++j) {
+                U32 v = pIndices[t * 3 + j];
+                output[outTri * 3 + j] = v;
+                deadEnd.push_back(v);
+                candidates.push_back(v);
+                --liveCount[v];
+                if (timestamp - cacheTimes[v] > kVertexCacheSize) {
+                    cacheTimes[v] = timestamp++;
+                }
+            }
+            ++outTri;
+        }
+
+        // Next fanning vertex is the 1-ring vertex that has been in the cache longest, yet will
+        // still be there after its remaining triangles are emitted.
+        I32 next = -1;
+        I32 bestPriority = -1;
+        for (U32 c = 0; c < candidates.size(); ++c) {
+            U32 v = candidates[c];
+            if (liveCount[v] == 0) continue;
+            I32 age = static_cast<I32>(timestamp - cacheTimes[v]);
+            I32 priority = (age + 2 * static_cast<I32>(liveCount[v]) <= cacheSize) ? age : 0;
+            if (priority > bestPriority) {
+                bestPriority = priority;
+                next = static_cast<I32>(v);
+            }
+        }
+
+        if (next < 0) {
+            // Dead end, fall back to recently used vertices, then to the next unfinished one in order.
+            restart = true;
+            while (!deadEnd.empty()) {
+                U32 v = deadEnd.back();
+                deadEnd.pop_back();
+                if (liveCount[v] > 0) {
+                    next = static_cast<I32>(v);
+                    break;
+                }
+            }
+            while (next < 0 && cursor < vertexCount) {
+                if (liveCount[cursor] > 0) next = static_cast<I32>(cursor);
+                ++cursor;
+            }
+        }
+        fanning = next;
+    }
+
+    memcpy(pIndices, output.data(), sizeof(U32) * triCount * 3);
+    return clusterCount;
+}
+
+
+void optimizeOverdraw(U32* pIndices,
+                      U32 indexCount,
+                      const Vertex* pVertices,
+                      U32 vertexCount,
+                      const U32* pClusters,
+                      U32 clusterCount,
+                      const Vector3& center,
+                      R32 threshold)
+{
+    U32 triCount = indexCount / 3;
+    if (triCount == 0 || clusterCount == 0) return;
+
+    // Split the hard clusters, where the cache restarted anyway, wherever the cache miss ratio
+    // from a cold cache is already within threshold of the whole hard cluster's.
+    CacheSimulator cache(vertexCount, kVertexCacheSize);
+    std::vector<U32> clusters;
+    clusters.reserve(clusterCount * 2);
+    for (U32 c = 0; c < clusterCount; ++c) {
+        U32 start = pClusters[c];
+        U32 end = (c + 1 < clusterCount) ? pClusters[c + 1] : triCount;
+
+        U32 misses = 0;
+        cache.flush();
+        for (U32 t = start; t < end; ++t) {
+            misses += cache.accessTriangle(pIndices + t * 3);
+        }
+        R32 acmr = static_cast<R32>(misses) / static_cast<R32>(end - start);
+
+        U32 softStart = start;
+        misses = 0;
+        cache.flush();
+        for (U32 t = start; t < end; ++t) {
+            misses += cache.accessTriangle(pIndices + t * 3);
+            if (t + 1 < end && static_cast<R32>(misses) <= acmr * threshold * static_cast<R32>(t + 1 - softStart)) {
+                clusters.push_back(softStart);
+                softStart = t + 1;
+                misses = 0;
+                cache.flush();
+            }
+        }
+        clusters.push_back(softStart);
+    }
+
+    // Sort clusters by how far out, along their average normal, they sit from the center.
+    struct ClusterOrder
+    {
+        R32 _key;
+        U32 _cluster;
+    };
+    std::vector<ClusterOrder> order(clusters.size());
+    for (U32 c = 0; c < clusters.size(); ++c) {
+        U32 start = clusters[c];
+        U32 end = (c + 1 < clusters.size()) ? clusters[c + 1] : triCount;
+        Vector3 centroid;
+        Vector3 normal;
+        R32 area = 0.0f;
+        for (U32 t = start; t < end; ++t) {
+            const Vertex& a = pVertices[pIndices[t * 3 + 0]];
+            const Vertex& b = pVertices[pIndices[t * 3 + 1]];
+            const Vertex& d = pVertices[pIndices[t * 3 + 2]];
+            Vector3 p0(a._position._x, a._position._y, a._position._z);
+            Vector3 p1(b._position._x, b._position._y, b._position._z);
+            Vector3 p2(d._position._x, d._position._y, d._position._z);
+            // Counter clockwise front faces, the cross product is twice the area along the normal.
+            Vector3 n = (p1 - p0).cross(p2 - p0);
+            R32 triArea = n.length();
+            centroid = centroid + (p0 + p1 + p2) * (triArea / 3.0f);
+            normal = normal + n;
+            area += triArea;
+        }
+        R32 normalLength = normal.length();
+        R32 key = 0.0f;
+        if (area > 0.0f && normalLength > 0.0f) {
+            key = (centroid / area - center).dot(normal / normalLength);
+        }
+        order[c]._key = key;
+        order[c]._cluster = c;
+    }
+    std::stable_sort(order.begin(), order.end(),
+                     [] (const ClusterOrder& a, const ClusterOrder& b) { return a._key > b._key; });
+
+    std::vector<U32> output(triCount * 3);
+    U32 outIndex = 0;
+    for (U32 i = 0; i < order.size(); ++i) {
+        U32 c = order[i]._cluster;
+        U32 start = clusters[c];
+        U32 end = (c + 1 < clusters.size()) ? clusters[c + 1] : triCount;
+        memcpy(&output[outIndex], pIndices + start * 3, sizeof(U32) * (end - start) * 3);
+        outIndex += (end - start) * 3;
+    }
+    memcpy(pIndices, output.data(), sizeof(U32) * triCount * 3);
+}
+
+
+void optimizeVertexFetch(Vertex* pVertices,
+                         U32* pIndices,
+                         U32 indexCount,
+                         U32 vertexCount)
+{
+    const U32 kUnused = 0xffffffffu;
+    std::vector<U32> remap(vertexCount, kUnused);
+    U32 next = 0;
+    for (U32 i = 0; i < indexCount; ++i) {
+        U32& slot = remap[pIndices[i]];
+        if (slot == kUnused) slot = next++;
+        pIndices[i] = slot;
+    }
+    for (U32 v = 0; v < vertexCount; ++v) {
+        if (remap[v] == kUnused) remap[v] = next++;
+    }
+
+    std::vector<Vertex> vertices(pVertices, pVertices + vertexCount);
+    for (U32 v = 0; v < vertexCount; ++v) {
+        pVertices[remap[v]] = vertices[v];
+    }
+}
+
+
+void optimizeMesh(Vertex* pVertices,
+                  U32 vertexCount,
+                  U32* pIndices,
+                  U32 indexCount,
+                  const Vector3& center)
+{
+    std::vector<U32> clusters(indexCount / 3);
+    U32 clusterCount = optimizeVertexCache(pIndices, indexCount, vertexCount, clusters.data());
+    optimizeOverdraw(pIndices, indexCount, pVertices, vertexCount, clusters.data(), clusterCount, center);
+    optimizeVertexFetch(pVertices, pIndices, indexCount, vertexCount);
+}
+
+
+VertexCacheStats analyzeVertexCache(const U32* pIndices,
+                                    U32 indexCount,
+                                    U32 vertexCount,
+                                    U32 cacheSize)
+{
+    VertexCacheStats stats = { };
+    U32 triCount = indexCount / 3;
+    if (triCount == 0 || vertexCount == 0) return stats;
+
+    CacheSimulator cache(vertexCount, cacheSize);
+    std::vector<U8> referenced(vertexCount, 0);
+    U32 misses = 0;
+    U32 referencedCount = 0;
+    for (U32 i = 0; i < triCount * 3; ++i) {
+        U32 v = pIndices[i];
+        misses += cache.access(v);
+        if (!referenced[v]) {
+            referenced[v] = 1;
+            ++referencedCount;
+        }
+    }
+    stats._acmr = static_cast<R32>(misses) / static_cast<R32>(triCount);
+    stats._atvr = static_cast<R32>(misses) / static_cast<R32>(referencedCount);
+    return stats;
+}
+} // jcl
@@ -0,0 +1,64 @@
+//
+#pragma once
+
+#include "../GlobalDef.h"
+#include "../Math/Vector4.h"
+
+namespace jcl {
+
+
+// Post-transform cache size the optimizer targets, and that the stats are simulated with.
+// Small enough to still help on hardware with bigger caches.
+static const U32 kVertexCacheSize = 16;
+
+
+struct VertexCacheStats
+{
+    // Average cache miss ratio, vertex shader invocations per triangle. 0.5 at best, 3 at worst.
+    R32 _acmr;
+    // Average transformed vertex ratio, invocations per referenced vertex. 1 at best.
+    R32 _atvr;
+};
+
+
+// Reorder triangles of an indexed triangle list for post-transform cache locality, with
+// Tipsify (Sander et al. 2007). Runs in linear time. Indices must be below vertexCount.
+// Writes to pClusters, if given, the first triangle of every run that restarted the cache,
+// and returns how many were written. pClusters needs room for indexCount / 3 entries.
+U32 optimizeVertexCache(U32* pIndices,
+                        U32 indexCount,
+                        U32 vertexCount,
+                        U32* pClusters = nullptr);
+
+// Reorder the clusters of a cache optimized list so that triangles facing out from center,
+// the ones most likely to occlude the rest of the mesh, draw first. Clusters are split further
+// while their cache miss ratio stays within threshold of the cache optimized order.
+void optimizeOverdraw(U32* pIndices,
+                      U32 indexCount,
+                      const Vertex* pVertices,
+                      U32 vertexCount,
+                      const U32* pClusters,
+                      U32 clusterCount,
+                      const Vector3& center,
+                      R32 threshold = 1.05f);
+
+// Reorder vertices in the order the indices first reference them, and remap the indices.
+// Unreferenced vertices are moved to the end.
+void optimizeVertexFetch(Vertex* pVertices,
+                         U32* pIndices,
+                         U32 indexCount,
+                         U32 vertexCount);
+
+// Run all of the above on one submesh, whose indices are relative to its first vertex.
+void optimizeMesh(Vertex* pVertices,
+                  U32 vertexCount,
+                  U32* pIndices,
+                  U32 indexCount,
+                  const Vector3& center);
+
+// Simulate a FIFO post-transform cache of cacheSize entries over the index list.
+VertexCacheStats analyzeVertexCache(const U32* pIndices,
+                                    U32 indexCount,
+                                    U32 vertexCount,
+                                    U32 cacheSize = kVertexCacheSize);
+} // jcl
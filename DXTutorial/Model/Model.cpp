@@ -6,177 +6,491 @@
 #define TINYGLTF_IMPLEMENTATION
 #define TINYGLTF_NO_STB_IMAGE_WRITE
 #include "tiny_gltf.h"
+#include "MeshOptimizer.h"
+#include "../VertexFormat.h"
+#include "../MappedFile.h"
+#include "MeshCache.h"
+#include "../Math/SIMD.h"
+#include "../JobSystem.h"
+
+#include <memory>
 
 
 namespace jcl {
 
 
-void loadSamplers(tinygltf::Model* pModel, gfx::BackendRenderer* pRenderer)
+struct GLTFImage
 {
-    for (U32 i = 0; i < pModel->samplers.size(); ++i) {
-        tinygltf::Sampler& sampler = pModel->samplers[i];
+    U32 _width;
+    U32 _height;
+};
+
+
+// Buffers and image sizes of a glTF or GLB file, read straight out of file mappings.
+// tinygltf only parses the scene description, with buffers and images taken out of it, so
+// buffer contents are never copied into its byte vectors and images are never decoded.
+struct GLTFSource
+{
+    MappedFile _file;
+    // External .bin files.
+    std::vector<std::unique_ptr<MappedFile>> _bufferFiles;
+    // Buffers decoded from data uris.
+    std::vector<std::vector<U8>> _decodedBuffers;
+    std::vector<const U8*> _buffers;
+    std::vector<U64> _bufferSizes;
+    std::vector<GLTFImage> _images;
+};
+
+
+static const U32 kGLBMagic = 0x46546c67;
+static const U32 kGLBChunkJSON = 0x4e4f534a;
+static const U32 kGLBChunkBIN = 0x004e4942;
+
+
+static U32 readU32(const U8* pBytes)
+{
+    U32 value;
+    memcpy(&value, pBytes, sizeof(value));
+    return value;
+}
+
+
+static std::string getBaseDirectory(const std::string& path)
+{
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+
+// Map the buffer, or decode it if it is a data uri. uri is empty for the GLB binary chunk.
+static B32 openGLTFBuffer(GLTFSource* pSource, const std::string& baseDir, const std::string& uri,
+                          U64 byteLength, const U8* pBinChunk, U64 binChunkSize)
+{
+    const U8* pData = nullptr;
+    U64 size = 0;
+    if (uri.empty()) {
+        pData = pBinChunk;
+        size = binChunkSize;
+    } else if (tinygltf::IsDataURI(uri)) {
+        std::string mimeType;
+        pSource->_decodedBuffers.emplace_back();
+        std::vector<U8>& decoded = pSource->_decodedBuffers.back();
+        if (!tinygltf::DecodeDataURI(&decoded, mimeType, uri, static_cast<size_t>(byteLength), true)) return false;
+        pData = decoded.data();
+        size = decoded.size();
+    } else {
+        pSource->_bufferFiles.emplace_back(new MappedFile());
+        MappedFile* pFile = pSource->_bufferFiles.back().get();
+        if (!pFile->open(baseDir + uri)) return false;
+        pData = pFile->getData();
+        size = pFile->getSize();
     }
+    if (!pData || size < byteLength) return false;
+    pSource->_buffers.push_back(pData);
+    pSource->_bufferSizes.push_back(byteLength);
+    return true;
 }
 
 
-void loadTextures(tinygltf::Model* pModel, std::vector<RenderUUID>& textures, FrontEndRenderer* pRenderer)
+// Image size from its header alone, the pixels aren't needed until textures are uploaded.
+static GLTFImage readGLTFImage(const GLTFSource& source, const nlohmann::json& bufferViews,
+                               const nlohmann::json& image, const std::string& baseDir)
 {
-    for (U32 i = 0; i < pModel->images.size(); ++i) {
-        tinygltf::Image& image = pModel->images[i];
-        gfx::Resource* pTexture = nullptr;
-        
-        if (image.component == 3) {
-            
+    I32 width = 0;
+    I32 height = 0;
+    I32 components = 0;
+    if (image.count("bufferView")) {
+        const nlohmann::json& view = bufferViews.at(image["bufferView"].get<size_t>());
+        size_t buffer = view.at("buffer").get<size_t>();
+        U64 offset = view.value("byteOffset", 0ull);
+        U64 length = view.at("byteLength").get<U64>();
+        if (buffer < source._buffers.size() && offset + length <= source._bufferSizes[buffer]) {
+            stbi_info_from_memory(source._buffers[buffer] + offset, static_cast<int>(length), &width, &height, &components);
+        }
+    } else if (image.count("uri")) {
+        std::string uri = image["uri"].get<std::string>();
+        if (tinygltf::IsDataURI(uri)) {
+            std::vector<U8> decoded;
+            std::string mimeType;
+            if (tinygltf::DecodeDataURI(&decoded, mimeType, uri, 0, false) && !decoded.empty()) {
+                stbi_info_from_memory(decoded.data(), static_cast<int>(decoded.size()), &width, &height, &components);
+            }
+        } else {
+            stbi_info((baseDir + uri).c_str(), &width, &height, &components);
         }
-       
-        RenderUUID id = pRenderer->createTexture(   gfx::RESOURCE_DIMENSION_2D, 
-                                    gfx::RESOURCE_USAGE_DEFAULT, 
-                                    gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                                    DXGI_FORMAT_R8G8B8A8_UNORM,
-                                    image.width, image.height, 1, 0, TEXT("ttext"));
-        textures.push_back(id);
     }
+    // Missing images still get a texture, materials index textures by image.
+    GLTFImage info;
+    info._width = width > 0 ? static_cast<U32>(width) : 1u;
+    info._height = height > 0 ? static_cast<U32>(height) : 1u;
+    return info;
 }
 
 
-std::vector<Material> loadMaterials(tinygltf::Model* pModel, std::vector<RenderUUID>& textures)
+// Map a .gltf or .glb file and its buffers, and parse the rest of it into pModel.
+static B32 openGLTF(const std::string& path, tinygltf::Model* pModel, GLTFSource* pSource)
 {
-    std::vector<Material> materials;
-    for (U32 i = 0; i < pModel->materials.size(); ++i) {
-        tinygltf::Material& mat = pModel->materials[i];
-        Material material = { };
-        if (mat.values.find("baseColorTexture") != mat.values.end()) {
-            tinygltf::Texture& texture = pModel->textures[mat.values["baseColorTexture"].TextureIndex()];
-            material.setAlbedoId(textures[mat.values["baseColorTexture"].TextureIndex()]);
+    if (!pSource->_file.open(path)) return false;
+    const U8* pBytes = pSource->_file.getData();
+    U64 size = pSource->_file.getSize();
+
+    const U8* pJSON = pBytes;
+    U64 jsonSize = size;
+    const U8* pBinChunk = nullptr;
+    U64 binChunkSize = 0;
+    if (size >= 20 && readU32(pBytes) == kGLBMagic) {
+        // GLB, a 12 byte header, then a JSON chunk, and an optional binary chunk.
+        U64 length = readU32(pBytes + 8) < size ? readU32(pBytes + 8) : size;
+        jsonSize = readU32(pBytes + 12);
+        if (readU32(pBytes + 16) != kGLBChunkJSON || 20 + jsonSize > length) return false;
+        pJSON = pBytes + 20;
+        U64 binOffset = 20 + ((jsonSize + 3) & ~3ull);
+        if (binOffset + 8 <= length && readU32(pBytes + binOffset + 4) == kGLBChunkBIN) {
+            binChunkSize = readU32(pBytes + binOffset);
+            pBinChunk = pBytes + binOffset + 8;
+            if (binOffset + 8 + binChunkSize > length) return false;
         }
-        materials.push_back(material);
     }
-    return materials;
+
+    nlohmann::json document = nlohmann::json::parse(pJSON, pJSON + jsonSize, nullptr, false);
+    if (document.is_discarded() || !document.is_object()) return false;
+
+    std::string baseDir = getBaseDirectory(path);
+    if (document.count("buffers")) {
+        const nlohmann::json& buffers = document["buffers"];
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            std::string uri = buffers[i].value("uri", std::string());
+            U64 byteLength = buffers[i].value("byteLength", 0ull);
+            if (!openGLTFBuffer(pSource, baseDir, uri, byteLength, pBinChunk, binChunkSize)) return false;
+        }
+    }
+    if (document.count("images")) {
+        const nlohmann::json& images = document["images"];
+        const nlohmann::json& bufferViews = document["bufferViews"];
+        pSource->_images.reserve(images.size());
+        for (size_t i = 0; i < images.size(); ++i) {
+            pSource->_images.push_back(readGLTFImage(*pSource, bufferViews, images[i], baseDir));
+        }
+    }
+
+    document.erase("buffers");
+    document.erase("images");
+    std::string json = document.dump();
+
+    tinygltf::TinyGLTF loader;
+    std::string err;
+    std::string warn;
+    return loader.LoadASCIIFromString(pModel, &err, &warn, json.c_str(), static_cast<U32>(json.size()), baseDir);
 }
 
 
-void loadNode(tinygltf::Model* pModel, tinygltf::Node& node, std::vector<Vertex>& vertices, std::vector<U32>& indices, std::vector<SubMesh>& submeshes, std::vector<Material>& materials)
+// Element count of the accessor's type, 0 for matrices, which vertices have no use for.
+static U32 getComponentCount(I32 type)
 {
-    // contains mesh.
-    if (node.mesh > -1) {
-        tinygltf::Mesh& mmesh = pModel->meshes[node.mesh];
-        for (U32 i = 0; i < mmesh.primitives.size(); ++i) {
-            SubMesh submesh = { };
-            tinygltf::Primitive& primitive = mmesh.primitives[i];
-            R32* positionAttribs = nullptr;
-            R32* normalAttribs = nullptr;
-            R32* tangentAttribs = nullptr;
-            R32* texCoordAttribs = nullptr;
-    
-            // POSITION should always be garuanteed.
-            const tinygltf::Accessor& positionAccessor = pModel->accessors[primitive.attributes["POSITION"]];
-            const tinygltf::BufferView& bufView = pModel->bufferViews[positionAccessor.bufferView];
-            positionAttribs = reinterpret_cast<R32*>(&pModel->buffers[bufView.buffer].data[positionAccessor.byteOffset + bufView.byteOffset]);
-
-            if (primitive.attributes.find("NORMAL") != primitive.attributes.end()) {
-                const tinygltf::Accessor& normalAccessor = pModel->accessors[primitive.attributes["NORMAL"]];
-                const tinygltf::BufferView& bufView = pModel->bufferViews[normalAccessor.bufferView];
-                normalAttribs = reinterpret_cast<R32*>(&pModel->buffers[bufView.buffer].data[normalAccessor.byteOffset + bufView.byteOffset]);
-            }
+    switch (type) {
+        case TINYGLTF_TYPE_SCALAR: return 1;
+        case TINYGLTF_TYPE_VEC2: return 2;
+        case TINYGLTF_TYPE_VEC3: return 3;
+        case TINYGLTF_TYPE_VEC4: return 4;
+        default: return 0;
+    }
+}
 
-            if (primitive.attributes.find("TANGENT") != primitive.attributes.end()) {
-                const tinygltf::Accessor& tangentAccessor = pModel->accessors[primitive.attributes["TANGENT"]];
-                const tinygltf::BufferView& bufView = pModel->bufferViews[tangentAccessor.bufferView];
-                tangentAttribs = reinterpret_cast<R32*>(&pModel->buffers[bufView.buffer].data[tangentAccessor.byteOffset + bufView.byteOffset]);         
-            }
 
-            if (primitive.attributes.find("TEXCOORD_0") != primitive.attributes.end()) {
-                const tinygltf::Accessor& texcoordAccessor = pModel->accessors[primitive.attributes["TEXCOORD_0"]];
-                const tinygltf::BufferView& bufView = pModel->bufferViews[texcoordAccessor.bufferView];    
-                texCoordAttribs = reinterpret_cast<R32*>(&pModel->buffers[bufView.buffer].data[texcoordAccessor.byteOffset + bufView.byteOffset]);
-            }
+static R32 readComponent(const U8* pSrc, I32 componentType, B32 normalized)
+{
+    switch (componentType) {
+        case TINYGLTF_COMPONENT_TYPE_BYTE: {
+            R32 v = static_cast<R32>(*reinterpret_cast<const I8*>(pSrc));
+            return normalized ? fmaxf(v / 127.0f, -1.0f) : v;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+            R32 v = static_cast<R32>(*pSrc);
+            return normalized ? v / 255.0f : v;
+        }
+        case TINYGLTF_COMPONENT_TYPE_SHORT: {
+            I16 s;
+            memcpy(&s, pSrc, sizeof(s));
+            return normalized ? fmaxf(static_cast<R32>(s) / 32767.0f, -1.0f) : static_cast<R32>(s);
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            U16 s;
+            memcpy(&s, pSrc, sizeof(s));
+            return normalized ? static_cast<R32>(s) / 65535.0f : static_cast<R32>(s);
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+            U32 u;
+            memcpy(&u, pSrc, sizeof(u));
+            return static_cast<R32>(u);
+        }
+        case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+            R32 f;
+            memcpy(&f, pSrc, sizeof(f));
+            return f;
+        }
+        default: return 0.0f;
+    }
+}
+
 
-            U64 currVertCount = vertices.size();
-
-            for (U32 i = 0; i < positionAccessor.count; ++i) {
-                Vertex vert = { };
-                vert._position._x = positionAttribs[i * 3 + 0];
-                vert._position._y = positionAttribs[i * 3 + 1];
-                vert._position._z = positionAttribs[i * 3 + 2];
-                vert._position._w = 1.0f;
-        
-                vert._normal._x = normalAttribs[i * 3 + 0];
-                vert._normal._y = normalAttribs[i * 3 + 1];
-                vert._normal._z = normalAttribs[i * 3 + 2];
-                vert._normal._w = 1.0f;
-
-                if (tangentAttribs) {
-                    vert._tangent._x = tangentAttribs[i * 3 + 0];
-                    vert._tangent._y = tangentAttribs[i * 3 + 1];
-                    vert._tangent._z = tangentAttribs[i * 3 + 2];
-                }
-
-                vert._tangent._w = 1.0f;
-                if (texCoordAttribs) {
-                    vert._texcoords._x = texCoordAttribs[i * 2 + 0];
-                    vert._texcoords._y = texCoordAttribs[i * 2 + 1]; 
-                } else {
-                    vert._texcoords._x = vert._texcoords._y = 0.0f;
-                }
-                vertices.push_back(vert);
+// Gather count elements of the accessor into the 4 floats at pOut, and every outStride bytes
+// after it. Components the accessor doesn't have are taken from fill, and so is everything
+// when there is no accessor. Honors the buffer view byte stride. Float elements are moved with
+// one unaligned 4 wide load and store each, as long as 16 bytes can be read from the buffer.
+static void readAccessor(const GLTFSource& source,
+                         const tinygltf::Model& model,
+                         const tinygltf::Accessor* pAccessor,
+                         U64 count,
+                         const Vector4& fill,
+                         R32* pOut,
+                         U64 outStride)
+{
+    using namespace simd;
+    U8* pDst = reinterpret_cast<U8*>(pOut);
+    F4 fillValue = fill.load();
+    U32 components = pAccessor ? getComponentCount(pAccessor->type) : 0;
+    const U8* pSrc = nullptr;
+    const U8* pEnd = nullptr;
+    U64 srcStride = 0;
+    if (components && pAccessor->bufferView >= 0) {
+        const tinygltf::BufferView& view = model.bufferViews[pAccessor->bufferView];
+        I32 componentSize = tinygltf::GetComponentSizeInBytes(pAccessor->componentType);
+        if (componentSize > 0 && view.buffer >= 0 && static_cast<size_t>(view.buffer) < source._buffers.size()) {
+            srcStride = view.byteStride ? view.byteStride : componentSize * components;
+            U64 viewEnd = view.byteOffset + view.byteLength;
+            U64 first = view.byteOffset + pAccessor->byteOffset;
+            U64 readable = count ? (count - 1) * srcStride + componentSize * components : 0;
+            if (viewEnd <= source._bufferSizes[view.buffer] && first + readable <= viewEnd) {
+                pSrc = source._buffers[view.buffer] + first;
+                pEnd = source._buffers[view.buffer] + source._bufferSizes[view.buffer];
             }
+        }
+    }
+
+    if (!pSrc) {
+        // Sparse only or missing accessors, all fill.
+        for (U64 i = 0; i < count; ++i, pDst += outStride) {
+            store(reinterpret_cast<R32*>(pDst), fillValue);
+        }
+        return;
+    }
+
+    if (pAccessor->componentType == TINYGLTF_COMPONENT_TYPE_FLOAT) {
+        // Lanes past the accessor's components come from fill.
+        F4 keep = cmplt(set(0.0f, 1.0f, 2.0f, 3.0f), splat(static_cast<R32>(components)));
+        U64 i = 0;
+        for (; i < count && pSrc + 16 <= pEnd; ++i, pSrc += srcStride, pDst += outStride) {
+            F4 v = load(reinterpret_cast<const R32*>(pSrc));
+            store(reinterpret_cast<R32*>(pDst), select(keep, v, fillValue));
+        }
+        // Last few elements, too close to the end of the buffer for a full load.
+        for (; i < count; ++i, pSrc += srcStride, pDst += outStride) {
+            R32 element[4];
+            store(element, fillValue);
+            memcpy(element, pSrc, sizeof(R32) * components);
+            store(reinterpret_cast<R32*>(pDst), load(element));
+        }
+        return;
+    }
+
+    U32 componentSize = static_cast<U32>(tinygltf::GetComponentSizeInBytes(pAccessor->componentType));
+    for (U64 i = 0; i < count; ++i, pSrc += srcStride, pDst += outStride) {
+        R32 element[4];
+        store(element, fillValue);
+        for (U32 c = 0; c < components; ++c) {
+            element[c] = readComponent(pSrc + c * componentSize, pAccessor->componentType, pAccessor->normalized);
+        }
+        store(reinterpret_cast<R32*>(pDst), load(element));
+    }
+}
 
-            const tinygltf::Accessor& indicesAccessor = pModel->accessors[primitive.indices];
-            const tinygltf::BufferView& indBufView = pModel->bufferViews[indicesAccessor.bufferView];
-            const tinygltf::Buffer& indBuf = pModel->buffers[indBufView.buffer];
-            U64 indicesOffset = indices.size();
-            U64 indicesCount = indicesAccessor.count;
-            switch (indicesAccessor.componentType) {
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
-                    const U32* buf = (const U32*)&indBuf.data[indicesAccessor.byteOffset + indBufView.byteOffset];
-                    for (U32 idx = 0; idx < indicesCount; ++idx) {
-                        indices.push_back(buf[idx]);
-                    }
-                } break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
-                    const U16* buf = (const U16*)&indBuf.data[indicesAccessor.byteOffset + indBufView.byteOffset];
-                    for (U32 idx = 0; idx < indicesCount; ++idx) {
-                        indices.push_back((U32)buf[idx]);
-                    }
-                } break;
-                case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
-                    const U8* buf = (const U8*)&indBuf.data[indicesAccessor.byteOffset + indBufView.byteOffset];
-                    for (U32 idx = 0; idx < indicesCount; ++idx) {
-                        indices.push_back((U32)buf[idx]);
-                    }
-                } break;
-                default: {
-                } break;
+
+// Widen the index accessor into pOut, which has room for accessor.count indices. Returns false
+// if an index is not below vertCount, the primitive can't be drawn or optimized then.
+static B32 readIndices(const GLTFSource& source,
+                       const tinygltf::Model& model,
+                       const tinygltf::Accessor& accessor,
+                       U64 vertCount,
+                       U32* pOut)
+{
+    U64 count = accessor.count;
+    const U8* pSrc = nullptr;
+    I32 componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    if (accessor.bufferView >= 0 && componentSize > 0 && componentSize <= 4) {
+        const tinygltf::BufferView& view = model.bufferViews[accessor.bufferView];
+        U64 first = view.byteOffset + accessor.byteOffset;
+        if (view.buffer >= 0 && static_cast<size_t>(view.buffer) < source._buffers.size() &&
+            first + count * componentSize <= source._bufferSizes[view.buffer]) {
+            pSrc = source._buffers[view.buffer] + first;
+        }
+    }
+    if (!pSrc) {
+        memset(pOut, 0, sizeof(U32) * count);
+        return count == 0 || vertCount > 0;
+    }
+
+    // Index buffer views are tightly packed, the spec doesn't allow a stride on them.
+    switch (accessor.componentType) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+            memcpy(pOut, pSrc, sizeof(U32) * count);
+        } break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            for (U64 i = 0; i < count; ++i) {
+                U16 index;
+                memcpy(&index, pSrc + i * sizeof(U16), sizeof(U16));
+                pOut[i] = index;
+            }
+        } break;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+            for (U64 i = 0; i < count; ++i) {
+                pOut[i] = pSrc[i];
             }
+        } break;
+        default: {
+            memset(pOut, 0, sizeof(U32) * count);
+        } break;
+    }
+
+    // Files are untrusted, the optimizer indexes per vertex arrays with these.
+    for (U64 i = 0; i < count; ++i) {
+        if (pOut[i] >= vertCount) return false;
+    }
+    return true;
+}
+
+
+static const tinygltf::Accessor* findAttribute(const tinygltf::Model& model, const tinygltf::Primitive& primitive, const char* name)
+{
+    auto it = primitive.attributes.find(name);
+    if (it == primitive.attributes.end() || it->second < 0 || static_cast<size_t>(it->second) >= model.accessors.size()) return nullptr;
+    return &model.accessors[it->second];
+}
+
+
+void loadSamplers(tinygltf::Model* pModel, gfx::BackendRenderer* pRenderer)
+{
+    for (U32 i = 0; i < pModel->samplers.size(); ++i) {
+        tinygltf::Sampler& sampler = pModel->samplers[i];
+    }
+}
 
-            submesh.initialize(currVertCount, positionAccessor.count, indicesOffset, indicesCount, &materials[primitive.material]);
-            submeshes.push_back(submesh);
+
+// Albedo texture of each material, as an index into the model's images.
+std::vector<I32> loadMaterials(const tinygltf::Model& model)
+{
+    std::vector<I32> materials;
+    for (U32 i = 0; i < model.materials.size(); ++i) {
+        const tinygltf::Material& mat = model.materials[i];
+        I32 albedo = -1;
+        auto baseColor = mat.values.find("baseColorTexture");
+        if (baseColor != mat.values.end()) {
+            albedo = baseColor->second.TextureIndex();
         }
+        materials.push_back(albedo);
     }
+    return materials;
+}
+
 
+// A primitive of the scene, and the place of its vertices and indices in the model's streams.
+struct GLTFPrimitive
+{
+    const tinygltf::Primitive* _pPrimitive;
+    const tinygltf::Accessor* _pPosition;
+    MeshCacheSubMesh _submesh;
+};
+
+
+// Lay out every primitive under the node, and its children, back to back in the streams.
+void gatherPrimitives(const tinygltf::Model& model, const tinygltf::Node& node, std::vector<GLTFPrimitive>& primitives, U64* pVertexCount, U64* pIndexCount)
+{
+    if (node.mesh > -1) {
+        const tinygltf::Mesh& mesh = model.meshes[node.mesh];
+        for (const tinygltf::Primitive& primitive : mesh.primitives) {
+            // POSITION should always be garuanteed.
+            const tinygltf::Accessor* pPosition = findAttribute(model, primitive, "POSITION");
+            if (!pPosition) continue;
+
+            GLTFPrimitive gathered = { };
+            gathered._pPrimitive = &primitive;
+            gathered._pPosition = pPosition;
+            gathered._submesh._vertOffset = *pVertexCount;
+            gathered._submesh._vertCount = pPosition->count;
+            gathered._submesh._indOffset = *pIndexCount;
+            gathered._submesh._indCount = primitive.indices >= 0 ? model.accessors[primitive.indices].count : 0;
+            gathered._submesh._material = primitive.material;
+            *pVertexCount += gathered._submesh._vertCount;
+            *pIndexCount += gathered._submesh._indCount;
+            primitives.push_back(gathered);
+        }
+    }
     for (U32 child = 0; child < node.children.size(); ++child) {
-        tinygltf::Node& childNode = pModel->nodes[node.children[child]];
-        loadNode(pModel, childNode, vertices, indices, submeshes, materials);
+        gatherPrimitives(model, model.nodes[node.children[child]], primitives, pVertexCount, pIndexCount);
+    }
+}
+
+
+// Gather the primitive's attributes and indices into its place in the streams, and optimize it.
+// Primitives don't share anything they write, so any number of them can load at once. A primitive
+// with indices out of range is left with none, and draws nothing.
+void loadPrimitive(const GLTFSource& source, const tinygltf::Model& model, GLTFPrimitive& gathered, Vertex* pVertices, U32* pIndices, const Vector3& center)
+{
+    const tinygltf::Primitive& primitive = *gathered._pPrimitive;
+    MeshCacheSubMesh& submesh = gathered._submesh;
+
+    // Every attribute is gathered straight into the vertices, one attribute at a time.
+    U64 vertCount = submesh._vertCount;
+    Vertex* pVertex = pVertices + submesh._vertOffset;
+    readAccessor(source, model, gathered._pPosition, vertCount, Vector4(0.0f, 0.0f, 0.0f, 1.0f), &pVertex->_position._x, sizeof(Vertex));
+    readAccessor(source, model, findAttribute(model, primitive, "NORMAL"), vertCount,
+                 Vector4(0.0f, 0.0f, 0.0f, 1.0f), &pVertex->_normal._x, sizeof(Vertex));
+    readAccessor(source, model, findAttribute(model, primitive, "TANGENT"), vertCount,
+                 Vector4(0.0f, 0.0f, 0.0f, 1.0f), &pVertex->_tangent._x, sizeof(Vertex));
+    readAccessor(source, model, findAttribute(model, primitive, "TEXCOORD_0"), vertCount,
+                 Vector4(0.0f, 0.0f, 0.0f, 0.0f), &pVertex->_texcoords._x, sizeof(Vertex));
+
+    U32* pIndex = pIndices + submesh._indOffset;
+    if (submesh._indCount && !readIndices(source, model, model.accessors[primitive.indices], vertCount, pIndex)) {
+        DEBUG("glTF primitive indexes past its %llu vertices, it is dropped.", (unsigned long long)vertCount);
+        memset(pIndex, 0, sizeof(U32) * submesh._indCount);
+        submesh._indCount = 0;
+        return;
     }
+    optimizeMesh(pVertex, static_cast<U32>(vertCount), pIndex, static_cast<U32>(submesh._indCount), center);
 }
 
 
-std::vector<SubMesh> loadMeshes(tinygltf::Model* pModel, FrontEndRenderer* pRenderer, VertexBuffer* vertBuffer, IndexBuffer* pInd, std::vector<Material>& materials)
+std::vector<MeshCacheSubMesh> loadMeshes(const GLTFSource& source, const tinygltf::Model& model, std::vector<Vertex>& vertices, std::vector<U32>& indices, const Bounds3D& bounds, JobSystem* pJobs)
 {
-    std::vector<Vertex> vertices;
-    std::vector<U32> indices;
-    std::vector<SubMesh> submeshes;
+    std::vector<MeshCacheSubMesh> submeshes;
+    if (model.scenes.empty()) return submeshes;
 
-    tinygltf::Scene& scene = pModel->scenes[pModel->defaultScene];
+    const tinygltf::Scene& scene = model.scenes[model.defaultScene >= 0 ? model.defaultScene : 0];
+    std::vector<GLTFPrimitive> primitives;
+    U64 vertexCount = 0;
+    U64 indexCount = 0;
     for (U32 i = 0; i < scene.nodes.size(); ++i) {
-        tinygltf::Node& node = pModel->nodes[scene.nodes[i]];
-        loadNode(pModel, node, vertices, indices, submeshes, materials);
+        gatherPrimitives(model, model.nodes[scene.nodes[i]], primitives, &vertexCount, &indexCount);
     }
+    vertices.resize(vertexCount);
+    indices.resize(indexCount);
 
-    *vertBuffer = pRenderer->createVertexBuffer(vertices.data(), sizeof(Vertex), sizeof(Vertex) * vertices.size());
-
-    *pInd = pRenderer->createIndexBufferView(indices.data(), indices.size() * sizeof(U32));
+    Vector3 center = bounds.getCenter();
+    auto load = [&] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            loadPrimitive(source, model, primitives[i], vertices.data(), indices.data(), center);
+        }
+    };
+    if (pJobs) {
+        pJobs->parallelFor(static_cast<U32>(primitives.size()), 1, load);
+    } else {
+        load(0, static_cast<U32>(primitives.size()));
+    }
 
+    submeshes.reserve(primitives.size());
+    for (const GLTFPrimitive& primitive : primitives) {
+        submeshes.push_back(primitive._submesh);
+    }
     return submeshes;
 }
 
@@ -191,43 +505,129 @@ void SubMesh::initialize(U64 vertOffset, U64 vertCount, U64 indOffset, U64 indCo
 }
 
 
-void Model::processGLTF(const std::string& path, FrontEndRenderer* pRenderer)
+B32 Model::loadGLTFData(const std::string& path, ModelData* pData, JobSystem* pJobs)
 {
-    tinygltf::TinyGLTF loader;
     tinygltf::Model model;
-    std::string err;
-    std::string warn;
-    bool ret = loader.LoadASCIIFromFile(&model, &err, &warn, path);
+    GLTFSource source;
+    B32 ret = openGLTF(path, &model, &source);
     ASSERT(ret);
+    if (!ret) return false;
 
-    std::vector<RenderUUID> textureResources;
-    loadTextures(&model, textureResources, pRenderer);
-    m_materials = loadMaterials(&model, textureResources);
-    m_submeshes = loadMeshes(&model, pRenderer, &m_vertexBuffer, &m_indexBuffer, m_materials);
-
-    m_totalVertices = m_totalIndices = 0;
-    for (auto& submesh : m_submeshes) {
-        m_totalVertices += static_cast<U32>(submesh.m_vertCount);
-        m_totalIndices += static_cast<U32>(submesh.m_indCount);
+    for (const GLTFImage& image : source._images) {
+        pData->_textureSizes.push_back(std::make_pair(image._width, image._height));
+    }
+    pData->_materials = loadMaterials(model);
+
+    // glTF requires min/max on every POSITION accessor, so bounds come for free.
+    Bounds3D& bounds = pData->_bounds;
+    bounds = Bounds3D(Vector3(FLT_MAX, FLT_MAX, FLT_MAX), Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    for (const tinygltf::Mesh& mesh : model.meshes) {
+        for (const tinygltf::Primitive& primitive : mesh.primitives) {
+            auto position = primitive.attributes.find("POSITION");
+            if (position == primitive.attributes.end()) continue;
+            const tinygltf::Accessor& accessor = model.accessors[position->second];
+            if (accessor.minValues.size() < 3 || accessor.maxValues.size() < 3) continue;
+            bounds._min = Vector3(fminf(bounds._min._x, (R32)accessor.minValues[0]),
+                                  fminf(bounds._min._y, (R32)accessor.minValues[1]),
+                                  fminf(bounds._min._z, (R32)accessor.minValues[2]));
+            bounds._max = Vector3(fmaxf(bounds._max._x, (R32)accessor.maxValues[0]),
+                                  fmaxf(bounds._max._y, (R32)accessor.maxValues[1]),
+                                  fmaxf(bounds._max._z, (R32)accessor.maxValues[2]));
+        }
+    }
+    if (bounds._min._x > bounds._max._x) {
+        bounds = Bounds3D();
     }
 
+    pData->_submeshes = loadMeshes(source, model, pData->_vertexStorage, pData->_indexStorage, bounds, pJobs);
+    setStreams(pData);
+    return true;
 }
 
 
-B32 Model::initialize(const std::string& path, FrontEndRenderer* pRenderer)
+void Model::setStreams(ModelData* pData)
 {
+    pData->_pVertices = pData->_vertexStorage.data();
+    pData->_vertexCount = pData->_vertexStorage.size();
+    if (pData->_vertexFormat == VERTEX_FORMAT_PACKED) {
+        pData->_packedStorage.resize(pData->_vertexStorage.size());
+        packVertices(pData->_vertexStorage.data(), static_cast<U32>(pData->_vertexStorage.size()),
+                     pData->_bounds, pData->_packedStorage.data());
+        pData->_pVertices = pData->_packedStorage.data();
+        // Float vertices are not needed past this.
+        std::vector<Vertex>().swap(pData->_vertexStorage);
+    }
+    pData->_pIndices = pData->_indexStorage.data();
+    pData->_indexCount = pData->_indexStorage.size();
+}
+
+
+B32 Model::load(const std::string& path, VertexFormat format, ModelData* pData, JobSystem* pJobs)
+{
+    pData->_vertexFormat = format;
     size_t extBegin = path.find_last_of('.');
+    if (extBegin == std::string::npos) return false;
     std::string extStr = path.substr(extBegin, path.size() - extBegin);
-    if (extStr.compare(".gltf") == 0)
-        processGLTF(path, pRenderer);
+    if (extStr.compare(".gltf") == 0 || extStr.compare(".glb") == 0)
+        return loadGLTFData(path, pData, pJobs);
     if (extStr.compare(".obj") == 0)
-        processOBJ(path, pRenderer);
+        return loadOBJData(path, pData);
     return false;
 }
 
 
+B32 Model::create(const ModelData& data, FrontEndRenderer* pRenderer)
+{
+    m_vertexFormat = data._vertexFormat;
+    m_bounds = data._bounds;
+
+    m_textures.reserve(data._textureSizes.size());
+    for (const std::pair<U32, U32>& size : data._textureSizes) {
+        RenderUUID id = pRenderer->createTexture(   gfx::RESOURCE_DIMENSION_2D, 
+                                    gfx::RESOURCE_USAGE_DEFAULT, 
+                                    gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                                    DXGI_FORMAT_R8G8B8A8_UNORM,
+                                    size.first, size.second, 1, 0, TEXT("ttext"));
+        m_textures.push_back(id);
+    }
+
+    m_materials.reserve(data._materials.size());
+    for (I32 albedo : data._materials) {
+        Material material = { };
+        if (albedo >= 0 && static_cast<size_t>(albedo) < m_textures.size()) {
+            material.setAlbedoId(m_textures[albedo]);
+        }
+        m_materials.push_back(material);
+    }
+
+    // The upload queue copies the streams out right away, they can be freed on return.
+    U32 stride = getVertexStride(m_vertexFormat);
+    m_vertexBuffer = pRenderer->createVertexBuffer(data._pVertices, stride, stride * data._vertexCount);
+    m_indexBuffer = pRenderer->createIndexBufferView(data._pIndices, data._indexCount * sizeof(U32));
+    m_totalVertices = static_cast<U32>(data._vertexCount);
+    m_totalIndices = static_cast<U32>(data._indexCount);
+
+    m_submeshes.resize(data._submeshes.size());
+    for (size_t i = 0; i < data._submeshes.size(); ++i) {
+        const MeshCacheSubMesh& submesh = data._submeshes[i];
+        I32 material = submesh._material;
+        Material* pMaterial = (material >= 0 && static_cast<size_t>(material) < m_materials.size()) ? &m_materials[material] : nullptr;
+        m_submeshes[i].initialize(submesh._vertOffset, submesh._vertCount, submesh._indOffset, submesh._indCount, pMaterial);
+    }
+    return true;
+}
+
+
+B32 Model::initialize(const std::string& path, FrontEndRenderer* pRenderer, VertexFormat format)
+{
+    ModelData data;
+    if (!load(path, format, &data)) return false;
+    return create(data, pRenderer);
+}
+
+
 B32 Model::cleanUp()
 {
     return false;
 }
-} // jcl
\ No newline at end of file
+} // jcl
@@ -5,12 +5,16 @@
 #include "../Math/Vector4.h"
 #include "../GlobalDef.h"
 #include "../FrontEndRenderer.h"
+#include "MeshCache.h"
 
+#include <memory>
 #include <string>
 #include <vector>
 
 namespace jcl {
 
+class JobSystem;
+
 class Material
 {
 public:
@@ -69,11 +73,68 @@ public:
     Material* m_materialId;
 };
 
+
+// Cpu side geometry of a model, before it reaches the renderer.
+// Submesh indices are relative to the submesh's first vertex.
+struct MeshData
+{
+    std::vector<Vertex> _vertices;
+    std::vector<U32> _indices;
+    std::vector<SubMesh> _submeshes;
+    Bounds3D _bounds;
+};
+
+
+// Everything a model needs from its source files, built without the renderer, so it can be
+// loaded on any thread. Streams are in their upload format, and either live in the storage
+// vectors or point into a mapped mesh cache.
+struct ModelData
+{
+    ModelData()
+        : _vertexFormat(VERTEX_FORMAT_FLOAT)
+        , _pVertices(nullptr)
+        , _vertexCount(0)
+        , _pIndices(nullptr)
+        , _indexCount(0) { }
+
+    VertexFormat _vertexFormat;
+    const void* _pVertices;
+    U64 _vertexCount;
+    const U32* _pIndices;
+    U64 _indexCount;
+    std::vector<Vertex> _vertexStorage;
+    std::vector<PackedVertex> _packedStorage;
+    std::vector<U32> _indexStorage;
+    std::unique_ptr<MeshCache> _pCache;
+
+    // Submesh materials index _materials, -1 for none.
+    std::vector<MeshCacheSubMesh> _submeshes;
+    // Albedo texture of each material, as an index into _textureSizes, -1 for none.
+    std::vector<I32> _materials;
+    // Width and height of each texture.
+    std::vector<std::pair<U32, U32>> _textureSizes;
+    Bounds3D _bounds;
+};
+
+
 class Model
 {
 public:
-
-    B32 initialize(const std::string& path, FrontEndRenderer* pRenderer);
+    // Parse an OBJ file and weld its vertices, without touching the renderer.
+    static B32 loadOBJ(const std::string& path, MeshData* pData);
+    // Reorder every submesh for the post-transform cache, overdraw, and then vertex fetch.
+    static void optimizeMeshData(MeshData* pData);
+
+    // Load an OBJ, glTF or GLB file into pData, without touching the renderer. Safe to call from
+    // any thread. With a job system, glTF primitives are gathered and optimized in parallel on it.
+    static B32 load(const std::string& path, VertexFormat format, ModelData* pData, JobSystem* pJobs = nullptr);
+    // Create the model's gpu resources from loaded data. Must run on the renderer's thread.
+    B32 create(const ModelData& data, FrontEndRenderer* pRenderer);
+
+    // load() then create(), on the calling thread.
+    // Packed vertex formats quantize positions against the model bounds, meshes drawing the model
+    // need getPositionDequantization(getBounds(), ...) in their PerMeshDescriptor.
+    B32 initialize(const std::string& path, FrontEndRenderer* pRenderer, VertexFormat format = VERTEX_FORMAT_FLOAT);
     B32 cleanUp();
 
     RenderUUID getVertexBufferView() const { return m_vertexBuffer.vertexBufferView; }
@@ -84,11 +145,14 @@ public:
     U32 getTotalIndices() const { return m_totalIndices; }
 
     Bounds3D getBounds() const { return m_bounds; }
+    VertexFormat getVertexFormat() const { return m_vertexFormat; }
 
 private:
 
-    void processGLTF(const std::string& path, FrontEndRenderer* pRenderer);
-    void processOBJ(const std::string& path, FrontEndRenderer* pRenderer);
+    static B32 loadGLTFData(const std::string& path, ModelData* pData, JobSystem* pJobs);
+    static B32 loadOBJData(const std::string& path, ModelData* pData);
+    // Point the streams at the storage vectors, packing the vertices first if the format asks for it.
+    static void setStreams(ModelData* pData);
 
     VertexBuffer m_vertexBuffer;
     IndexBuffer m_indexBuffer;
@@ -96,6 +160,7 @@ private:
     U32 m_totalVertices;
     U32 m_totalIndices;
     Bounds3D m_bounds;
+    VertexFormat m_vertexFormat;
 
     std::vector<SubMesh> m_submeshes;
     std::vector<Material> m_materials;
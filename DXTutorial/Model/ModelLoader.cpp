@@ -0,0 +1,93 @@
+//
+#include "ModelLoader.h"
+#include "../JobSystem.h"
+
+namespace jcl {
+
+
+void ModelLoader::initialize(FrontEndRenderer* pRenderer, JobSystem* pJobs)
+{
+    m_pRenderer = pRenderer;
+    m_pJobs = pJobs;
+}
+
+
+void ModelLoader::cleanUp()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_loadedSignal.wait(lock, [this] { return m_loadedCount == m_requestedCount; });
+        m_loaded.clear();
+    }
+    m_requestedCount = 0;
+    m_loadedCount = 0;
+    m_finishedCount = 0;
+}
+
+
+void ModelLoader::load(Model* pModel, const std::string& path, VertexFormat format, LoadCallback callback)
+{
+    Request* pRequest = new Request();
+    pRequest->_pModel = pModel;
+    pRequest->_path = path;
+    pRequest->_format = format;
+    pRequest->_callback = std::move(callback);
+    pRequest->_loaded = false;
+    pRequest->_pLoader = this;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        ++m_requestedCount;
+    }
+    // Loads block on the disk, they stay out of the way of the frame's jobs.
+    m_pJobs->runBackground(&ModelLoader::loadJob, pRequest, 1, nullptr);
+}
+
+
+void ModelLoader::loadJob(void* pData, U32 begin, U32 end)
+{
+    Request* pRequest = static_cast<Request*>(pData);
+    ModelLoader* pLoader = pRequest->_pLoader;
+    pRequest->_loaded = Model::load(pRequest->_path, pRequest->_format, &pRequest->_data, pLoader->m_pJobs);
+    {
+        std::lock_guard<std::mutex> lock(pLoader->m_mutex);
+        pLoader->m_loaded.push_back(std::unique_ptr<Request>(pRequest));
+        ++pLoader->m_loadedCount;
+    }
+    pLoader->m_loadedSignal.notify_all();
+}
+
+
+U32 ModelLoader::update()
+{
+    std::deque<std::unique_ptr<Request>> loaded;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        loaded.swap(m_loaded);
+    }
+
+    for (std::unique_ptr<Request>& pRequest : loaded) {
+        B32 succeeded = pRequest->_loaded && pRequest->_pModel->create(pRequest->_data, m_pRenderer);
+        ++m_finishedCount;
+        if (pRequest->_callback) pRequest->_callback(pRequest->_pModel, succeeded);
+    }
+    return static_cast<U32>(loaded.size());
+}
+
+
+void ModelLoader::waitAll()
+{
+    while (!isIdle()) {
+        if (update() || m_pJobs->runBackgroundJob()) continue;
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_loadedSignal.wait(lock, [this] { return !m_loaded.empty(); });
+    }
+}
+
+
+R32 ModelLoader::getProgress() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_requestedCount == 0) return 1.0f;
+    return static_cast<R32>(m_loadedCount + m_finishedCount) / static_cast<R32>(2 * m_requestedCount);
+}
+} // jcl
@@ -0,0 +1,85 @@
+//
+#pragma once
+
+#include "Model.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace jcl {
+
+class JobSystem;
+
+
+/*
+    Model Loader loads models in the background, as background jobs of the job system. Parsing,
+    welding, mesh optimization and vertex packing run on the workers, independent models and
+    independent glTF primitives in parallel. Gpu resources are only created in update(), on the thread that owns
+    the renderer, so that is the single point loads reach the renderer through.
+*/
+class ModelLoader
+{
+public:
+    // Called from update() once the model is created, or failed to load.
+    typedef std::function<void(Model* pModel, B32 succeeded)> LoadCallback;
+
+    ModelLoader()
+        : m_pRenderer(nullptr)
+        , m_pJobs(nullptr)
+        , m_requestedCount(0)
+        , m_loadedCount(0)
+        , m_finishedCount(0) { }
+
+    void initialize(FrontEndRenderer* pRenderer, JobSystem* pJobs);
+    // Waits for loads in flight, and drops them without creating their models.
+    void cleanUp();
+
+    // Queue pModel to load from path. pModel must stay alive until its callback has run.
+    void load(Model* pModel,
+              const std::string& path,
+              VertexFormat format = VERTEX_FORMAT_FLOAT,
+              LoadCallback callback = LoadCallback());
+
+    // Create every model that finished loading so far, and run their callbacks. Call once a frame,
+    // from the renderer's thread. Returns the number of models finished.
+    U32 update();
+    // Help the workers load, and update(), until every queued model is finished.
+    void waitAll();
+
+    // Fraction of the queued work done, loading and creation count as half of each model.
+    R32 getProgress() const;
+    U32 getRequestedCount() const { return m_requestedCount; }
+    U32 getFinishedCount() const { return m_finishedCount; }
+    B32 isIdle() const { return m_finishedCount == m_requestedCount; }
+
+private:
+    struct Request
+    {
+        Model* _pModel;
+        std::string _path;
+        VertexFormat _format;
+        LoadCallback _callback;
+        ModelData _data;
+        B32 _loaded;
+        ModelLoader* _pLoader;
+    };
+
+    static void loadJob(void* pData, U32 begin, U32 end);
+
+    FrontEndRenderer* m_pRenderer;
+    JobSystem* m_pJobs;
+
+    // Requests the workers are done with, waiting for update(). Owned by the job until then.
+    std::deque<std::unique_ptr<Request>> m_loaded;
+    mutable std::mutex m_mutex;
+    std::condition_variable m_loadedSignal;
+    U32 m_requestedCount;
+    // Guarded by m_mutex, written by the workers.
+    U32 m_loadedCount;
+    U32 m_finishedCount;
+};
+} // jcl
@@ -5,6 +5,9 @@
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 #include "../Math/Bounds3D.h"
+#include "MeshOptimizer.h"
+#include "MeshCache.h"
+#include "../Hash.h"
 
 #include <vector>
 #include <cmath>
@@ -12,7 +15,85 @@
 namespace jcl {
 
 
-void Model::processOBJ(const std::string& path, FrontEndRenderer* pRenderer)
+// Open addressed map from a face corner's (position, normal, texcoord) index tuple to the
+// vertex it was welded into. Sized up front from the corner count, so it never rehashes.
+class VertexWelder
+{
+public:
+    explicit VertexWelder(size_t cornerCount)
+    {
+        size_t capacity = 16;
+        while (capacity < cornerCount * 2) capacity <<= 1;
+        m_mask = capacity - 1;
+        m_slots.resize(capacity, Slot());
+        m_stamp = 1;
+    }
+
+    // Forget every tuple. Slots stamped by an earlier clear read as empty, so this is O(1).
+    void clear() { ++m_stamp; }
+
+    // Returns the slot holding idx, or the empty slot to insert it into.
+    U32* find(const tinyobj::index_t& idx)
+    {
+        U32 h = static_cast<U32>(idx.vertex_index) * 0x9E3779B1u;
+        h ^= static_cast<U32>(idx.normal_index) * 0x85EBCA77u;
+        h ^= static_cast<U32>(idx.texcoord_index) * 0xC2B2AE3Du;
+        h ^= h >> 15;
+        for (size_t i = h & m_mask; ; i = (i + 1) & m_mask) {
+            Slot& slot = m_slots[i];
+            if (slot._stamp != m_stamp) {
+                slot._key = idx;
+                slot._stamp = m_stamp;
+                slot._vertex = kEmpty;
+                return &slot._vertex;
+            }
+            if (slot._key.vertex_index == idx.vertex_index
+                && slot._key.normal_index == idx.normal_index
+                && slot._key.texcoord_index == idx.texcoord_index) {
+                return &slot._vertex;
+            }
+        }
+    }
+
+    static const U32 kEmpty = 0xffffffffu;
+
+private:
+    struct Slot
+    {
+        tinyobj::index_t _key;
+        U32 _vertex;
+        U32 _stamp;
+    };
+
+    std::vector<Slot> m_slots;
+    size_t m_mask;
+    U32 m_stamp;
+};
+
+
+static Vertex makeVertex(const tinyobj::attrib_t& attrib, const tinyobj::index_t& idx)
+{
+    Vertex vert = { };
+    vert._position._x = attrib.vertices[3 * idx.vertex_index + 0];
+    vert._position._y = attrib.vertices[3 * idx.vertex_index + 1];
+    vert._position._z = attrib.vertices[3 * idx.vertex_index + 2];
+    vert._position._w = 1.0f;
+    // Normals and texcoords are optional in OBJ, faces without them get an index of -1.
+    if (idx.normal_index >= 0) {
+        vert._normal._x = attrib.normals[3 * idx.normal_index + 0];
+        vert._normal._y = attrib.normals[3 * idx.normal_index + 1];
+        vert._normal._z = attrib.normals[3 * idx.normal_index + 2];
+    }
+    vert._normal._w = 1.0f;
+    if (idx.texcoord_index >= 0) {
+        vert._texcoords._x = attrib.texcoords[2 * idx.texcoord_index + 0];
+        vert._texcoords._y = attrib.texcoords[2 * idx.texcoord_index + 1];
+    }
+    return vert;
+}
+
+
+B32 Model::loadOBJ(const std::string& path, MeshData* pData)
 {
     std::vector<tinyobj::shape_t> shapes;
     std::vector<tinyobj::material_t> materials;
@@ -27,18 +108,39 @@ void Model::processOBJ(const std::string& path, FrontEndRenderer* pRenderer)
 
     if (!err.empty()) {
         // do err logging.
-        return;
+        return false;
     }
 
     if (!result) {
-        return;
+        return false;
     }
     // We calculate the bounds of the mesh to determine if it is not centered at the origin.
     Bounds3D bounds(Vector3(FLT_MAX, FLT_MAX, FLT_MAX), Vector3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
-    std::vector<Vertex> vertices;
-    std::vector<U32> indices;
+    std::vector<Vertex>& vertices = pData->_vertices;
+    std::vector<U32>& indices = pData->_indices;
+    vertices.clear();
+    indices.clear();
+    pData->_submeshes.clear();
+
+    // Count the face corners first, so nothing below has to grow. Every corner is an index,
+    // and at worst a vertex of its own.
+    size_t totalCorners = 0;
+    size_t maxShapeCorners = 0;
+    for (size_t s = 0; s < shapes.size(); ++s) {
+        size_t corners = 0;
+        const std::vector<unsigned char>& faceVertices = shapes[s].mesh.num_face_vertices;
+        for (size_t f = 0; f < faceVertices.size(); ++f) {
+            corners += faceVertices[f];
+        }
+        totalCorners += corners;
+        maxShapeCorners = corners > maxShapeCorners ? corners : maxShapeCorners;
+    }
+    indices.reserve(totalCorners);
+    vertices.reserve(totalCorners);
+    VertexWelder welder(maxShapeCorners);
 
-    // Each shape is a submesh.
+    // Each shape is a submesh. Corners that share a (position, normal, texcoord) tuple are welded
+    // into one vertex. Indices are relative to the submesh's first vertex, which is drawn as the base vertex.
     size_t indexOffset = 0;
     size_t vertexOffset = 0;
     for (size_t s = 0; s < shapes.size(); ++s) {
@@ -46,36 +148,27 @@ void Model::processOBJ(const std::string& path, FrontEndRenderer* pRenderer)
         SubMesh submesh;
         size_t indexCount = 0;
         size_t vertexCount = 0;
+        if (s > 0) welder.clear();
 
         for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); ++f) {
             I32 fv = shapes[s].mesh.num_face_vertices[f];
             for (size_t v = 0; v < fv; ++v) {
-                tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
-                ++vertexCount;
+                const tinyobj::index_t& idx = shapes[s].mesh.indices[index_offset + v];
+                U32* pVertex = welder.find(idx);
+                if (*pVertex == VertexWelder::kEmpty) {
+                    *pVertex = static_cast<U32>(vertexCount++);
+                    Vertex vert = makeVertex(attrib, idx);
+                    vertices.push_back(vert);
+
+                    bounds._max = Vector3(fmaxf(bounds._max._x, vert._position._x),
+                                          fmaxf(bounds._max._y, vert._position._y),
+                                          fmaxf(bounds._max._z, vert._position._z));
+                    bounds._min = Vector3(fminf(bounds._min._x, vert._position._x),
+                                          fminf(bounds._min._y, vert._position._y),
+                                          fminf(bounds._min._z, vert._position._z));
+                }
+                indices.push_back(*pVertex);
                 ++indexCount;
-                Vertex vert;
-                vert._position._x = attrib.vertices[3 * idx.vertex_index + 0];
-                vert._position._y = attrib.vertices[3 * idx.vertex_index + 1];
-                vert._position._z = attrib.vertices[3 * idx.vertex_index + 2];
-                vert._position._w = 1.0f;
-                vert._normal._x = attrib.normals[3 * idx.normal_index + 0];
-                vert._normal._y = attrib.normals[3 * idx.normal_index + 1];
-                vert._normal._z = attrib.normals[3 * idx.normal_index + 2];
-                vert._normal._w = 1.0f;
-                vert._texcoords._x = attrib.texcoords[2 * idx.texcoord_index + 0];
-                vert._texcoords._y = attrib.texcoords[2 * idx.texcoord_index + 1];
-                vert._texcoords._z = 0.0f;
-                vert._texcoords._w = 0.0f;
-
-                vertices.push_back(vert);
-                indices.push_back(indices.size());
-
-                bounds._max = Vector3(fmaxf(bounds._max._x, vert._position._x),
-                                      fmaxf(bounds._max._y, vert._position._y),
-                                      fmaxf(bounds._max._z, vert._position._z));
-                bounds._min = Vector3(fminf(bounds._min._x, vert._position._x),
-                                      fminf(bounds._min._y, vert._position._y),
-                                      fminf(bounds._min._z, vert._position._z));
             }
 
             index_offset += fv;
@@ -90,7 +183,7 @@ void Model::processOBJ(const std::string& path, FrontEndRenderer* pRenderer)
         submesh.m_vertOffset = vertexOffset;
         vertexOffset += vertexCount;
         indexOffset += indexCount;
-        m_submeshes.push_back(submesh);
+        pData->_submeshes.push_back(submesh);
     }
 
     if (bounds.getCenter() != Vector3(0.f, 0.f, 0.f)) {
@@ -101,12 +194,77 @@ void Model::processOBJ(const std::string& path, FrontEndRenderer* pRenderer)
             vertex._position._y = vertex._position._y + diff._y;
             vertex._position._z = vertex._position._z + diff._z;
         }
+        // Bounds follow the vertices to the origin.
+        bounds._min = bounds._min + diff;
+        bounds._max = bounds._max + diff;
     }
 
-    m_vertexBuffer = pRenderer->createVertexBuffer(vertices.data(), sizeof(Vertex), sizeof(Vertex) * vertices.size());
-    m_indexBuffer = pRenderer->createIndexBufferView(indices.data(), indices.size() * sizeof(U32));
-    m_totalIndices = indices.size();
-    m_totalVertices = vertices.size();
-    m_bounds = bounds;
+    pData->_bounds = bounds;
+    return true;
+}
+
+
+void Model::optimizeMeshData(MeshData* pData)
+{
+    for (size_t i = 0; i < pData->_submeshes.size(); ++i) {
+        const SubMesh& submesh = pData->_submeshes[i];
+        optimizeMesh(&pData->_vertices[submesh.m_vertOffset], static_cast<U32>(submesh.m_vertCount),
+                     &pData->_indices[submesh.m_indOffset], static_cast<U32>(submesh.m_indCount),
+                     pData->_bounds.getCenter());
+    }
+}
+
+
+B32 Model::loadOBJData(const std::string& path, ModelData* pData)
+{
+    // The cache is keyed on the source bytes, so any edit to the OBJ rebuilds it.
+    U64 sourceHash = 0;
+    {
+        MappedFile source;
+        if (source.open(path)) sourceHash = hashBytes(source.getData(), source.getSize());
+    }
+    std::string cachePath = getMeshCachePath(path);
+    if (sourceHash) {
+        std::unique_ptr<MeshCache> pCache(new MeshCache());
+        if (pCache->open(cachePath, sourceHash, pData->_vertexFormat)) {
+            pData->_pVertices = pCache->getVertices();
+            pData->_vertexCount = pCache->getVertexCount();
+            pData->_pIndices = pCache->getIndices();
+            pData->_indexCount = pCache->getIndexCount();
+            pData->_submeshes.assign(pCache->getSubMeshes(), pCache->getSubMeshes() + pCache->getSubMeshCount());
+            pData->_bounds = pCache->getBounds();
+            pData->_pCache = std::move(pCache);
+            return true;
+        }
+    }
+
+    MeshData data;
+    if (!loadOBJ(path, &data)) {
+        return false;
+    }
+    optimizeMeshData(&data);
+
+    pData->_bounds = data._bounds;
+    pData->_submeshes.resize(data._submeshes.size());
+    for (size_t i = 0; i < data._submeshes.size(); ++i) {
+        const SubMesh& submesh = data._submeshes[i];
+        MeshCacheSubMesh& out = pData->_submeshes[i];
+        out = MeshCacheSubMesh();
+        out._vertOffset = submesh.m_vertOffset;
+        out._vertCount = submesh.m_vertCount;
+        out._indOffset = submesh.m_indOffset;
+        out._indCount = submesh.m_indCount;
+        out._material = -1;
+    }
+    pData->_vertexStorage = std::move(data._vertices);
+    pData->_indexStorage = std::move(data._indices);
+    setStreams(pData);
+
+    if (sourceHash) {
+        MeshCache::write(cachePath, sourceHash, pData->_vertexFormat, pData->_pVertices, pData->_vertexCount,
+                         pData->_pIndices, pData->_indexCount, pData->_submeshes.data(),
+                         static_cast<U32>(pData->_submeshes.size()), pData->_bounds);
+    }
+    return true;
 }
-} // jcl
\ No newline at end of file
+} // jcl
@@ -0,0 +1,247 @@
+//
+#include "NullBackend.h"
+
+namespace gfx {
+
+
+NullBackend* getBackendNull()
+{
+    static NullBackend backend;
+    return &backend;
+}
+
+
+NullBackend::NullBackend()
+    : m_pBackbufferPass(nullptr)
+    , m_pBackbufferRTV(nullptr)
+    , m_presentCount(0)
+    , m_submitCount(0)
+    , m_recordCommands(false)
+{
+    m_capture = FrameCapture();
+    m_lastCapture = FrameCapture();
+    m_pSwapChain = nullptr;
+    m_hardwareRaytracingCompatible = false;
+    m_harwareMachineLearningCompatible = false;
+    m_hardwareMeshShadingCompatible = false;
+}
+
+
+void NullBackend::initialize(HWND handle, bool isFullScreen, const GpuConfiguration& configs)
+{
+    if (!m_pBackbufferRTV)
+        m_pBackbufferRTV = new RenderTargetView();
+    if (!m_pBackbufferPass) {
+        m_pBackbufferPass = new RenderPass();
+        m_pBackbufferPass->setRenderTargets(&m_pBackbufferRTV, 1);
+    }
+}
+
+
+void NullBackend::cleanUp()
+{
+    delete m_pBackbufferPass;
+    delete m_pBackbufferRTV;
+    m_pBackbufferPass = nullptr;
+    m_pBackbufferRTV = nullptr;
+}
+
+
+void NullBackend::submit(RendererT queue, CommandList** cmdLists, U32 numCmdLists)
+{
+    m_submitCount += numCmdLists;
+    if (!m_recordCommands) return;
+    for (U32 i = 0; i < numCmdLists; ++i) {
+        // Lists created before recording was enabled record nothing.
+        RecordingCommandList* pList = dynamic_cast<RecordingCommandList*>(cmdLists[i]);
+        if (!pList) continue;
+        m_capture._stream.insert(m_capture._stream.end(), pList->getData(), pList->getData() + pList->getSizeBytes());
+        m_capture._listCount += 1;
+        m_capture._commandCount += pList->getCommandCount();
+        m_capture._drawCount += pList->getDrawCount();
+        m_capture._hash = pList->hash(m_capture._hash);
+    }
+}
+
+
+void NullBackend::present()
+{
+    ++m_presentCount;
+    m_lastCapture._stream.swap(m_capture._stream);
+    m_lastCapture._listCount = m_capture._listCount;
+    m_lastCapture._commandCount = m_capture._commandCount;
+    m_lastCapture._drawCount = m_capture._drawCount;
+    m_lastCapture._hash = m_capture._hash;
+    m_capture._stream.clear();
+    m_capture._listCount = 0;
+    m_capture._commandCount = 0;
+    m_capture._drawCount = 0;
+    m_capture._hash = 0;
+}
+
+
+void NullBackend::createBuffer(Resource** buffer,
+                               ResourceUsage usage,
+                               ResourceBindFlags binds,
+                               U32 widthBytes,
+                               U32 structureByteStride,
+                               const TCHAR* debugName)
+{
+    ResourceNull* pResource = new ResourceNull(RESOURCE_DIMENSION_BUFFER, usage, binds, widthBytes);
+    // Only buffers the cpu writes to, or reads from, need any backing memory.
+    if (usage != RESOURCE_USAGE_DEFAULT)
+        pResource->_memory.resize(widthBytes);
+    *buffer = pResource;
+}
+
+
+void NullBackend::createTexture(Resource** texture,
+                                ResourceDimension dimension,
+                                ResourceUsage usage,
+                                ResourceBindFlags binds,
+                                DXGI_FORMAT format,
+                                U32 width,
+                                U32 height,
+                                U32 depth,
+                                U32 structureByteStride,
+                                const TCHAR* debugName)
+{
+    *texture = new ResourceNull(dimension, usage, binds, 0ull);
+}
+
+
+void NullBackend::destroyResource(Resource* resource)
+{
+    delete static_cast<ResourceNull*>(resource);
+}
+
+
+void NullBackend::createRenderTargetView(RenderTargetView** rtv, Resource* texture, const RenderTargetViewDesc& desc)
+{
+    *rtv = new RenderTargetView();
+}
+
+
+void NullBackend::createUnorderedAccessView(UnorderedAccessView** uav, Resource* texture, const UnorderedAccessViewDesc& desc)
+{
+    *uav = new UnorderedAccessView();
+}
+
+
+void NullBackend::createShaderResourceView(ShaderResourceView** srv, Resource* resource, const ShaderResourceViewDesc& desc)
+{
+    *srv = new ShaderResourceView();
+}
+
+
+void NullBackend::createDepthStencilView(DepthStencilView** dsv, Resource* texture, const DepthStencilViewDesc& desc)
+{
+    *dsv = new DepthStencilView();
+}
+
+
+void NullBackend::createVertexBufferView(VertexBufferView** view, Resource* buffer, U32 vertexStride, U32 bufferSzBytes)
+{
+    *view = new VertexBufferView();
+}
+
+
+void NullBackend::createIndexBufferView(IndexBufferView** view, Resource* buffer, DXGI_FORMAT format, U32 szBytes)
+{
+    *view = new IndexBufferView();
+}
+
+
+void NullBackend::createGraphicsPipelineState(GraphicsPipeline** ppPipeline, const GraphicsPipelineInfo* pInfo)
+{
+    *ppPipeline = new GraphicsPipeline();
+}
+
+
+void NullBackend::createComputePipelineState(ComputePipeline** ppPipeline, const ComputePipelineInfo* pInfo)
+{
+    *ppPipeline = new ComputePipeline();
+}
+
+
+void NullBackend::createRayTracingPipelineState(RayTracingPipeline** ppPipeline, const RayTracingPipelineInfo* pInfo)
+{
+    *ppPipeline = new RayTracingPipeline();
+}
+
+
+void NullBackend::createDescriptorTable(DescriptorTable** table)
+{
+    *table = new DescriptorTable();
+}
+
+
+void NullBackend::destroyDescriptorTable(DescriptorTable* table)
+{
+    delete table;
+}
+
+
+void NullBackend::createRenderPass(RenderPass** pPass, U32 rtvSize, B32 hasDepthStencil)
+{
+    *pPass = new RenderPass();
+}
+
+
+void NullBackend::destroyRenderPass(RenderPass* pPass)
+{
+    delete pPass;
+}
+
+
+void NullBackend::createRootSignature(RootSignature** pRootSignature)
+{
+    *pRootSignature = new RootSignature();
+}
+
+
+void NullBackend::destroyRootSignature(RootSignature* pRootSig)
+{
+    delete pRootSig;
+}
+
+
+void NullBackend::createCommandList(CommandList** pList)
+{
+    if (m_recordCommands) {
+        *pList = new RecordingCommandList();
+    } else {
+        *pList = new CommandList();
+    }
+}
+
+
+void NullBackend::destroyCommandList(CommandList* pCmdList)
+{
+    delete pCmdList;
+}
+
+
+void NullBackend::createSampler(Sampler** sampler, const SamplerDesc* pDesc)
+{
+    *sampler = new Sampler();
+}
+
+
+void NullBackend::destroySampler(Sampler* sampler)
+{
+    delete sampler;
+}
+
+
+void NullBackend::createFence(Fence** ppFence)
+{
+    *ppFence = new Fence();
+}
+
+
+void NullBackend::destroyFence(Fence* pFence)
+{
+    delete pFence;
+}
+} // gfx
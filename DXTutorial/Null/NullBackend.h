@@ -0,0 +1,147 @@
+//
+#pragma once
+
+#include "../BackendRenderer.h"
+#include "../RecordingCommandList.h"
+
+#include <vector>
+
+namespace gfx {
+
+
+// Null resource, cpu visible resources keep a system memory copy so that the front end
+// can map and write to them as it would to an upload heap.
+struct ResourceNull : public Resource
+{
+    ResourceNull(ResourceDimension dimension,
+                 ResourceUsage usage,
+                 ResourceBindFlags flags,
+                 U64 szBytes)
+        : Resource(dimension, usage, flags)
+        , _szBytes(szBytes) { }
+
+    void* map(const ResourceMappingRange* pRange) override {
+        if (_memory.empty()) return nullptr;
+        return _memory.data();
+    }
+
+    void unmap(const ResourceMappingRange* pRange) override { }
+
+    U64 _szBytes;
+    std::vector<U8> _memory;
+};
+
+
+/*
+    Null backend renderer. Hands out valid, no-op gpu objects for every create call so that the
+    front end can run its full frame (culling, descriptor updates, command recording, submission)
+    without a device. Used for headless builds and cpu profiling of the submission path.
+*/
+class NullBackend : public BackendRenderer
+{
+public:
+    NullBackend();
+
+    void initialize(HWND handle,
+                    bool isFullScreen,
+                    const GpuConfiguration& configs) override;
+    void cleanUp() override;
+
+    void submit(RendererT queue, CommandList** cmdLists, U32 numCmdLists) override;
+    void present() override;
+
+    void createBuffer(Resource** buffer,
+                      ResourceUsage usage,
+                      ResourceBindFlags binds,
+                      U32 widthBytes,
+                      U32 structureByteStride,
+                      const TCHAR* debugName) override;
+    void createTexture(Resource** texture,
+                       ResourceDimension dimension,
+                       ResourceUsage usage,
+                       ResourceBindFlags binds,
+                       DXGI_FORMAT format,
+                       U32 width,
+                       U32 height,
+                       U32 depth,
+                       U32 structureByteStride,
+                       const TCHAR* debugName) override;
+    void destroyResource(Resource* resource) override;
+
+    void createRenderTargetView(RenderTargetView** rtv, Resource* texture, const RenderTargetViewDesc& desc) override;
+    void createUnorderedAccessView(UnorderedAccessView** uav, Resource* texture, const UnorderedAccessViewDesc& desc) override;
+    void createShaderResourceView(ShaderResourceView** srv,
+                                  Resource* resource,
+                                  const ShaderResourceViewDesc& desc) override;
+    void createDepthStencilView(DepthStencilView** dsv, Resource* texture, const DepthStencilViewDesc& desc) override;
+    void createVertexBufferView(VertexBufferView** view,
+                                Resource* buffer,
+                                U32 vertexStride,
+                                U32 bufferSzBytes) override;
+    void createIndexBufferView(IndexBufferView** view,
+                               Resource* buffer,
+                               DXGI_FORMAT format,
+                               U32 szBytes) override;
+
+    void createGraphicsPipelineState(GraphicsPipeline** ppPipeline,
+                                     const GraphicsPipelineInfo* pInfo) override;
+    void createComputePipelineState(ComputePipeline** ppPipeline,
+                                    const ComputePipelineInfo* pInfo) override;
+    B32 isPipelineCreationThreadSafe() override { return true; }
+    void createRayTracingPipelineState(RayTracingPipeline** ppPipeline,
+                                       const RayTracingPipelineInfo* pInfo) override;
+
+    void createDescriptorTable(DescriptorTable** table) override;
+    void destroyDescriptorTable(DescriptorTable* table) override;
+    void createRenderPass(RenderPass** pPass,
+                          U32 rtvSize,
+                          B32 hasDepthStencil) override;
+    void destroyRenderPass(RenderPass* pPass) override;
+    void createRootSignature(RootSignature** pRootSignature) override;
+    void destroyRootSignature(RootSignature* pRootSig) override;
+    void createCommandList(CommandList** pList) override;
+    void destroyCommandList(CommandList* pCmdList) override;
+    void createSampler(Sampler** sampler, const SamplerDesc* pDesc) override;
+    void destroySampler(Sampler* sampler) override;
+    void createFence(Fence** ppFence) override;
+    void destroyFence(Fence* pFence) override;
+
+    RendererT getSwapchainQueue() override { return kGraphicsQueueId; }
+    RenderPass* getBackbufferRenderPass() override { return m_pBackbufferPass; }
+    RenderTargetView* getSwapchainRenderTargetView() override { return m_pBackbufferRTV; }
+
+    // Number of frames presented, and command lists submitted so far.
+    U64 getPresentCount() const { return m_presentCount; }
+    U64 getSubmitCount() const { return m_submitCount; }
+
+    // Lists created from now on encode their commands into a RecordingCommandList stream, and
+    // the streams submitted each frame are captured, until the next present().
+    void setCommandRecording(B32 enable) { m_recordCommands = enable; }
+    B32 isCommandRecording() const { return m_recordCommands; }
+
+    struct FrameCapture
+    {
+        // Streams of every recording list submitted, back to back, in submission order.
+        std::vector<U8> _stream;
+        U32 _listCount;
+        U32 _commandCount;
+        U32 _drawCount;
+        // Hash of the lists' streams, chained in submission order.
+        U64 _hash;
+    };
+    // Capture of the last frame presented.
+    const FrameCapture& getLastFrameCapture() const { return m_lastCapture; }
+
+private:
+    RenderPass* m_pBackbufferPass;
+    RenderTargetView* m_pBackbufferRTV;
+    U64 m_presentCount;
+    U64 m_submitCount;
+    B32 m_recordCommands;
+    FrameCapture m_capture;
+    FrameCapture m_lastCapture;
+};
+
+
+NullBackend* getBackendNull();
+} // gfx
@@ -0,0 +1,437 @@
+//
+#include "OcclusionCuller.h"
+#include "Math/SIMD.h"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+namespace jcl {
+
+// Occluder faces per setup job.
+static const U32 kFacesPerChunk = 256;
+// Faces are clipped to this many times the screen, in normalized device coordinates, to keep
+// edge functions precise. Nothing past the screen is drawn anyway.
+static const R32 kGuardBand = 2.0f;
+// Clip planes: near, then the four guard band sides.
+static const U32 kClipPlaneCount = 5;
+// Edges reach half a pixel, and a little more for rounding, past a pixel center.
+static const R32 kPixelReach = 0.5f + 1.0f / 256.0f;
+// Faces of less than a pixel, twice their area here, cannot cover one whole.
+static const R32 kMinDoubleArea = 2.0f;
+// Corners closer to the eye plane than this are taken as crossing the near plane.
+static const R32 kMinClipW = 1e-6f;
+
+// Box sides, counter clockwise seen from outside, over corners numbered by their max x, y and z bits.
+static const U32 kBoxFaceIndices[24] = {
+    0, 4, 6, 2,
+    1, 3, 7, 5,
+    0, 1, 5, 4,
+    2, 6, 7, 3,
+    0, 2, 3, 1,
+    4, 5, 7, 6
+};
+
+
+static R32 maxf(R32 a, R32 b) { return a > b ? a : b; }
+static R32 minf(R32 a, R32 b) { return a < b ? a : b; }
+
+
+static R32 clipDistance(const R32* v, U32 plane)
+{
+    switch (plane) {
+        // Reversed depth puts the near plane at z = w.
+        case 0: return v[3] - v[2];
+        case 1: return kGuardBand * v[3] - v[0];
+        case 2: return kGuardBand * v[3] + v[0];
+        case 3: return kGuardBand * v[3] - v[1];
+        default: return kGuardBand * v[3] + v[1];
+    }
+}
+
+
+// Sutherland-Hodgman, keep the part of the polygon in front of the plane.
+static U32 clipPolygon(const R32 (*pIn)[4], U32 count, R32 (*pOut)[4], U32 plane)
+{
+    U32 outCount = 0;
+    for (U32 i = 0; i < count; ++i) {
+        const R32* a = pIn[i];
+        const R32* b = pIn[(i + 1) % count];
+        R32 da = clipDistance(a, plane);
+        R32 db = clipDistance(b, plane);
+        if (da >= 0.0f) {
+            memcpy(pOut[outCount++], a, sizeof(R32) * 4);
+        }
+        if ((da >= 0.0f) != (db >= 0.0f)) {
+            R32 t = da / (da - db);
+            for (U32 c = 0; c < 4; ++c) {
+                pOut[outCount][c] = a[c] + (b[c] - a[c]) * t;
+            }
+            ++outCount;
+        }
+    }
+    return outCount;
+}
+
+
+void OcclusionCuller::initialize(U32 width, U32 height)
+{
+    m_width = width;
+    m_height = height;
+    m_tilesX = width / kTileWidth;
+    m_tilesY = height / kTileHeight;
+    m_depth.assign(width * height, 0.0f);
+    m_tileDepth.assign(m_tilesX * m_tilesY, 0.0f);
+    m_stats = { };
+    clear();
+}
+
+
+void OcclusionCuller::clear()
+{
+    m_positions.clear();
+    m_indices.clear();
+    m_faces.clear();
+    m_occluderCount = 0;
+}
+
+
+void OcclusionCuller::addOccluder(const Vector3* pPositions,
+                                  U32 vertexCount,
+                                  const U32* pIndices,
+                                  U32 indexCount,
+                                  const Matrix44& world,
+                                  B32 closed)
+{
+    U32 base = static_cast<U32>(m_positions.size() / 3);
+    for (U32 i = 0; i < vertexCount; ++i) {
+        Vector4 position = Vector4(pPositions[i], 1.0f) * world;
+        m_positions.push_back(position._x);
+        m_positions.push_back(position._y);
+        m_positions.push_back(position._z);
+    }
+    for (U32 i = 0; i + 3 <= indexCount; i += 3) {
+        OccluderFace face = { static_cast<U32>(m_indices.size()), 3, closed };
+        m_faces.push_back(face);
+        m_indices.push_back(base + pIndices[i]);
+        m_indices.push_back(base + pIndices[i + 1]);
+        m_indices.push_back(base + pIndices[i + 2]);
+    }
+    m_occluderCount += 1;
+}
+
+
+void OcclusionCuller::addOccluder(const Bounds3D& worldBounds)
+{
+    U32 base = static_cast<U32>(m_positions.size() / 3);
+    for (U32 i = 0; i < 8; ++i) {
+        m_positions.push_back((i & 1) ? worldBounds._max._x : worldBounds._min._x);
+        m_positions.push_back((i & 2) ? worldBounds._max._y : worldBounds._min._y);
+        m_positions.push_back((i & 4) ? worldBounds._max._z : worldBounds._min._z);
+    }
+    for (U32 i = 0; i < 24; i += 4) {
+        OccluderFace face = { static_cast<U32>(m_indices.size()), 4, true };
+        m_faces.push_back(face);
+        for (U32 v = 0; v < 4; ++v) {
+            m_indices.push_back(base + kBoxFaceIndices[i + v]);
+        }
+    }
+    m_occluderCount += 1;
+}
+
+
+void OcclusionCuller::setupFaces(const Matrix44& viewToClip, U32 begin, U32 end, FaceChunk& chunk) const
+{
+    using namespace m::simd;
+
+    U32 tileCount = m_tilesX * m_tilesY;
+    chunk._faces.clear();
+    chunk._bins.resize(tileCount);
+    for (std::vector<U32>& bin : chunk._bins) {
+        bin.clear();
+    }
+    chunk._binned = 0;
+
+    F4 r0 = viewToClip.row(0);
+    F4 r1 = viewToClip.row(1);
+    F4 r2 = viewToClip.row(2);
+    F4 r3 = viewToClip.row(3);
+    R32 width = (R32)m_width;
+    R32 height = (R32)m_height;
+
+    for (U32 f = begin; f < end; ++f) {
+        const OccluderFace& face = m_faces[f];
+        R32 polygons[2][kMaxFaceEdges][4];
+        U32 count = face._vertexCount;
+        U32 current = 0;
+        U32 outside = 0;
+        for (U32 v = 0; v < count; ++v) {
+            const R32* p = &m_positions[m_indices[face._firstIndex + v] * 3];
+            store(polygons[0][v], transform(set(p[0], p[1], p[2], 1.0f), r0, r1, r2, r3));
+            for (U32 plane = 0; plane < kClipPlaneCount; ++plane) {
+                outside |= clipDistance(polygons[0][v], plane) < 0.0f ? (1u << plane) : 0u;
+            }
+        }
+        // Most faces are in front of every plane, and skip clipping.
+        for (U32 plane = 0; plane < kClipPlaneCount && count >= 3; ++plane) {
+            if (!(outside & (1u << plane))) continue;
+            count = clipPolygon(polygons[current], count, polygons[current ^ 1], plane);
+            current ^= 1;
+        }
+        if (count < 3) continue;
+
+        R32 p[kMaxFaceEdges][3];
+        for (U32 v = 0; v < count; ++v) {
+            const R32* clip = polygons[current][v];
+            R32 invW = 1.0f / clip[3];
+            p[v][0] = (clip[0] * invW * 0.5f + 0.5f) * width;
+            p[v][1] = (0.5f - clip[1] * invW * 0.5f) * height;
+            p[v][2] = clip[2] * invW;
+        }
+
+        // Twice the signed area, from the fan of triangles over the face. The largest of them
+        // is the one depth is best taken from.
+        R32 doubleArea = 0.0f;
+        R32 largest = 0.0f;
+        U32 planeVertex = 1;
+        for (U32 v = 1; v + 1 < count; ++v) {
+            R32 cross = (p[v][0] - p[0][0]) * (p[v + 1][1] - p[0][1]) - (p[v + 1][0] - p[0][0]) * (p[v][1] - p[0][1]);
+            doubleArea += cross;
+            if (fabsf(cross) > largest) {
+                largest = fabsf(cross);
+                planeVertex = v;
+            }
+        }
+        if (fabsf(doubleArea) < kMinDoubleArea) continue;
+        // Screen y points down, faces turned to the eye wind clockwise on it.
+        if (face._closed && doubleArea > 0.0f) continue;
+
+        R32 minX = FLT_MAX, minY = FLT_MAX;
+        R32 maxX = -FLT_MAX, maxY = -FLT_MAX;
+        for (U32 v = 0; v < count; ++v) {
+            minX = minf(minX, p[v][0]);
+            maxX = maxf(maxX, p[v][0]);
+            minY = minf(minY, p[v][1]);
+            maxY = maxf(maxY, p[v][1]);
+        }
+        ScreenFace screen;
+        screen._minX = (I32)maxf(floorf(minX), 0.0f);
+        screen._minY = (I32)maxf(floorf(minY), 0.0f);
+        screen._maxX = (I32)minf(ceilf(maxX), width);
+        screen._maxY = (I32)minf(ceilf(maxY), height);
+        if (screen._minX >= screen._maxX || screen._minY >= screen._maxY) continue;
+
+        // Either winding is drawn, edges are turned to face inwards.
+        R32 inward = doubleArea < 0.0f ? 1.0f : -1.0f;
+        screen._edgeCount = count;
+        screen._x0 = p[0][0];
+        screen._y0 = p[0][1];
+        for (U32 e = 0; e < count; ++e) {
+            const R32* a = p[e];
+            const R32* b = p[(e + 1) % count];
+            R32 edgeA = inward * (b[1] - a[1]);
+            R32 edgeB = -inward * (b[0] - a[0]);
+            screen._edgeA[e] = edgeA;
+            screen._edgeB[e] = edgeB;
+            screen._edgeC[e] = edgeA * (screen._x0 - a[0]) + edgeB * (screen._y0 - a[1])
+                             - kPixelReach * (fabsf(edgeA) + fabsf(edgeB));
+        }
+
+        // Depth over the screen is a plane, its farthest over a pixel half a pixel's reach down.
+        const R32* q1 = p[planeVertex];
+        const R32* q2 = p[planeVertex + 1];
+        R32 dx1 = q1[0] - p[0][0], dy1 = q1[1] - p[0][1], dz1 = q1[2] - p[0][2];
+        R32 dx2 = q2[0] - p[0][0], dy2 = q2[1] - p[0][1], dz2 = q2[2] - p[0][2];
+        R32 cross = dx1 * dy2 - dx2 * dy1;
+        screen._dzdx = (dz1 * dy2 - dz2 * dy1) / cross;
+        screen._dzdy = (dx1 * dz2 - dx2 * dz1) / cross;
+        screen._z0 = p[0][2] - kPixelReach * (fabsf(screen._dzdx) + fabsf(screen._dzdy));
+
+        U32 faceIdx = static_cast<U32>(chunk._faces.size());
+        chunk._faces.push_back(screen);
+        U32 firstTileX = screen._minX / kTileWidth;
+        U32 lastTileX = (screen._maxX - 1) / kTileWidth;
+        U32 firstTileY = screen._minY / kTileHeight;
+        U32 lastTileY = (screen._maxY - 1) / kTileHeight;
+        for (U32 ty = firstTileY; ty <= lastTileY; ++ty) {
+            for (U32 tx = firstTileX; tx <= lastTileX; ++tx) {
+                chunk._bins[ty * m_tilesX + tx].push_back(faceIdx);
+            }
+        }
+        chunk._binned += (lastTileX - firstTileX + 1) * (lastTileY - firstTileY + 1);
+    }
+}
+
+
+void OcclusionCuller::rasterizeTile(U32 tile)
+{
+    using namespace m::simd;
+
+    I32 tileX = (I32)((tile % m_tilesX) * kTileWidth);
+    I32 tileY = (I32)((tile / m_tilesX) * kTileHeight);
+    for (I32 y = tileY; y < tileY + (I32)kTileHeight; ++y) {
+        memset(&m_depth[y * m_width + tileX], 0, sizeof(R32) * kTileWidth);
+    }
+
+    F4 zero = splat(0.0f);
+    F4 laneCenters = set(0.5f, 1.5f, 2.5f, 3.5f);
+    for (U32 c = 0; c < m_chunkCount; ++c) {
+        const FaceChunk& chunk = m_chunks[c];
+        for (U32 faceIdx : chunk._bins[tile]) {
+            const ScreenFace& face = chunk._faces[faceIdx];
+            // Tiles are a multiple of four pixels wide, start on a group of four.
+            I32 x0 = (face._minX > tileX ? face._minX : tileX) & ~3;
+            I32 x1 = face._maxX < tileX + (I32)kTileWidth ? face._maxX : tileX + (I32)kTileWidth;
+            I32 y0 = face._minY > tileY ? face._minY : tileY;
+            I32 y1 = face._maxY < tileY + (I32)kTileHeight ? face._maxY : tileY + (I32)kTileHeight;
+
+            U32 edgeCount = face._edgeCount;
+            F4 edgeA[kMaxFaceEdges];
+            for (U32 e = 0; e < edgeCount; ++e) {
+                edgeA[e] = splat(face._edgeA[e]);
+            }
+            F4 dzdx = splat(face._dzdx);
+            for (I32 y = y0; y < y1; ++y) {
+                R32 dy = (R32)y + 0.5f - face._y0;
+                F4 rowEdge[kMaxFaceEdges];
+                for (U32 e = 0; e < edgeCount; ++e) {
+                    rowEdge[e] = splat(face._edgeB[e] * dy + face._edgeC[e]);
+                }
+                F4 rowZ = splat(face._dzdy * dy + face._z0);
+                R32* pRow = &m_depth[y * m_width];
+                for (I32 x = x0; x < x1; x += 4) {
+                    F4 dx = add(splat((R32)x - face._x0), laneCenters);
+                    F4 inside = madd(edgeA[0], dx, rowEdge[0]);
+                    for (U32 e = 1; e < edgeCount; ++e) {
+                        inside = min(inside, madd(edgeA[e], dx, rowEdge[e]));
+                    }
+                    F4 z = madd(dzdx, dx, rowZ);
+                    F4 depth = load(pRow + x);
+                    store(pRow + x, select(cmplt(inside, zero), depth, max(depth, z)));
+                }
+            }
+        }
+    }
+
+    F4 farthest = splat(FLT_MAX);
+    for (I32 y = tileY; y < tileY + (I32)kTileHeight; ++y) {
+        const R32* pRow = &m_depth[y * m_width + tileX];
+        for (U32 x = 0; x < kTileWidth; x += 4) {
+            farthest = min(farthest, load(pRow + x));
+        }
+    }
+    R32 lanes[4];
+    store(lanes, farthest);
+    m_tileDepth[tile] = minf(minf(lanes[0], lanes[1]), minf(lanes[2], lanes[3]));
+}
+
+
+void OcclusionCuller::rasterize(const Matrix44& viewToClip, JobSystem* pJobs)
+{
+    m_viewToClip = viewToClip;
+    U32 faceCount = static_cast<U32>(m_faces.size());
+    m_chunkCount = (faceCount + kFacesPerChunk - 1) / kFacesPerChunk;
+    if (m_chunks.size() < m_chunkCount) m_chunks.resize(m_chunkCount);
+
+    auto setupChunks = [this, &viewToClip, faceCount] (U32 begin, U32 end) {
+        for (U32 c = begin; c < end; ++c) {
+            U32 first = c * kFacesPerChunk;
+            U32 last = first + kFacesPerChunk < faceCount ? first + kFacesPerChunk : faceCount;
+            setupFaces(viewToClip, first, last, m_chunks[c]);
+        }
+    };
+    auto rasterizeTiles = [this] (U32 begin, U32 end) {
+        for (U32 tile = begin; tile < end; ++tile) {
+            rasterizeTile(tile);
+        }
+    };
+    U32 tileCount = m_tilesX * m_tilesY;
+    if (pJobs) {
+        pJobs->parallelFor(m_chunkCount, 1, setupChunks);
+        pJobs->parallelFor(tileCount, 1, rasterizeTiles);
+    } else {
+        setupChunks(0, m_chunkCount);
+        rasterizeTiles(0, tileCount);
+    }
+
+    m_stats._occluders = m_occluderCount;
+    m_stats._faces = faceCount;
+    m_stats._rasterizedFaces = 0;
+    m_stats._binnedFaces = 0;
+    m_stats._coveredTiles = 0;
+    for (U32 c = 0; c < m_chunkCount; ++c) {
+        m_stats._rasterizedFaces += static_cast<U32>(m_chunks[c]._faces.size());
+        m_stats._binnedFaces += m_chunks[c]._binned;
+    }
+    for (U32 tile = 0; tile < tileCount; ++tile) {
+        m_stats._coveredTiles += m_tileDepth[tile] > 0.0f ? 1 : 0;
+    }
+}
+
+
+B32 OcclusionCuller::isVisible(const Vector3& center, const Vector3& extent) const
+{
+    using namespace m::simd;
+
+    if (m_stats._rasterizedFaces == 0) return true;
+
+    // Corners are the projected center, plus or minus each projected half extent axis.
+    F4 r0 = m_viewToClip.row(0);
+    F4 r1 = m_viewToClip.row(1);
+    F4 r2 = m_viewToClip.row(2);
+    F4 clipCenter = transform(set(center._x, center._y, center._z, 1.0f), r0, r1, r2, m_viewToClip.row(3));
+    F4 axisX = mul(splat(extent._x), r0);
+    F4 axisY = mul(splat(extent._y), r1);
+    F4 axisZ = mul(splat(extent._z), r2);
+
+    R32 minX = FLT_MAX, minY = FLT_MAX;
+    R32 maxX = -FLT_MAX, maxY = -FLT_MAX;
+    R32 nearest = -FLT_MAX;
+    for (U32 i = 0; i < 8; ++i) {
+        F4 corner = (i & 1) ? add(clipCenter, axisX) : sub(clipCenter, axisX);
+        corner = (i & 2) ? add(corner, axisY) : sub(corner, axisY);
+        corner = (i & 4) ? add(corner, axisZ) : sub(corner, axisZ);
+        R32 clip[4];
+        store(clip, corner);
+        if (clip[3] <= kMinClipW) return true;
+        R32 invW = 1.0f / clip[3];
+        R32 x = (clip[0] * invW * 0.5f + 0.5f) * m_width;
+        R32 y = (0.5f - clip[1] * invW * 0.5f) * m_height;
+        minX = minf(minX, x);
+        maxX = maxf(maxX, x);
+        minY = minf(minY, y);
+        maxY = maxf(maxY, y);
+        nearest = maxf(nearest, clip[2] * invW);
+    }
+
+    // Every pixel the box touches, even in part.
+    I32 x0 = (I32)maxf(floorf(minX), 0.0f);
+    I32 y0 = (I32)maxf(floorf(minY), 0.0f);
+    I32 x1 = (I32)minf(ceilf(maxX), (R32)m_width);
+    I32 y1 = (I32)minf(ceilf(maxY), (R32)m_height);
+    // Off screen, leave it to the frustum test.
+    if (x0 >= x1 || y0 >= y1) return true;
+
+    I32 firstTileX = x0 / (I32)kTileWidth;
+    I32 lastTileX = (x1 - 1) / (I32)kTileWidth;
+    I32 firstTileY = y0 / (I32)kTileHeight;
+    I32 lastTileY = (y1 - 1) / (I32)kTileHeight;
+    for (I32 ty = firstTileY; ty <= lastTileY; ++ty) {
+        for (I32 tx = firstTileX; tx <= lastTileX; ++tx) {
+            // All of the tile is nearer than the box.
+            if (m_tileDepth[ty * m_tilesX + tx] > nearest) continue;
+            I32 px0 = x0 > tx * (I32)kTileWidth ? x0 : tx * (I32)kTileWidth;
+            I32 px1 = x1 < (tx + 1) * (I32)kTileWidth ? x1 : (tx + 1) * (I32)kTileWidth;
+            I32 py0 = y0 > ty * (I32)kTileHeight ? y0 : ty * (I32)kTileHeight;
+            I32 py1 = y1 < (ty + 1) * (I32)kTileHeight ? y1 : (ty + 1) * (I32)kTileHeight;
+            for (I32 y = py0; y < py1; ++y) {
+                const R32* pRow = &m_depth[y * m_width];
+                for (I32 x = px0; x < px1; ++x) {
+                    if (pRow[x] <= nearest) return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+} // jcl
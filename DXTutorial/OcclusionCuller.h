@@ -0,0 +1,139 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "JobSystem.h"
+
+#include <vector>
+
+namespace jcl {
+
+
+struct OcclusionStats
+{
+    // Occluders, and their faces, drawn by the last rasterize().
+    U32 _occluders;
+    U32 _faces;
+    // Faces left to rasterize after clipping, and dropping the ones facing away or too small to cover a pixel.
+    U32 _rasterizedFaces;
+    // Faces listed in tile bins, one for every tile a face touches.
+    U32 _binnedFaces;
+    // Tiles fully covered by occluders.
+    U32 _coveredTiles;
+};
+
+
+/*
+    Occlusion Culler draws a few large occluders, low poly stand-ins or the boxes of solid meshes,
+    into a small depth buffer on the cpu, then tests mesh bounds against it. Depth is reversed like
+    the scene's, greater is nearer. Every pixel keeps the nearest occluder over it, written only where
+    an occluder face covers the whole pixel, and at the farthest depth it has over it, so bounds are only
+    found hidden if they are hidden at full resolution too. Faces are convex polygons: box sides, and
+    triangles, drawn whole after clipping, so no edges run inside of them. Pixels on the edge between
+    two triangles of a mesh are covered whole by neither, give large flat occluders as boxes.
+    Faces are set up and binned to screen tiles in chunks, then each tile is rasterized by one job,
+    four pixels at a time, so no two jobs write the same pixels. Tiles keep their farthest depth,
+    most hidden bounds are rejected from it.
+*/
+class OcclusionCuller
+{
+public:
+    static const U32 kDefaultWidth = 256;
+    static const U32 kDefaultHeight = 144;
+    static const U32 kTileWidth = 32;
+    static const U32 kTileHeight = 16;
+
+    OcclusionCuller()
+        : m_width(0), m_height(0), m_tilesX(0), m_tilesY(0), m_occluderCount(0), m_chunkCount(0), m_stats() { }
+
+    // Width must be a multiple of kTileWidth, height of kTileHeight. Keep the aspect of the view.
+    void initialize(U32 width = kDefaultWidth, U32 height = kDefaultHeight);
+
+    // Drop the occluders given so far. The depth drawn of them stays until the next rasterize().
+    void clear();
+    // Triangles of an occluder, positions in object space, placed in the world by world. Everything
+    // behind an occluder is culled, keep it inside of the mesh it stands for. Both are copied.
+    // Closed occluders, wound counter clockwise seen from outside, skip the triangles facing away.
+    void addOccluder(const Vector3* pPositions,
+                     U32 vertexCount,
+                     const U32* pIndices,
+                     U32 indexCount,
+                     const Matrix44& world,
+                     B32 closed = false);
+    // A solid box in world space, such as the bounds of a wall or of a building's walls.
+    void addOccluder(const Bounds3D& worldBounds);
+    U32 getOccluderCount() const { return m_occluderCount; }
+
+    // Draw the occluders as seen through viewToClip, a reversed depth view-projection.
+    // With pJobs, faces are set up, and tiles rasterized, in parallel on it.
+    void rasterize(const Matrix44& viewToClip, JobSystem* pJobs = nullptr);
+
+    // False if the box, given by its world space center and half extent, is behind the occluders
+    // over all of the screen it covers. Boxes crossing the near plane are always visible.
+    // Safe to call from many threads at once, after rasterize().
+    B32 isVisible(const Vector3& center, const Vector3& extent) const;
+
+    U32 getWidth() const { return m_width; }
+    U32 getHeight() const { return m_height; }
+    // Depth drawn by the last rasterize(), rows top to bottom, 0 where no occluder covers a pixel.
+    const R32* getDepth() const { return m_depth.data(); }
+    const OcclusionStats& getStats() const { return m_stats; }
+
+private:
+    // A box side clipped by the near plane and the four guard band sides.
+    static const U32 kMaxFaceEdges = 4 + 5;
+
+    // Triangle or box side of an occluder, by its indices.
+    struct OccluderFace
+    {
+        U32 _firstIndex;
+        U32 _vertexCount;
+        B32 _closed;
+    };
+
+    // A face on screen. Edge functions e = a * (x - x0) + b * (y - y0) + c at pixel centers, positive
+    // inside, lowered by half a pixel's reach so they only pass pixels covered whole. Depth is the plane
+    // z = z0 + dzdx * (x - x0) + dzdy * (y - y0), lowered the same way to the farthest over a pixel.
+    struct ScreenFace
+    {
+        U32 _edgeCount;
+        R32 _edgeA[kMaxFaceEdges];
+        R32 _edgeB[kMaxFaceEdges];
+        R32 _edgeC[kMaxFaceEdges];
+        R32 _x0, _y0;
+        R32 _z0, _dzdx, _dzdy;
+        // Pixels the face may cover, max excluded.
+        I32 _minX, _minY, _maxX, _maxY;
+    };
+
+    // Screen faces of a chunk of occluder faces, and the ones touching each tile.
+    struct FaceChunk
+    {
+        std::vector<ScreenFace> _faces;
+        std::vector<std::vector<U32>> _bins;
+        U32 _binned;
+    };
+
+    // Clip, set up and bin occluder faces [begin, end) into the chunk.
+    void setupFaces(const Matrix44& viewToClip, U32 begin, U32 end, FaceChunk& chunk) const;
+    // Clear tile and draw the faces binned to it.
+    void rasterizeTile(U32 tile);
+
+    U32 m_width;
+    U32 m_height;
+    U32 m_tilesX;
+    U32 m_tilesY;
+    // World space occluder vertices, three floats each, and the faces over them.
+    std::vector<R32> m_positions;
+    std::vector<U32> m_indices;
+    std::vector<OccluderFace> m_faces;
+    U32 m_occluderCount;
+    std::vector<FaceChunk> m_chunks;
+    U32 m_chunkCount;
+    std::vector<R32> m_depth;
+    // Farthest depth of each tile.
+    std::vector<R32> m_tileDepth;
+    Matrix44 m_viewToClip;
+    OcclusionStats m_stats;
+};
+} // jcl
@@ -0,0 +1,756 @@
+//
+#include "PipelineCache.h"
+#include "Hash.h"
+#include "MappedFile.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace jcl {
+
+
+/*
+    Pipeline cache file layout, native endian:
+        PipelineCacheHeader
+        _recordCount records, each a PipelineCacheRecord then _szBytes of description.
+    Root signatures come first, pipelines refer to them by key.
+*/
+struct PipelineCacheHeader
+{
+    U32 _magic;
+    U32 _version;
+    U32 _recordCount;
+    U32 _reserved;
+};
+
+
+enum PipelineCacheRecordType
+{
+    PIPELINE_CACHE_RECORD_ROOT_SIGNATURE,
+    PIPELINE_CACHE_RECORD_GRAPHICS_PIPELINE,
+    PIPELINE_CACHE_RECORD_COMPUTE_PIPELINE
+};
+
+
+struct PipelineCacheRecord
+{
+    U32 _type;
+    U32 _reserved;
+    U64 _szBytes;
+};
+
+
+// Appends a description field by field, so struct padding never reaches the hash.
+class DescriptionWriter
+{
+public:
+    DescriptionWriter(std::vector<U8>& out)
+        : m_out(out) { m_out.clear(); }
+
+    template<typename T>
+    void write(T value) { append(&value, sizeof(T)); }
+    void writeBool(B32 value) { write<U8>(value ? 1 : 0); }
+    void writeBytes(const void* pData, U64 szBytes)
+    {
+        write(szBytes);
+        append(pData, szBytes);
+    }
+    // Length, terminator included, then the characters. Null is length 0.
+    void writeString(const char* str)
+    {
+        U32 length = str ? static_cast<U32>(strlen(str)) + 1 : 0;
+        write(length);
+        append(str, length);
+    }
+
+private:
+    void append(const void* pData, U64 szBytes)
+    {
+        if (!szBytes) return;
+        size_t at = m_out.size();
+        m_out.resize(at + static_cast<size_t>(szBytes));
+        memcpy(m_out.data() + at, pData, static_cast<size_t>(szBytes));
+    }
+
+    std::vector<U8>& m_out;
+};
+
+
+// Reads a description back in the order it was written. Descriptions can come from a corrupt
+// file, reading past the end returns zeros and fails the reader.
+class DescriptionReader
+{
+public:
+    DescriptionReader(const std::vector<U8>& description)
+        : m_pCursor(description.data())
+        , m_pEnd(description.data() + description.size())
+        , m_isValid(true) { }
+
+    // Every field read, and nothing left over.
+    B32 isDone() const { return m_isValid && m_pCursor == m_pEnd; }
+
+    template<typename T>
+    T read()
+    {
+        T value = T();
+        const U8* pData = take(sizeof(T));
+        if (pData) memcpy(&value, pData, sizeof(T));
+        return value;
+    }
+    B32 readBool() { return read<U8>() != 0; }
+    const void* readBytes(U64& szBytes)
+    {
+        szBytes = read<U64>();
+        const U8* pData = take(szBytes);
+        if (!pData) szBytes = 0;
+        return szBytes ? pData : nullptr;
+    }
+    const char* readString()
+    {
+        U32 length = read<U32>();
+        const U8* pData = take(length);
+        if (!pData || !length) return nullptr;
+        if (pData[length - 1] != 0) {
+            m_isValid = false;
+            return nullptr;
+        }
+        return reinterpret_cast<const char*>(pData);
+    }
+
+private:
+    const U8* take(U64 szBytes)
+    {
+        if (!m_isValid || szBytes > static_cast<U64>(m_pEnd - m_pCursor)) {
+            m_isValid = false;
+            return nullptr;
+        }
+        const U8* pData = m_pCursor;
+        m_pCursor += szBytes;
+        return pData;
+    }
+
+    const U8* m_pCursor;
+    const U8* m_pEnd;
+    B32 m_isValid;
+};
+
+
+static void encodeRootSignature(DescriptionWriter& writer,
+                                gfx::ShaderVisibilityFlags visibleFlags,
+                                const gfx::PipelineLayout* pLayouts,
+                                U32 numLayouts,
+                                const gfx::StaticSamplerDesc* pStaticSamplers,
+                                U32 staticSamplerCount)
+{
+    writer.write<U32>(visibleFlags);
+    writer.write(numLayouts);
+    for (U32 i = 0; i < numLayouts; ++i) {
+        writer.write<U32>(pLayouts[i]._type);
+        writer.write(pLayouts[i]._numConstantBuffers);
+        writer.write(pLayouts[i]._numSamplers);
+        writer.write(pLayouts[i]._numUnorderedAcessViews);
+        writer.write(pLayouts[i]._numShaderResourceViews);
+    }
+    staticSamplerCount = pStaticSamplers ? staticSamplerCount : 0;
+    writer.write(staticSamplerCount);
+    for (U32 i = 0; i < staticSamplerCount; ++i) {
+        const gfx::StaticSamplerDesc& sampler = pStaticSamplers[i];
+        writer.write<U32>(sampler._addressU);
+        writer.write<U32>(sampler._addressV);
+        writer.write<U32>(sampler._addressW);
+        for (U32 c = 0; c < 4; ++c) writer.write(sampler._borderColor[c]);
+        writer.write<U32>(sampler._comparisonFunc);
+        writer.write<U32>(sampler._filter);
+        writer.write(sampler._maxAnisotropy);
+        writer.write(sampler._minLod);
+        writer.write(sampler._maxLod);
+        writer.write(sampler._mipLodBias);
+        writer.write(sampler._registerSpace);
+        writer.write(sampler._shaderRegister);
+    }
+}
+
+
+static B32 decodeRootSignature(const std::vector<U8>& description,
+                               gfx::ShaderVisibilityFlags& visibleFlags,
+                               std::vector<gfx::PipelineLayout>& layouts,
+                               std::vector<gfx::StaticSamplerDesc>& staticSamplers)
+{
+    DescriptionReader reader(description);
+    visibleFlags = reader.read<U32>();
+    U32 numLayouts = reader.read<U32>();
+    // Counts are bounded by what is left to read, before anything is allocated for them.
+    if (numLayouts > description.size()) return false;
+    layouts.resize(numLayouts);
+    for (U32 i = 0; i < numLayouts; ++i) {
+        layouts[i]._type = static_cast<gfx::PipelineLayoutType>(reader.read<U32>());
+        layouts[i]._numConstantBuffers = reader.read<U32>();
+        layouts[i]._numSamplers = reader.read<U32>();
+        layouts[i]._numUnorderedAcessViews = reader.read<U32>();
+        layouts[i]._numShaderResourceViews = reader.read<U32>();
+    }
+    U32 staticSamplerCount = reader.read<U32>();
+    if (staticSamplerCount > description.size()) return false;
+    staticSamplers.resize(staticSamplerCount);
+    for (U32 i = 0; i < staticSamplerCount; ++i) {
+        gfx::StaticSamplerDesc& sampler = staticSamplers[i];
+        sampler._addressU = static_cast<gfx::SamplerAddressMode>(reader.read<U32>());
+        sampler._addressV = static_cast<gfx::SamplerAddressMode>(reader.read<U32>());
+        sampler._addressW = static_cast<gfx::SamplerAddressMode>(reader.read<U32>());
+        for (U32 c = 0; c < 4; ++c) sampler._borderColor[c] = reader.read<R32>();
+        sampler._comparisonFunc = static_cast<gfx::ComparisonFunc>(reader.read<U32>());
+        sampler._filter = static_cast<gfx::SamplerFilter>(reader.read<U32>());
+        sampler._maxAnisotropy = reader.read<R32>();
+        sampler._minLod = reader.read<R32>();
+        sampler._maxLod = reader.read<R32>();
+        sampler._mipLodBias = reader.read<R32>();
+        sampler._registerSpace = reader.read<U32>();
+        sampler._shaderRegister = reader.read<U32>();
+    }
+    return reader.isDone();
+}
+
+
+static void writeShader(DescriptionWriter& writer, const gfx::ShaderByteCode& shader)
+{
+    writer.writeBytes(shader._pByteCode, shader._pByteCode ? shader._szBytes : 0);
+}
+
+
+static void readShader(DescriptionReader& reader, gfx::ShaderByteCode& shader)
+{
+    U64 szBytes = 0;
+    // Backends only read the bytecode.
+    shader._pByteCode = const_cast<void*>(reader.readBytes(szBytes));
+    shader._szBytes = static_cast<size_t>(szBytes);
+}
+
+
+static void writeStencilOp(DescriptionWriter& writer, const gfx::DepthStencilOpDesc& op)
+{
+    writer.write<U32>(op._stencilFunc);
+    writer.write<U32>(op._stencilFailOp);
+    writer.write<U32>(op._stencilDepthFailOp);
+    writer.write<U32>(op._stencilPassOp);
+}
+
+
+static void readStencilOp(DescriptionReader& reader, gfx::DepthStencilOpDesc& op)
+{
+    op._stencilFunc = static_cast<gfx::ComparisonFunc>(reader.read<U32>());
+    op._stencilFailOp = static_cast<gfx::StencilOp>(reader.read<U32>());
+    op._stencilDepthFailOp = static_cast<gfx::StencilOp>(reader.read<U32>());
+    op._stencilPassOp = static_cast<gfx::StencilOp>(reader.read<U32>());
+}
+
+
+// Pipeline descriptions start with their type, then their root signature key.
+static B32 isSavedPipelineDescription(const std::vector<U8>& description, U32 type)
+{
+    DescriptionReader reader(description);
+    U32 descriptionType = reader.read<U32>();
+    B32 isCachedRootSignature = reader.readBool();
+    return descriptionType == type && isCachedRootSignature;
+}
+
+
+void PipelineCache::initialize(gfx::BackendRenderer* pBackend)
+{
+    m_pBackend = pBackend;
+    m_stats = { };
+}
+
+
+void PipelineCache::cleanUp()
+{
+    m_pipelines.clear();
+    for (auto& it : m_rootSignatures) {
+        if (it.second._pRootSignature) m_pBackend->destroyRootSignature(it.second._pRootSignature);
+    }
+    for (gfx::RootSignature* pRootSignature : m_uncachedRootSignatures) {
+        m_pBackend->destroyRootSignature(pRootSignature);
+    }
+    m_uncachedRootSignatures.clear();
+    m_rootSignatures.clear();
+    m_rootSignatureKeys.clear();
+    m_description.clear();
+}
+
+
+void PipelineCache::writeRootSignatureKey
+    (
+        DescriptionWriter& writer,
+        const gfx::RootSignature* pRootSignature,
+        B32& isPersistent
+    ) const
+{
+    std::lock_guard<std::mutex> lock(m_rootSignatureMutex);
+    auto it = m_rootSignatureKeys.find(pRootSignature);
+    isPersistent = it != m_rootSignatureKeys.end();
+    writer.writeBool(isPersistent);
+    writer.write<U64>(isPersistent ? it->second : static_cast<U64>(reinterpret_cast<uintptr_t>(pRootSignature)));
+}
+
+
+gfx::RootSignature* PipelineCache::readRootSignatureKey(DescriptionReader& reader) const
+{
+    B32 isCached = reader.readBool();
+    U64 key = reader.read<U64>();
+    if (!isCached) return reinterpret_cast<gfx::RootSignature*>(static_cast<uintptr_t>(key));
+    std::lock_guard<std::mutex> lock(m_rootSignatureMutex);
+    auto it = m_rootSignatures.find(key);
+    return it != m_rootSignatures.end() ? it->second._pRootSignature : nullptr;
+}
+
+
+B32 PipelineCache::buildRootSignature(U64 key, RootSignatureEntry& entry)
+{
+    gfx::ShaderVisibilityFlags visibleFlags = 0;
+    std::vector<gfx::PipelineLayout> layouts;
+    std::vector<gfx::StaticSamplerDesc> staticSamplers;
+    if (!decodeRootSignature(entry._description, visibleFlags, layouts, staticSamplers)) return false;
+    m_pBackend->createRootSignature(&entry._pRootSignature);
+    entry._pRootSignature->initialize(visibleFlags,
+                                      layouts.data(),
+                                      static_cast<U32>(layouts.size()),
+                                      staticSamplers.empty() ? nullptr : staticSamplers.data(),
+                                      static_cast<U32>(staticSamplers.size()));
+    m_rootSignatureKeys[entry._pRootSignature] = key;
+    return true;
+}
+
+
+gfx::RootSignature* PipelineCache::getRootSignature
+    (
+        gfx::ShaderVisibilityFlags visibleFlags,
+        gfx::PipelineLayout* pLayouts,
+        U32 numLayouts,
+        gfx::StaticSamplerDesc* pStaticSamplers,
+        U32 staticSamplerCount
+    )
+{
+    // A description of its own, m_description is the pipelines' scratch.
+    std::vector<U8> description;
+    DescriptionWriter writer(description);
+    encodeRootSignature(writer, visibleFlags, pLayouts, numLayouts, pStaticSamplers, staticSamplerCount);
+    U64 key = hashBytes(description.data(), description.size());
+
+    {
+        std::lock_guard<std::mutex> lock(m_rootSignatureMutex);
+        auto it = m_rootSignatures.find(key);
+        if (it != m_rootSignatures.end() && it->second._description == description && it->second._pRootSignature) {
+            it->second._isUsed = true;
+            m_stats._rootSignatureHits += 1;
+            return it->second._pRootSignature;
+        }
+    }
+
+    // Built outside of the lock, another thread may be building the same one meanwhile.
+    gfx::RootSignature* pRootSignature = nullptr;
+    m_pBackend->createRootSignature(&pRootSignature);
+    pRootSignature->initialize(visibleFlags, pLayouts, numLayouts, pStaticSamplers, staticSamplerCount);
+
+    std::lock_guard<std::mutex> lock(m_rootSignatureMutex);
+    m_stats._rootSignatureMisses += 1;
+    auto inserted = m_rootSignatures.emplace(key, RootSignatureEntry());
+    RootSignatureEntry& entry = inserted.first->second;
+    if (!inserted.second) {
+        if (entry._description == description && entry._pRootSignature) {
+            // Lost the race, keep the one inserted first.
+            m_pBackend->destroyRootSignature(pRootSignature);
+            entry._isUsed = true;
+            return entry._pRootSignature;
+        }
+        // Two descriptions on one key, the second stays uncached.
+        DEBUG("Pipeline cache root signature key collision.");
+        m_uncachedRootSignatures.push_back(pRootSignature);
+        return pRootSignature;
+    }
+    entry._description.swap(description);
+    entry._pRootSignature = pRootSignature;
+    entry._isUsed = true;
+    m_rootSignatureKeys[pRootSignature] = key;
+    return pRootSignature;
+}
+
+
+void PipelineCache::encodeGraphicsPipeline(const gfx::GraphicsPipelineInfo& info, B32& isPersistent)
+{
+    DescriptionWriter writer(m_description);
+    writer.write<U32>(PIPELINE_TYPE_GRAPHICS);
+    writeRootSignatureKey(writer, info._pRootSignature, isPersistent);
+    writer.write<U32>(info._topology);
+    writer.write<U32>(info._dsvFormat);
+    U32 renderTargetCount = info._numRenderTargets < 8 ? info._numRenderTargets : 8;
+    writer.write(renderTargetCount);
+    writer.write(info._sampleMask);
+    // Formats past the render target count have to be unknown anyway.
+    for (U32 i = 0; i < renderTargetCount; ++i) {
+        writer.write<U32>(info._rtvFormats[i]);
+    }
+    writeShader(writer, info._vertexShader);
+    writeShader(writer, info._hullShader);
+    writeShader(writer, info._domainShader);
+    writeShader(writer, info._geometryShader);
+    writeShader(writer, info._pixelShader);
+
+    const gfx::RasterizationStateInfo& raster = info._rasterizationState;
+    writer.writeBool(raster._antialiasedLinesEnable);
+    writer.writeBool(raster._conservativeRasterizationEnable);
+    writer.write<U32>(raster._cullMode);
+    writer.write<U32>(raster._fillMode);
+    writer.write(raster._depthBias);
+    writer.writeBool(raster._depthClipEnable);
+    writer.writeBool(raster._multisampleEnable);
+    writer.write(raster._depthBiasClamp);
+    writer.write(raster._forcedSampleCount);
+    writer.writeBool(raster._frontCounterClockwise);
+    writer.write(raster._slopedScaledDepthBias);
+
+    // Depth and stencil state is ignored with the test off, and left out.
+    const gfx::DepthStencilStateInfo& depthStencil = info._depthStencilState;
+    writer.writeBool(depthStencil._depthEnable);
+    if (depthStencil._depthEnable) {
+        writer.write<U32>(depthStencil._depthWriteMask);
+        writer.write<U32>(depthStencil._depthFunc);
+    }
+    writer.writeBool(depthStencil._stencilEnable);
+    if (depthStencil._stencilEnable) {
+        writer.write(depthStencil._stencilReadMask);
+        writer.write(depthStencil._stencilWriteMask);
+        writeStencilOp(writer, depthStencil._frontFace);
+        writeStencilOp(writer, depthStencil._backFace);
+    }
+
+    // Without independent blend, only the first target's blend state is used.
+    const gfx::BlendStateInfo& blend = info._blendState;
+    writer.writeBool(blend._alphaToCoverageEnable);
+    writer.writeBool(blend._independentBlendEnable);
+    U32 blendTargetCount = blend._independentBlendEnable && renderTargetCount > 1 ? renderTargetCount : 1;
+    for (U32 i = 0; i < blendTargetCount; ++i) {
+        const gfx::RenderTargetBlend& target = blend._renderTargets[i];
+        writer.writeBool(target._blendEnable);
+        writer.writeBool(target._logicOpEnable);
+        writer.write<U32>(target._srcBlend);
+        writer.write<U32>(target._dstBlend);
+        writer.write<U32>(target._blendOp);
+        writer.write<U32>(target._srcBlendAlpha);
+        writer.write<U32>(target._dstBlendAlpha);
+        writer.write<U32>(target._blendOpAlpha);
+        writer.write<U32>(target._logicOp);
+        writer.write(target._renderTargetWriteMask);
+    }
+    writer.write<U32>(info._ibCutValue);
+
+    U32 elementCount = info._inputLayout._pInputElements ? info._inputLayout._elementCount : 0;
+    writer.write(elementCount);
+    for (U32 i = 0; i < elementCount; ++i) {
+        const gfx::InputElementInfo& element = info._inputLayout._pInputElements[i];
+        writer.writeString(element._semanticName);
+        writer.write(element._semanticIndex);
+        writer.write<U32>(element._format);
+        writer.write(element._inputSlot);
+        writer.write(element._alignedByteOffset);
+        writer.write<U32>(element._classification);
+        writer.write(element._instanceDataStepRate);
+    }
+}
+
+
+void PipelineCache::encodeComputePipeline(const gfx::ComputePipelineInfo& info, B32& isPersistent)
+{
+    DescriptionWriter writer(m_description);
+    writer.write<U32>(PIPELINE_TYPE_COMPUTE);
+    writeRootSignatureKey(writer, info._pRootSignature, isPersistent);
+    writeShader(writer, info._computeShader);
+}
+
+
+B32 PipelineCache::buildPipeline(PipelineEntry& entry) const
+{
+    DescriptionReader reader(entry._description);
+    reader.read<U32>();
+    if (entry._type == PIPELINE_TYPE_COMPUTE) {
+        gfx::ComputePipelineInfo info = { };
+        info._pRootSignature = readRootSignatureKey(reader);
+        readShader(reader, info._computeShader);
+        if (!reader.isDone() || !info._pRootSignature) return false;
+        m_pBackend->createComputePipelineState(&entry._pComputePipeline, &info);
+        return true;
+    }
+
+    gfx::GraphicsPipelineInfo info = { };
+    info._pRootSignature = readRootSignatureKey(reader);
+    info._topology = static_cast<gfx::PrimitiveTopology>(reader.read<U32>());
+    info._dsvFormat = static_cast<DXGI_FORMAT>(reader.read<U32>());
+    info._numRenderTargets = reader.read<U32>();
+    info._sampleMask = reader.read<U32>();
+    if (info._numRenderTargets > 8) return false;
+    for (U32 i = 0; i < 8; ++i) {
+        info._rtvFormats[i] = i < info._numRenderTargets ? static_cast<DXGI_FORMAT>(reader.read<U32>())
+                                                         : DXGI_FORMAT_UNKNOWN;
+    }
+    readShader(reader, info._vertexShader);
+    readShader(reader, info._hullShader);
+    readShader(reader, info._domainShader);
+    readShader(reader, info._geometryShader);
+    readShader(reader, info._pixelShader);
+
+    gfx::RasterizationStateInfo& raster = info._rasterizationState;
+    raster._antialiasedLinesEnable = reader.readBool();
+    raster._conservativeRasterizationEnable = reader.readBool();
+    raster._cullMode = static_cast<gfx::CullMode>(reader.read<U32>());
+    raster._fillMode = static_cast<gfx::FillMode>(reader.read<U32>());
+    raster._depthBias = reader.read<I32>();
+    raster._depthClipEnable = reader.readBool();
+    raster._multisampleEnable = reader.readBool();
+    raster._depthBiasClamp = reader.read<R32>();
+    raster._forcedSampleCount = reader.read<U32>();
+    raster._frontCounterClockwise = reader.readBool();
+    raster._slopedScaledDepthBias = reader.read<R32>();
+
+    gfx::DepthStencilStateInfo& depthStencil = info._depthStencilState;
+    depthStencil._depthEnable = reader.readBool();
+    if (depthStencil._depthEnable) {
+        depthStencil._depthWriteMask = static_cast<gfx::DepthWriteMask>(reader.read<U32>());
+        depthStencil._depthFunc = static_cast<gfx::ComparisonFunc>(reader.read<U32>());
+    }
+    depthStencil._stencilEnable = reader.readBool();
+    if (depthStencil._stencilEnable) {
+        depthStencil._stencilReadMask = reader.read<U8>();
+        depthStencil._stencilWriteMask = reader.read<U8>();
+        readStencilOp(reader, depthStencil._frontFace);
+        readStencilOp(reader, depthStencil._backFace);
+    }
+
+    gfx::BlendStateInfo& blend = info._blendState;
+    blend._alphaToCoverageEnable = reader.readBool();
+    blend._independentBlendEnable = reader.readBool();
+    U32 blendTargetCount = blend._independentBlendEnable && info._numRenderTargets > 1 ? info._numRenderTargets : 1;
+    for (U32 i = 0; i < blendTargetCount; ++i) {
+        gfx::RenderTargetBlend& target = blend._renderTargets[i];
+        target._blendEnable = reader.readBool();
+        target._logicOpEnable = reader.readBool();
+        target._srcBlend = static_cast<gfx::Blend>(reader.read<U32>());
+        target._dstBlend = static_cast<gfx::Blend>(reader.read<U32>());
+        target._blendOp = static_cast<gfx::BlendOp>(reader.read<U32>());
+        target._srcBlendAlpha = static_cast<gfx::Blend>(reader.read<U32>());
+        target._dstBlendAlpha = static_cast<gfx::Blend>(reader.read<U32>());
+        target._blendOpAlpha = static_cast<gfx::BlendOp>(reader.read<U32>());
+        target._logicOp = static_cast<gfx::LogicOp>(reader.read<U32>());
+        target._renderTargetWriteMask = reader.read<U8>();
+    }
+    info._ibCutValue = static_cast<gfx::IBCutValue>(reader.read<U32>());
+
+    U32 elementCount = reader.read<U32>();
+    if (elementCount > entry._description.size()) return false;
+    std::vector<gfx::InputElementInfo> elements(elementCount);
+    for (U32 i = 0; i < elementCount; ++i) {
+        gfx::InputElementInfo& element = elements[i];
+        element._semanticName = reader.readString();
+        element._semanticIndex = reader.read<U32>();
+        element._format = static_cast<DXGI_FORMAT>(reader.read<U32>());
+        element._inputSlot = reader.read<U32>();
+        element._alignedByteOffset = reader.read<U32>();
+        element._classification = static_cast<gfx::InputClassification>(reader.read<U32>());
+        element._instanceDataStepRate = reader.read<U32>();
+    }
+    info._inputLayout._elementCount = elementCount;
+    info._inputLayout._pInputElements = elementCount ? elements.data() : nullptr;
+
+    if (!reader.isDone() || !info._pRootSignature) return false;
+    m_pBackend->createGraphicsPipelineState(&entry._pGraphicsPipeline, &info);
+    return true;
+}
+
+
+PipelineCache::PipelineEntry* PipelineCache::findPipeline(PipelineType type, B32 isPersistent)
+{
+    U64 key = hashBytes(m_description.data(), m_description.size());
+    auto it = m_pipelines.find(key);
+    if (it != m_pipelines.end() && it->second._description != m_description) {
+        DEBUG("Pipeline cache key collision.");
+        return nullptr;
+    }
+
+    PipelineEntry* pEntry = nullptr;
+    if (it != m_pipelines.end()) {
+        pEntry = &it->second;
+    } else {
+        pEntry = &m_pipelines[key];
+        pEntry->_type = type;
+        pEntry->_description = m_description;
+        pEntry->_pGraphicsPipeline = nullptr;
+        pEntry->_pComputePipeline = nullptr;
+        pEntry->_isPersistent = isPersistent;
+    }
+    pEntry->_isUsed = true;
+
+    if (pEntry->_pGraphicsPipeline || pEntry->_pComputePipeline) {
+        m_stats._hits += 1;
+    } else {
+        if (!buildPipeline(*pEntry)) DEBUG("Pipeline cache failed to decode a pipeline description.");
+        m_stats._misses += 1;
+    }
+    return pEntry;
+}
+
+
+gfx::GraphicsPipeline* PipelineCache::getGraphicsPipeline(const gfx::GraphicsPipelineInfo& info)
+{
+    B32 isPersistent = false;
+    encodeGraphicsPipeline(info, isPersistent);
+    PipelineEntry* pEntry = findPipeline(PIPELINE_TYPE_GRAPHICS, isPersistent);
+    if (pEntry) return pEntry->_pGraphicsPipeline;
+
+    gfx::GraphicsPipeline* pPipeline = nullptr;
+    m_pBackend->createGraphicsPipelineState(&pPipeline, &info);
+    m_stats._misses += 1;
+    return pPipeline;
+}
+
+
+gfx::ComputePipeline* PipelineCache::getComputePipeline(const gfx::ComputePipelineInfo& info)
+{
+    B32 isPersistent = false;
+    encodeComputePipeline(info, isPersistent);
+    PipelineEntry* pEntry = findPipeline(PIPELINE_TYPE_COMPUTE, isPersistent);
+    if (pEntry) return pEntry->_pComputePipeline;
+
+    gfx::ComputePipeline* pPipeline = nullptr;
+    m_pBackend->createComputePipelineState(&pPipeline, &info);
+    m_stats._misses += 1;
+    return pPipeline;
+}
+
+
+U32 PipelineCache::prebuild(const std::string& path, JobSystem* pJobs)
+{
+    MappedFile file;
+    if (!file.open(path) || file.getSize() < sizeof(PipelineCacheHeader)) return 0;
+    PipelineCacheHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    if (header._magic != kPipelineCacheMagic || header._version != kPipelineCacheVersion) return 0;
+
+    // Root signatures are built here, in file order, pipelines only read them once built.
+    std::vector<PipelineEntry*> pending;
+    const U8* pCursor = file.getData() + sizeof(header);
+    const U8* pEnd = file.getData() + file.getSize();
+    for (U32 i = 0; i < header._recordCount; ++i) {
+        PipelineCacheRecord record;
+        if (static_cast<U64>(pEnd - pCursor) < sizeof(record)) break;
+        memcpy(&record, pCursor, sizeof(record));
+        pCursor += sizeof(record);
+        if (record._szBytes > static_cast<U64>(pEnd - pCursor)) break;
+        std::vector<U8> description(pCursor, pCursor + record._szBytes);
+        pCursor += record._szBytes;
+        U64 key = hashBytes(description.data(), description.size());
+
+        if (record._type == PIPELINE_CACHE_RECORD_ROOT_SIGNATURE) {
+            std::lock_guard<std::mutex> lock(m_rootSignatureMutex);
+            if (m_rootSignatures.find(key) != m_rootSignatures.end()) continue;
+            RootSignatureEntry& entry = m_rootSignatures[key];
+            entry._description.swap(description);
+            entry._pRootSignature = nullptr;
+            entry._isUsed = false;
+            if (!buildRootSignature(key, entry)) m_rootSignatures.erase(key);
+            continue;
+        }
+
+        PipelineType type = record._type == PIPELINE_CACHE_RECORD_COMPUTE_PIPELINE ? PIPELINE_TYPE_COMPUTE
+                                                                                   : PIPELINE_TYPE_GRAPHICS;
+        if (record._type != PIPELINE_CACHE_RECORD_GRAPHICS_PIPELINE
+            && record._type != PIPELINE_CACHE_RECORD_COMPUTE_PIPELINE) continue;
+        // Only pipelines of cached root signatures are saved, any other record is corrupt.
+        if (!isSavedPipelineDescription(description, type)) continue;
+        if (m_pipelines.find(key) != m_pipelines.end()) continue;
+        PipelineEntry& entry = m_pipelines[key];
+        entry._type = type;
+        entry._description.swap(description);
+        entry._pGraphicsPipeline = nullptr;
+        entry._pComputePipeline = nullptr;
+        entry._isUsed = false;
+        entry._isPersistent = true;
+        pending.push_back(&entry);
+    }
+
+    // Entries are all in place, jobs only fill in the pipeline of their own.
+    std::atomic<U32> built(0);
+    PipelineEntry* const* ppPending = pending.data();
+    auto buildRange = [this, ppPending, &built] (U32 begin, U32 end) {
+        for (U32 i = begin; i < end; ++i) {
+            if (buildPipeline(*ppPending[i])) built.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+    if (pJobs && m_pBackend->isPipelineCreationThreadSafe()) {
+        pJobs->parallelFor(static_cast<U32>(pending.size()), 1, buildRange);
+    } else {
+        buildRange(0, static_cast<U32>(pending.size()));
+    }
+    m_stats._prebuilt += built.load();
+    return built.load();
+}
+
+
+static B32 writeRecord(FILE* pFile, U32 type, const std::vector<U8>& description)
+{
+    PipelineCacheRecord record = { };
+    record._type = type;
+    record._szBytes = description.size();
+    return fwrite(&record, sizeof(record), 1, pFile) == 1
+        && (description.empty() || fwrite(description.data(), 1, description.size(), pFile) == description.size());
+}
+
+
+B32 PipelineCache::save(const std::string& path) const
+{
+    // Written in key order, so the same set of pipelines always writes the same file.
+    std::vector<U64> rootSignatureKeys;
+    for (const auto& it : m_rootSignatures) {
+        if (it.second._isUsed && it.second._pRootSignature) rootSignatureKeys.push_back(it.first);
+    }
+    std::vector<U64> pipelineKeys;
+    for (const auto& it : m_pipelines) {
+        if (it.second._isUsed && it.second._isPersistent) pipelineKeys.push_back(it.first);
+    }
+    std::sort(rootSignatureKeys.begin(), rootSignatureKeys.end());
+    std::sort(pipelineKeys.begin(), pipelineKeys.end());
+
+    PipelineCacheHeader header = { };
+    header._magic = kPipelineCacheMagic;
+    header._version = kPipelineCacheVersion;
+    header._recordCount = static_cast<U32>(rootSignatureKeys.size() + pipelineKeys.size());
+
+    std::string tempPath = path + ".tmp";
+    FILE* pFile = fopen(tempPath.c_str(), "wb");
+    if (!pFile) return false;
+    B32 written = fwrite(&header, sizeof(header), 1, pFile) == 1;
+    for (U64 key : rootSignatureKeys) {
+        written = written && writeRecord(pFile,
+                                         PIPELINE_CACHE_RECORD_ROOT_SIGNATURE,
+                                         m_rootSignatures.at(key)._description);
+    }
+    for (U64 key : pipelineKeys) {
+        const PipelineEntry& entry = m_pipelines.at(key);
+        U32 type = entry._type == PIPELINE_TYPE_COMPUTE ? PIPELINE_CACHE_RECORD_COMPUTE_PIPELINE
+                                                        : PIPELINE_CACHE_RECORD_GRAPHICS_PIPELINE;
+        written = written && writeRecord(pFile, type, entry._description);
+    }
+    written = (fclose(pFile) == 0) && written;
+    if (!written) {
+        remove(tempPath.c_str());
+        return false;
+    }
+
+    // rename() won't replace an existing file everywhere, so the old cache is removed first.
+    remove(path.c_str());
+    if (rename(tempPath.c_str(), path.c_str()) != 0) {
+        remove(tempPath.c_str());
+        return false;
+    }
+    return true;
+}
+} // jcl
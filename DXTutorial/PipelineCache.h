@@ -0,0 +1,127 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "BackendRenderer.h"
+#include "JobSystem.h"
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace jcl {
+
+
+// Bump whenever the description encoding changes. Older cache files are ignored.
+static const U32 kPipelineCacheVersion = 1;
+static const U32 kPipelineCacheMagic = 0x4f53504a; // "JPSO"
+
+class DescriptionWriter;
+class DescriptionReader;
+
+
+struct PipelineCacheStats
+{
+    // Requests served by a pipeline already built, this run or by prebuild().
+    U32 _hits;
+    // Requests that built their pipeline on the spot.
+    U32 _misses;
+    // Pipelines built by prebuild(), ahead of any request.
+    U32 _prebuilt;
+    U32 _rootSignatureHits;
+    U32 _rootSignatureMisses;
+};
+
+
+/*
+    Pipeline Cache hands out shared root signatures and pipelines, keyed by a hash of their whole
+    description: shader bytecode, rasterizer, depth stencil and blend state, render target formats,
+    input layout and root signature. Descriptions are encoded canonically first, state the gpu
+    ignores is left out, such as blend targets of a non independent blend, or stencil ops with
+    stencil off, so descriptions that build the same pipeline share it. Pipelines are built from
+    the decoded canonical description, what is built is exactly what was hashed.
+
+    save() writes the descriptions requested this run. prebuild() reads them back on the next
+    start and builds them all ahead of the requests, in parallel if the backend allows it.
+    Root signatures may be requested from many threads at once, pipeline requests and prebuild()
+    must come from one thread.
+*/
+class PipelineCache
+{
+public:
+    PipelineCache()
+        : m_pBackend(nullptr)
+        , m_stats() { }
+
+    void initialize(gfx::BackendRenderer* pBackend);
+    // Root signatures are destroyed here, pipelines live as long as the backend.
+    void cleanUp();
+
+    gfx::RootSignature* getRootSignature(gfx::ShaderVisibilityFlags visibleFlags,
+                                         gfx::PipelineLayout* pLayouts,
+                                         U32 numLayouts,
+                                         gfx::StaticSamplerDesc* pStaticSamplers = nullptr,
+                                         U32 staticSamplerCount = 0);
+    // Root signatures not made by getRootSignature() work too, but their pipelines are not saved.
+    gfx::GraphicsPipeline* getGraphicsPipeline(const gfx::GraphicsPipelineInfo& info);
+    gfx::ComputePipeline* getComputePipeline(const gfx::ComputePipelineInfo& info);
+
+    // Build every root signature and pipeline saved at path, on pJobs. Returns the pipelines built,
+    // 0 if there is no valid cache file at path.
+    U32 prebuild(const std::string& path, JobSystem* pJobs);
+    B32 save(const std::string& path) const;
+
+    const PipelineCacheStats& getStats() const { return m_stats; }
+    U32 getPipelineCount() const { return static_cast<U32>(m_pipelines.size()); }
+
+private:
+    PipelineCache(const PipelineCache&) = delete;
+    PipelineCache& operator=(const PipelineCache&) = delete;
+
+    enum PipelineType
+    {
+        PIPELINE_TYPE_GRAPHICS,
+        PIPELINE_TYPE_COMPUTE
+    };
+    struct RootSignatureEntry
+    {
+        std::vector<U8> _description;
+        gfx::RootSignature* _pRootSignature;
+        B32 _isUsed;
+    };
+    struct PipelineEntry
+    {
+        PipelineType _type;
+        std::vector<U8> _description;
+        gfx::GraphicsPipeline* _pGraphicsPipeline;
+        gfx::ComputePipeline* _pComputePipeline;
+        // Requested this run, saved by save().
+        B32 _isUsed;
+        // Root signature came from this cache, so the description can be saved.
+        B32 _isPersistent;
+    };
+
+    void encodeGraphicsPipeline(const gfx::GraphicsPipelineInfo& info, B32& isPersistent);
+    void encodeComputePipeline(const gfx::ComputePipelineInfo& info, B32& isPersistent);
+    // Root signatures of this cache are written by key, others by address, and can't be saved.
+    void writeRootSignatureKey(DescriptionWriter& writer, const gfx::RootSignature* pRootSignature, B32& isPersistent) const;
+    gfx::RootSignature* readRootSignatureKey(DescriptionReader& reader) const;
+    B32 buildRootSignature(U64 key, RootSignatureEntry& entry);
+    // Find the pipeline m_description describes, building it if needed. Returns null on a hash collision.
+    PipelineEntry* findPipeline(PipelineType type, B32 isPersistent);
+    B32 buildPipeline(PipelineEntry& entry) const;
+
+    gfx::BackendRenderer* m_pBackend;
+    PipelineCacheStats m_stats;
+    std::unordered_map<U64, RootSignatureEntry> m_rootSignatures;
+    std::unordered_map<const gfx::RootSignature*, U64> m_rootSignatureKeys;
+    // Root signatures built on a key collision, not in m_rootSignatures.
+    std::vector<gfx::RootSignature*> m_uncachedRootSignatures;
+    // Guards the root signatures and their keys, getRootSignature() may run on many threads.
+    mutable std::mutex m_rootSignatureMutex;
+    std::unordered_map<U64, PipelineEntry> m_pipelines;
+    // Scratch for the description being looked up.
+    std::vector<U8> m_description;
+};
+} // jcl
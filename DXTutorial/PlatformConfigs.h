@@ -0,0 +1,161 @@
+#pragma once
+
+// Platform neutral types and definitions. Everything that only needs the engine's basic
+// types (math, the renderer front end, the resource caches, model loaders) should include
+// this instead of WinConfigs.h, so that it can be built headless on any platform.
+
+#if defined(_WIN32) && !defined(JCL_HEADLESS)
+#define JCL_PLATFORM_WINDOWS 1
+#else
+#define JCL_PLATFORM_WINDOWS 0
+#endif
+
+#if JCL_PLATFORM_WINDOWS
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#include <dxgi.h>
+#include <dxgi1_4.h>
+#endif
+
+#include <stddef.h>
+#include <string>
+#include <math.h>
+#include <float.h>
+#include <string.h>
+
+typedef unsigned char U8;
+typedef char I8;
+typedef unsigned short U16;
+typedef short I16;
+typedef unsigned U32;
+typedef int I32;
+typedef unsigned long long U64;
+typedef long long I64;
+
+typedef I32 B32;
+typedef I8 B8;
+typedef size_t SIZEB;
+
+typedef float R32;
+typedef double R64;
+
+
+#if !JCL_PLATFORM_WINDOWS
+// Minimal stand ins for the Win32 and DXGI types that show up in the renderer interfaces.
+// Values of DXGI_FORMAT match the native enum, so serialized formats stay compatible
+// between the headless and windows builds.
+typedef void* HWND;
+typedef char CHAR;
+typedef char TCHAR;
+typedef unsigned int UINT;
+
+#define TEXT(str) str
+
+struct RECT
+{
+    I32 left;
+    I32 top;
+    I32 right;
+    I32 bottom;
+};
+
+struct IDXGISwapChain1;
+
+enum DXGI_FORMAT
+{
+    DXGI_FORMAT_UNKNOWN = 0,
+    DXGI_FORMAT_R32G32B32A32_TYPELESS = 1,
+    DXGI_FORMAT_R32G32B32A32_FLOAT = 2,
+    DXGI_FORMAT_R32G32B32A32_UINT = 3,
+    DXGI_FORMAT_R32G32B32A32_SINT = 4,
+    DXGI_FORMAT_R32G32B32_TYPELESS = 5,
+    DXGI_FORMAT_R32G32B32_FLOAT = 6,
+    DXGI_FORMAT_R32G32B32_UINT = 7,
+    DXGI_FORMAT_R32G32B32_SINT = 8,
+    DXGI_FORMAT_R16G16B16A16_TYPELESS = 9,
+    DXGI_FORMAT_R16G16B16A16_FLOAT = 10,
+    DXGI_FORMAT_R16G16B16A16_UNORM = 11,
+    DXGI_FORMAT_R16G16B16A16_UINT = 12,
+    DXGI_FORMAT_R16G16B16A16_SNORM = 13,
+    DXGI_FORMAT_R16G16B16A16_SINT = 14,
+    DXGI_FORMAT_R32G32_TYPELESS = 15,
+    DXGI_FORMAT_R32G32_FLOAT = 16,
+    DXGI_FORMAT_R32G32_UINT = 17,
+    DXGI_FORMAT_R32G32_SINT = 18,
+    DXGI_FORMAT_R32G8X24_TYPELESS = 19,
+    DXGI_FORMAT_D32_FLOAT_S8X24_UINT = 20,
+    DXGI_FORMAT_R32_FLOAT_X8X24_TYPELESS = 21,
+    DXGI_FORMAT_X32_TYPELESS_G8X24_UINT = 22,
+    DXGI_FORMAT_R10G10B10A2_TYPELESS = 23,
+    DXGI_FORMAT_R10G10B10A2_UNORM = 24,
+    DXGI_FORMAT_R10G10B10A2_UINT = 25,
+    DXGI_FORMAT_R11G11B10_FLOAT = 26,
+    DXGI_FORMAT_R8G8B8A8_TYPELESS = 27,
+    DXGI_FORMAT_R8G8B8A8_UNORM = 28,
+    DXGI_FORMAT_R8G8B8A8_UNORM_SRGB = 29,
+    DXGI_FORMAT_R8G8B8A8_UINT = 30,
+    DXGI_FORMAT_R8G8B8A8_SNORM = 31,
+    DXGI_FORMAT_R8G8B8A8_SINT = 32,
+    DXGI_FORMAT_R16G16_TYPELESS = 33,
+    DXGI_FORMAT_R16G16_FLOAT = 34,
+    DXGI_FORMAT_R16G16_UNORM = 35,
+    DXGI_FORMAT_R16G16_UINT = 36,
+    DXGI_FORMAT_R16G16_SNORM = 37,
+    DXGI_FORMAT_R16G16_SINT = 38,
+    DXGI_FORMAT_R32_TYPELESS = 39,
+    DXGI_FORMAT_D32_FLOAT = 40,
+    DXGI_FORMAT_R32_FLOAT = 41,
+    DXGI_FORMAT_R32_UINT = 42,
+    DXGI_FORMAT_R32_SINT = 43,
+    DXGI_FORMAT_R24G8_TYPELESS = 44,
+    DXGI_FORMAT_D24_UNORM_S8_UINT = 45,
+    DXGI_FORMAT_R24_UNORM_X8_TYPELESS = 46,
+    DXGI_FORMAT_X24_TYPELESS_G8_UINT = 47,
+    DXGI_FORMAT_R8G8_TYPELESS = 48,
+    DXGI_FORMAT_R8G8_UNORM = 49,
+    DXGI_FORMAT_R8G8_UINT = 50,
+    DXGI_FORMAT_R8G8_SNORM = 51,
+    DXGI_FORMAT_R8G8_SINT = 52,
+    DXGI_FORMAT_R16_TYPELESS = 53,
+    DXGI_FORMAT_R16_FLOAT = 54,
+    DXGI_FORMAT_D16_UNORM = 55,
+    DXGI_FORMAT_R16_UNORM = 56,
+    DXGI_FORMAT_R16_UINT = 57,
+    DXGI_FORMAT_R16_SNORM = 58,
+    DXGI_FORMAT_R16_SINT = 59,
+    DXGI_FORMAT_R8_TYPELESS = 60,
+    DXGI_FORMAT_R8_UNORM = 61,
+    DXGI_FORMAT_R8_UINT = 62,
+    DXGI_FORMAT_R8_SNORM = 63,
+    DXGI_FORMAT_R8_SINT = 64,
+    DXGI_FORMAT_A8_UNORM = 65,
+    DXGI_FORMAT_B8G8R8A8_UNORM = 87,
+    DXGI_FORMAT_B8G8R8X8_UNORM = 88,
+    DXGI_FORMAT_B8G8R8A8_TYPELESS = 90,
+    DXGI_FORMAT_B8G8R8A8_UNORM_SRGB = 91
+};
+#endif
+
+
+#if _DEBUG
+#include <stdio.h>
+#include <assert.h>
+#if defined(_MSC_VER)
+#define DEBUG(str, ...) printf(str ## "\n", ## __VA_ARGS__)
+#else
+#define DEBUG(str, ...) printf(str "\n", ## __VA_ARGS__)
+#endif
+#define ASSERT(x) assert(x)
+#else
+#define DEBUG(str, ...)
+#define ASSERT(x)
+#endif
+
+#define CONST_PI                3.141592653589793238462643383279502884197169399375
+#define CONST_PI_HALF           1.57079632679489661923   // pi/2
+#define CONST_PI_QUARTER        0.785398163397448309616 // pi/4
+#define CONST_2_PI              6.283185307 // 2 * pi
+#define CONST_TOLERANCE         0.0001     //
+#define EPSILON                 0.0000001 //
+#define R_E                     2.71828182845904523536   // e
+#define ToRads(deg) ((deg) * (static_cast<R32>(CONST_PI) / 180.0f))
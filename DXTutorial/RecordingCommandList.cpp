@@ -0,0 +1,632 @@
+//
+#include "RecordingCommandList.h"
+#include "Hash.h"
+
+#include <stdint.h>
+#include <string.h>
+
+namespace gfx {
+
+
+enum CommandOp
+{
+    COMMAND_OP_RESET,
+    COMMAND_OP_CLOSE,
+    COMMAND_OP_DRAW_INDEXED_INSTANCED,
+    COMMAND_OP_DRAW_INSTANCED,
+    COMMAND_OP_SET_GRAPHICS_PIPELINE,
+    COMMAND_OP_SET_COMPUTE_PIPELINE,
+    COMMAND_OP_SET_RAY_TRACING_PIPELINE,
+    COMMAND_OP_SET_ACCELERATION_STRUCTURE,
+    COMMAND_OP_SET_RENDER_PASS,
+    COMMAND_OP_DISPATCH,
+    COMMAND_OP_SET_VERTEX_BUFFERS,
+    COMMAND_OP_SET_GRAPHICS_ROOT_SIGNATURE,
+    COMMAND_OP_SET_COMPUTE_ROOT_SIGNATURE,
+    COMMAND_OP_SET_INDEX_BUFFER,
+    COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE,
+    COMMAND_OP_SET_COMPUTE_ROOT_DESCRIPTOR_TABLE,
+    COMMAND_OP_SET_COMPUTE_ROOT_CBV,
+    COMMAND_OP_SET_COMPUTE_ROOT_SRV,
+    COMMAND_OP_SET_GRAPHICS_ROOT_CBV,
+    COMMAND_OP_SET_GRAPHICS_ROOT_SRV,
+    COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT,
+    COMMAND_OP_SET_VIEWPORTS,
+    COMMAND_OP_SET_SCISSORS,
+    COMMAND_OP_SET_DESCRIPTOR_TABLES,
+    COMMAND_OP_CLEAR_RENDER_TARGET,
+    COMMAND_OP_CLEAR_DEPTH_STENCIL,
+    COMMAND_OP_COPY_RESOURCE,
+    COMMAND_OP_COPY_BUFFER_REGION,
+    COMMAND_OP_COPY_BUFFER_TO_TEXTURE_2D,
+    COMMAND_OP_SET_MARKER
+};
+
+
+// Reads the stream back in the order it was written.
+class CommandReader
+{
+public:
+    CommandReader(const U8* pData, U64 szBytes, void* const* ppObjects)
+        : m_pCursor(pData)
+        , m_pEnd(pData + szBytes)
+        , m_ppObjects(ppObjects) { }
+
+    B32 isDone() const { return m_pCursor >= m_pEnd; }
+
+    template<typename T>
+    T read()
+    {
+        T value;
+        memcpy(&value, m_pCursor, sizeof(T));
+        m_pCursor += sizeof(T);
+        return value;
+    }
+
+    template<typename T>
+    T* readObject() { return static_cast<T*>(m_ppObjects[read<U32>()]); }
+
+    // Copies count elements into out, grown to fit, as the stream isn't aligned.
+    template<typename T>
+    T* readArray(U32 count, std::vector<T>& out)
+    {
+        if (out.size() < count) out.resize(count);
+        memcpy(out.data(), m_pCursor, count * sizeof(T));
+        m_pCursor += count * sizeof(T);
+        return count ? out.data() : nullptr;
+    }
+
+    const char* readString()
+    {
+        U32 length = read<U32>();
+        if (length == 0) return nullptr;
+        // Written with its terminator.
+        const char* str = reinterpret_cast<const char*>(m_pCursor);
+        m_pCursor += length;
+        return str;
+    }
+
+private:
+    const U8* m_pCursor;
+    const U8* m_pEnd;
+    void* const* m_ppObjects;
+};
+
+
+RecordingCommandList::RecordingCommandList()
+    : m_sizeBytes(0)
+    , m_commandCount(0)
+    , m_drawCount(0)
+{
+    _isRecording = false;
+    m_objects.push_back(nullptr);
+    memset(m_objectCache, 0, sizeof(m_objectCache));
+}
+
+
+U8* RecordingCommandList::allocate(U64 szBytes)
+{
+    if (m_sizeBytes + szBytes > m_data.size()) {
+        U64 capacity = m_data.size() ? m_data.size() : 4096ull;
+        while (capacity < m_sizeBytes + szBytes) capacity *= 2;
+        m_data.resize(capacity);
+    }
+    U8* pOut = m_data.data() + m_sizeBytes;
+    m_sizeBytes += szBytes;
+    return pOut;
+}
+
+
+void RecordingCommandList::writeOp(U8 op)
+{
+    *allocate(1) = op;
+    ++m_commandCount;
+}
+
+
+template<typename T>
+void RecordingCommandList::write(const T& value)
+{
+    memcpy(allocate(sizeof(T)), &value, sizeof(T));
+}
+
+
+void RecordingCommandList::writeArray(const void* pData, U32 count, U64 elementSzBytes)
+{
+    write<U32>(count);
+    if (count) memcpy(allocate(count * elementSzBytes), pData, count * elementSzBytes);
+}
+
+
+void RecordingCommandList::writeObject(const void* pObject)
+{
+    U32 index = 0;
+    CachedObject& cached = m_objectCache[(reinterpret_cast<uintptr_t>(pObject) >> 4) & (kObjectCacheSize - 1)];
+    if (pObject && cached._pObject == pObject) {
+        index = cached._index;
+    } else if (pObject) {
+        auto it = m_objectIndices.find(pObject);
+        if (it != m_objectIndices.end()) {
+            index = it->second;
+        } else {
+            index = static_cast<U32>(m_objects.size());
+            m_objects.push_back(const_cast<void*>(pObject));
+            m_objectIndices.emplace(pObject, index);
+        }
+        cached._pObject = pObject;
+        cached._index = index;
+    }
+    write<U32>(index);
+}
+
+
+void RecordingCommandList::writeString(const char* str)
+{
+    U32 length = str ? static_cast<U32>(strlen(str)) + 1u : 0u;
+    write<U32>(length);
+    if (length) memcpy(allocate(length), str, length);
+}
+
+
+void RecordingCommandList::reset(const char* debugTag)
+{
+    m_sizeBytes = 0;
+    m_commandCount = 0;
+    m_drawCount = 0;
+    m_objects.resize(1);
+    m_objectIndices.clear();
+    memset(m_objectCache, 0, sizeof(m_objectCache));
+    writeOp(COMMAND_OP_RESET);
+    writeString(debugTag);
+    _isRecording = true;
+}
+
+
+void RecordingCommandList::close()
+{
+    writeOp(COMMAND_OP_CLOSE);
+    _isRecording = false;
+}
+
+
+void RecordingCommandList::drawIndexedInstanced(U32 indexCountPerInstance,
+                                                U32 instanceCount,
+                                                U32 startIndexLocation,
+                                                U32 baseVertexLocation,
+                                                U32 startInstanceLocation)
+{
+    writeOp(COMMAND_OP_DRAW_INDEXED_INSTANCED);
+    write(indexCountPerInstance);
+    write(instanceCount);
+    write(startIndexLocation);
+    write(baseVertexLocation);
+    write(startInstanceLocation);
+    ++m_drawCount;
+}
+
+
+void RecordingCommandList::drawInstanced(U32 vertexCountPerInstance,
+                                         U32 instanceCount,
+                                         U32 startVertexLocation,
+                                         U32 startInstanceLocation)
+{
+    writeOp(COMMAND_OP_DRAW_INSTANCED);
+    write(vertexCountPerInstance);
+    write(instanceCount);
+    write(startVertexLocation);
+    write(startInstanceLocation);
+    ++m_drawCount;
+}
+
+
+void RecordingCommandList::setGraphicsPipeline(GraphicsPipeline* pPipeline)
+{
+    writeOp(COMMAND_OP_SET_GRAPHICS_PIPELINE);
+    writeObject(pPipeline);
+}
+
+
+void RecordingCommandList::setComputePipeline(ComputePipeline* pPipeline)
+{
+    writeOp(COMMAND_OP_SET_COMPUTE_PIPELINE);
+    writeObject(pPipeline);
+}
+
+
+void RecordingCommandList::setRayTracingPipeline(RayTracingPipeline* pPipeline)
+{
+    writeOp(COMMAND_OP_SET_RAY_TRACING_PIPELINE);
+    writeObject(pPipeline);
+}
+
+
+void RecordingCommandList::setAccelerationStructure(Resource* pAccelerationStructure)
+{
+    writeOp(COMMAND_OP_SET_ACCELERATION_STRUCTURE);
+    writeObject(pAccelerationStructure);
+}
+
+
+void RecordingCommandList::setRenderPass(RenderPass* pass)
+{
+    writeOp(COMMAND_OP_SET_RENDER_PASS);
+    writeObject(pass);
+}
+
+
+void RecordingCommandList::dispatch(U32 x, U32 y, U32 z)
+{
+    writeOp(COMMAND_OP_DISPATCH);
+    write(x);
+    write(y);
+    write(z);
+    ++m_drawCount;
+}
+
+
+void RecordingCommandList::setVertexBuffers(U32 startSlot, VertexBufferView** vbvs, U32 vertexBufferCount)
+{
+    writeOp(COMMAND_OP_SET_VERTEX_BUFFERS);
+    write(startSlot);
+    write(vertexBufferCount);
+    for (U32 i = 0; i < vertexBufferCount; ++i) {
+        writeObject(vbvs[i]);
+    }
+}
+
+
+void RecordingCommandList::setGraphicsRootSignature(RootSignature* pRootSignature)
+{
+    writeOp(COMMAND_OP_SET_GRAPHICS_ROOT_SIGNATURE);
+    writeObject(pRootSignature);
+}
+
+
+void RecordingCommandList::setComputeRootSignature(RootSignature* pRootSignature)
+{
+    writeOp(COMMAND_OP_SET_COMPUTE_ROOT_SIGNATURE);
+    writeObject(pRootSignature);
+}
+
+
+void RecordingCommandList::setIndexBuffer(IndexBufferView* buffer)
+{
+    writeOp(COMMAND_OP_SET_INDEX_BUFFER);
+    writeObject(buffer);
+}
+
+
+void RecordingCommandList::setGraphicsRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable)
+{
+    writeOp(COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE);
+    write(rootParameterIndex);
+    writeObject(pTable);
+}
+
+
+void RecordingCommandList::setComputeRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable)
+{
+    writeOp(COMMAND_OP_SET_COMPUTE_ROOT_DESCRIPTOR_TABLE);
+    write(rootParameterIndex);
+    writeObject(pTable);
+}
+
+
+void RecordingCommandList::setComputeRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset)
+{
+    writeOp(COMMAND_OP_SET_COMPUTE_ROOT_CBV);
+    write(rootParameterIndex);
+    writeObject(pConstantBuffer);
+    write(offset);
+}
+
+
+void RecordingCommandList::setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset)
+{
+    writeOp(COMMAND_OP_SET_COMPUTE_ROOT_SRV);
+    write(rootParameterIndex);
+    writeObject(pShaderResourceView);
+    write(offset);
+}
+
+
+void RecordingCommandList::setGraphicsRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset)
+{
+    writeOp(COMMAND_OP_SET_GRAPHICS_ROOT_CBV);
+    write(rootParameterIndex);
+    writeObject(pConstantBuffer);
+    write(offset);
+}
+
+
+void RecordingCommandList::setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset)
+{
+    writeOp(COMMAND_OP_SET_GRAPHICS_ROOT_SRV);
+    write(rootParameterIndex);
+    writeObject(pShaderResourceView);
+    write(offset);
+}
+
+
+void RecordingCommandList::setGraphicsRoot32BitConstant(U32 rootParameterIndex)
+{
+    writeOp(COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT);
+    write(rootParameterIndex);
+}
+
+
+void RecordingCommandList::setViewports(Viewport* pViewports, U32 viewportCount)
+{
+    writeOp(COMMAND_OP_SET_VIEWPORTS);
+    writeArray(pViewports, viewportCount, sizeof(Viewport));
+}
+
+
+void RecordingCommandList::setScissors(Scissor* pScissors, U32 scissorCount)
+{
+    writeOp(COMMAND_OP_SET_SCISSORS);
+    writeArray(pScissors, scissorCount, sizeof(Scissor));
+}
+
+
+void RecordingCommandList::setDescriptorTables(DescriptorTable** pTables, U32 tableCount)
+{
+    writeOp(COMMAND_OP_SET_DESCRIPTOR_TABLES);
+    write(tableCount);
+    for (U32 i = 0; i < tableCount; ++i) {
+        writeObject(pTables[i]);
+    }
+}
+
+
+void RecordingCommandList::clearRenderTarget(RenderTargetView* rtv, R32* rgba, U32 numRects, RECT* rects)
+{
+    writeOp(COMMAND_OP_CLEAR_RENDER_TARGET);
+    writeObject(rtv);
+    memcpy(allocate(sizeof(R32) * 4), rgba, sizeof(R32) * 4);
+    writeArray(rects, rects ? numRects : 0u, sizeof(RECT));
+}
+
+
+void RecordingCommandList::clearDepthStencil(DepthStencilView* dsv,
+                                             ClearFlags flags,
+                                             R32 depth,
+                                             U8 stencil,
+                                             U32 numRects,
+                                             const RECT* rects)
+{
+    writeOp(COMMAND_OP_CLEAR_DEPTH_STENCIL);
+    writeObject(dsv);
+    write(flags);
+    write(depth);
+    write(stencil);
+    writeArray(rects, rects ? numRects : 0u, sizeof(RECT));
+}
+
+
+void RecordingCommandList::copyResource(Resource* pDst, Resource* pSrc)
+{
+    writeOp(COMMAND_OP_COPY_RESOURCE);
+    writeObject(pDst);
+    writeObject(pSrc);
+}
+
+
+void RecordingCommandList::copyBufferRegion(Resource* pDst, U64 dstOffset, Resource* pSrc, U64 srcOffset, U64 szBytes)
+{
+    writeOp(COMMAND_OP_COPY_BUFFER_REGION);
+    writeObject(pDst);
+    write(dstOffset);
+    writeObject(pSrc);
+    write(srcOffset);
+    write(szBytes);
+}
+
+
+void RecordingCommandList::copyBufferToTexture2D(Resource* pDst,
+                                                 Resource* pSrc,
+                                                 U64 srcOffset,
+                                                 U32 width,
+                                                 U32 height,
+                                                 DXGI_FORMAT format,
+                                                 U32 rowPitch)
+{
+    writeOp(COMMAND_OP_COPY_BUFFER_TO_TEXTURE_2D);
+    writeObject(pDst);
+    writeObject(pSrc);
+    write(srcOffset);
+    write(width);
+    write(height);
+    write(static_cast<U32>(format));
+    write(rowPitch);
+}
+
+
+void RecordingCommandList::setMarker(const char* tag)
+{
+    writeOp(COMMAND_OP_SET_MARKER);
+    writeString(tag);
+}
+
+
+U64 RecordingCommandList::hash(U64 seed) const
+{
+    return jcl::hashBytes(m_data.data(), m_sizeBytes, seed);
+}
+
+
+void RecordingCommandList::replay(CommandList* pList) const
+{
+    CommandReader reader(m_data.data(), m_sizeBytes, m_objects.data());
+    std::vector<void*> objects;
+    std::vector<Viewport> viewports;
+    std::vector<Scissor> scissors;
+    std::vector<RECT> rects;
+    while (!reader.isDone()) {
+        switch (reader.read<U8>()) {
+            case COMMAND_OP_RESET:
+                pList->reset(reader.readString());
+                break;
+            case COMMAND_OP_CLOSE:
+                pList->close();
+                break;
+            case COMMAND_OP_DRAW_INDEXED_INSTANCED:
+            {
+                U32 indexCount = reader.read<U32>();
+                U32 instanceCount = reader.read<U32>();
+                U32 startIndex = reader.read<U32>();
+                U32 baseVertex = reader.read<U32>();
+                U32 startInstance = reader.read<U32>();
+                pList->drawIndexedInstanced(indexCount, instanceCount, startIndex, baseVertex, startInstance);
+            } break;
+            case COMMAND_OP_DRAW_INSTANCED:
+            {
+                U32 vertexCount = reader.read<U32>();
+                U32 instanceCount = reader.read<U32>();
+                U32 startVertex = reader.read<U32>();
+                U32 startInstance = reader.read<U32>();
+                pList->drawInstanced(vertexCount, instanceCount, startVertex, startInstance);
+            } break;
+            case COMMAND_OP_SET_GRAPHICS_PIPELINE:
+                pList->setGraphicsPipeline(reader.readObject<GraphicsPipeline>());
+                break;
+            case COMMAND_OP_SET_COMPUTE_PIPELINE:
+                pList->setComputePipeline(reader.readObject<ComputePipeline>());
+                break;
+            case COMMAND_OP_SET_RAY_TRACING_PIPELINE:
+                pList->setRayTracingPipeline(reader.readObject<RayTracingPipeline>());
+                break;
+            case COMMAND_OP_SET_ACCELERATION_STRUCTURE:
+                pList->setAccelerationStructure(reader.readObject<Resource>());
+                break;
+            case COMMAND_OP_SET_RENDER_PASS:
+                pList->setRenderPass(reader.readObject<RenderPass>());
+                break;
+            case COMMAND_OP_DISPATCH:
+            {
+                U32 x = reader.read<U32>();
+                U32 y = reader.read<U32>();
+                U32 z = reader.read<U32>();
+                pList->dispatch(x, y, z);
+            } break;
+            case COMMAND_OP_SET_VERTEX_BUFFERS:
+            {
+                U32 startSlot = reader.read<U32>();
+                U32 count = reader.read<U32>();
+                if (objects.size() < count) objects.resize(count);
+                for (U32 i = 0; i < count; ++i) objects[i] = reader.readObject<void>();
+                pList->setVertexBuffers(startSlot, reinterpret_cast<VertexBufferView**>(objects.data()), count);
+            } break;
+            case COMMAND_OP_SET_GRAPHICS_ROOT_SIGNATURE:
+                pList->setGraphicsRootSignature(reader.readObject<RootSignature>());
+                break;
+            case COMMAND_OP_SET_COMPUTE_ROOT_SIGNATURE:
+                pList->setComputeRootSignature(reader.readObject<RootSignature>());
+                break;
+            case COMMAND_OP_SET_INDEX_BUFFER:
+                pList->setIndexBuffer(reader.readObject<IndexBufferView>());
+                break;
+            case COMMAND_OP_SET_GRAPHICS_ROOT_DESCRIPTOR_TABLE:
+            {
+                U32 index = reader.read<U32>();
+                pList->setGraphicsRootDescriptorTable(index, reader.readObject<DescriptorTable>());
+            } break;
+            case COMMAND_OP_SET_COMPUTE_ROOT_DESCRIPTOR_TABLE:
+            {
+                U32 index = reader.read<U32>();
+                pList->setComputeRootDescriptorTable(index, reader.readObject<DescriptorTable>());
+            } break;
+            case COMMAND_OP_SET_COMPUTE_ROOT_CBV:
+            {
+                U32 index = reader.read<U32>();
+                Resource* pResource = reader.readObject<Resource>();
+                pList->setComputeRootConstantBufferView(index, pResource, reader.read<U64>());
+            } break;
+            case COMMAND_OP_SET_COMPUTE_ROOT_SRV:
+            {
+                U32 index = reader.read<U32>();
+                Resource* pResource = reader.readObject<Resource>();
+                pList->setComputeRootShaderResourceView(index, pResource, reader.read<U64>());
+            } break;
+            case COMMAND_OP_SET_GRAPHICS_ROOT_CBV:
+            {
+                U32 index = reader.read<U32>();
+                Resource* pResource = reader.readObject<Resource>();
+                pList->setGraphicsRootConstantBufferView(index, pResource, reader.read<U64>());
+            } break;
+            case COMMAND_OP_SET_GRAPHICS_ROOT_SRV:
+            {
+                U32 index = reader.read<U32>();
+                Resource* pResource = reader.readObject<Resource>();
+                pList->setGraphicsRootShaderResourceView(index, pResource, reader.read<U64>());
+            } break;
+            case COMMAND_OP_SET_GRAPHICS_ROOT_32BIT_CONSTANT:
+                pList->setGraphicsRoot32BitConstant(reader.read<U32>());
+                break;
+            case COMMAND_OP_SET_VIEWPORTS:
+            {
+                U32 count = reader.read<U32>();
+                pList->setViewports(reader.readArray(count, viewports), count);
+            } break;
+            case COMMAND_OP_SET_SCISSORS:
+            {
+                U32 count = reader.read<U32>();
+                pList->setScissors(reader.readArray(count, scissors), count);
+            } break;
+            case COMMAND_OP_SET_DESCRIPTOR_TABLES:
+            {
+                U32 count = reader.read<U32>();
+                if (objects.size() < count) objects.resize(count);
+                for (U32 i = 0; i < count; ++i) objects[i] = reader.readObject<void>();
+                pList->setDescriptorTables(reinterpret_cast<DescriptorTable**>(objects.data()), count);
+            } break;
+            case COMMAND_OP_CLEAR_RENDER_TARGET:
+            {
+                RenderTargetView* pView = reader.readObject<RenderTargetView>();
+                R32 rgba[4];
+                for (U32 i = 0; i < 4; ++i) rgba[i] = reader.read<R32>();
+                U32 count = reader.read<U32>();
+                pList->clearRenderTarget(pView, rgba, count, reader.readArray(count, rects));
+            } break;
+            case COMMAND_OP_CLEAR_DEPTH_STENCIL:
+            {
+                DepthStencilView* pView = reader.readObject<DepthStencilView>();
+                ClearFlags flags = reader.read<ClearFlags>();
+                R32 depth = reader.read<R32>();
+                U8 stencil = reader.read<U8>();
+                U32 count = reader.read<U32>();
+                pList->clearDepthStencil(pView, flags, depth, stencil, count, reader.readArray(count, rects));
+            } break;
+            case COMMAND_OP_COPY_RESOURCE:
+            {
+                Resource* pDst = reader.readObject<Resource>();
+                pList->copyResource(pDst, reader.readObject<Resource>());
+            } break;
+            case COMMAND_OP_COPY_BUFFER_REGION:
+            {
+                Resource* pDst = reader.readObject<Resource>();
+                U64 dstOffset = reader.read<U64>();
+                Resource* pSrc = reader.readObject<Resource>();
+                U64 srcOffset = reader.read<U64>();
+                pList->copyBufferRegion(pDst, dstOffset, pSrc, srcOffset, reader.read<U64>());
+            } break;
+            case COMMAND_OP_COPY_BUFFER_TO_TEXTURE_2D:
+            {
+                Resource* pDst = reader.readObject<Resource>();
+                Resource* pSrc = reader.readObject<Resource>();
+                U64 srcOffset = reader.read<U64>();
+                U32 width = reader.read<U32>();
+                U32 height = reader.read<U32>();
+                DXGI_FORMAT format = static_cast<DXGI_FORMAT>(reader.read<U32>());
+                pList->copyBufferToTexture2D(pDst, pSrc, srcOffset, width, height, format, reader.read<U32>());
+            } break;
+            case COMMAND_OP_SET_MARKER:
+                pList->setMarker(reader.readString());
+                break;
+            default:
+                // Corrupt stream, nothing after this can be trusted.
+                return;
+        }
+    }
+}
+} // gfx
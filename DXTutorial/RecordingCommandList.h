@@ -0,0 +1,112 @@
+//
+#pragma once
+
+#include "BackendRenderer.h"
+
+#include <unordered_map>
+#include <vector>
+
+namespace gfx {
+
+
+/*
+    Recording Command List encodes every call into a packed, linear stream of commands, an op byte
+    followed by its arguments, unaligned. Gpu objects are written as indices into the list's object
+    table, numbered in order of first use, so the same frame records the same bytes on every run,
+    and captures can be hashed and diffed. replay() decodes the stream into any other list, on any
+    thread, as long as the objects recorded are still alive.
+*/
+class RecordingCommandList : public CommandList
+{
+public:
+    RecordingCommandList();
+
+    void reset(const char* debugTag = nullptr) override;
+    void close() override;
+
+    void drawIndexedInstanced(U32 indexCountPerInstance,
+                              U32 instanceCount,
+                              U32 startIndexLocation,
+                              U32 baseVertexLocation,
+                              U32 startInstanceLocation) override;
+    void drawInstanced(U32 vertexCountPerInstance,
+                       U32 instanceCount,
+                       U32 startVertexLocation,
+                       U32 startInstanceLocation) override;
+
+    void setGraphicsPipeline(GraphicsPipeline* pPipeline) override;
+    void setComputePipeline(ComputePipeline* pPipeline) override;
+    void setRayTracingPipeline(RayTracingPipeline* pPipeline) override;
+    void setAccelerationStructure(Resource* pAccelerationStructure) override;
+    void setRenderPass(RenderPass* pass) override;
+    void dispatch(U32 x, U32 y, U32 z) override;
+    void setVertexBuffers(U32 startSlot, VertexBufferView** vbvs, U32 vertexBufferCount) override;
+    void setGraphicsRootSignature(RootSignature* pRootSignature) override;
+    void setComputeRootSignature(RootSignature* pRootSignature) override;
+    void setIndexBuffer(IndexBufferView* buffer) override;
+    void setGraphicsRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) override;
+    void setComputeRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) override;
+    void setComputeRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset = 0ull) override;
+    void setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset = 0ull) override;
+    void setGraphicsRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset = 0ull) override;
+    void setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset = 0ull) override;
+    void setGraphicsRoot32BitConstant(U32 rootParameterIndex) override;
+    void setViewports(Viewport* pViewports, U32 viewportCount) override;
+    void setScissors(Scissor* pScissors, U32 scissorCount) override;
+    void setDescriptorTables(DescriptorTable** pTables, U32 tableCount) override;
+    void clearRenderTarget(RenderTargetView* rtv, R32* rgba, U32 numRects, RECT* rects) override;
+    void clearDepthStencil(DepthStencilView* dsv,
+                           ClearFlags flags,
+                           R32 depth,
+                           U8 stencil,
+                           U32 numRects,
+                           const RECT* rects) override;
+    void copyResource(Resource* pDst, Resource* pSrc) override;
+    void copyBufferRegion(Resource* pDst, U64 dstOffset, Resource* pSrc, U64 srcOffset, U64 szBytes) override;
+    void copyBufferToTexture2D(Resource* pDst,
+                               Resource* pSrc,
+                               U64 srcOffset,
+                               U32 width,
+                               U32 height,
+                               DXGI_FORMAT format,
+                               U32 rowPitch) override;
+    void setMarker(const char* tag = nullptr) override;
+
+    // Decode the stream, calling the same commands on pList, reset() and close() included.
+    void replay(CommandList* pList) const;
+
+    const U8* getData() const { return m_data.data(); }
+    U64 getSizeBytes() const { return m_sizeBytes; }
+    U32 getCommandCount() const { return m_commandCount; }
+    // Draws and dispatches recorded.
+    U32 getDrawCount() const { return m_drawCount; }
+    U32 getObjectCount() const { return static_cast<U32>(m_objects.size()); }
+    // Hash of the stream. Objects count by their order of first use, so equal frames hash equal.
+    U64 hash(U64 seed = 0ull) const;
+
+private:
+    U8* allocate(U64 szBytes);
+    void writeOp(U8 op);
+    template<typename T>
+    void write(const T& value);
+    void writeArray(const void* pData, U32 count, U64 elementSzBytes);
+    void writeObject(const void* pObject);
+    void writeString(const char* str);
+
+    std::vector<U8> m_data;
+    U64 m_sizeBytes;
+    U32 m_commandCount;
+    U32 m_drawCount;
+    // Objects the stream refers to, by index. Index 0 is null.
+    std::vector<void*> m_objects;
+    std::unordered_map<const void*, U32> m_objectIndices;
+    // Direct mapped cache in front of m_objectIndices, a frame binds the same few objects over and over.
+    struct CachedObject
+    {
+        const void* _pObject;
+        U32 _index;
+    };
+    static const U32 kObjectCacheSize = 64;
+    CachedObject m_objectCache[kObjectCacheSize];
+};
+} // gfx
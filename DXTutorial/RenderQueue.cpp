@@ -0,0 +1,183 @@
+//
+#include "RenderQueue.h"
+#include "SlotMap.h"
+
+#include <string.h>
+
+namespace jcl {
+
+static const U32 kRadixBits = 8;
+static const U32 kRadixBuckets = 1 << kRadixBits;
+static const U32 kRadixPasses = 64 / kRadixBits;
+
+
+// Slot index of the id, folded down to the given number of bits.
+static U64 foldId(RenderUUID uuid, U32 bits)
+{
+    U32 index = SlotMap<void*>::getIndex(uuid);
+    return static_cast<U64>((index ^ (index >> bits)) & ((1u << bits) - 1u));
+}
+
+
+// Float bits of the depth. Depths behind the eye are clamped to 0, so all keys stay ordered.
+static U64 depthBits(R32 depth)
+{
+    if (!(depth > 0.0f)) return 0ull;
+    U32 bits;
+    memcpy(&bits, &depth, sizeof(bits));
+    return static_cast<U64>(bits);
+}
+
+
+U64 RenderQueue::makeOpaqueKey(U32 pipeline, RenderUUID vertexBuffer, RenderUUID material, R32 depth)
+{
+    return (static_cast<U64>(RENDER_LAYER_OPAQUE) << 62ull)
+         | (static_cast<U64>(pipeline & 0x3f) << 56ull)
+         | (foldId(vertexBuffer, 12) << 44ull)
+         | (foldId(material, 12) << 32ull)
+         | depthBits(depth);
+}
+
+
+U64 RenderQueue::makeTransparentKey(U32 pipeline, RenderUUID vertexBuffer, RenderUUID material, R32 depth)
+{
+    return (static_cast<U64>(RENDER_LAYER_TRANSPARENT) << 62ull)
+         | ((~depthBits(depth) & 0xffffffffull) << 30ull)
+         | (static_cast<U64>(pipeline & 0x3f) << 24ull)
+         | (foldId(vertexBuffer, 12) << 12ull)
+         | foldId(material, 12);
+}
+
+
+// Both items can be drawn by the same instanced draw.
+static B32 isSameDraw(const RenderItem& a, const RenderItem& b)
+{
+    const GeometrySubMesh* pA = a._pSubMesh;
+    const GeometrySubMesh* pB = b._pSubMesh;
+    return a._pMesh->_vertexBufferView == b._pMesh->_vertexBufferView
+        && a._pMesh->_indexBufferView == b._pMesh->_indexBufferView
+        && pA->_materialDescriptor == pB->_materialDescriptor
+        && pA->_vertCount == pB->_vertCount
+        && pA->_startVert == pB->_startVert
+        && pA->_indCount == pB->_indCount
+        && pA->_indOffset == pB->_indOffset;
+}
+
+
+void RenderQueue::clear()
+{
+    for (U32 i = 0; i < RENDER_LAYER_COUNT; ++i) {
+        m_layerCounts[i] = 0;
+    }
+    m_items.clear();
+    m_entries.clear();
+    m_sorted.clear();
+}
+
+
+void RenderQueue::reserve(U32 count)
+{
+    m_items.reserve(count);
+    m_entries.reserve(count);
+    m_scratch.reserve(count);
+    m_sorted.reserve(count);
+}
+
+
+void RenderQueue::push(RenderLayer layer,
+                       U32 pipeline,
+                       const Matrix44& viewToClip,
+                       GeometryMesh** pMeshes,
+                       U32 meshCount,
+                       GeometrySubMesh** pSubMeshes)
+{
+    U32 submeshIdx = 0;
+    for (U32 i = 0; i < meshCount; ++i) {
+        GeometryMesh* pMesh = pMeshes[i];
+
+        // Center of the transformed bounds is the transformed center, no need for the full box.
+        Vector4 center = pMesh->_bounds.isEmpty() ? Vector4(0.0f, 0.0f, 0.0f, 1.0f)
+                                                  : Vector4(pMesh->_bounds.getCenter(), 1.0f);
+        if (pMesh->_meshDescriptor) {
+            center = center * pMesh->_meshDescriptor->_world;
+        }
+        R32 depth = (center * viewToClip)._w;
+        // Each vertex format draws with a pipeline of its own.
+        U32 meshPipeline = pipeline * VERTEX_FORMAT_COUNT + pMesh->_vertexFormat;
+
+        for (U32 j = 0; j < pMesh->_submeshCount; ++j, ++submeshIdx) {
+            GeometrySubMesh* pSubMesh = pSubMeshes[submeshIdx];
+            Entry entry;
+            entry._item = static_cast<U32>(m_items.size());
+            entry._key = (layer == RENDER_LAYER_OPAQUE)
+                ? makeOpaqueKey(meshPipeline, pMesh->_vertexBufferView, pSubMesh->_materialDescriptor, depth)
+                : makeTransparentKey(meshPipeline, pMesh->_vertexBufferView, pSubMesh->_materialDescriptor, depth);
+            m_entries.push_back(entry);
+            m_items.push_back({ pMesh, pSubMesh });
+        }
+    }
+    m_layerCounts[layer] += submeshIdx;
+}
+
+
+void RenderQueue::sort()
+{
+    U32 count = static_cast<U32>(m_entries.size());
+    m_scratch.resize(count);
+
+    // Histogram every digit in one read of the keys.
+    U32 histograms[kRadixPasses][kRadixBuckets];
+    memset(histograms, 0, sizeof(histograms));
+    for (U32 i = 0; i < count; ++i) {
+        U64 key = m_entries[i]._key;
+        for (U32 pass = 0; pass < kRadixPasses; ++pass) {
+            ++histograms[pass][(key >> (pass * kRadixBits)) & (kRadixBuckets - 1)];
+        }
+    }
+
+    Entry* pSrc = m_entries.data();
+    Entry* pDst = m_scratch.data();
+    for (U32 pass = 0; pass < kRadixPasses; ++pass) {
+        U32* histogram = histograms[pass];
+        U32 shift = pass * kRadixBits;
+
+        // Every key has the same digit, this pass would not move anything.
+        if (count == 0 || histogram[(pSrc[0]._key >> shift) & (kRadixBuckets - 1)] == count) continue;
+
+        U32 offset = 0;
+        for (U32 b = 0; b < kRadixBuckets; ++b) {
+            U32 bucketCount = histogram[b];
+            histogram[b] = offset;
+            offset += bucketCount;
+        }
+        for (U32 i = 0; i < count; ++i) {
+            const Entry& entry = pSrc[i];
+            pDst[histogram[(entry._key >> shift) & (kRadixBuckets - 1)]++] = entry;
+        }
+        Entry* pTemp = pSrc;
+        pSrc = pDst;
+        pDst = pTemp;
+    }
+
+    m_sorted.resize(count);
+    for (U32 i = 0; i < count; ++i) {
+        m_sorted[i] = m_items[pSrc[i]._item];
+    }
+}
+
+
+U32 RenderQueue::buildBatches(RenderLayer layer, std::vector<RenderBatch>& batches) const
+{
+    batches.clear();
+    const RenderItem* pItems = getItems(layer);
+    U32 itemCount = getItemCount(layer);
+    for (U32 i = 0; i < itemCount; ++i) {
+        if (!batches.empty() && isSameDraw(pItems[batches.back()._firstItem], pItems[i])) {
+            ++batches.back()._instanceCount;
+            continue;
+        }
+        batches.push_back({ i, 1 });
+    }
+    return static_cast<U32>(batches.size());
+}
+} // jcl
@@ -0,0 +1,102 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+
+#include <vector>
+
+namespace jcl {
+
+
+enum RenderLayer
+{
+    RENDER_LAYER_OPAQUE = 0,
+    RENDER_LAYER_TRANSPARENT = 1,
+    RENDER_LAYER_COUNT = 2
+};
+
+
+// A single submesh draw, along with the mesh that owns it.
+struct RenderItem
+{
+    GeometryMesh* _pMesh;
+    GeometrySubMesh* _pSubMesh;
+};
+
+
+// Run of sorted items that draw the same submesh of the same geometry with the same material,
+// submitted as one instanced draw. Each item is one instance, in item order.
+struct RenderBatch
+{
+    U32 _firstItem;
+    U32 _instanceCount;
+};
+
+
+/*
+    Render Queue orders submesh draws by a 64 bit sort key, so that draws sharing state end up
+    next to each other. Keys are sorted with an LSD radix sort, 8 bits per pass, and passes on
+    digits that every key shares are skipped.
+
+    Opaque key, most to least significant:
+        layer (2) | pipeline (6) | vertex buffer (12) | material (12) | view depth (32), front to back.
+    Transparent key:
+        layer (2) | view depth (32), back to front | pipeline (6) | vertex buffer (12) | material (12).
+
+    View depth is the clip space w of the mesh bounds center, kept as its float bits, which sort
+    the same as the float for positive values. Vertex buffer and material are the slot indices of
+    their ids, folded into 12 bits, collisions only cost some grouping. Pipeline combines the pass
+    pipeline with the mesh VertexFormat, so meshes of one format draw together.
+*/
+class RenderQueue
+{
+public:
+    RenderQueue() { clear(); }
+
+    void clear();
+    void reserve(U32 count);
+
+    // Queue every submesh of the given meshes. Submeshes are laid out as in FrontEndRenderer::pushMesh.
+    void push(RenderLayer layer,
+              U32 pipeline,
+              const Matrix44& viewToClip,
+              GeometryMesh** pMeshes,
+              U32 meshCount,
+              GeometrySubMesh** pSubMeshes);
+
+    // Sort queued items by key. Items are then grouped by layer, in layer order.
+    void sort();
+
+    // Sorted items of the layer, valid after sort() until the next push() or clear().
+    const RenderItem* getItems(RenderLayer layer) const { return m_sorted.data() + getLayerStart(layer); }
+    U32 getItemCount(RenderLayer layer) const { return m_layerCounts[layer]; }
+    U32 getItemCount() const { return static_cast<U32>(m_items.size()); }
+
+    // Merge runs of identical draws in the sorted items of the layer into instanced batches.
+    // Returns the number of batches written.
+    U32 buildBatches(RenderLayer layer, std::vector<RenderBatch>& batches) const;
+
+    static U64 makeOpaqueKey(U32 pipeline, RenderUUID vertexBuffer, RenderUUID material, R32 depth);
+    static U64 makeTransparentKey(U32 pipeline, RenderUUID vertexBuffer, RenderUUID material, R32 depth);
+
+private:
+    struct Entry
+    {
+        U64 _key;
+        U32 _item;
+    };
+
+    U32 getLayerStart(RenderLayer layer) const {
+        U32 start = 0;
+        for (U32 i = 0; i < layer; ++i) start += m_layerCounts[i];
+        return start;
+    }
+
+    U32 m_layerCounts[RENDER_LAYER_COUNT];
+    std::vector<RenderItem> m_items;
+    std::vector<Entry> m_entries;
+    // Radix sort ping pong buffer.
+    std::vector<Entry> m_scratch;
+    std::vector<RenderItem> m_sorted;
+};
+} // jcl
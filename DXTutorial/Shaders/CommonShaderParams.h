@@ -10,4 +10,16 @@
 
 #define DIELECTRIC_SPECULAR_VALUE 0.04
 
+// Froxel grid of the clustered light assignment. Tiles split the screen, slices split view depth
+// exponentially from near to far, so slice = floor(log(depth / near) / log(far / near) * slices).
+#define LIGHT_CLUSTER_TILES_X 16
+#define LIGHT_CLUSTER_TILES_Y 9
+#define LIGHT_CLUSTER_SLICES 24
+// Light counts of a cluster are packed in one uint, point lights low, spot lights high.
+#define LIGHT_CLUSTER_COUNT_BITS 16
+
+// Depth bias of the shadow test, in shadow clip depth, which is reversed. It grows with the
+// cascade, and for point and spot views, with the distance from the light.
+#define SHADOW_DEPTH_BIAS 0.0005
+
 #endif // _COMMON_SHADER_PARAMS_H_
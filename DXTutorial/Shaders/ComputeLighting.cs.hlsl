@@ -17,18 +17,80 @@ StructuredBuffer<PointLight> PointLights : register ( t5 );
 StructuredBuffer<SpotLight> SpotLights : register ( t6 );
 StructuredBuffer<LightTransformation> LightTransforms : register ( t7 );
 
+// Lights of each froxel, assigned on the cpu by LightClusters: x the offset of its lights in
+// LightIndices, y the point light count in the low LIGHT_CLUSTER_COUNT_BITS, spot lights above.
+StructuredBuffer<uint2> LightClusters : register ( t8 );
+StructuredBuffer<uint> LightIndices : register ( t9 );
+
 // We use depth to determine position in screenspace, which in turn,
 // convert back to world space with the inverse View and Projection matrices.
-Texture2D<float> Depth : register ( t8 );
+Texture2D<float> Depth : register ( t10 );
 
 // Shadow Maps to be indexed depending on the light.
-Texture2D<float> SunlightShadowResolve : register ( t9 );
-TextureCubeArray<float> PointLightShadowAtlas : register ( t10 );
-Texture2DArray<float> SpotLightShadowAtlas : register ( t11 );
-Texture2DArray<float> DirectionLightShadowAtlas : register ( t12 );
+Texture2D<float> SunlightShadowResolve : register ( t11 );
+// Tiles of every shadow view, depth reversed, placed by the AtlasRect of the view's transform.
+Texture2D<float> ShadowAtlas : register ( t12 );
 
 RWTexture2D<float4> OutResult : register ( u0 );
 
+
+// Shadow coordinates of a position in a view, false if it is outside of it.
+bool InShadowView(float3 ShadowCoord)
+{
+    return all( ShadowCoord.xy == saturate( ShadowCoord.xy ) ) && ShadowCoord.z >= 0.0;
+}
+
+
+// 1 if the position is lit in the tile of the view, 0 if something is nearer the light.
+float SampleShadowAtlas(float3 ShadowCoord, float4 AtlasRect)
+{
+    uint AtlasWidth, AtlasHeight;
+    ShadowAtlas.GetDimensions( AtlasWidth, AtlasHeight );
+    float2 AtlasSize = float2( AtlasWidth, AtlasHeight );
+    int2 TileSize = int2( AtlasRect.xy * AtlasSize );
+    int2 Texel = min( int2( ShadowCoord.xy * AtlasRect.xy * AtlasSize ), TileSize - 1 ) + int2( AtlasRect.zw * AtlasSize );
+    float Occluder = ShadowAtlas.Load( int3( Texel, 0 ) ).r;
+    return ShadowCoord.z + SHADOW_DEPTH_BIAS >= Occluder ? 1.0 : 0.0;
+}
+
+
+// Shadow of a direction light, from the first of its cascades the position falls in. Cascades
+// are fitted to spheres around the view, nearer ones are smaller, so the first is the sharpest.
+float DirectionLightShadow(float3 WorldPos, DirectionLight Light)
+{
+    for ( int Cascade = 0; Cascade < Light.ShadowCascadeCount; ++Cascade )
+    {
+        LightTransformation LightTransform = LightTransforms[Light.LightTransformIndex + Cascade];
+        float3 ShadowCoord = CalculateShadowCoord( WorldPos, LightTransform.ViewToClip );
+        if ( LightTransform.AtlasRect.x <= 0.0 || !InShadowView( ShadowCoord ) ) continue;
+        return SampleShadowAtlas( ShadowCoord, LightTransform.AtlasRect );
+    }
+    // Past the last cascade, nothing is shadowed.
+    return 1.0;
+}
+
+
+// Shadow of a view of a point or spot light, lit if the view has no tile this frame.
+float LocalLightShadow(float3 WorldPos, LightTransformation LightTransform)
+{
+    if ( LightTransform.AtlasRect.x <= 0.0 ) return 1.0;
+    float3 ShadowCoord = CalculateShadowCoord( WorldPos, LightTransform.ViewToClip );
+    if ( !InShadowView( ShadowCoord ) ) return 1.0;
+    return SampleShadowAtlas( ShadowCoord, LightTransform.AtlasRect );
+}
+
+
+// Faces of a point light are picked by the major axis from the light, +x, -x, +y, -y, +z then -z.
+float PointLightShadow(float3 WorldPos, PointLight Light)
+{
+    float3 ToPixel = WorldPos - Light.WorldPos.xyz;
+    float3 Axis = abs( ToPixel );
+    int Face = Axis.x >= Axis.y && Axis.x >= Axis.z ? ( ToPixel.x >= 0.0 ? 0 : 1 )
+             : Axis.y >= Axis.z ? ( ToPixel.y >= 0.0 ? 2 : 3 ) 
+             : ( ToPixel.z >= 0.0 ? 4 : 5 );
+    return LocalLightShadow( WorldPos, LightTransforms[Light.LightTransformIndex + Face] );
+}
+
 [numthreads(16, 16, 1)]
 void main
     ( 
@@ -66,14 +128,43 @@ void main
         DirectionLight Light = DirectionLights[i]; 
         float3 Radiance = DirectionLightRadiance(V, Albedo, Normal, Roughness, Metallic, F0, Light);
         // Look for the direction light that contains the sunlight shadow.
-        if (Global.SunLightShadowIndex == i) {
-            LightTransformation LightTransform = LightTransforms[Light.LightTransformIndex];
-            float2 ShadowCoord = CalculateShadowCoord(WorldPos, LightTransform.ViewToClip);
-            Radiance *= DirectionLightShadowAtlas.Load(int4(ShadowCoord, i, 0)).r;
+        if (Global.SunLightShadowIndex == i && Light.ShadowIndex >= 0) {
+            Radiance *= DirectionLightShadow(WorldPos, Light);
         }
         PixelColor += Radiance; 
     }
 
+    // Froxel of the pixel. Depth is reversed, so view depth = Near * Far / (z * (Far - Near) + Near).
+    float ViewDepth = Global.Near * Global.Far / ( ZDepth * ( Global.Far - Global.Near ) + Global.Near );
+    uint2 Tile = min( DTid.xy * uint2( LIGHT_CLUSTER_TILES_X, LIGHT_CLUSTER_TILES_Y ) / Global.TargetSize.xy, 
+                      uint2( LIGHT_CLUSTER_TILES_X - 1, LIGHT_CLUSTER_TILES_Y - 1 ) );
+    float SliceCoord = log( ViewDepth / Global.Near ) / log( Global.Far / Global.Near ) * LIGHT_CLUSTER_SLICES;
+    uint Slice = (uint)clamp( SliceCoord, 0.0, LIGHT_CLUSTER_SLICES - 1.0 );
+    uint2 Cluster = LightClusters[( Slice * LIGHT_CLUSTER_TILES_Y + Tile.y ) * LIGHT_CLUSTER_TILES_X + Tile.x];
+    uint PointCount = Cluster.y & ( ( 1u << LIGHT_CLUSTER_COUNT_BITS ) - 1u );
+    uint SpotCount = Cluster.y >> LIGHT_CLUSTER_COUNT_BITS;
+    float3 ViewDir = normalize( V );
+
+    for ( uint p = 0; p < PointCount; ++p )
+    {
+        PointLight Light = PointLights[LightIndices[Cluster.x + p]];
+        float3 Radiance = PointLightRadiance(ViewDir, Albedo, Normal, Roughness, Metallic, F0, WorldPos, Light);
+        if ( Light.LightTransformIndex >= 0 ) {
+            Radiance *= PointLightShadow(WorldPos, Light);
+        }
+        PixelColor += Radiance;
+    }
+
+    for ( uint s = 0; s < SpotCount; ++s )
+    {
+        SpotLight Light = SpotLights[LightIndices[Cluster.x + PointCount + s]];
+        float3 Radiance = SpotLightRadiance(ViewDir, Albedo, Normal, Roughness, Metallic, F0, WorldPos, Light);
+        if ( Light.LightTransformIndex >= 0 ) {
+            Radiance *= LocalLightShadow(WorldPos, LightTransforms[Light.LightTransformIndex]);
+        }
+        PixelColor += Radiance;
+    }
+
     // Output the final color to the result.
     OutResult[DTid.xy] = float4(PixelColor, 1);
 }
\ No newline at end of file
@@ -16,6 +16,9 @@ cbuffer PerspectiveTransform : register ( b1 )
 PSInputBasic main( VSInputGeometry Input )
 {
 	PSInputBasic Output;
+#if PACKED_VERTEX
+	DecodePackedVertex(Input, Mesh);
+#endif
 	float4x4 WorldToViewClip = mul( ViewToClip, Mesh.World );
 	Output.Position = mul( WorldToViewClip, Input.Position );
 	//Output.TexCoord = Input.TexCoord;
@@ -8,15 +8,15 @@ cbuffer Global : register (b0)
 };
 
 
-cbuffer PerMaterial : register (b2)
+cbuffer PerMaterial : register (b1)
 {
     MeshMaterials Material;
 };
 
-Texture2D<float4> AlbedoMap : register (t0);
-Texture2D<float4> NormalMap : register (t1);
-Texture2D<float4> RoughnessMetallicMap : register (t2);
-Texture2D<float4> EmissionMap : register (t3);
+Texture2D<float4> AlbedoMap : register (t1);
+Texture2D<float4> NormalMap : register (t2);
+Texture2D<float4> RoughnessMetallicMap : register (t3);
+Texture2D<float4> EmissionMap : register (t4);
 
 SamplerState SurfaceSampler : register (s0);
 
@@ -1,15 +1,17 @@
 //
 #include "ShaderGlobalDef.hlsli"
 
-cbuffer PerMesh : register (b1)
-{
-    MeshTransforms Mesh;
-};
+// Per instance mesh transforms. The cpu offsets the view to the first instance of each draw.
+StructuredBuffer<MeshTransforms> MeshInstances : register (t0);
 
 
-PSInputGeometry main( VSInputGeometry Input )
+PSInputGeometry main( VSInputGeometry Input, uint InstanceId : SV_InstanceID )
 {
     PSInputGeometry Ps;
+    MeshTransforms Mesh = MeshInstances[InstanceId];
+#if PACKED_VERTEX
+    DecodePackedVertex(Input, Mesh);
+#endif
 
     Ps.Position = mul( Mesh.WorldToViewClip, Input.Position );
     Ps.Normal = mul( Mesh.N, Input.Normal ) * 0.5 + 0.5;
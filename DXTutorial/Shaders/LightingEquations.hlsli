@@ -1,7 +1,7 @@
 #ifndef LIGHTING_EQUATIONS_H
 #define LIGHTING_EQUATIONS_H
 
-#define JCL_PI 3.14159;
+#define JCL_PI 3.14159
 
 struct DirectionLight
 {
@@ -9,8 +9,9 @@ struct DirectionLight
     float4 Dir;
     float4 Color;
     int ShadowIndex; // -1 if no shadow.
-    int LightTransformIndex;
-    int2 Pad0;
+    int LightTransformIndex; // Transform of the first cascade, the others follow.
+    int ShadowCascadeCount;
+    int Pad0;
 };
 
 
@@ -19,8 +20,8 @@ struct PointLight
     float4 WorldPos;
     float3 Color;
     float Radius;
-    float ShadowIndex;
-    int LightTransformIndex;
+    int ShadowIndex; // -1 if no shadow.
+    int LightTransformIndex; // Transform of the +x face, -x, +y, -y, +z and -z follow. -1 if no shadow.
     int2 Pad0;
 };
 
@@ -30,10 +31,12 @@ struct SpotLight
     float4 WorldPos;
     float4 Color;
     float3 Dir;
-    float Length;
-    float ShadowIndex;
-    int LightTransformIndex;
-    int2 Pad0;
+    float Range;
+    // Cosines of the cone's half angles, full intensity inside CosInner, none outside CosOuter.
+    float CosInner;
+    float CosOuter;
+    int ShadowIndex; // -1 if no shadow.
+    int LightTransformIndex; // -1 if no shadow.
 };
 
 
@@ -41,6 +44,8 @@ struct LightTransformation
 {
     float4x4 ViewToClip;
     float4x4 ClipToView;
+    // Tile of the shadow atlas, uv scale in xy and offset in zw, zero if the view has none.
+    float4 AtlasRect;
 };
 
 float GGX(float NoH, float roughness)
@@ -150,24 +155,100 @@ float3 DirectionLightRadiance
     return Color;
 }
 
+// Direct illumination of a light from direction L, arriving with Radiance.
+float3 LocalLightRadiance
+    (
+        float3 V,
+        float3 Albedo,
+        float3 N,
+        float Roughness,
+        float Metallic,
+        float3 F0,
+        // Unit vector from the surface to the light.
+        float3 L,
+        // Light color, attenuated.
+        float3 Radiance
+    )
+{
+    float3 H = normalize( L + V );
+    float NoL = dot( N, L );
+    if (NoL <= 0) 
+    {
+        return float3( 0, 0, 0 );
+    }
+    NoL = clamp( NoL, 0.001, 1.0 );
+    float NoV = clamp( abs( dot( N, V ) ), 0.001, 1.0 );
+    float NoH = clamp( dot( N, H ), 0.001, 1.0 );
+    float VoH = clamp( dot( V, H ), 0.001, 1.0 );
+
+    float D = GGX( NoH, Roughness );
+    float G = SchlickSmithGGX( NoL, NoV, Roughness );
+    float3 F = FresnelSchlick( VoH, F0 );
+    float3 Kd = ( float3( 1.0, 1.0, 1.0 ) - F ) * ( 1.0 - Metallic );
+    return ( Kd * Albedo / JCL_PI + BRDF( D, F, G, NoL, NoV ) ) * Radiance * NoL;
+}
+
+
+// Inverse square falloff, windowed to reach zero at the light's range.
+float DistanceAttenuation(float DistanceSq, float Range)
+{
+    float Ratio = DistanceSq / ( Range * Range );
+    float Window = saturate( 1.0 - Ratio * Ratio );
+    return Window * Window / ( DistanceSq + 1.0 );
+}
+
+
 // Calculate direct illumination from point light source.
-float3 PointLightRadiance()
+float3 PointLightRadiance
+    (
+        // View vector, normalized.
+        float3 V,
+        float3 Albedo,
+        float3 N,
+        float Roughness,
+        float Metallic,
+        float3 F0,
+        // Shaded position in world space.
+        float3 WorldPos,
+        PointLight Light
+    )
 {
-    float3 radiance = float3(0.0, 0.0, 0.0);
-    return radiance;
+    float3 ToLight = Light.WorldPos.xyz - WorldPos;
+    float DistanceSq = max( dot( ToLight, ToLight ), 0.0001 );
+    float3 Radiance = Light.Color * DistanceAttenuation( DistanceSq, Light.Radius );
+    return LocalLightRadiance( V, Albedo, N, Roughness, Metallic, F0, ToLight * rsqrt( DistanceSq ), Radiance );
 }
 
 // Calculate direction illumination from spot light source.
-float3 SpotLightRadiance()
+float3 SpotLightRadiance
+    (
+        // View vector, normalized.
+        float3 V,
+        float3 Albedo,
+        float3 N,
+        float Roughness,
+        float Metallic,
+        float3 F0,
+        // Shaded position in world space.
+        float3 WorldPos,
+        SpotLight Light
+    )
 {
-    float3 radiance = float3(0.0, 0.0, 0.0);
-    return radiance;
+    float3 ToLight = Light.WorldPos.xyz - WorldPos;
+    float DistanceSq = max( dot( ToLight, ToLight ), 0.0001 );
+    float3 L = ToLight * rsqrt( DistanceSq );
+    float Cone = smoothstep( Light.CosOuter, Light.CosInner, dot( -L, Light.Dir ) );
+    float3 Radiance = Light.Color.xyz * DistanceAttenuation( DistanceSq, Light.Range ) * Cone;
+    return LocalLightRadiance( V, Albedo, N, Roughness, Metallic, F0, L, Radiance );
 }
 
 
-// Calculate the shadow coordinate to be used for sampling a shadow map.
-float2 CalculateShadowCoord(float3 WorldPosition, float4x4 LightViewToClip)
+// Calculate the shadow coordinate to be used for sampling a shadow map: uv in xy, the depth
+// to compare in z. Outside the map if xy isn't within [0, 1].
+float3 CalculateShadowCoord(float3 WorldPosition, float4x4 LightViewToClip)
 {
-    return float2(0, 0);
+    float4 ShadowClip = mul( LightViewToClip, float4( WorldPosition, 1.0 ) );
+    ShadowClip.xyz /= ShadowClip.w;
+    return float3( ShadowClip.x * 0.5 + 0.5, 0.5 - ShadowClip.y * 0.5, ShadowClip.z );
 }
 #endif
\ No newline at end of file
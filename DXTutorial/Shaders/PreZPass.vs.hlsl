@@ -1,11 +1,9 @@
 // Shader Code for a pre z pass.
 #include "ShaderGlobalDef.hlsli"
 
-// PerMesh constant buffer, to be sync'ed with cpu GlobalDef.h struct.
-cbuffer PerMesh : register (b1)
-{
-    MeshTransforms Mesh;
-};
+// Per instance mesh transforms, to be sync'ed with cpu GlobalDef.h struct.
+// The cpu offsets the view to the first instance of each draw.
+StructuredBuffer<MeshTransforms> MeshInstances : register (t0);
 
 
 #ifdef ALPHA_CUTOFF
@@ -15,9 +13,15 @@ cbuffer PerMesh : register (b1)
 #endif
     main 
     (
-        VSInputGeometry VertexInput
+        VSInputGeometry VertexInput,
+        uint InstanceId : SV_InstanceID
     )
 {
+  MeshTransforms Mesh = MeshInstances[InstanceId];
+#if PACKED_VERTEX
+  DecodePackedVertex(VertexInput, Mesh);
+#endif
+
 #ifdef ALPHA_CUTOFF
     PSInputAlpha Input;
     Input.TexCoord = VertexInput.TexCoord;
@@ -0,0 +1,3 @@
+// PreZPass.vs for meshes with VERTEX_FORMAT_PACKED vertices.
+#define PACKED_VERTEX 1
+#include "PreZPass.vs.hlsl"
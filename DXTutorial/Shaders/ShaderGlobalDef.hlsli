@@ -45,6 +45,9 @@ struct MeshTransforms
     float4x4 WorldToViewClip;
     float4x4 PrevWorldToViewClip;
     float4x4 N;
+    // Packed vertex position dequantization.
+    float4 PositionScale;
+    float4 PositionOffset;
 };
 
 // Per material struct.
@@ -136,6 +139,28 @@ float3 CalculateBinormal(float3 N, float3 T)
 }
 
 
+// Unit vector from its octahedral encoding in [-1, 1]^2.
+float3 DecodeOctahedral(float2 E)
+{
+    float3 V = float3(E.xy, 1.0 - abs(E.x) - abs(E.y));
+    float T = saturate(-V.z);
+    V.xy += (V.xy >= 0.0) ? -T : T;
+    return normalize(V);
+}
+
+
+// Expand a PackedVertex, as read through the packed input layout (see PackedVertex in GlobalDef.h),
+// into the values a float Vertex would have given. Vertex shaders compiled with PACKED_VERTEX call this first.
+void DecodePackedVertex(inout VSInputGeometry Input, MeshTransforms Mesh)
+{
+    float TangentSign = Input.Position.w * 2.0 - 1.0;
+    Input.Position = float4(Input.Position.xyz * Mesh.PositionScale.xyz + Mesh.PositionOffset.xyz, 1.0);
+    Input.Normal = float4(DecodeOctahedral(Input.Normal.xy), 1.0);
+    Input.Tangent = float4(DecodeOctahedral(Input.Tangent.xy), TangentSign);
+    Input.TexCoord = float4(Input.TexCoord.xy, 0.0, 0.0);
+}
+
+
 // If using a more traditional pipeline, it would be best to calculate it's metallic mask.
 float SolveForMetallic(float3 Diffuse, float Specular, float OneMinusSpecularStrength)
 {
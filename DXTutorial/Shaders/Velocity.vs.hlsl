@@ -8,6 +8,9 @@ cbuffer PerMesh : register (b1)
 PSInputVelocity main( VSInputGeometry Input )
 {
     PSInputVelocity Output;
+#if PACKED_VERTEX
+    DecodePackedVertex(Input, Mesh);
+#endif
 
     Output.ClipPosition = mul(Mesh.WorldToViewClip, Input.Position);
     Output.PrevClipPosition = mul(Mesh.PrevWorldToViewClip, Input.Position);
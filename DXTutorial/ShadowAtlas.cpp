@@ -0,0 +1,156 @@
+//
+#include "ShadowAtlas.h"
+
+namespace jcl {
+namespace Shadows {
+
+
+void ShadowAtlas::initialize(U32 size, U32 minTileSize)
+{
+    ASSERT(size && (size & (size - 1)) == 0);
+    ASSERT(minTileSize && (minTileSize & (minTileSize - 1)) == 0 && minTileSize <= size);
+    m_size = size;
+    m_minTileSize = minTileSize;
+    m_levelCount = 1;
+    while ((size >> (m_levelCount - 1)) > minTileSize) ++m_levelCount;
+
+    m_levelOffsets.resize(m_levelCount + 1);
+    U32 nodeCount = 0;
+    for (U32 level = 0; level < m_levelCount; ++level) {
+        m_levelOffsets[level] = nodeCount;
+        nodeCount += 1u << (level * 2);
+    }
+    m_levelOffsets[m_levelCount] = nodeCount;
+    m_states.assign(nodeCount, NODE_STATE_NONE);
+    m_freeSlots.assign(nodeCount, 0);
+    m_freeNodes.assign(m_levelCount, std::vector<U32>());
+    m_usedTexels = 0;
+    pushFree(0, 0);
+}
+
+
+U32 ShadowAtlas::getLevel(U32 size) const
+{
+    U32 level = 0;
+    while (level + 1 < m_levelCount && (m_size >> (level + 1)) >= size) ++level;
+    return level;
+}
+
+
+void ShadowAtlas::pushFree(U32 level, U32 node)
+{
+    m_states[node] = NODE_STATE_FREE;
+    m_freeSlots[node] = static_cast<U32>(m_freeNodes[level].size());
+    m_freeNodes[level].push_back(node);
+}
+
+
+void ShadowAtlas::removeFree(U32 level, U32 node)
+{
+    std::vector<U32>& nodes = m_freeNodes[level];
+    U32 slot = m_freeSlots[node];
+    nodes[slot] = nodes.back();
+    m_freeSlots[nodes[slot]] = slot;
+    nodes.pop_back();
+}
+
+
+ShadowAtlas::Tile ShadowAtlas::allocate(U32 size)
+{
+    if (!m_levelCount || size > m_size) return kInvalidTile;
+    U32 level = getLevel(size);
+    // Smallest free node that fits, then split down to the level asked for.
+    U32 from = level + 1;
+    while (from > 0 && m_freeNodes[from - 1].empty()) --from;
+    if (from == 0) return kInvalidTile;
+    --from;
+
+    U32 node = m_freeNodes[from].back();
+    removeFree(from, node);
+    for (U32 l = from; l < level; ++l) {
+        m_states[node] = NODE_STATE_SPLIT;
+        U32 side = 1u << l;
+        U32 index = node - m_levelOffsets[l];
+        U32 x = (index % side) * 2;
+        U32 y = (index / side) * 2;
+        // Keep the first child, the others are free to take.
+        pushFree(l + 1, getNode(l + 1, x + 1, y));
+        pushFree(l + 1, getNode(l + 1, x, y + 1));
+        pushFree(l + 1, getNode(l + 1, x + 1, y + 1));
+        node = getNode(l + 1, x, y);
+    }
+    m_states[node] = NODE_STATE_USED;
+    U64 tileSize = m_size >> level;
+    m_usedTexels += tileSize * tileSize;
+    return node;
+}
+
+
+void ShadowAtlas::free(Tile tile)
+{
+    if (tile == kInvalidTile || tile >= m_states.size() || m_states[tile] != NODE_STATE_USED) return;
+    U32 level = 0;
+    while (m_levelOffsets[level + 1] <= tile) ++level;
+    U64 tileSize = m_size >> level;
+    m_usedTexels -= tileSize * tileSize;
+
+    U32 node = tile;
+    // Merge with the siblings for as long as all four are free.
+    while (level > 0) {
+        U32 side = 1u << level;
+        U32 index = node - m_levelOffsets[level];
+        U32 x = (index % side) & ~1u;
+        U32 y = (index / side) & ~1u;
+        U32 siblings[4] = { getNode(level, x, y), getNode(level, x + 1, y),
+                            getNode(level, x, y + 1), getNode(level, x + 1, y + 1) };
+        B32 allFree = true;
+        for (U32 sibling : siblings) {
+            allFree = allFree && (sibling == node || m_states[sibling] == NODE_STATE_FREE);
+        }
+        if (!allFree) break;
+        for (U32 sibling : siblings) {
+            if (sibling != node) removeFree(level, sibling);
+            m_states[sibling] = NODE_STATE_NONE;
+        }
+        --level;
+        node = getNode(level, x / 2, y / 2);
+    }
+    pushFree(level, node);
+}
+
+
+B32 ShadowAtlas::canAllocate(U32 size) const
+{
+    if (!m_levelCount || size > m_size) return false;
+    U32 level = getLevel(size);
+    for (U32 l = 0; l <= level; ++l) {
+        if (!m_freeNodes[l].empty()) return true;
+    }
+    return false;
+}
+
+
+U32 ShadowAtlas::getLargestFreeSize() const
+{
+    for (U32 level = 0; level < m_levelCount; ++level) {
+        if (!m_freeNodes[level].empty()) return m_size >> level;
+    }
+    return 0;
+}
+
+
+ShadowAtlasRect ShadowAtlas::getRect(Tile tile) const
+{
+    ShadowAtlasRect rect = { };
+    if (tile == kInvalidTile || tile >= m_states.size()) return rect;
+    U32 level = 0;
+    while (m_levelOffsets[level + 1] <= tile) ++level;
+    U32 side = 1u << level;
+    U32 index = tile - m_levelOffsets[level];
+    rect._size = m_size >> level;
+    rect._x = (index % side) * rect._size;
+    rect._y = (index / side) * rect._size;
+    return rect;
+}
+} // Shadows
+} // jcl
@@ -0,0 +1,84 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+
+#include <vector>
+
+namespace jcl {
+namespace Shadows {
+
+
+// Texel rectangle of a tile in the atlas, always square.
+struct ShadowAtlasRect
+{
+    U32 _x;
+    U32 _y;
+    U32 _size;
+};
+
+
+/*
+    Shadow Atlas hands out square tiles of a square depth atlas, power of two sized, with a
+    quadtree: a node is free, used, or split into four children of half its size. A tile is
+    taken from the smallest free node that fits, splitting it down to the size asked for, and
+    freed nodes merge back with their siblings once all four are free, so the atlas doesn't
+    fragment into tiles too small to use. Free nodes of each level are kept in lists, so both
+    take constant time, give or take the levels walked.
+
+    Only texels are managed here, which tiles to keep and which to evict is left to the caller.
+*/
+class ShadowAtlas
+{
+public:
+    typedef U32 Tile;
+    static const Tile kInvalidTile = 0xffffffffu;
+
+    ShadowAtlas() : m_size(0), m_minTileSize(0), m_levelCount(0), m_usedTexels(0) { }
+
+    // Both sizes must be powers of two, minTileSize at most size.
+    void initialize(U32 size, U32 minTileSize);
+
+    // A tile of size texels a side, rounded up to a power of two no smaller than the minimum.
+    // Returns kInvalidTile if no free node is large enough.
+    Tile allocate(U32 size);
+    void free(Tile tile);
+    // True if a tile of this size could be allocated now.
+    B32 canAllocate(U32 size) const;
+
+    ShadowAtlasRect getRect(Tile tile) const;
+    U32 getSize() const { return m_size; }
+    U32 getMinTileSize() const { return m_minTileSize; }
+    U64 getUsedTexels() const { return m_usedTexels; }
+    // Size of the largest tile that can be allocated now, 0 if none.
+    U32 getLargestFreeSize() const;
+
+private:
+    enum NodeState : U8
+    {
+        // Part of a free or used ancestor.
+        NODE_STATE_NONE,
+        NODE_STATE_FREE,
+        NODE_STATE_USED,
+        NODE_STATE_SPLIT
+    };
+
+    // Level of tiles of this size, 0 being the whole atlas.
+    U32 getLevel(U32 size) const;
+    // Nodes of a level are numbered row by row, after those of the levels above.
+    U32 getNode(U32 level, U32 x, U32 y) const { return m_levelOffsets[level] + y * (1u << level) + x; }
+    void pushFree(U32 level, U32 node);
+    void removeFree(U32 level, U32 node);
+
+    U32 m_size;
+    U32 m_minTileSize;
+    U32 m_levelCount;
+    U64 m_usedTexels;
+    std::vector<U32> m_levelOffsets;
+    std::vector<U8> m_states;
+    // Position of each free node in the free list of its level.
+    std::vector<U32> m_freeSlots;
+    std::vector<std::vector<U32>> m_freeNodes;
+};
+} // Shadows
+} // jcl
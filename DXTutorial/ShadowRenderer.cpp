@@ -2,42 +2,69 @@
 #include "ShadowRenderer.h"
 #include "BackendRenderer.h"
 #include "LightRenderer.h"
+#include "PipelineCache.h"
+#include "VertexFormat.h"
+
+#include <algorithm>
+#include <math.h>
 
 namespace jcl {
 namespace Shadows {
 
+// One depth atlas holds every shadow's tiles, its size is the memory the shadows may take,
+// 128MB of 16 bit depth.
+static const U32 kShadowAtlasSize = 8192;
+static const U32 kShadowAtlasMinTileSize = 64;
+// Tiles of point and spot shadows only shrink once their light needs them this many times
+// smaller, so lights on the edge of two sizes don't render again every frame.
+static const U32 kShadowTileShrinkRatio = 4;
+// Point and spot shadows see from this fraction of their range on.
+static const R32 kLocalShadowNearRatio = 0.01f;
+// Screen height point and spot tiles are sized for when the camera has no target size.
+static const R32 kDefaultTargetHeight = 1080.0f;
+// Widest cone of a spot shadow, in radians.
+static const R32 kMaxSpotShadowAngle = 170.0f * 3.14159265f / 180.0f;
+
+const R32 LightShadow::kDefaultShadowDistance = 100.0f;
+const R32 LightShadow::kDefaultSplitLambda = 0.75f;
+
 gfx::Resource* sunlightShadowMapCascadeResource;
-gfx::Resource* directionLightShadowMapAtlasResource;
-gfx::Resource* pointLightShadowMapAtlasResource;
-gfx::Resource* spotLightShadowMapAtlasResource;
+gfx::Resource* shadowAtlasResource;
 
 gfx::RenderTargetView* sunlightShadowMapRTV;
-gfx::RenderTargetView* pointLightShadowMapAtlasRTV;
-gfx::RenderTargetView* spotLightShadowMapAtlasRTV;
 
 gfx::RootSignature* shadowRootSignature;
 
 gfx::ShaderResourceView* sunlightShadowMapSRV;
-gfx::ShaderResourceView* pointLightShadowMapAtlasSRV;
-gfx::ShaderResourceView* spotLightShadowMapAtlasSRV;
+gfx::ShaderResourceView* shadowAtlasSRV;
+gfx::DepthStencilView* shadowAtlasDSV;
+gfx::RenderPass* shadowAtlasRenderPass;
+
+// Shadow pipeline for each VertexFormat.
+gfx::GraphicsPipeline* shadowRenderPipelines[VERTEX_FORMAT_COUNT];
 
-gfx::GraphicsPipeline* shadowRenderPipeline;
+ShadowAtlas shadowAtlas;
+ShadowStats shadowStats;
+// Counts updateShadows(), shadows of lights visible in the last one have it as their last used frame.
+U32 shadowFrame;
 
 std::vector<LightShadow*> pointLightShadows;
 std::vector<LightShadow*> directionLightShadows;
 std::vector<LightShadow*> spotLightShadows;
+// Point and spot shadows of the lights visible in the last updateShadows().
+std::vector<LightShadow*> activeLocalShadows;
 
-std::vector<gfx::DepthStencilView*> pointLightDSVs;
-std::vector<gfx::DepthStencilView*> directionLightDSVs;
-std::vector<gfx::DepthStencilView*> spotLightDSVs;
-
-std::vector<gfx::RenderPass*> pointLightRenderPasses;
-std::vector<gfx::RenderPass*> directionLightRenderPasses;
-std::vector<gfx::RenderPass*> spotLightRenderPasses;
+// A point or spot shadow in view, with the tile size its light covers on screen.
+struct ShadowRequest
+{
+    LightShadow* _shadow;
+    const Lights::Light* _light;
+    U32 _size;
+};
+std::vector<ShadowRequest> shadowRequests;
 
-void createShadowRootSignature(gfx::BackendRenderer* pRenderer)
+void createShadowRootSignature(PipelineCache* pPipelineCache)
 {
-    pRenderer->createRootSignature(&shadowRootSignature);
     gfx::PipelineLayout layouts[4];
     layouts[0] = { };
     layouts[0]._type = gfx::PIPELINE_LAYOUT_TYPE_CBV;
@@ -55,24 +82,13 @@ void createShadowRootSignature(gfx::BackendRenderer* pRenderer)
     layouts[3]._type = gfx::PIPELINE_LAYOUT_TYPE_SAMPLERS;
     layouts[3]._numSamplers = 1;
     
-    shadowRootSignature->initialize(gfx::SHADER_VISIBILITY_VERTEX | gfx::SHADER_VISIBILITY_PIXEL,
-                                    layouts, 4);
+    shadowRootSignature = pPipelineCache->getRootSignature(gfx::SHADER_VISIBILITY_VERTEX | gfx::SHADER_VISIBILITY_PIXEL,
+                                                           layouts, 4);
 }
 
-void createShadowMapPipeline(gfx::BackendRenderer* pRenderer)
+void createShadowMapPipeline(PipelineCache* pPipelineCache)
 {
-    std::vector<gfx::InputElementInfo> elements(4);
-    std::vector<const CHAR*> semantics = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD" };
-    U32 offset = 0;
-    for (size_t i = 0; i < elements.size(); ++i) {
-        elements[i]._alignedByteOffset = offset;
-        elements[i]._classification = gfx::INPUT_CLASSIFICATION_PER_VERTEX;
-        elements[i]._format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-        elements[i]._instanceDataStepRate = 0;
-        elements[i]._semanticIndex = 0;
-        elements[i]._semanticName = semantics[i];
-        offset += sizeof(Vector4);
-    }
+    gfx::InputElementInfo elements[kVertexElementCount];
 
     gfx::GraphicsPipelineInfo info = { };
     info._blendState._alphaToCoverageEnable = false;
@@ -86,7 +102,8 @@ void createShadowMapPipeline(gfx::BackendRenderer* pRenderer)
     info._blendState._renderTargets[0]._logicOpEnable = false;
     info._numRenderTargets = 0;
     info._depthStencilState._backFace._stencilDepthFailOp = gfx::STENCIL_OP_ZERO;
-    info._depthStencilState._depthFunc = gfx::COMPARISON_FUNC_LESS;
+    // Depth is reversed, as the scene's is, 1 nearest the light.
+    info._depthStencilState._depthFunc = gfx::COMPARISON_FUNC_GREATER;
     info._depthStencilState._depthWriteMask = gfx::DEPTH_WRITE_MASK_ALL;
     info._depthStencilState._depthEnable = true;
     info._depthStencilState._frontFace = { };
@@ -95,10 +112,10 @@ void createShadowMapPipeline(gfx::BackendRenderer* pRenderer)
     info._depthStencilState._stencilWriteMask = 0xff;
     // 16 bit unorm for shadow maps, as they don't need to be insanely precise,
     // But applications will want better precision depending on the situation.
-    info._dsvFormat = DXGI_FORMAT_D32_FLOAT;
+    info._dsvFormat = DXGI_FORMAT_D16_UNORM;
     info._ibCutValue = gfx::IB_CUT_VALUE_DISABLED;
-    info._inputLayout._elementCount = elements.size();
-    info._inputLayout._pInputElements = elements.data();
+    info._inputLayout._elementCount = kVertexElementCount;
+    info._inputLayout._pInputElements = elements;
     info._sampleMask = 0xffffffff;
     info._topology = gfx::PRIMITIVE_TOPOLOGY_TRIANGLES;
     info._rasterizationState._antialiasedLinesEnable = false;
@@ -108,7 +125,8 @@ void createShadowMapPipeline(gfx::BackendRenderer* pRenderer)
     info._rasterizationState._frontCounterClockwise = true;
     info._rasterizationState._depthBiasClamp = 0.f;
     info._rasterizationState._depthBias = 0;
-    info._rasterizationState._depthClipEnable = true;
+    // Casters between the light and a view are culled in, and clamped to its near plane.
+    info._rasterizationState._depthClipEnable = false;
     info._rasterizationState._slopedScaledDepthBias = 0.f;
     info._rasterizationState._forcedSampleCount = 0;
     info._pRootSignature = shadowRootSignature;
@@ -117,14 +135,117 @@ void createShadowMapPipeline(gfx::BackendRenderer* pRenderer)
     //info._pixelShader._szBytes = 0;
     info._vertexShader._pByteCode = new U8[1024 * 1024 * 5];
     //retrieveShader("Depth.ps.cso", &info._pixelShader._pByteCode, info._pixelShader._szBytes);
-    retrieveShader("Depth.vs.cso", &info._vertexShader._pByteCode, info._vertexShader._szBytes);
-
-    pRenderer->createGraphicsPipelineState(&shadowRenderPipeline, &info);
+    for (U32 format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+        getVertexInputElements(VertexFormat(format), elements);
+        retrieveShader(getVertexShaderPath(VertexFormat(format), "Depth.vs.cso"), 
+                       &info._vertexShader._pByteCode, info._vertexShader._szBytes);
+        shadowRenderPipelines[format] = pPipelineCache->getGraphicsPipeline(info);
+    }
 
     delete[] info._pixelShader._pByteCode;
     delete[] info._vertexShader._pByteCode;
 }
 
+
+// Draw the meshes into the bound shadow map.
+static void recordShadowDraws(gfx::CommandList* pList, 
+                              gfx::Resource* pConstants, 
+                              GeometryMesh** pShadowMeshes, 
+                              GeometrySubMesh** pShadowSubMeshes, 
+                              U32 shadowMeshCount)
+{
+    U32 boundFormat = VERTEX_FORMAT_COUNT;
+    U64 submeshIdx = 0;
+    for (U32 i = 0; i < shadowMeshCount; ++i) {
+        RenderUUID vertUUID = pShadowMeshes[i]->_vertexBufferView;
+        RenderUUID indUUID = pShadowMeshes[i]->_indexBufferView;
+
+        if (pShadowMeshes[i]->_vertexFormat != boundFormat) {
+            boundFormat = pShadowMeshes[i]->_vertexFormat;
+            pList->setGraphicsPipeline(shadowRenderPipelines[boundFormat]);
+        }
+
+        pList->setGraphicsRootConstantBufferView(0, pConstants, pShadowMeshes[i]->_meshDescriptorOffset);
+        gfx::VertexBufferView* pView = getVertexBufferView(vertUUID);
+
+        pList->setVertexBuffers(0, &pView, 1);
+
+        if (indUUID != 0) 
+            pList->setIndexBuffer(getIndexBufferView(indUUID));
+
+        for (U64 j = 0; j < pShadowMeshes[i]->_submeshCount; ++j, ++submeshIdx) {
+            if (pShadowSubMeshes[submeshIdx]->_matData->_matrialFlags & MATERIAL_USE_ALBEDO_MAP) { }
+            if (indUUID != 0) {
+                pList->drawIndexedInstanced(pShadowSubMeshes[submeshIdx]->_indCount, 
+                                            pShadowSubMeshes[submeshIdx]->_vertInst, 
+                                            pShadowSubMeshes[submeshIdx]->_indOffset, 
+                                            pShadowSubMeshes[submeshIdx]->_startVert, 0);
+            } else {
+                pList->drawInstanced(pShadowSubMeshes[submeshIdx]->_vertCount, 
+                                        pShadowSubMeshes[submeshIdx]->_vertInst, 
+                                        pShadowSubMeshes[submeshIdx]->_startVert, 0);
+            }
+        }
+    }
+}
+
+
+
+
+// Draw the casters of a view into its tile of the atlas. Returns the meshes drawn.
+static U32 recordShadowView(gfx::CommandList* pList,
+                            const ShadowView& view,
+                            U32 transformIdx,
+                            gfx::Resource* pTransforms,
+                            gfx::Resource* pConstants,
+                            GeometryMesh** pMeshes,
+                            GeometrySubMesh** pSubMeshes,
+                            U32 meshCount,
+                            const MeshCuller* pCuller,
+                            std::vector<GeometryMesh*>& visibleMeshes,
+                            std::vector<GeometrySubMesh*>& visibleSubMeshes,
+                            CullStats* pStats)
+{
+    R32 x = static_cast<R32>(view._rect._x);
+    R32 y = static_cast<R32>(view._rect._y);
+    R32 size = static_cast<R32>(view._rect._size);
+    RECT rect = { };
+    rect.left = view._rect._x;
+    rect.top = view._rect._y;
+    rect.right = view._rect._x + view._rect._size;
+    rect.bottom = view._rect._y + view._rect._size;
+    gfx::Viewport viewport = { };
+    viewport.x = x;
+    viewport.y = y;
+    viewport.w = size;
+    viewport.h = size;
+    viewport.mind = 0.f;
+    viewport.maxd = 1.f;
+    gfx::Scissor scissor = { };
+    scissor.left = x;
+    scissor.top = y;
+    scissor.right = x + size;
+    scissor.bottom = y + size;
+    pList->setViewports(&viewport, 1);
+    pList->setScissors(&scissor, 1);
+    // Only the tile is cleared, the rest of the atlas holds other views.
+    pList->clearDepthStencil(shadowAtlasDSV, gfx::CLEAR_FLAG_DEPTH, 0.0f, 0, 1, &rect);
+    pList->setGraphicsRootConstantBufferView(1, pTransforms, 256 * transformIdx);
+
+    GeometryMesh** pShadowMeshes = pMeshes;
+    GeometrySubMesh** pShadowSubMeshes = pSubMeshes;
+    U32 shadowMeshCount = meshCount;
+    if (pCuller) {
+        shadowMeshCount = pCuller->cull(view._casterPlanes, 5, visibleMeshes, visibleSubMeshes, pStats);
+        pShadowMeshes = visibleMeshes.data();
+        pShadowSubMeshes = visibleSubMeshes.data();
+    }
+
+    recordShadowDraws(pList, pConstants, pShadowMeshes, pShadowSubMeshes, shadowMeshCount);
+    return shadowMeshCount;
+}
+
+
 void generateShadowCommands
     (
         // list to record our commands to. 
@@ -139,77 +260,60 @@ void generateShadowCommands
         U32 submeshCount,
         //
         gfx::Resource* pGlobal,
-        Lights::LightSystem* pLightSystem
+        gfx::Resource* pConstants,
+        Lights::LightSystem* pLightSystem,
+        const MeshCuller* pCuller,
+        CullStats* pStats
     )
 {
     gfx::Resource* pTransforms = getLightTransforms(pLightSystem);
-    // Direction light shadow map check and render.
-    for (U32 i = 0; i < directionLightShadows.size(); ++i) {
-        LightShadow* shadowInfo = directionLightShadows[i];
-        
-        if (!shadowInfo->needsUpdate()) 
+    std::vector<GeometryMesh*> visibleMeshes;
+    std::vector<GeometrySubMesh*> visibleSubMeshes;
+    shadowStats._renderedViews = 0;
+    shadowStats._cachedViews = 0;
+    shadowStats._casterDraws = 0;
+
+    // Casters that moved since the last frame put the tiles they cross out of date, those of
+    // lights out of view too, as their tiles are kept for when the light comes back.
+    for (LightShadow* shadowInfo : pointLightShadows) {
+        markShadowViewsMoved(shadowInfo, pCuller);
+    }
+    for (LightShadow* shadowInfo : spotLightShadows) {
+        markShadowViewsMoved(shadowInfo, pCuller);
+    }
+
+    pList->setRenderPass(shadowAtlasRenderPass);
+    pList->setGraphicsRootSignature(shadowRootSignature);
+
+    // Cascades follow the camera, they are rendered every frame.
+    for (LightShadow* shadowInfo : directionLightShadows) {
+        for (U32 v = 0; v < shadowInfo->getViewCount(); ++v) {
+            const ShadowView& view = shadowInfo->getView(v);
+            if (view._tile == ShadowAtlas::kInvalidTile) continue;
+            shadowStats._casterDraws += recordShadowView(pList, view, shadowInfo->getLightTransformIndex() + v,
+                                                         pTransforms, pConstants, pMeshes, pSubMeshes, meshCount,
+                                                         pCuller, visibleMeshes, visibleSubMeshes, pStats);
+            ++shadowStats._renderedViews;
+        }
+        // Signal the shadowmap is no longer in need of rerendering.
+        signalClean(shadowInfo);
+    }
+
+    // Point and spot shadows of the lights in view, only the views out of date are rendered again.
+    for (LightShadow* shadowInfo : activeLocalShadows) {
+        if (!shadowInfo->getTileSize()) 
             continue;
-        
-        U32 shadowIdx = shadowInfo->getShadowIndex();
-        gfx::DepthStencilView* directionLightDSV = directionLightDSVs[shadowIdx];
-        gfx::RenderPass* directionLightRenderPass = directionLightRenderPasses[shadowIdx];
-        RECT rect = { };
-        rect.bottom = 512;
-        rect.right = 512;
-        rect.left = rect.top = 0; 
-        gfx::Viewport viewport = { };
-        viewport.x = 0.f;
-        viewport.y = 0.f;
-        viewport.w = 512.f;
-        viewport.h = 512.f;
-        viewport.mind = 1.f;
-        viewport.maxd = 0.f;
-        gfx::Scissor scissor = { };
-        scissor.bottom = 512.f;
-        scissor.right = 512.0f;
-        scissor.left = 0.f;
-        scissor.top = 0.f;
-        pList->setViewports(&viewport, 1);
-        pList->setScissors(&scissor, 1);
-        pList->setRenderPass(directionLightRenderPass);
-        pList->clearDepthStencil(directionLightDSV, gfx::CLEAR_FLAG_DEPTH, 1.0f, 0, 1, &rect);
-        pList->setGraphicsRootSignature(shadowRootSignature);
-        pList->setGraphicsPipeline(shadowRenderPipeline);
-        pList->setGraphicsRootConstantBufferView(1, pTransforms, 256 * i);
-
-        // Set up resources for this shadow.
-        U64 submeshIdx = 0;
-        for (U32 i = 0; i < meshCount; ++i) {
-            RenderUUID meshUUID = pMeshes[i]->_meshTransform;
-            RenderUUID vertUUID = pMeshes[i]->_vertexBufferView;
-            RenderUUID indUUID = pMeshes[i]->_indexBufferView;
-
-            gfx::Resource* pMeshDescriptor = getResource(meshUUID);
-            pList->setGraphicsRootConstantBufferView(0, pMeshDescriptor);
-            gfx::VertexBufferView* pView = getVertexBufferView(vertUUID);
-
-            pList->setVertexBuffers(0, &pView, 1);
-
-            if (indUUID != 0) 
-                pList->setIndexBuffer(getIndexBufferView(indUUID));
-
-            for (U64 j = 0; j < pMeshes[i]->_submeshCount; ++j, ++submeshIdx) {
-                RenderUUID matUUID = pSubMeshes[submeshIdx]->_materialDescriptor;
-                gfx::Resource* pMatDescriptor = getResource(matUUID);
-                if (pSubMeshes[submeshIdx]->_matData->_matrialFlags & MATERIAL_USE_ALBEDO_MAP) { }
-                if (indUUID != 0) {
-                    pList->drawIndexedInstanced(pSubMeshes[submeshIdx]->_indCount, 
-                                                pSubMeshes[submeshIdx]->_vertInst, 
-                                                pSubMeshes[submeshIdx]->_indOffset, 
-                                                pSubMeshes[submeshIdx]->_startVert, 0);
-                } else {
-                    pList->drawInstanced(pSubMeshes[submeshIdx]->_vertCount, 
-                                            pSubMeshes[submeshIdx]->_vertInst, 
-                                            pSubMeshes[submeshIdx]->_startVert, 0);
-                }
+        for (U32 v = 0; v < shadowInfo->getViewCount(); ++v) {
+            const ShadowView& view = shadowInfo->getView(v);
+            if (!view._dirty) {
+                ++shadowStats._cachedViews;
+                continue;
             }
+            shadowStats._casterDraws += recordShadowView(pList, view, shadowInfo->getLightTransformIndex() + v,
+                                                         pTransforms, pConstants, pMeshes, pSubMeshes, meshCount,
+                                                         pCuller, visibleMeshes, visibleSubMeshes, pStats);
+            ++shadowStats._renderedViews;
         }
-        // Signal the shadowmap is no longer in need of rerendering.
         signalClean(shadowInfo);
     }
 }
@@ -218,7 +322,9 @@ void generateShadowCommands
 void signalClean(LightShadow* lightShadow)
 {
     if (!lightShadow) return;
-    lightShadow->m_dirty = false;
+    for (U32 v = 0; v < lightShadow->m_viewCount; ++v) {
+        lightShadow->m_views[v]._dirty = false;
+    }
 }
 
 
@@ -229,118 +335,519 @@ void setLightShadowIndex(LightShadow* lightShadow, U32 idx)
 }
 
 
+// Take a tile for each view, returns false, keeping the tiles the shadow has, if any doesn't fit.
+B32 allocateShadowTiles(LightShadow* lightShadow, U32 tileSize)
+{
+    ShadowAtlas::Tile tiles[kMaxShadowViews];
+    for (U32 v = 0; v < lightShadow->m_viewCount; ++v) {
+        tiles[v] = shadowAtlas.allocate(tileSize);
+        if (tiles[v] == ShadowAtlas::kInvalidTile) {
+            for (U32 i = 0; i < v; ++i) {
+                shadowAtlas.free(tiles[i]);
+            }
+            return false;
+        }
+    }
+    freeShadowTiles(lightShadow);
+    for (U32 v = 0; v < lightShadow->m_viewCount; ++v) {
+        ShadowView& view = lightShadow->m_views[v];
+        view._tile = tiles[v];
+        view._rect = shadowAtlas.getRect(tiles[v]);
+        view._dirty = true;
+    }
+    lightShadow->m_tileSize = lightShadow->m_views[0]._rect._size;
+    return true;
+}
+
+
+void freeShadowTiles(LightShadow* lightShadow)
+{
+    if (!lightShadow) return;
+    for (U32 v = 0; v < lightShadow->m_viewCount; ++v) {
+        ShadowView& view = lightShadow->m_views[v];
+        shadowAtlas.free(view._tile);
+        view._tile = ShadowAtlas::kInvalidTile;
+        view._rect = { };
+    }
+    lightShadow->m_tileSize = 0;
+}
+
+
+void markShadowViewsMoved(LightShadow* lightShadow, const MeshCuller* pCuller)
+{
+    if (!lightShadow || !lightShadow->m_tileSize) return;
+    // Without a culler, or with other meshes than last frame, nothing tells what moved.
+    B32 allMoved = !pCuller || pCuller->haveMeshesChanged();
+    for (U32 v = 0; v < lightShadow->m_viewCount; ++v) {
+        ShadowView& view = lightShadow->m_views[v];
+        if (view._dirty) continue;
+        if (allMoved) {
+            view._dirty = true;
+            continue;
+        }
+        for (const Bounds3D& bounds : pCuller->getMovedBounds()) {
+            if (lightShadow->intersects(bounds, v)) {
+                view._dirty = true;
+                break;
+            }
+        }
+    }
+}
+
+
+// Free the tiles of the shadow whose light was visible least recently, and not this frame.
+// Returns false if there is none to evict.
+static B32 evictShadowTiles()
+{
+    LightShadow* pOldest = nullptr;
+    std::vector<LightShadow*>* pLists[] = { &pointLightShadows, &spotLightShadows };
+    for (std::vector<LightShadow*>* pShadows : pLists) {
+        for (LightShadow* shadow : *pShadows) {
+            if (!shadow->getTileSize() || shadow->getLastUsedFrame() == shadowFrame) continue;
+            if (!pOldest || shadow->getLastUsedFrame() < pOldest->getLastUsedFrame()) pOldest = shadow;
+        }
+    }
+    if (!pOldest) return false;
+    shadowStats._evictedTiles += pOldest->getViewCount();
+    freeShadowTiles(pOldest);
+    return true;
+}
+
+
+// Texels of a side of the tiles of a light whose influence is the sphere at position, by the
+// pixels the sphere covers on screen, rounded up to a power of two the atlas can hold.
+static U32 computeShadowTileSize(const LightShadow& shadow, const Vector3& position, R32 radius, const Globals& camera)
+{
+    Vector3 cameraPosition(camera._cameraPos._x, camera._cameraPos._y, camera._cameraPos._z);
+    R32 distance = (position - cameraPosition).length();
+    U32 maxSize = shadow.getMapSize();
+    // From inside the light, it may cover the whole screen.
+    if (distance <= radius) return maxSize;
+    R32 height = camera._targetSize[1] ? static_cast<R32>(camera._targetSize[1]) : kDefaultTargetHeight;
+    R32 pixels = radius / distance * camera._proj._[1][1] * height;
+    // A face of a point light sees about half the sphere across.
+    if (shadow.getShadowType() == LightShadow::SHADOW_TYPE_OMNIDIRECTIONAL) pixels *= 0.5f;
+    U32 size = kShadowAtlasMinTileSize;
+    while (size < maxSize && static_cast<R32>(size) < pixels) size <<= 1;
+    return size;
+}
+
+
+// Registered shadows know where they are in the list of their type.
+static B32 isShadowRegistered(const LightShadow* shadow, const std::vector<LightShadow*>& shadows)
+{
+    return shadow && shadow->getShadowIndex() < shadows.size() && shadows[shadow->getShadowIndex()] == shadow;
+}
+
+
+void updateShadows(const Globals& camera, Lights::LightSystem* pLightSystem)
+{
+    ++shadowFrame;
+    shadowStats._shadows = 0;
+    shadowStats._unshadowed = 0;
+    shadowStats._evictedTiles = 0;
+
+    for (U32 i = 0; i < pLightSystem->getDirectionLightCount(); ++i) {
+        Lights::DirectionLight* pLight = pLightSystem->getDirectionLight(i);
+        if (!isShadowRegistered(pLight->_shadow, directionLightShadows)) continue;
+        pLight->_shadow->update(pLight, pLightSystem->getTransform(pLight->_transform), camera);
+        ++shadowStats._shadows;
+    }
+
+    shadowRequests.clear();
+    for (U32 idx : pLightSystem->getVisiblePointLights()) {
+        const Lights::PointLight& light = pLightSystem->getPointLight(idx);
+        if (!isShadowRegistered(light._shadow, pointLightShadows) || light._transform == Lights::kNoLightTransform) continue;
+        ShadowRequest request = { light._shadow, &light,
+                                  computeShadowTileSize(*light._shadow, light._position, light._radius, camera) };
+        shadowRequests.push_back(request);
+    }
+    for (U32 idx : pLightSystem->getVisibleSpotLights()) {
+        const Lights::SpotLight& light = pLightSystem->getSpotLight(idx);
+        if (!isShadowRegistered(light._shadow, spotLightShadows) || light._transform == Lights::kNoLightTransform) continue;
+        ShadowRequest request = { light._shadow, &light,
+                                  computeShadowTileSize(*light._shadow, light._position, light._range, camera) };
+        shadowRequests.push_back(request);
+    }
+    // Every shadow in view is marked first, so none of them is evicted for another.
+    activeLocalShadows.clear();
+    for (const ShadowRequest& request : shadowRequests) {
+        request._shadow->m_lastUsedFrame = shadowFrame;
+        activeLocalShadows.push_back(request._shadow);
+    }
+    // Larger tiles first, they are the hardest to find room for.
+    std::stable_sort(shadowRequests.begin(), shadowRequests.end(), [] (const ShadowRequest& a, const ShadowRequest& b) {
+        return a._size > b._size;
+    });
+
+    for (const ShadowRequest& request : shadowRequests) {
+        LightShadow* shadow = request._shadow;
+        U32 size = request._size;
+        U32 current = shadow->m_tileSize;
+        if (current && size > current) {
+            // Grow into new tiles, keeping the old ones if there is no room.
+            while (!allocateShadowTiles(shadow, size) && evictShadowTiles()) { }
+        } else if (!current || size * kShadowTileShrinkRatio <= current) {
+            freeShadowTiles(shadow);
+            // Settle for smaller tiles once every shadow out of view is evicted, or none.
+            while (!allocateShadowTiles(shadow, size)) {
+                if (evictShadowTiles()) continue;
+                if (size <= kShadowAtlasMinTileSize) break;
+                size >>= 1;
+            }
+        }
+        ++shadowStats._shadows;
+        if (!shadow->m_tileSize) ++shadowStats._unshadowed;
+        shadow->update(request._light, pLightSystem->getTransform(request._light->_transform), camera);
+    }
+    shadowStats._usedTexels = shadowAtlas.getUsedTexels();
+}
+
+
 void generateShadowResolveCommand(gfx::CommandList* pList)
 {
 }
 
 
-void initializeShadowRenderer(gfx::BackendRenderer* pRenderer)
+void initializeShadowRenderer(gfx::BackendRenderer* pRenderer, PipelineCache* pPipelineCache)
 {
-    // 8MB
-    pRenderer->createTexture(&directionLightShadowMapAtlasResource, 
-                             gfx::RESOURCE_DIMENSION_2D,
-                             gfx::RESOURCE_USAGE_DEFAULT,
-                             gfx::RESOURCE_BIND_DEPTH_STENCIL | gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                             DXGI_FORMAT_R32_TYPELESS,
-                             512u, 512u, 8u, 0, TEXT("DirectionLightShadowAtlas"));
-    // 50MB
-    pRenderer->createTexture(&pointLightShadowMapAtlasResource,
-                             gfx::RESOURCE_DIMENSION_2D,
-                             gfx::RESOURCE_USAGE_DEFAULT,
-                             gfx::RESOURCE_BIND_DEPTH_STENCIL | gfx::RESOURCE_BIND_SHADER_RESOURCE,
-                             DXGI_FORMAT_R16_TYPELESS,
-                             256u, 256u, 6u * 32u, 0u, TEXT("PointLightShadowAtlas"));
-    // 34MB
-    pRenderer->createTexture(&spotLightShadowMapAtlasResource,
+    // 128MB
+    pRenderer->createTexture(&shadowAtlasResource, 
                              gfx::RESOURCE_DIMENSION_2D,
                              gfx::RESOURCE_USAGE_DEFAULT,
                              gfx::RESOURCE_BIND_DEPTH_STENCIL | gfx::RESOURCE_BIND_SHADER_RESOURCE,
                              DXGI_FORMAT_R16_TYPELESS,
-                             512u, 512u, 32u, 0u, TEXT("SpotLightShadowAtlas"));
-    createShadowRootSignature(pRenderer);
-    createShadowMapPipeline(pRenderer);
+                             kShadowAtlasSize, kShadowAtlasSize, 1, 
+                             0, TEXT("ShadowAtlas"));
+    gfx::DepthStencilViewDesc dsvDesc = { };
+    dsvDesc._format = DXGI_FORMAT_D16_UNORM;
+    dsvDesc._dimension = gfx::DSV_DIMENSION_TEXTURE_2D;
+    dsvDesc._texture2D._mipSlice = 0;
+    pRenderer->createDepthStencilView(&shadowAtlasDSV, shadowAtlasResource, dsvDesc);
+    pRenderer->createRenderPass(&shadowAtlasRenderPass, 0, true);
+    shadowAtlasRenderPass->setDepthStencil(shadowAtlasDSV);
+
+    gfx::ShaderResourceViewDesc srvDesc = { };
+    srvDesc._format = DXGI_FORMAT_R16_UNORM;
+    srvDesc._dimension = gfx::SRV_DIMENSION_TEXTURE_2D;
+    srvDesc._texture2D._mipLevels = 1;
+    srvDesc._texture2D._mostDetailedMip = 0;
+    srvDesc._texture2D._planeSlice = 0;
+    srvDesc._texture2D._resourceMinLODClamp = 0.f;
+    pRenderer->createShaderResourceView(&shadowAtlasSRV, shadowAtlasResource, srvDesc);
+
+    shadowAtlas.initialize(kShadowAtlasSize, kShadowAtlasMinTileSize);
+    pointLightShadows.clear();
+    directionLightShadows.clear();
+    spotLightShadows.clear();
+    activeLocalShadows.clear();
+    shadowStats = { };
+    shadowStats._atlasTexels = static_cast<U64>(kShadowAtlasSize) * kShadowAtlasSize;
+    shadowFrame = 0;
+
+    createShadowRootSignature(pPipelineCache);
+    createShadowMapPipeline(pPipelineCache);
 }
 
 
-void registerShadow(gfx::BackendRenderer* pRenderer, LightShadow* shadow)
+void cleanUpShadowRenderer(gfx::BackendRenderer* pRenderer)
 {
-    gfx::DepthStencilViewDesc desc;
-    gfx::DepthStencilView* dsv = nullptr;
-    desc._texture2D._mipSlice = 0;
-    U32 index = 0;
+    pointLightShadows.clear();
+    directionLightShadows.clear();
+    spotLightShadows.clear();
+    activeLocalShadows.clear();
+    pRenderer->destroyRenderPass(shadowAtlasRenderPass);
+    pRenderer->destroyResource(shadowAtlasResource);
+    shadowAtlasRenderPass = nullptr;
+    shadowAtlasResource = nullptr;
+}
 
-    switch (shadow->getShadowType()) {
-        case LightShadow::SHADOW_TYPE_DIRECTIONAL:
-            {
-                directionLightShadows.push_back(shadow);
-                index = static_cast<U32>(directionLightShadows.size() - 1ull);
-                desc._format = DXGI_FORMAT_D32_FLOAT;
-                desc._dimension = gfx::DSV_DIMENSION_TEXTURE_2D;
-                desc._texture2D._mipSlice = index; // MipSlice + ( ArraySlice * MipLevels )
-                //desc._flags = gfx::DEPTH_STENCIL_FLAG_ONLY_DEPTH;
-                pRenderer->createDepthStencilView(&dsv, directionLightShadowMapAtlasResource, desc);
-                directionLightDSVs.push_back(dsv);
-                gfx::RenderPass* rp = nullptr;
-                pRenderer->createRenderPass(&rp, 0, true);
-                rp->setDepthStencil(dsv);
-                directionLightRenderPasses.push_back(rp);
-            } break;
-        case LightShadow::SHADOW_TYPE_OMNIDIRECTIONAL:
-            {
-                pointLightShadows.push_back(shadow);
-                index = static_cast<U32>(pointLightShadows.size() - 1ull);
-                desc._texture2D._mipSlice = index;
-                //desc._flags = gfx::DEPTH_STENCIL_FLAG_ONLY_DEPTH;
-                desc._dimension = gfx::DSV_DIMENSION_TEXTURE_2D_ARRAY;
-                pRenderer->createDepthStencilView(&dsv, pointLightShadowMapAtlasResource, desc);
-                pointLightDSVs.push_back(dsv);
-                gfx::RenderPass* rp = nullptr;
-                pRenderer->createRenderPass(&rp, 0, true);
-                rp->setDepthStencil(dsv);
-            } break;
-        case LightShadow::SHADOW_TYPE_SPOT:
+
+static std::vector<LightShadow*>* getShadowList(LightShadow::ShadowType type)
+{
+    switch (type) {
+        case LightShadow::SHADOW_TYPE_DIRECTIONAL: return &directionLightShadows;
+        case LightShadow::SHADOW_TYPE_OMNIDIRECTIONAL: return &pointLightShadows;
+        case LightShadow::SHADOW_TYPE_SPOT: return &spotLightShadows;
+        default: return nullptr;
+    }
+}
+
+
+B32 registerShadow(gfx::BackendRenderer* pRenderer, LightShadow* shadow)
+{
+    std::vector<LightShadow*>* pShadows = getShadowList(shadow->getShadowType());
+    if (!pShadows) return false;
+    // Cascades are rendered every frame anyway, they keep their tiles for good.
+    if (shadow->getShadowType() == LightShadow::SHADOW_TYPE_DIRECTIONAL 
+        && !allocateShadowTiles(shadow, shadow->getMapSize())) {
+        DEBUG("Shadow atlas has no room left for the cascades of this shadow.");
+        return false;
+    }
+    setLightShadowIndex(shadow, static_cast<U32>(pShadows->size()));
+    pShadows->push_back(shadow);
+    return true;
+}
+
+
+void unregisterShadow(LightShadow* shadow)
+{
+    std::vector<LightShadow*>* pShadows = shadow ? getShadowList(shadow->getShadowType()) : nullptr;
+    if (!pShadows || !isShadowRegistered(shadow, *pShadows)) return;
+    freeShadowTiles(shadow);
+    U32 idx = shadow->getShadowIndex();
+    (*pShadows)[idx] = pShadows->back();
+    setLightShadowIndex((*pShadows)[idx], idx);
+    pShadows->pop_back();
+    activeLocalShadows.erase(std::remove(activeLocalShadows.begin(), activeLocalShadows.end(), shadow), 
+                             activeLocalShadows.end());
+}
+
+
+gfx::Resource* getShadowAtlas()
+{
+    return shadowAtlasResource;
+}
+
+
+gfx::ShaderResourceView* getShadowAtlasSRV()
+{
+    return shadowAtlasSRV;
+}
+
+
+const ShadowStats& getShadowStats()
+{
+    return shadowStats;
+}
+
+
+U32 getShadowResolutionSize(ShadowResolution resolution)
+{
+    return 512u << resolution;
+}
+
+
+void LightShadow::initialize(ShadowType type, ShadowResolution resolution, U32 cascadeCount)
+{
+    m_type = type;
+    m_shadowResolution = resolution;
+    m_mapSize = getShadowResolutionSize(resolution);
+    switch (type) {
+        case SHADOW_TYPE_DIRECTIONAL:
             {
-                spotLightShadows.push_back(shadow);
-                index = static_cast<U32>(spotLightShadows.size() - 1ull);
-                desc._texture2D._mipSlice = index;
-                //desc._flags = gfx::DEPTH_STENCIL_FLAG_ONLY_DEPTH;
-                desc._dimension = gfx::DSV_DIMENSION_TEXTURE_2D;
-                pRenderer->createDepthStencilView(&dsv, spotLightShadowMapAtlasResource, desc);
-                spotLightDSVs.push_back(dsv);
-                gfx::RenderPass* rp = nullptr;
-                pRenderer->createRenderPass(&rp, 0, true);
-                rp->setDepthStencil(dsv);
+                m_viewCount = cascadeCount < 1 ? 1 : cascadeCount;
+                m_viewCount = m_viewCount > kMaxShadowCascades ? kMaxShadowCascades : m_viewCount;
             } break;
-        default: break;
+        case SHADOW_TYPE_OMNIDIRECTIONAL: m_viewCount = kShadowCubeFaces; break;
+        default: m_viewCount = 1; break;
     }
-    
-    setLightShadowIndex(shadow, index);
+    m_shadowDistance = kDefaultShadowDistance;
+    m_splitLambda = kDefaultSplitLambda;
+    m_shadowIdx = 0xffffffffu;
+    m_lightTransformIdx = 0;
+    m_tileSize = 0;
+    m_lightPosition = Vector3();
+    m_lightDirection = Vector3();
+    // No light yet, the first update makes the views.
+    m_lightRange = -1.0f;
+    m_lightAngle = 0.0f;
+    m_lastUsedFrame = 0;
+    for (U32 i = 0; i < kMaxShadowViews; ++i) {
+        m_views[i] = { };
+        m_views[i]._tile = ShadowAtlas::kInvalidTile;
+    }
+}
+
+
+void LightShadow::setCascadeSplits(R32 shadowDistance, R32 splitLambda)
+{
+    m_shadowDistance = shadowDistance;
+    m_splitLambda = splitLambda < 0.0f ? 0.0f : (splitLambda > 1.0f ? 1.0f : splitLambda);
 }
 
 
-void LightShadow::update(Lights::Light* light, Lights::LightTransform* pTransform)
+void LightShadow::update(const Lights::Light* light, Lights::LightTransform* pTransforms, const Globals& camera)
 {       
-    if (!light || !pTransform) return;
-    Matrix44 mProjection;
-    Matrix44 mView;
+    if (!light || !pTransforms) return;
     switch (m_type) {
         case SHADOW_TYPE_DIRECTIONAL:
             {
-                Lights::DirectionLight* dirLight = static_cast<Lights::DirectionLight*>(light);
-                
-                mProjection = Matrix44::orthographicRH(40.f, 40.f, 0.1, 100.0f);
-                mView = Matrix44::lookAtRH(dirLight->_position + Vector3(10.f, -10.f, 10.f), 
-                                           dirLight->_direction, 
-                                           Vector3(0.0f, 1.f, 0.0f));
+                updateCascades(*static_cast<const Lights::DirectionLight*>(light), camera);
+            } break;
+        default: 
+            {
+                updateLocalViews(*light);
             } break;
     }
 
-    m_viewToClip = mView * mProjection; 
-    
-    pTransform->_viewToClip = m_viewToClip;
-    pTransform->_clipToView = m_viewToClip.inverse();
+    // Tiles as a scale and offset of uvs in the atlas, zero for views without one.
+    R32 atlasScale = 1.0f / static_cast<R32>(kShadowAtlasSize);
+    for (U32 v = 0; v < m_viewCount; ++v) {
+        const ShadowView& view = m_views[v];
+        pTransforms[v]._viewToClip = view._viewToClip;
+        pTransforms[v]._clipToView = view._viewToClip.inverse();
+        pTransforms[v]._atlasRect = Vector4(view._rect._size * atlasScale, view._rect._size * atlasScale,
+                                            view._rect._x * atlasScale, view._rect._y * atlasScale);
+    }
     m_lightTransformIdx = light->_transform;
-    m_dirty = true;
+}
+
+
+B32 LightShadow::needsUpdate() const
+{
+    for (U32 v = 0; v < m_viewCount; ++v) {
+        if (m_views[v]._tile != ShadowAtlas::kInvalidTile && m_views[v]._dirty) return true;
+    }
+    return false;
+}
+
+
+// Practical split scheme: lambda blends logarithmic splits, which keep texels per pixel even
+// through the view, with uniform ones, which keep the first cascades from being too small to use.
+static R32 computeSplitDepth(R32 zNear, R32 zFar, U32 split, U32 splitCount, R32 lambda)
+{
+    R32 t = static_cast<R32>(split) / static_cast<R32>(splitCount);
+    R32 logSplit = zNear * powf(zFar / zNear, t);
+    R32 uniformSplit = zNear + (zFar - zNear) * t;
+    return lambda * logSplit + (1.0f - lambda) * uniformSplit;
+}
+
+
+// Casters are culled against the frustum without its near plane, index 5 with depth reversed.
+static void extractShadowViewPlanes(ShadowView& view)
+{
+    extractFrustumPlanes(view._viewToClip, view._planes);
+    for (U32 i = 0; i < 5; ++i) {
+        view._casterPlanes[i] = view._planes[i];
+    }
+}
+
+
+void LightShadow::updateCascades(const Lights::DirectionLight& light, const Globals& camera)
+{
+    R32 zNear = camera._near > 0.0f ? camera._near : 1e-4f;
+    R32 zFar = camera._far < m_shadowDistance ? camera._far : m_shadowDistance;
+    zFar = zFar > zNear ? zFar : zNear * 2.0f;
+    // Squared distance off the view axis of the frustum's corners, at depth 1.
+    R32 tanX = 1.0f / camera._proj._[0][0];
+    R32 tanY = 1.0f / camera._proj._[1][1];
+    R32 cornerSq = tanX * tanX + tanY * tanY;
+
+    Vector3 direction = light._direction.normalize();
+    // The light's view must not turn with the camera, or snapping to texels can't hold still.
+    Vector3 up = fabsf(direction._y) > 0.99f ? Vector3(1.0f, 0.0f, 0.0f) : Vector3(0.0f, 1.0f, 0.0f);
+    // Axes of the shadow map, as lookAtRH() makes them.
+    Vector3 axisX = up.cross(-direction).normalize();
+    Vector3 axisY = (-direction).cross(axisX);
+
+    R32 splitNear = zNear;
+    for (U32 c = 0; c < m_viewCount; ++c) {
+        ShadowView& cascade = m_views[c];
+        R32 splitFar = computeSplitDepth(zNear, zFar, c + 1, m_viewCount, m_splitLambda);
+        // Smallest sphere through the corners at both depths, centered on the view axis. Wide
+        // views reach their far corners first, then it is centered on the far plane.
+        R32 centerDepth = 0.5f * (splitNear + splitFar) * (1.0f + cornerSq);
+        centerDepth = centerDepth < splitFar ? centerDepth : splitFar;
+        R32 farOffset = splitFar - centerDepth;
+        R32 radius = sqrtf(splitFar * splitFar * cornerSq + farOffset * farOffset);
+        // Rounded up, so float noise doesn't resize the cascade, and its texels, from frame to frame.
+        radius = ceilf(radius * 16.0f) / 16.0f;
+        // A texel of margin around the sphere, as snapping moves it by up to half of one.
+        R32 texelSize = 2.0f * radius / static_cast<R32>(m_mapSize - 2);
+        R32 extent = texelSize * static_cast<R32>(m_mapSize);
+
+        // Snap the center to whole texels across the light, so as the camera moves, the cascade
+        // moves by whole texels, and everything in it lands on the same texels it did before.
+        Vector4 viewCenter = Vector4(0.0f, 0.0f, -centerDepth, 1.0f) * camera._viewToWorld;
+        Vector3 center(viewCenter._x, viewCenter._y, viewCenter._z);
+        R32 x = center.dot(axisX);
+        R32 y = center.dot(axisY);
+        center = center + axisX * (floorf(x / texelSize + 0.5f) * texelSize - x) 
+                        + axisY * (floorf(y / texelSize + 0.5f) * texelSize - y);
+        cascade._center = center;
+        cascade._radius = radius;
+        cascade._splitNear = splitNear;
+        cascade._splitFar = splitFar;
+        cascade._texelSize = texelSize;
+
+        // Looking down the light from the edge of the sphere, depth reversed. Casters in front of
+        // the near plane are clamped to it, as the shadow pipeline doesn't clip depth.
+        Matrix44 view = Matrix44::lookAtRH(center - direction * radius, center, up);
+        cascade._viewToClip = view * Matrix44::orthographicRH(extent, extent, 2.0f * radius, 0.0f);
+        extractShadowViewPlanes(cascade);
+        splitNear = splitFar;
+    }
+}
+
+
+void LightShadow::updateLocalViews(const Lights::Light& light)
+{
+    Vector3 direction;
+    R32 range = 0.0f;
+    R32 angle = 0.0f;
+    if (m_type == SHADOW_TYPE_SPOT) {
+        const Lights::SpotLight& spot = static_cast<const Lights::SpotLight&>(light);
+        direction = spot._direction;
+        range = spot._range;
+        angle = spot._outer;
+    } else {
+        range = static_cast<const Lights::PointLight&>(light)._radius;
+    }
+    range = range > 1e-3f ? range : 1e-3f;
+    // Views, and what was rendered of them, hold until the light moves.
+    if (range == m_lightRange && angle == m_lightAngle 
+        && light._position == m_lightPosition && direction == m_lightDirection) {
+        return;
+    }
+    m_lightPosition = light._position;
+    m_lightDirection = direction;
+    m_lightRange = range;
+    m_lightAngle = angle;
+
+    R32 zNear = range * kLocalShadowNearRatio;
+    if (m_type == SHADOW_TYPE_SPOT) {
+        R32 fov = 2.0f * angle;
+        fov = fov < kMaxSpotShadowAngle ? fov : kMaxSpotShadowAngle;
+        Vector3 up = fabsf(direction._y) > 0.99f ? Vector3(1.0f, 0.0f, 0.0f) : Vector3(0.0f, 1.0f, 0.0f);
+        Matrix44 view = Matrix44::lookAtRH(light._position, light._position + direction, up);
+        m_views[0]._viewToClip = view * Matrix44::perspectiveRH(fov, 1.0f, zNear, range);
+    } else {
+        // Faces in the order the lighting picks them by the major axis.
+        static const Vector3 kFaceDirections[kShadowCubeFaces] = {
+            Vector3(1.0f, 0.0f, 0.0f), Vector3(-1.0f, 0.0f, 0.0f),
+            Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, -1.0f, 0.0f),
+            Vector3(0.0f, 0.0f, 1.0f), Vector3(0.0f, 0.0f, -1.0f)
+        };
+        static const Vector3 kFaceUps[kShadowCubeFaces] = {
+            Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f),
+            Vector3(0.0f, 0.0f, -1.0f), Vector3(0.0f, 0.0f, 1.0f),
+            Vector3(0.0f, 1.0f, 0.0f), Vector3(0.0f, 1.0f, 0.0f)
+        };
+        Matrix44 proj = Matrix44::perspectiveRH(0.5f * 3.14159265f, 1.0f, zNear, range);
+        for (U32 f = 0; f < kShadowCubeFaces; ++f) {
+            Matrix44 view = Matrix44::lookAtRH(light._position, light._position + kFaceDirections[f], kFaceUps[f]);
+            m_views[f]._viewToClip = view * proj;
+        }
+    }
+    for (U32 v = 0; v < m_viewCount; ++v) {
+        extractShadowViewPlanes(m_views[v]);
+        m_views[v]._dirty = true;
+    }
+}
+
+
+B32 LightShadow::intersects(const Bounds3D& bounds, U32 view) const
+{
+    Vector3 center = bounds.getCenter();
+    Vector3 extent = bounds.getExtent() * 0.5f;
+    for (U32 i = 0; i < 5; ++i) {
+        const Plane& plane = m_views[view]._casterPlanes[i];
+        R32 radius = fabsf(plane._a) * extent._x + fabsf(plane._b) * extent._y + fabsf(plane._c) * extent._z;
+        if (plane.distance(center) + radius < 0.0f)
+            return false;
+    }
+    return true;
 }
 } // Shadows
-} // jcl
\ No newline at end of file
+} // jcl
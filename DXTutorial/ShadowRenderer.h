@@ -1,19 +1,24 @@
 #pragma once
 
 
-#include "WinConfigs.h"
+#include "PlatformConfigs.h"
 #include "BackendRenderer.h"
 #include "Math/Bounds3D.h"
 #include "GraphicsResources.h"
 #include "GlobalDef.h"
 #include "Math/Plane.h"
+#include "Culling.h"
+#include "ShadowAtlas.h"
 
 namespace jcl {
 
+class PipelineCache;
+
 namespace Lights {
 struct Light;
+struct DirectionLight;
 struct LightTransform;
-struct LightSystem;
+class LightSystem;
 }
 
 namespace Shadows {
@@ -30,8 +35,57 @@ enum ShadowResolution
 };
 
 
+// Most cascades a direction shadow splits the camera view into.
+static const U32 kMaxShadowCascades = 4;
+// Faces of a point shadow, +x, -x, +y, -y, +z then -z.
+static const U32 kShadowCubeFaces = 6;
+// Most views of one shadow, each rendered into a tile of the shadow atlas.
+static const U32 kMaxShadowViews = kShadowCubeFaces;
+
+
+// Size in texels of a side of a shadow map of the given resolution.
+U32 getShadowResolutionSize(ShadowResolution resolution);
+
+
+// One view of a shadow, rendered into its own tile of the shadow atlas: a cascade of a direction
+// shadow, a face of a point shadow, or the cone of a spot shadow. Depth is reversed, 1 nearest the light.
+struct ShadowView
+{
+    // World to shadow clip.
+    Matrix44 _viewToClip;
+    // Planes of the view's frustum, normals facing inwards, in extractFrustumPlanes() order.
+    Plane _planes[6];
+    // Planes casters are culled against, the frustum without its near plane, since anything
+    // between the light and the view still casts into it.
+    Plane _casterPlanes[5];
+    // Tile of the atlas, ShadowAtlas::kInvalidTile if the view found no room.
+    ShadowAtlas::Tile _tile;
+    ShadowAtlasRect _rect;
+    // Tile needs rendering again, its light or casters moved, or it is new.
+    B32 _dirty;
+    // Cascades only, world units a texel of the tile covers, the camera depths covered, and the
+    // bounding sphere of the camera view between them, in world space.
+    R32 _texelSize;
+    R32 _splitNear;
+    R32 _splitFar;
+    Vector3 _center;
+    R32 _radius;
+};
+
+
 // Light Shadow is the object that holds the info to the shadow atlas, along with other 
 // info regarding the shadow to be drawn.
+//
+// Direction shadows split the camera view in depth into cascades, each fitted to the bounding
+// sphere of its part of the view, rendered to a tile of the atlas of its own, and given a
+// transform of its own, following the light's. Splits blend logarithmic and uniform spacing.
+// The sphere keeps the cascade the same size however the camera turns, and the projection is
+// moved to whole texels, so shadow edges don't shimmer as the camera moves. Cascades are
+// rendered every frame.
+//
+// Point and spot shadows render a tile per face, or one for the cone, sized by how large the
+// light is on screen. Tiles are kept from frame to frame, and only rendered again when the
+// light or a caster in their view moved.
 class LightShadow
 {
 public:
@@ -42,27 +96,54 @@ public:
         SHADOW_TYPE_SPOT
     };
 
-    // Initialize this shadow in order to use it!
-    void initialize(ShadowType type, ShadowResolution resolution) {
-        m_type = type;
-        m_shadowResolution = resolution;
-    }
+    // Distance from the camera direction shadows reach by default.
+    static const R32 kDefaultShadowDistance;
+    // Blend of logarithmic splits to uniform splits by default, 1 being only logarithmic.
+    static const R32 kDefaultSplitLambda;
+
+    // Initialize this shadow in order to use it! Direction shadows render each cascade at the
+    // resolution, at most kMaxShadowCascades of them. Point and spot shadows take the resolution
+    // as the most their tiles may have.
+    void initialize(ShadowType type, ShadowResolution resolution, U32 cascadeCount = 1);
+    // Distance from the camera cascades cover, and how logarithmic their splits are.
+    void setCascadeSplits(R32 shadowDistance, R32 splitLambda);
 
-    // Update with the given light info.
-    void update(Lights::Light* pLight, Lights::LightTransform* pTransform);
+    // Update with the given light info, writing view v, and where its tile is, to pTransforms[v],
+    // from the light's transform index on. Direction shadows fit their cascades to the view of
+    // the camera, its _viewToWorld, _proj, _near and _far, with projection a perspectiveRH().
+    // Point and spot shadows keep their views unless the light moved.
+    void update(const Lights::Light* pLight, Lights::LightTransform* pTransforms, const Globals& camera);
 
     ShadowType getShadowType() const { return m_type; }
-    // 6 Planes corresponding to each side of the view frustum.
-    const Plane* getViewFrustumPlanes() const { return m_planes; }
+    // 6 Planes corresponding to each side of the view's frustum.
+    const Plane* getViewFrustumPlanes(U32 view = 0) const { return m_views[view]._planes; }
+    // Index of the shadow among those registered of its type.
     U32 getShadowIndex() const { return m_shadowIdx; }
     U32 getLightTransformIndex() const { return m_lightTransformIdx; }
-    Matrix44 getViewToClip() const { return m_viewToClip; }
+    Matrix44 getViewToClip(U32 view = 0) const { return m_views[view]._viewToClip; }
+    // Cascades of a direction shadow, faces of a point shadow, 1 for a spot shadow.
+    U32 getViewCount() const { return m_viewCount; }
+    const ShadowView& getView(U32 view) const { return m_views[view]; }
+    U32 getCascadeCount() const { return m_type == SHADOW_TYPE_DIRECTIONAL ? m_viewCount : 0; }
+    // Texels of a side of a view's tile, the cascade size, or the most tiles of a local shadow have.
+    U32 getMapSize() const { return m_mapSize; }
+    // Texels of a side of the tiles the shadow has now, 0 if it has none.
+    U32 getTileSize() const { return m_tileSize; }
 
-    B32 needsUpdate() const { return m_dirty; }
+    // Last updateShadows() the shadow's light was visible in.
+    U32 getLastUsedFrame() const { return m_lastUsedFrame; }
 
-    B32 intersects(const Bounds3D& bounds);
+    // True if any of the views needs rendering.
+    B32 needsUpdate() const;
+
+    // Test world space bounds against the casters of a view.
+    B32 intersects(const Bounds3D& bounds, U32 view = 0) const;
 
 private:
+    void updateCascades(const Lights::DirectionLight& light, const Globals& camera);
+    // Views of a point or spot light, if it moved since the last update.
+    void updateLocalViews(const Lights::Light& light);
+
     // Index of the shadow in a given shadow map, depending on if it is within an array.
     U32 m_shadowIdx;
     // Light transform index.
@@ -71,25 +152,64 @@ private:
     ShadowType m_type;
     // Shadow resolution.
     ShadowResolution m_shadowResolution;
-    // View Frustum Planes.
-    Plane m_planes[6];
-    // View to Clip matrix.
-    Matrix44 m_viewToClip;
-
-    // Dirty flag.
-    B32 m_dirty;
+    U32 m_mapSize;
+    U32 m_tileSize;
+    U32 m_viewCount;
+    ShadowView m_views[kMaxShadowViews];
+    // Cascade splits.
+    R32 m_shadowDistance;
+    R32 m_splitLambda;
+    // Light as the views were last made for, position, unit direction, reach and cone half angle.
+    Vector3 m_lightPosition;
+    Vector3 m_lightDirection;
+    R32 m_lightRange;
+    R32 m_lightAngle;
+    // Frame the shadow's light was last visible, the least recent are evicted first.
+    U32 m_lastUsedFrame;
 
     friend void setLightShadowIndex(LightShadow* lightShadow, U32 idx);
     friend void signalClean(LightShadow* lightShadow);
+    friend B32 allocateShadowTiles(LightShadow* lightShadow, U32 tileSize);
+    friend void freeShadowTiles(LightShadow* lightShadow);
+    friend void markShadowViewsMoved(LightShadow* lightShadow, const MeshCuller* pCuller);
+    friend void updateShadows(const Globals& camera, Lights::LightSystem* pLightSystem);
 };
 
-void initializeShadowRenderer(gfx::BackendRenderer* pRenderer);
+
+struct ShadowStats
+{
+    // Shadows of the visible lights, and those left without tiles for lack of room.
+    U32 _shadows;
+    U32 _unshadowed;
+    // Views rendered last frame, and views kept from an earlier one.
+    U32 _renderedViews;
+    U32 _cachedViews;
+    // Tiles evicted last frame to make room, least recently used first.
+    U32 _evictedTiles;
+    // Caster draws recorded last frame.
+    U32 _casterDraws;
+    // Atlas texels in tiles, and in the whole atlas.
+    U64 _usedTexels;
+    U64 _atlasTexels;
+};
+
+
+void initializeShadowRenderer(gfx::BackendRenderer* pRenderer, PipelineCache* pPipelineCache);
 void cleanUpShadowRenderer(gfx::BackendRenderer* pRenderer);
-// Register the shadow to it's gpu resources.
-void registerShadow(gfx::BackendRenderer* pRenderer, LightShadow* shadow);
-// Unregister the shadow from the gpu.
+// Register the shadow to it's gpu resources. Direction shadows take their cascade tiles of the
+// atlas for good, returns false if there is no room for them. Point and spot shadows take tiles
+// while their light is visible.
+B32 registerShadow(gfx::BackendRenderer* pRenderer, LightShadow* shadow);
+// Unregister the shadow from the gpu, giving back its tiles.
 void unregisterShadow(LightShadow* shadow);
 
+// Update the shadows of the direction lights, and of the point and spot lights visible in the
+// last LightSystem::cull(), writing their transforms. Point and spot shadows get tiles sized by
+// how much of the screen their light covers, larger ones first, and keep them while they fit.
+// When the atlas is full, tiles of the shadows whose light was visible least recently are
+// evicted, then visible shadows settle for smaller tiles, or none.
+void updateShadows(const Globals& camera, Lights::LightSystem* pLightSystem);
+
 void generateShadowCommands
     (
         // list to record our commands to. 
@@ -104,8 +224,15 @@ void generateShadowCommands
         U32 submeshCount,
         // Global
         gfx::Resource* pGlobal,
+        // Frame constant buffer, holding each mesh's descriptor at its _meshDescriptorOffset.
+        gfx::Resource* pConstants,
         // Light Transforms
-        Lights::LightSystem* pLightSystem
+        Lights::LightSystem* pLightSystem,
+        // Culler prepared with the same meshes, each shadow only draws what its frustum sees.
+        // Null draws every mesh.
+        const MeshCuller* pCuller = nullptr,
+        // Visible and culled counts, summed over all shadows rendered.
+        CullStats* pStats = nullptr
     );
 // Generate the shadow resolve. This is to be used for one direction light only!
 // 
@@ -113,6 +240,9 @@ void generateShadowResolveCommand(gfx::CommandList* pList);
 
 // Retrieve the shadow atlas used by the lighting stage.
 gfx::Resource* getShadowAtlas();
+gfx::ShaderResourceView* getShadowAtlasSRV();
+// Counts of the last updateShadows() and generateShadowCommands().
+const ShadowStats& getShadowStats();
 gfx::RenderTargetView* getShadowResolve();
 } // Shadows
 } // jcl
\ No newline at end of file
@@ -1,6 +1,6 @@
 #pragma once
 
-#include "WinConfigs.h"
+#include "PlatformConfigs.h"
 #include "BackendRenderer.h"
 #include "FrontEndRenderer.h"
 
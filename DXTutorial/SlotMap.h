@@ -0,0 +1,111 @@
+//
+#pragma once
+
+#include "PlatformConfigs.h"
+
+#include <vector>
+
+namespace jcl {
+
+
+/*
+    Slot Map stores values in one dense array of slots, addressed by generational handles.
+    A handle packs the slot index in its low 32 bits, and the slot's generation in the high
+    32 bits. Erasing a value bumps the slot's generation and puts it on a free list, so stale
+    handles to a reused slot are caught on lookup instead of aliasing the new value.
+    Generations start at 1, so a handle of 0 is never valid and can be used as null.
+*/
+template<typename T>
+class SlotMap
+{
+public:
+    typedef U64 Handle;
+
+    static const Handle kInvalidHandle = 0ull;
+
+    SlotMap() : m_freeHead(kEndOfList), m_count(0) { }
+
+    static U32 getIndex(Handle handle) { return static_cast<U32>(handle & 0xffffffffull); }
+    static U32 getGeneration(Handle handle) { return static_cast<U32>(handle >> 32ull); }
+
+    void reserve(U32 count) { m_slots.reserve(count); }
+
+    Handle insert(const T& value) {
+        U32 index;
+        if (m_freeHead != kEndOfList) {
+            index = m_freeHead;
+            m_freeHead = m_slots[index]._nextFree;
+        } else {
+            index = static_cast<U32>(m_slots.size());
+            m_slots.push_back(Slot());
+        }
+        Slot& slot = m_slots[index];
+        slot._value = value;
+        slot._nextFree = kOccupied;
+        ++m_count;
+        return makeHandle(index, slot._generation);
+    }
+
+    // Returns the value for the handle, or null if the handle is stale or invalid.
+    T* find(Handle handle) {
+        U32 index = getIndex(handle);
+        if (index >= m_slots.size()) return nullptr;
+        Slot& slot = m_slots[index];
+        if (slot._generation != getGeneration(handle) || slot._nextFree != kOccupied) return nullptr;
+        return &slot._value;
+    }
+
+    const T* find(Handle handle) const {
+        return const_cast<SlotMap*>(this)->find(handle);
+    }
+
+    B32 contains(Handle handle) const { return find(handle) != nullptr; }
+
+    // Frees the slot, every handle to it goes stale. Returns false if the handle was already stale.
+    B32 erase(Handle handle) {
+        if (!find(handle)) return false;
+        U32 index = getIndex(handle);
+        Slot& slot = m_slots[index];
+        slot._value = T();
+        // Skip 0 on wrap around, so no live handle can ever equal kInvalidHandle.
+        slot._generation = (slot._generation == 0xffffffffu) ? 1u : slot._generation + 1u;
+        slot._nextFree = m_freeHead;
+        m_freeHead = index;
+        --m_count;
+        return true;
+    }
+
+    void clear() {
+        for (U32 i = 0; i < m_slots.size(); ++i) {
+            if (m_slots[i]._nextFree == kOccupied) {
+                erase(makeHandle(i, m_slots[i]._generation));
+            }
+        }
+    }
+
+    U32 size() const { return m_count; }
+    U32 capacity() const { return static_cast<U32>(m_slots.size()); }
+
+private:
+    static const U32 kEndOfList = 0xffffffffu;
+    static const U32 kOccupied = 0xfffffffeu;
+
+    struct Slot
+    {
+        Slot() : _value(), _generation(1u), _nextFree(kEndOfList) { }
+
+        T _value;
+        U32 _generation;
+        // Next free slot, or kOccupied while the slot holds a value.
+        U32 _nextFree;
+    };
+
+    static Handle makeHandle(U32 index, U32 generation) {
+        return (static_cast<Handle>(generation) << 32ull) | static_cast<Handle>(index);
+    }
+
+    std::vector<Slot> m_slots;
+    U32 m_freeHead;
+    U32 m_count;
+};
+} // jcl
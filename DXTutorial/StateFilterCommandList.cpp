@@ -0,0 +1,413 @@
+//
+#include "StateFilterCommandList.h"
+
+#include <string.h>
+
+namespace gfx {
+
+
+// Count of viewports, scissors or tables that were never set, or too many to keep. Matches no call.
+static const U32 kUnknownCount = 0xffffffff;
+// Bound object that was never set, matches no call, null included.
+static const U8 kUnknownObjectTag = 0;
+static const void* const kUnknownObject = &kUnknownObjectTag;
+
+
+U32 StateFilterStats::getForwardedCount() const
+{
+    U32 total = 0;
+    for (U32 i = 0; i < STATE_CALL_COUNT; ++i) total += _forwarded[i];
+    return total;
+}
+
+
+U32 StateFilterStats::getFilteredCount() const
+{
+    U32 total = 0;
+    for (U32 i = 0; i < STATE_CALL_COUNT; ++i) total += _filtered[i];
+    return total;
+}
+
+
+void StateFilterStats::add(const StateFilterStats& other)
+{
+    for (U32 i = 0; i < STATE_CALL_COUNT; ++i) {
+        _forwarded[i] += other._forwarded[i];
+        _filtered[i] += other._filtered[i];
+    }
+}
+
+
+StateFilterCommandList::StateFilterCommandList(CommandList* pList)
+    : m_pList(pList)
+{
+    _isRecording = false;
+    m_stats = { };
+    invalidate();
+}
+
+
+void StateFilterCommandList::setList(CommandList* pList)
+{
+    m_pList = pList;
+    _isRecording = false;
+    invalidate();
+}
+
+
+void StateFilterCommandList::invalidate()
+{
+    m_pPipeline = kUnknownObject;
+    m_pGraphicsRootSignature = kUnknownObject;
+    m_pComputeRootSignature = kUnknownObject;
+    clearRootParameters(m_graphicsRootParameters);
+    clearRootParameters(m_computeRootParameters);
+    for (U32 i = 0; i < kMaxVertexBuffers; ++i) m_pVertexBuffers[i] = kUnknownObject;
+    m_pIndexBuffer = kUnknownObject;
+    m_viewportCount = kUnknownCount;
+    m_scissorCount = kUnknownCount;
+    m_descriptorTableCount = kUnknownCount;
+}
+
+
+void StateFilterCommandList::clearRootParameters(RootParameter* pParameters)
+{
+    for (U32 i = 0; i < kMaxRootParameters; ++i) {
+        pParameters[i]._type = ROOT_PARAMETER_TYPE_NONE;
+        pParameters[i]._pObject = nullptr;
+        pParameters[i]._offset = 0ull;
+    }
+}
+
+
+void StateFilterCommandList::clearRootDescriptorTables(RootParameter* pParameters)
+{
+    for (U32 i = 0; i < kMaxRootParameters; ++i) {
+        if (pParameters[i]._type == ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE) {
+            pParameters[i]._type = ROOT_PARAMETER_TYPE_NONE;
+            pParameters[i]._pObject = nullptr;
+        }
+    }
+}
+
+
+B32 StateFilterCommandList::count(StateCall call, B32 changed)
+{
+    if (changed) m_stats._forwarded[call] += 1;
+    else m_stats._filtered[call] += 1;
+    return changed;
+}
+
+
+B32 StateFilterCommandList::bind(StateCall call, const void*& bound, const void* pObject)
+{
+    B32 changed = bound != pObject;
+    bound = pObject;
+    return count(call, changed);
+}
+
+
+B32 StateFilterCommandList::bindRootParameter
+    (
+        RootParameter* pParameters,
+        U32 index,
+        RootParameterType type,
+        const void* pObject,
+        U64 offset
+    )
+{
+    // Parameters past the ones tracked always go through.
+    if (index >= kMaxRootParameters) return count(STATE_CALL_ROOT_PARAMETER, true);
+    RootParameter& parameter = pParameters[index];
+    B32 changed = parameter._type != type || parameter._pObject != pObject || parameter._offset != offset;
+    parameter._type = type;
+    parameter._pObject = pObject;
+    parameter._offset = offset;
+    return count(STATE_CALL_ROOT_PARAMETER, changed);
+}
+
+
+void StateFilterCommandList::reset(const char* debugTag)
+{
+    m_stats = { };
+    invalidate();
+    m_pList->reset(debugTag);
+    _isRecording = true;
+}
+
+
+void StateFilterCommandList::close()
+{
+    m_pList->close();
+    _isRecording = false;
+}
+
+
+void StateFilterCommandList::drawIndexedInstanced
+    (
+        U32 indexCountPerInstance,
+        U32 instanceCount,
+        U32 startIndexLocation,
+        U32 baseVertexLocation,
+        U32 startInstanceLocation
+    )
+{
+    m_pList->drawIndexedInstanced(indexCountPerInstance,
+                                  instanceCount,
+                                  startIndexLocation,
+                                  baseVertexLocation,
+                                  startInstanceLocation);
+}
+
+
+void StateFilterCommandList::drawInstanced
+    (
+        U32 vertexCountPerInstance,
+        U32 instanceCount,
+        U32 startVertexLocation,
+        U32 startInstanceLocation
+    )
+{
+    m_pList->drawInstanced(vertexCountPerInstance, instanceCount, startVertexLocation, startInstanceLocation);
+}
+
+
+void StateFilterCommandList::setGraphicsPipeline(GraphicsPipeline* pPipeline)
+{
+    if (bind(STATE_CALL_PIPELINE, m_pPipeline, pPipeline)) m_pList->setGraphicsPipeline(pPipeline);
+}
+
+
+void StateFilterCommandList::setComputePipeline(ComputePipeline* pPipeline)
+{
+    if (bind(STATE_CALL_PIPELINE, m_pPipeline, pPipeline)) m_pList->setComputePipeline(pPipeline);
+}
+
+
+void StateFilterCommandList::setRayTracingPipeline(RayTracingPipeline* pPipeline)
+{
+    if (bind(STATE_CALL_PIPELINE, m_pPipeline, pPipeline)) m_pList->setRayTracingPipeline(pPipeline);
+}
+
+
+void StateFilterCommandList::setAccelerationStructure(Resource* pAccelerationStructure)
+{
+    m_pList->setAccelerationStructure(pAccelerationStructure);
+}
+
+
+void StateFilterCommandList::setRenderPass(RenderPass* pass)
+{
+    // Render passes transition their targets, they always go through.
+    m_pList->setRenderPass(pass);
+}
+
+
+void StateFilterCommandList::dispatch(U32 x, U32 y, U32 z)
+{
+    m_pList->dispatch(x, y, z);
+}
+
+
+void StateFilterCommandList::setVertexBuffers(U32 startSlot, VertexBufferView** vbvs, U32 vertexBufferCount)
+{
+    B32 changed = startSlot + vertexBufferCount > kMaxVertexBuffers;
+    for (U32 i = 0; i < vertexBufferCount && startSlot + i < kMaxVertexBuffers; ++i) {
+        changed |= m_pVertexBuffers[startSlot + i] != vbvs[i];
+        m_pVertexBuffers[startSlot + i] = vbvs[i];
+    }
+    if (count(STATE_CALL_VERTEX_BUFFERS, changed)) m_pList->setVertexBuffers(startSlot, vbvs, vertexBufferCount);
+}
+
+
+void StateFilterCommandList::setGraphicsRootSignature(RootSignature* pRootSignature)
+{
+    if (bind(STATE_CALL_ROOT_SIGNATURE, m_pGraphicsRootSignature, pRootSignature)) {
+        // Root parameters don't survive a change of signature.
+        clearRootParameters(m_graphicsRootParameters);
+        m_pList->setGraphicsRootSignature(pRootSignature);
+    }
+}
+
+
+void StateFilterCommandList::setComputeRootSignature(RootSignature* pRootSignature)
+{
+    if (bind(STATE_CALL_ROOT_SIGNATURE, m_pComputeRootSignature, pRootSignature)) {
+        clearRootParameters(m_computeRootParameters);
+        m_pList->setComputeRootSignature(pRootSignature);
+    }
+}
+
+
+void StateFilterCommandList::setIndexBuffer(IndexBufferView* buffer)
+{
+    if (bind(STATE_CALL_INDEX_BUFFER, m_pIndexBuffer, buffer)) m_pList->setIndexBuffer(buffer);
+}
+
+
+void StateFilterCommandList::setGraphicsRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable)
+{
+    if (bindRootParameter(m_graphicsRootParameters,
+                          rootParameterIndex,
+                          ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE,
+                          pTable,
+                          0ull))
+        m_pList->setGraphicsRootDescriptorTable(rootParameterIndex, pTable);
+}
+
+
+void StateFilterCommandList::setComputeRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable)
+{
+    if (bindRootParameter(m_computeRootParameters,
+                          rootParameterIndex,
+                          ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE,
+                          pTable,
+                          0ull))
+        m_pList->setComputeRootDescriptorTable(rootParameterIndex, pTable);
+}
+
+
+void StateFilterCommandList::setComputeRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset)
+{
+    if (bindRootParameter(m_computeRootParameters,
+                          rootParameterIndex,
+                          ROOT_PARAMETER_TYPE_CBV,
+                          pConstantBuffer,
+                          offset))
+        m_pList->setComputeRootConstantBufferView(rootParameterIndex, pConstantBuffer, offset);
+}
+
+
+void StateFilterCommandList::setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset)
+{
+    if (bindRootParameter(m_computeRootParameters,
+                          rootParameterIndex,
+                          ROOT_PARAMETER_TYPE_SRV,
+                          pShaderResourceView,
+                          offset))
+        m_pList->setComputeRootShaderResourceView(rootParameterIndex, pShaderResourceView, offset);
+}
+
+
+void StateFilterCommandList::setGraphicsRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset)
+{
+    if (bindRootParameter(m_graphicsRootParameters,
+                          rootParameterIndex,
+                          ROOT_PARAMETER_TYPE_CBV,
+                          pConstantBuffer,
+                          offset))
+        m_pList->setGraphicsRootConstantBufferView(rootParameterIndex, pConstantBuffer, offset);
+}
+
+
+void StateFilterCommandList::setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset)
+{
+    if (bindRootParameter(m_graphicsRootParameters,
+                          rootParameterIndex,
+                          ROOT_PARAMETER_TYPE_SRV,
+                          pShaderResourceView,
+                          offset))
+        m_pList->setGraphicsRootShaderResourceView(rootParameterIndex, pShaderResourceView, offset);
+}
+
+
+void StateFilterCommandList::setGraphicsRoot32BitConstant(U32 rootParameterIndex)
+{
+    // Constants aren't tracked, the call goes through and the parameter is no longer known.
+    if (rootParameterIndex < kMaxRootParameters) {
+        m_graphicsRootParameters[rootParameterIndex]._type = ROOT_PARAMETER_TYPE_NONE;
+        m_graphicsRootParameters[rootParameterIndex]._pObject = nullptr;
+    }
+    count(STATE_CALL_ROOT_PARAMETER, true);
+    m_pList->setGraphicsRoot32BitConstant(rootParameterIndex);
+}
+
+
+void StateFilterCommandList::setViewports(Viewport* pViewports, U32 viewportCount)
+{
+    B32 changed = viewportCount != m_viewportCount
+               || memcmp(pViewports, m_viewports, viewportCount * sizeof(Viewport)) != 0;
+    if (!count(STATE_CALL_VIEWPORTS, changed)) return;
+    m_viewportCount = viewportCount <= kMaxViewports ? viewportCount : kUnknownCount;
+    if (m_viewportCount != kUnknownCount) memcpy(m_viewports, pViewports, viewportCount * sizeof(Viewport));
+    m_pList->setViewports(pViewports, viewportCount);
+}
+
+
+void StateFilterCommandList::setScissors(Scissor* pScissors, U32 scissorCount)
+{
+    B32 changed = scissorCount != m_scissorCount
+               || memcmp(pScissors, m_scissors, scissorCount * sizeof(Scissor)) != 0;
+    if (!count(STATE_CALL_SCISSORS, changed)) return;
+    m_scissorCount = scissorCount <= kMaxViewports ? scissorCount : kUnknownCount;
+    if (m_scissorCount != kUnknownCount) memcpy(m_scissors, pScissors, scissorCount * sizeof(Scissor));
+    m_pList->setScissors(pScissors, scissorCount);
+}
+
+
+void StateFilterCommandList::setDescriptorTables(DescriptorTable** pTables, U32 tableCount)
+{
+    B32 changed = tableCount != m_descriptorTableCount
+               || memcmp(pTables, m_pDescriptorTables, tableCount * sizeof(DescriptorTable*)) != 0;
+    if (!count(STATE_CALL_DESCRIPTOR_TABLES, changed)) return;
+    m_descriptorTableCount = tableCount <= kMaxDescriptorTables ? tableCount : kUnknownCount;
+    if (m_descriptorTableCount != kUnknownCount) memcpy(m_pDescriptorTables, pTables, tableCount * sizeof(DescriptorTable*));
+    // Root tables point into the tables bound here, they have to be set again.
+    clearRootDescriptorTables(m_graphicsRootParameters);
+    clearRootDescriptorTables(m_computeRootParameters);
+    m_pList->setDescriptorTables(pTables, tableCount);
+}
+
+
+void StateFilterCommandList::clearRenderTarget(RenderTargetView* rtv, R32* rgba, U32 numRects, RECT* rects)
+{
+    m_pList->clearRenderTarget(rtv, rgba, numRects, rects);
+}
+
+
+void StateFilterCommandList::clearDepthStencil
+    (
+        DepthStencilView* dsv,
+        ClearFlags flags,
+        R32 depth,
+        U8 stencil,
+        U32 numRects,
+        const RECT* rects
+    )
+{
+    m_pList->clearDepthStencil(dsv, flags, depth, stencil, numRects, rects);
+}
+
+
+void StateFilterCommandList::copyResource(Resource* pDst, Resource* pSrc)
+{
+    m_pList->copyResource(pDst, pSrc);
+}
+
+
+void StateFilterCommandList::copyBufferRegion(Resource* pDst, U64 dstOffset, Resource* pSrc, U64 srcOffset, U64 szBytes)
+{
+    m_pList->copyBufferRegion(pDst, dstOffset, pSrc, srcOffset, szBytes);
+}
+
+
+void StateFilterCommandList::copyBufferToTexture2D
+    (
+        Resource* pDst,
+        Resource* pSrc,
+        U64 srcOffset,
+        U32 width,
+        U32 height,
+        DXGI_FORMAT format,
+        U32 rowPitch
+    )
+{
+    m_pList->copyBufferToTexture2D(pDst, pSrc, srcOffset, width, height, format, rowPitch);
+}
+
+
+void StateFilterCommandList::setMarker(const char* tag)
+{
+    m_pList->setMarker(tag);
+}
+} // gfx
@@ -0,0 +1,160 @@
+//
+#pragma once
+
+#include "BackendRenderer.h"
+
+namespace gfx {
+
+
+// State calls a StateFilterCommandList tracks, for its counters.
+enum StateCall
+{
+    STATE_CALL_PIPELINE,
+    STATE_CALL_ROOT_SIGNATURE,
+    STATE_CALL_ROOT_PARAMETER,
+    STATE_CALL_VERTEX_BUFFERS,
+    STATE_CALL_INDEX_BUFFER,
+    STATE_CALL_VIEWPORTS,
+    STATE_CALL_SCISSORS,
+    STATE_CALL_DESCRIPTOR_TABLES,
+    STATE_CALL_COUNT
+};
+
+
+struct StateFilterStats
+{
+    // State calls passed on to the list, and dropped as redundant, by StateCall.
+    U32 _forwarded[STATE_CALL_COUNT];
+    U32 _filtered[STATE_CALL_COUNT];
+
+    U32 getForwardedCount() const;
+    U32 getFilteredCount() const;
+    void add(const StateFilterStats& other);
+};
+
+
+/*
+    State Filter Command List sits in front of another command list, and drops state calls that
+    would bind what is already bound: pipelines, root signatures, root parameters, vertex and index
+    buffers, viewports, scissors and descriptor tables. Everything else goes straight through.
+    Passes can then set the state they need without tracking what the previous draw left bound.
+    Bindings are cleared the way the gpu clears them, on reset(), by a new root signature for
+    root parameters, and by new descriptor tables for the root tables pointing into them.
+*/
+class StateFilterCommandList : public CommandList
+{
+public:
+    static const U32 kMaxRootParameters = 16;
+    static const U32 kMaxVertexBuffers = 16;
+    static const U32 kMaxViewports = 16;
+    static const U32 kMaxDescriptorTables = 4;
+
+    StateFilterCommandList(CommandList* pList = nullptr);
+
+    // List calls go to. Changing it clears the tracked state.
+    void setList(CommandList* pList);
+    CommandList* getList() const { return m_pList; }
+    // Forget what is bound, after recording on the list directly.
+    void invalidate();
+
+    // Counters since the last reset(), a list records once per frame.
+    const StateFilterStats& getStats() const { return m_stats; }
+
+    void init() override { m_pList->init(); }
+    void destroy() override { m_pList->destroy(); }
+    void reset(const char* debugTag = nullptr) override;
+    void close() override;
+
+    void drawIndexedInstanced(U32 indexCountPerInstance,
+                              U32 instanceCount,
+                              U32 startIndexLocation,
+                              U32 baseVertexLocation,
+                              U32 startInstanceLocation) override;
+    void drawInstanced(U32 vertexCountPerInstance,
+                       U32 instanceCount,
+                       U32 startVertexLocation,
+                       U32 startInstanceLocation) override;
+
+    void setGraphicsPipeline(GraphicsPipeline* pPipeline) override;
+    void setComputePipeline(ComputePipeline* pPipeline) override;
+    void setRayTracingPipeline(RayTracingPipeline* pPipeline) override;
+    void setAccelerationStructure(Resource* pAccelerationStructure) override;
+    void setRenderPass(RenderPass* pass) override;
+    void dispatch(U32 x, U32 y, U32 z) override;
+    void setVertexBuffers(U32 startSlot, VertexBufferView** vbvs, U32 vertexBufferCount) override;
+    void setGraphicsRootSignature(RootSignature* pRootSignature) override;
+    void setComputeRootSignature(RootSignature* pRootSignature) override;
+    void setIndexBuffer(IndexBufferView* buffer) override;
+    void setGraphicsRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) override;
+    void setComputeRootDescriptorTable(U32 rootParameterIndex, DescriptorTable* pTable) override;
+    void setComputeRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset = 0ull) override;
+    void setComputeRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset = 0ull) override;
+    void setGraphicsRootConstantBufferView(U32 rootParameterIndex, Resource* pConstantBuffer, U64 offset = 0ull) override;
+    void setGraphicsRootShaderResourceView(U32 rootParameterIndex, Resource* pShaderResourceView, U64 offset = 0ull) override;
+    void setGraphicsRoot32BitConstant(U32 rootParameterIndex) override;
+    void setViewports(Viewport* pViewports, U32 viewportCount) override;
+    void setScissors(Scissor* pScissors, U32 scissorCount) override;
+    void setDescriptorTables(DescriptorTable** pTables, U32 tableCount) override;
+    void clearRenderTarget(RenderTargetView* rtv, R32* rgba, U32 numRects, RECT* rects) override;
+    void clearDepthStencil(DepthStencilView* dsv,
+                           ClearFlags flags,
+                           R32 depth,
+                           U8 stencil,
+                           U32 numRects,
+                           const RECT* rects) override;
+    void copyResource(Resource* pDst, Resource* pSrc) override;
+    void copyBufferRegion(Resource* pDst, U64 dstOffset, Resource* pSrc, U64 srcOffset, U64 szBytes) override;
+    void copyBufferToTexture2D(Resource* pDst,
+                               Resource* pSrc,
+                               U64 srcOffset,
+                               U32 width,
+                               U32 height,
+                               DXGI_FORMAT format,
+                               U32 rowPitch) override;
+    void setMarker(const char* tag = nullptr) override;
+
+private:
+    enum RootParameterType
+    {
+        ROOT_PARAMETER_TYPE_NONE,
+        ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE,
+        ROOT_PARAMETER_TYPE_CBV,
+        ROOT_PARAMETER_TYPE_SRV
+    };
+    struct RootParameter
+    {
+        RootParameterType _type;
+        const void* _pObject;
+        U64 _offset;
+    };
+
+    void clearRootParameters(RootParameter* pParameters);
+    void clearRootDescriptorTables(RootParameter* pParameters);
+    // Returns true if the call changes state, and must be forwarded. Counts it either way.
+    B32 bind(StateCall call, const void*& bound, const void* pObject);
+    B32 bindRootParameter(RootParameter* pParameters,
+                          U32 index,
+                          RootParameterType type,
+                          const void* pObject,
+                          U64 offset);
+    B32 count(StateCall call, B32 changed);
+
+    CommandList* m_pList;
+    StateFilterStats m_stats;
+
+    // Graphics, compute and ray tracing pipelines share the one slot, as they do on the gpu.
+    const void* m_pPipeline;
+    const void* m_pGraphicsRootSignature;
+    const void* m_pComputeRootSignature;
+    RootParameter m_graphicsRootParameters[kMaxRootParameters];
+    RootParameter m_computeRootParameters[kMaxRootParameters];
+    const void* m_pVertexBuffers[kMaxVertexBuffers];
+    const void* m_pIndexBuffer;
+    Viewport m_viewports[kMaxViewports];
+    U32 m_viewportCount;
+    Scissor m_scissors[kMaxViewports];
+    U32 m_scissorCount;
+    DescriptorTable* m_pDescriptorTables[kMaxDescriptorTables];
+    U32 m_descriptorTableCount;
+};
+} // gfx
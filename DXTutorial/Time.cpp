@@ -1,6 +1,10 @@
 // 
 #include "Time.h"
 
+#if !JCL_PLATFORM_WINDOWS
+#include <chrono>
+#endif
+
 
 I64 Time::g_currT = 0;
 R64 Time::g_deltaT = 0.0;
@@ -9,22 +13,45 @@ I64 Time::g_prevT = 0;
 I64 g_ticksPerTime = 0;
 
 
-void Time::initialize()
+#if JCL_PLATFORM_WINDOWS
+static void queryFrequency(I64* pFrequency)
 {
-    if (!QueryPerformanceFrequency((LARGE_INTEGER *)&g_ticksPerTime)) {
+    if (!QueryPerformanceFrequency((LARGE_INTEGER *)pFrequency)) {
     }
+}
+
 
-    if (!QueryPerformanceCounter((LARGE_INTEGER *)&g_prevT)) {
+static void queryCounter(I64* pCounter)
+{
+    if (!QueryPerformanceCounter((LARGE_INTEGER *)pCounter)) {
 
     }
+}
+#else
+static void queryFrequency(I64* pFrequency)
+{
+    *pFrequency = (I64)std::chrono::steady_clock::period::den / (I64)std::chrono::steady_clock::period::num;
+}
 
+
+static void queryCounter(I64* pCounter)
+{
+    *pCounter = (I64)std::chrono::steady_clock::now().time_since_epoch().count();
+}
+#endif
+
+
+void Time::initialize()
+{
+    queryFrequency(&g_ticksPerTime);
+    queryCounter(&g_prevT);
     update();
 }
 
 
 void Time::update()
 {
-    QueryPerformanceCounter((LARGE_INTEGER *)&g_currT);
+    queryCounter(&g_currT);
     g_deltaT = (R64)(g_currT - g_prevT) / (R64)g_ticksPerTime;
     g_prevT = g_currT;
-}
\ No newline at end of file
+}
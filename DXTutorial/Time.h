@@ -1,7 +1,7 @@
 //
 #pragma once
 
-#include "WinConfigs.h"
+#include "PlatformConfigs.h"
 
 class Time
 {
@@ -0,0 +1,147 @@
+//
+#include "TransformBatch.h"
+#include "Math/SIMD.h"
+
+namespace jcl {
+
+
+void TransformBatch::resize(U32 count)
+{
+    U32 capacity = (count + kLaneCount - 1) & ~(kLaneCount - 1);
+    if (capacity != m_capacity) {
+        // Padding lanes hold identity, so the kernel never divides by a zero determinant.
+        std::vector<R32> elements(12 * capacity, 0.0f);
+        for (U32 i = 0; i < capacity; ++i) {
+            elements[0 * capacity + i] = 1.0f;
+            elements[4 * capacity + i] = 1.0f;
+            elements[8 * capacity + i] = 1.0f;
+        }
+        U32 keep = m_count < count ? m_count : count;
+        for (U32 e = 0; e < 12; ++e) {
+            for (U32 i = 0; i < keep; ++i) {
+                elements[e * capacity + i] = m_elements[e * m_capacity + i];
+            }
+        }
+        m_elements.swap(elements);
+        m_capacity = capacity;
+    }
+    m_count = count;
+}
+
+
+void TransformBatch::setWorld(U32 i, const Matrix44& world)
+{
+    for (U32 row = 0; row < 4; ++row) {
+        for (U32 col = 0; col < 3; ++col) {
+            m_elements[(row * 3 + col) * m_capacity + i] = world._[row][col];
+        }
+    }
+}
+
+
+Matrix44 TransformBatch::getWorld(U32 i) const
+{
+    Matrix44 world;
+    for (U32 row = 0; row < 4; ++row) {
+        for (U32 col = 0; col < 3; ++col) {
+            world._[row][col] = m_elements[(row * 3 + col) * m_capacity + i];
+        }
+    }
+    return world;
+}
+
+
+void TransformBatch::computeDescriptors(const Matrix44& viewToClip, PerMeshDescriptor* pDescriptors) const
+{
+    using namespace m::simd;
+
+    F4 vp[4][4];
+    for (U32 row = 0; row < 4; ++row) {
+        for (U32 col = 0; col < 4; ++col) {
+            vp[row][col] = splat(viewToClip._[row][col]);
+        }
+    }
+    const F4 zero = splat(0.0f);
+    const F4 one = splat(1.0f);
+
+    for (U32 base = 0; base < m_count; base += kLaneCount) {
+        // Each register holds one matrix element for kLaneCount meshes.
+        F4 w[4][3];
+        for (U32 row = 0; row < 4; ++row) {
+            for (U32 col = 0; col < 3; ++col) {
+                w[row][col] = load(&m_elements[(row * 3 + col) * m_capacity + base]);
+            }
+        }
+
+        // World * ViewToClip, with the implied (0, 0, 0, 1) column of the world transform.
+        F4 wvp[4][4];
+        for (U32 row = 0; row < 4; ++row) {
+            for (U32 col = 0; col < 4; ++col) {
+                F4 r = mul(w[row][0], vp[0][col]);
+                r = madd(w[row][1], vp[1][col], r);
+                r = madd(w[row][2], vp[2][col], r);
+                wvp[row][col] = (row == 3) ? add(r, vp[3][col]) : r;
+            }
+        }
+
+        // Normal matrix is the inverse transpose of the upper 3x3, which is its cofactor
+        // matrix over the determinant. The cofactor rows are cross products of the rows.
+        F4 n[3][3];
+        n[0][0] = sub(mul(w[1][1], w[2][2]), mul(w[1][2], w[2][1]));
+        n[0][1] = sub(mul(w[1][2], w[2][0]), mul(w[1][0], w[2][2]));
+        n[0][2] = sub(mul(w[1][0], w[2][1]), mul(w[1][1], w[2][0]));
+        n[1][0] = sub(mul(w[2][1], w[0][2]), mul(w[2][2], w[0][1]));
+        n[1][1] = sub(mul(w[2][2], w[0][0]), mul(w[2][0], w[0][2]));
+        n[1][2] = sub(mul(w[2][0], w[0][1]), mul(w[2][1], w[0][0]));
+        n[2][0] = sub(mul(w[0][1], w[1][2]), mul(w[0][2], w[1][1]));
+        n[2][1] = sub(mul(w[0][2], w[1][0]), mul(w[0][0], w[1][2]));
+        n[2][2] = sub(mul(w[0][0], w[1][1]), mul(w[0][1], w[1][0]));
+        F4 det = mul(w[0][0], n[0][0]);
+        det = madd(w[0][1], n[0][1], det);
+        det = madd(w[0][2], n[0][2], det);
+        F4 rDet = div(one, det);
+
+        // Back to one row per register, kLaneCount meshes at a time.
+        F4 worldRows[4][4];
+        F4 wvpRows[4][4];
+        F4 nRows[4][4];
+        for (U32 row = 0; row < 4; ++row) {
+            F4* pWorld = worldRows[row];
+            pWorld[0] = w[row][0];
+            pWorld[1] = w[row][1];
+            pWorld[2] = w[row][2];
+            pWorld[3] = (row == 3) ? one : zero;
+            transpose(pWorld[0], pWorld[1], pWorld[2], pWorld[3]);
+
+            F4* pWvp = wvpRows[row];
+            pWvp[0] = wvp[row][0];
+            pWvp[1] = wvp[row][1];
+            pWvp[2] = wvp[row][2];
+            pWvp[3] = wvp[row][3];
+            transpose(pWvp[0], pWvp[1], pWvp[2], pWvp[3]);
+
+            F4* pN = nRows[row];
+            if (row < 3) {
+                pN[0] = mul(n[row][0], rDet);
+                pN[1] = mul(n[row][1], rDet);
+                pN[2] = mul(n[row][2], rDet);
+                pN[3] = zero;
+                transpose(pN[0], pN[1], pN[2], pN[3]);
+            } else {
+                pN[0] = pN[1] = pN[2] = pN[3] = set(0.0f, 0.0f, 0.0f, 1.0f);
+            }
+        }
+
+        U32 lanes = (m_count - base) < kLaneCount ? (m_count - base) : kLaneCount;
+        for (U32 lane = 0; lane < lanes; ++lane) {
+            PerMeshDescriptor& descriptor = pDescriptors[base + lane];
+            for (U32 row = 0; row < 4; ++row) {
+                store(descriptor._previousWorldToViewClip._[row], load(descriptor._worldToViewClip._[row]));
+                store(descriptor._world._[row], worldRows[row][lane]);
+                store(descriptor._worldToViewClip._[row], wvpRows[row][lane]);
+                store(descriptor._n._[row], nRows[row][lane]);
+            }
+        }
+    }
+}
+} // jcl
@@ -0,0 +1,45 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+
+#include <vector>
+
+namespace jcl {
+
+
+/*
+    Transform Batch holds the world transforms of many meshes in structure of arrays form.
+    Each of the 12 elements of the affine 4x3 part of a world matrix lives in its own stream,
+    so that the descriptor kernel can work on several meshes per vector register with no
+    shuffling. The 4th column of every world transform is implied as (0, 0, 0, 1).
+*/
+class TransformBatch
+{
+public:
+    // Number of meshes processed per kernel step. Streams are padded to this.
+    static const U32 kLaneCount = 4;
+
+    TransformBatch() : m_count(0), m_capacity(0) { }
+
+    void resize(U32 count);
+    U32 getCount() const { return m_count; }
+
+    void setWorld(U32 i, const Matrix44& world);
+    Matrix44 getWorld(U32 i) const;
+
+    // Stream for matrix element (row, col), row in [0, 4), col in [0, 3).
+    R32* getStream(U32 row, U32 col) { return &m_elements[(row * 3 + col) * m_capacity]; }
+    const R32* getStream(U32 row, U32 col) const { return &m_elements[(row * 3 + col) * m_capacity]; }
+
+    // Writes _world, _worldToViewClip, _previousWorldToViewClip and _n for every mesh in the batch.
+    // The previous frame's _worldToViewClip in pDescriptors is carried over into _previousWorldToViewClip.
+    // pDescriptors must hold getCount() entries.
+    void computeDescriptors(const Matrix44& viewToClip, PerMeshDescriptor* pDescriptors) const;
+
+private:
+    U32 m_count;
+    U32 m_capacity;
+    std::vector<R32> m_elements;
+};
+} // jcl
@@ -0,0 +1,227 @@
+//
+#include "UploadQueue.h"
+
+#include <string.h>
+
+namespace jcl {
+
+
+static U64 alignUp(U64 value, U64 alignment)
+{
+    return (value + alignment - 1ull) & ~(alignment - 1ull);
+}
+
+
+void UploadQueue::initialize(gfx::BackendRenderer* pBackend, U64 stagingBytes)
+{
+    m_pBackend = pBackend;
+    m_capacity = alignUp(stagingBytes, kTexturePlacementAlignment);
+    m_head = 0;
+    m_usedBytes = 0;
+    m_open = Batch();
+    m_pBackend->createBuffer(&m_pStaging,
+                             gfx::RESOURCE_USAGE_CPU_TO_GPU,
+                             gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                             static_cast<U32>(m_capacity),
+                             0, TEXT("UploadStagingRing"));
+    // Upload heap memory stays mapped for the lifetime of the ring.
+    m_pBase = m_pStaging ? static_cast<U8*>(m_pStaging->map(nullptr)) : nullptr;
+}
+
+
+void UploadQueue::cleanUp()
+{
+    waitIdle();
+    for (U32 i = 0; i < m_freeLists.size(); ++i) {
+        m_pBackend->destroyCommandList(m_freeLists[i]);
+    }
+    m_freeLists.clear();
+    for (U32 i = 0; i < m_freeFences.size(); ++i) {
+        m_pBackend->destroyFence(m_freeFences[i]);
+    }
+    m_freeFences.clear();
+    if (m_pStaging) {
+        m_pStaging->unmap(nullptr);
+        m_pBackend->destroyResource(m_pStaging);
+    }
+    m_pStaging = nullptr;
+    m_pBase = nullptr;
+}
+
+
+B32 UploadQueue::tryAllocate(U64 szBytes, U64 alignment, U64* pOffset)
+{
+    U64 offset = alignUp(m_head, alignment);
+    U64 cost = offset - m_head + szBytes;
+    if (offset + szBytes > m_capacity) {
+        // Not enough room before the end, skip the rest of the ring and start over at 0.
+        offset = 0;
+        cost = m_capacity - m_head + szBytes;
+    }
+    if (m_usedBytes + cost > m_capacity) {
+        return false;
+    }
+    m_usedBytes += cost;
+    m_open._stagingBytes += cost;
+    m_head = offset + szBytes;
+    *pOffset = offset;
+    return true;
+}
+
+
+U8* UploadQueue::stage(U64 szBytes, U64 alignment, gfx::Resource** ppSrc, U64* pSrcOffset)
+{
+    if (szBytes > m_capacity || !m_pBase) {
+        gfx::Resource* pStaging = nullptr;
+        m_pBackend->createBuffer(&pStaging,
+                                 gfx::RESOURCE_USAGE_CPU_TO_GPU,
+                                 gfx::RESOURCE_BIND_SHADER_RESOURCE,
+                                 static_cast<U32>(szBytes),
+                                 0, TEXT("UploadStaging"));
+        m_open._dedicatedStaging.push_back(pStaging);
+        *ppSrc = pStaging;
+        *pSrcOffset = 0;
+        return static_cast<U8*>(pStaging->map(nullptr));
+    }
+
+    U64 offset = 0;
+    if (!tryAllocate(szBytes, alignment, &offset)) {
+        // The open batch may hold most of the ring, it has to go out before anything retires.
+        flush();
+        while (!tryAllocate(szBytes, alignment, &offset)) {
+            if (m_inFlight.empty()) {
+                // Only wasted space at the end is left, rewind the empty ring.
+                m_head = 0;
+                continue;
+            }
+            m_pBackend->waitFence(m_inFlight.front()._pFence);
+            retireFront();
+        }
+    }
+    *ppSrc = m_pStaging;
+    *pSrcOffset = offset;
+    return m_pBase + offset;
+}
+
+
+gfx::CommandList* UploadQueue::getOpenList()
+{
+    if (!m_open._pList) {
+        if (!m_freeLists.empty()) {
+            m_open._pList = m_freeLists.back();
+            m_freeLists.pop_back();
+        } else {
+            m_pBackend->createCommandList(&m_open._pList);
+            m_open._pList->init();
+        }
+        m_open._pList->reset("Upload");
+        m_open._ticket = m_nextTicket;
+    }
+    return m_open._pList;
+}
+
+
+UploadTicket UploadQueue::uploadBuffer(gfx::Resource* pDst, U64 dstOffset, const void* pData, U64 szBytes)
+{
+    if (!pDst || !szBytes) return m_completedTicket;
+
+    gfx::Resource* pSrc = nullptr;
+    U64 srcOffset = 0;
+    U8* pStaged = stage(szBytes, kBufferAlignment, &pSrc, &srcOffset);
+    memcpy(pStaged, pData, szBytes);
+    if (pSrc != m_pStaging) pSrc->unmap(nullptr);
+
+    getOpenList()->copyBufferRegion(pDst, dstOffset, pSrc, srcOffset, szBytes);
+    ++m_copyCount;
+    return m_nextTicket;
+}
+
+
+UploadTicket UploadQueue::uploadTexture2D(gfx::Resource* pDst,
+                                          const void* pData,
+                                          U32 width,
+                                          U32 height,
+                                          U32 bytesPerPixel,
+                                          DXGI_FORMAT format)
+{
+    if (!pDst || !width || !height) return m_completedTicket;
+
+    // Rows are padded out to the copy engine's pitch.
+    U64 srcPitch = static_cast<U64>(width) * bytesPerPixel;
+    U64 rowPitch = alignUp(srcPitch, kTexturePitchAlignment);
+    gfx::Resource* pSrc = nullptr;
+    U64 srcOffset = 0;
+    U8* pStaged = stage(rowPitch * height, kTexturePlacementAlignment, &pSrc, &srcOffset);
+    const U8* pRows = static_cast<const U8*>(pData);
+    for (U32 row = 0; row < height; ++row) {
+        memcpy(pStaged + row * rowPitch, pRows + row * srcPitch, srcPitch);
+    }
+    if (pSrc != m_pStaging) pSrc->unmap(nullptr);
+
+    getOpenList()->copyBufferToTexture2D(pDst, pSrc, srcOffset, width, height, format, static_cast<U32>(rowPitch));
+    ++m_copyCount;
+    return m_nextTicket;
+}
+
+
+UploadTicket UploadQueue::flush()
+{
+    if (!m_open._pList) return m_nextTicket - 1;
+
+    m_open._pList->close();
+    m_pBackend->submit(m_pBackend->getSwapchainQueue(), &m_open._pList, 1);
+    if (!m_freeFences.empty()) {
+        m_open._pFence = m_freeFences.back();
+        m_freeFences.pop_back();
+    } else {
+        m_pBackend->createFence(&m_open._pFence);
+    }
+    m_pBackend->signalFence(m_pBackend->getSwapchainQueue(), m_open._pFence);
+
+    m_inFlight.push_back(m_open);
+    m_open = Batch();
+    ++m_batchCount;
+    return m_nextTicket++;
+}
+
+
+void UploadQueue::retireFront()
+{
+    Batch& batch = m_inFlight.front();
+    m_usedBytes -= batch._stagingBytes;
+    m_completedTicket = batch._ticket;
+    for (U32 i = 0; i < batch._dedicatedStaging.size(); ++i) {
+        m_pBackend->destroyResource(batch._dedicatedStaging[i]);
+    }
+    m_freeFences.push_back(batch._pFence);
+    m_freeLists.push_back(batch._pList);
+    m_inFlight.pop_front();
+}
+
+
+void UploadQueue::retire()
+{
+    while (!m_inFlight.empty() && m_pBackend->isFenceComplete(m_inFlight.front()._pFence)) {
+        retireFront();
+    }
+}
+
+
+B32 UploadQueue::isComplete(UploadTicket ticket)
+{
+    retire();
+    return ticket <= m_completedTicket;
+}
+
+
+void UploadQueue::wait(UploadTicket ticket)
+{
+    if (ticket >= m_nextTicket) {
+        flush();
+    }
+    while (m_completedTicket < ticket && !m_inFlight.empty()) {
+        m_pBackend->waitFence(m_inFlight.front()._pFence);
+        retireFront();
+    }
+}
+} // jcl
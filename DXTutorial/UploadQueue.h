@@ -0,0 +1,117 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "BackendRenderer.h"
+
+#include <deque>
+#include <vector>
+
+namespace jcl {
+
+
+// Identifies the batch an upload was recorded into. Tickets grow with every batch, so an upload
+// is done once its ticket is at most the last completed ticket. 0 is always complete.
+typedef U64 UploadTicket;
+
+
+/*
+    Upload Queue moves data to gpu resources through one persistently mapped staging ring.
+    Uploads are copied into the ring right away, so the caller's memory can be freed on return,
+    and the gpu copies are batched into one command list with a single fence signal per flush.
+    Command lists and fences of retired batches are kept for the next ones.
+    Staging space is reclaimed in order, as batch fences complete. When the ring is full,
+    the open batch is flushed and the oldest batches are waited on. Uploads bigger than the
+    whole ring get a staging buffer of their own, released with their batch.
+*/
+class UploadQueue
+{
+public:
+    // Buffer placement, and texture row pitch and placement, alignments of the copy engine.
+    static const U64 kBufferAlignment = 16ull;
+    static const U64 kTexturePitchAlignment = 256ull;
+    static const U64 kTexturePlacementAlignment = 512ull;
+
+    UploadQueue()
+        : m_pBackend(nullptr)
+        , m_pStaging(nullptr)
+        , m_pBase(nullptr)
+        , m_capacity(0)
+        , m_head(0)
+        , m_usedBytes(0)
+        , m_nextTicket(1)
+        , m_completedTicket(0)
+        , m_batchCount(0)
+        , m_copyCount(0) { }
+
+    void initialize(gfx::BackendRenderer* pBackend, U64 stagingBytes);
+    void cleanUp();
+
+    // Stage szBytes of pData for copy into the buffer pDst at dstOffset.
+    UploadTicket uploadBuffer(gfx::Resource* pDst, U64 dstOffset, const void* pData, U64 szBytes);
+    // Stage a tightly packed 2D image for copy into mip 0 of the texture pDst.
+    UploadTicket uploadTexture2D(gfx::Resource* pDst,
+                                 const void* pData,
+                                 U32 width,
+                                 U32 height,
+                                 U32 bytesPerPixel,
+                                 DXGI_FORMAT format);
+
+    // Submit the open batch, if it has any copies. Returns the ticket of the last submitted batch.
+    UploadTicket flush();
+    // Reclaim the staging space of every batch the gpu has finished, without blocking.
+    void retire();
+
+    B32 isComplete(UploadTicket ticket);
+    // Block until the ticket's batch is done, flushing it first if still open.
+    void wait(UploadTicket ticket);
+    void waitIdle() { wait(m_nextTicket); }
+
+    // Ticket that uploads recorded now will complete with.
+    UploadTicket getOpenTicket() const { return m_nextTicket; }
+    UploadTicket getCompletedTicket() const { return m_completedTicket; }
+
+    // Batches submitted, and copies recorded, so far.
+    U64 getBatchCount() const { return m_batchCount; }
+    U64 getCopyCount() const { return m_copyCount; }
+    U64 getUsedBytes() const { return m_usedBytes; }
+    U64 getCapacity() const { return m_capacity; }
+
+private:
+    struct Batch
+    {
+        gfx::CommandList* _pList;
+        gfx::Fence* _pFence;
+        UploadTicket _ticket;
+        // Ring bytes to give back, alignment padding included.
+        U64 _stagingBytes;
+        // Staging buffers of uploads too big for the ring.
+        std::vector<gfx::Resource*> _dedicatedStaging;
+    };
+
+    // Reserve ring space and return a cpu pointer to it, along with the staging buffer and offset
+    // to copy from. Falls back to a dedicated buffer for uploads bigger than the ring.
+    U8* stage(U64 szBytes, U64 alignment, gfx::Resource** ppSrc, U64* pSrcOffset);
+    B32 tryAllocate(U64 szBytes, U64 alignment, U64* pOffset);
+    gfx::CommandList* getOpenList();
+    void retireFront();
+
+    gfx::BackendRenderer* m_pBackend;
+    gfx::Resource* m_pStaging;
+    U8* m_pBase;
+    U64 m_capacity;
+    U64 m_head;
+    U64 m_usedBytes;
+
+    UploadTicket m_nextTicket;
+    UploadTicket m_completedTicket;
+
+    Batch m_open;
+    std::deque<Batch> m_inFlight;
+    std::vector<gfx::CommandList*> m_freeLists;
+    std::vector<gfx::Fence*> m_freeFences;
+
+    U64 m_batchCount;
+    U64 m_copyCount;
+};
+} // jcl
@@ -2,13 +2,16 @@
 #include "VelocityRenderer.h"
 #include "BackendRenderer.h"
 #include "GraphicsResources.h"
+#include "PipelineCache.h"
+#include "VertexFormat.h"
 
 #include <array>
 
 namespace jcl {
 
 
-gfx::GraphicsPipeline* pPipelineVelocity = nullptr;
+// Velocity pipeline for each VertexFormat.
+gfx::GraphicsPipeline* pPipelinesVelocity[VERTEX_FORMAT_COUNT] = { };
 gfx::GraphicsPipeline* pPipelineVelocityResolve = nullptr;
 
 gfx::RootSignature* pVelocityRootSig = nullptr;
@@ -20,7 +23,7 @@ gfx::RenderTargetView* pVelocityRenderTargetView = nullptr;
 gfx::RenderPass* pVelocityRenderPass = nullptr;
 
 
-void initializePipeline(gfx::BackendRenderer* pRenderer)
+void initializePipeline(PipelineCache* pPipelineCache)
 {
     gfx::GraphicsPipelineInfo velocityPipelineInfo = { };
     velocityPipelineInfo._pRootSignature = pVelocityRootSig;
@@ -39,21 +42,9 @@ void initializePipeline(gfx::BackendRenderer* pRenderer)
 
     velocityPipelineInfo._sampleMask = 0xffffffff;
     
-    std::vector<gfx::InputElementInfo> elements(4);
-    std::vector<const CHAR*> semantics = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD" };
-    U32 offset = 0;
-    for (size_t i = 0; i < elements.size(); ++i) {
-        elements[i]._alignedByteOffset = offset;
-        elements[i]._classification = gfx::INPUT_CLASSIFICATION_PER_VERTEX;
-        elements[i]._format = DXGI_FORMAT_R32G32B32A32_FLOAT;
-        elements[i]._instanceDataStepRate = 0;
-        elements[i]._semanticIndex = 0;
-        elements[i]._semanticName = semantics[i];
-        offset += sizeof(Vector4);
-    }
-
-    velocityPipelineInfo._inputLayout._elementCount = elements.size();
-    velocityPipelineInfo._inputLayout._pInputElements = elements.data();
+    gfx::InputElementInfo elements[kVertexElementCount];
+    velocityPipelineInfo._inputLayout._elementCount = kVertexElementCount;
+    velocityPipelineInfo._inputLayout._pInputElements = elements;
 
     velocityPipelineInfo._rasterizationState._antialiasedLinesEnable = false;
     velocityPipelineInfo._rasterizationState._conservativeRasterizationEnable = false;
@@ -72,22 +63,25 @@ void initializePipeline(gfx::BackendRenderer* pRenderer)
     vertexShader._pByteCode = new U8[1024 * 64];
     pixelShader._pByteCode = new U8[1024 * 64];
 
-    retrieveShader("Velocity.vs.cso", &vertexShader._pByteCode, vertexShader._szBytes);
     retrieveShader("Velocity.ps.cso", &pixelShader._pByteCode, pixelShader._szBytes);
 
     velocityPipelineInfo._pixelShader = pixelShader;
-    velocityPipelineInfo._vertexShader = vertexShader;
 
-    pRenderer->createGraphicsPipelineState(&pPipelineVelocity, &velocityPipelineInfo);
+    for (U32 format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+        getVertexInputElements(VertexFormat(format), elements);
+        retrieveShader(getVertexShaderPath(VertexFormat(format), "Velocity.vs.cso"), 
+                       &vertexShader._pByteCode, vertexShader._szBytes);
+        velocityPipelineInfo._vertexShader = vertexShader;
+        pPipelinesVelocity[format] = pPipelineCache->getGraphicsPipeline(velocityPipelineInfo);
+    }
 
     delete[] vertexShader._pByteCode;
     delete[] pixelShader._pByteCode;
 }
 
 
-void initializeRootSignature(gfx::BackendRenderer* pRenderer)
+void initializeRootSignature(gfx::BackendRenderer* pRenderer, PipelineCache* pPipelineCache)
 {
-    pRenderer->createRootSignature(&pVelocityRootSig);
     pRenderer->createRootSignature(&pVelocityResolveRootSig);
     std::array<gfx::PipelineLayout, 2> layout;
 
@@ -100,7 +94,8 @@ void initializeRootSignature(gfx::BackendRenderer* pRenderer)
     layout[1]._numConstantBuffers = 1;
 
 
-    pVelocityRootSig->initialize(gfx::SHADER_VISIBILITY_PIXEL | gfx::SHADER_VISIBILITY_VERTEX, layout.data(), layout.size());
+    pVelocityRootSig = pPipelineCache->getRootSignature(gfx::SHADER_VISIBILITY_PIXEL | gfx::SHADER_VISIBILITY_VERTEX, 
+                                                        layout.data(), static_cast<U32>(layout.size()));
     
     std::array<gfx::PipelineLayout, 3> resolveLayout;
     //resolveLayout
@@ -136,10 +131,12 @@ void initializeRenderTarget(gfx::BackendRenderer* pRenderer)
 }
 
 
-void initializeVelocityRenderer(gfx::BackendRenderer* pRenderer, gfx::DepthStencilView* pDepth)
+void initializeVelocityRenderer(gfx::BackendRenderer* pRenderer, 
+                                PipelineCache* pPipelineCache, 
+                                gfx::DepthStencilView* pDepth)
 {
-    initializeRootSignature(pRenderer);
-    initializePipeline(pRenderer);
+    initializeRootSignature(pRenderer, pPipelineCache);
+    initializePipeline(pPipelineCache);
     initializeRenderTarget(pRenderer);
     initializeRenderPass(pRenderer, pDepth);
 }
@@ -153,11 +150,13 @@ void cleanUpVelocityRenderer(gfx::BackendRenderer* pRenderer)
 
 void submitVelocityCommands(gfx::BackendRenderer* pRenderer, 
                             gfx::Resource* pGlobal, 
+                            gfx::Resource* pConstants, 
                             gfx::CommandList* pList, 
                             GeometryMesh** pMeshes, 
                             U32 meshCount,
                             GeometrySubMesh** pSubMeshes,
-                            U32 submeshCount)
+                            U32 submeshCount,
+                            B32 clearTarget)
 {
     pList->setMarker("Velocity");
 
@@ -171,24 +170,27 @@ void submitVelocityCommands(gfx::BackendRenderer* pRenderer,
     viewport.y = 0.0f;
     viewport.mind = 0.0f;
     viewport.maxd = 1.0f;
-    pList->clearRenderTarget(pVelocityRenderTargetView, rgba, 1, &rect);
+    if (clearTarget)
+        pList->clearRenderTarget(pVelocityRenderTargetView, rgba, 1, &rect);
     pList->setViewports(&viewport, 1);
 
     pList->setGraphicsRootSignature(pVelocityRootSig);
     pList->setGraphicsRootConstantBufferView(GLOBAL_CONST_SLOT, pGlobal);
-    pList->setGraphicsPipeline(pPipelineVelocity);
 
+    U32 boundFormat = VERTEX_FORMAT_COUNT;
     U32 submeshIdx = 0;
     for (U32 i = 0; i < meshCount; ++i) {
         GeometryMesh* pMesh = pMeshes[i];
-        RenderUUID meshId = pMesh->_meshTransform;
         RenderUUID vertId = pMesh->_vertexBufferView;
+        if (pMesh->_vertexFormat != boundFormat) {
+            boundFormat = pMesh->_vertexFormat;
+            pList->setGraphicsPipeline(pPipelinesVelocity[boundFormat]);
+        }
         RenderUUID indId = pMesh->_indexBufferView;
-        gfx::Resource* pMeshDescriptor = getResource(meshId);
         gfx::VertexBufferView* vb = getVertexBufferView(vertId);
         
         pList->setVertexBuffers(0, &vb, 1);
-        pList->setGraphicsRootConstantBufferView(MESH_TRANSFORM_SLOT, pMeshDescriptor);
+        pList->setGraphicsRootConstantBufferView(MESH_TRANSFORM_SLOT, pConstants, pMesh->_meshDescriptorOffset);
 
         if (indId != 0)
             pList->setIndexBuffer(getIndexBufferView(indId));
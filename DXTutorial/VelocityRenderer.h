@@ -5,14 +5,22 @@
 
 namespace jcl {
 
-void initializeVelocityRenderer(gfx::BackendRenderer* pRenderer, gfx::DepthStencilView* pDepth);
+class PipelineCache;
+
+
+void initializeVelocityRenderer(gfx::BackendRenderer* pRenderer, 
+                                PipelineCache* pPipelineCache, 
+                                gfx::DepthStencilView* pDepth);
 void cleanUpVelocityRenderer(gfx::BackendRenderer* pRenderer);
 
 void submitVelocityCommands(gfx::BackendRenderer* pRenderer, 
                             gfx::Resource* pGlobal, 
+                            gfx::Resource* pConstants, 
                             gfx::CommandList* pList, 
                             GeometryMesh** pMeshes, 
                             U32 meshCount,
                             GeometrySubMesh** pSubMeshes,
-                            U32 submeshCount);
+                            U32 submeshCount,
+                            // The velocity target is cleared by the first of the lists a split pass records into.
+                            B32 clearTarget = true);
 } // jcl
\ No newline at end of file
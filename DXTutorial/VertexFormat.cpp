@@ -0,0 +1,247 @@
+//
+#include "VertexFormat.h"
+#include "Math/SIMD.h"
+
+#include <stddef.h>
+#include <string.h>
+
+namespace jcl {
+
+
+static_assert(sizeof(PackedVertex) == 20, "PackedVertex must match the packed input layout.");
+
+static const R32 kPositionRange = 65535.0f;
+static const R32 kSnormRange = 32767.0f;
+
+
+// Round to nearest even float to half conversion, overflowing to infinity.
+static U16 floatToHalf(R32 value)
+{
+    U32 bits;
+    memcpy(&bits, &value, sizeof(bits));
+    U32 sign = (bits >> 16) & 0x8000u;
+    U32 absBits = bits & 0x7fffffffu;
+    if (absBits >= 0x47800000u) {
+        // Too big for a half, or already inf/nan.
+        return static_cast<U16>(sign | (absBits > 0x7f800000u ? 0x7e00u : 0x7c00u));
+    }
+    if (absBits < 0x38800000u) {
+        // Half denormal, adding 0.5 lets the float unit do the rounding.
+        R32 f;
+        memcpy(&f, &absBits, sizeof(f));
+        f += 0.5f;
+        memcpy(&absBits, &f, sizeof(absBits));
+        return static_cast<U16>(sign | (absBits - 0x3f000000u));
+    }
+    // Rebias the exponent, and round the mantissa to nearest even.
+    absBits += 0xc8000fffu + ((absBits >> 13) & 1u);
+    return static_cast<U16>(sign | (absBits >> 13));
+}
+
+
+static R32 halfToFloat(U16 half)
+{
+    U32 sign = static_cast<U32>(half & 0x8000u) << 16;
+    U32 bits = static_cast<U32>(half & 0x7fffu) << 13;
+    U32 exponent = bits & 0x0f800000u;
+    bits += (127u - 15u) << 23;
+    if (exponent == 0x0f800000u) {
+        bits += (128u - 16u) << 23;
+    } else if (exponent == 0) {
+        // Denormal, renormalize through the float unit.
+        const U32 magicBits = 113u << 23;
+        R32 f, magic;
+        bits += 1u << 23;
+        memcpy(&f, &bits, sizeof(f));
+        memcpy(&magic, &magicBits, sizeof(magic));
+        f -= magic;
+        memcpy(&bits, &f, sizeof(bits));
+    }
+    bits |= sign;
+    R32 value;
+    memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+
+// Octahedral encoding of four unit vectors, given as x, y and z lanes, scaled to snorm range.
+static void encodeOctahedral(simd::F4 x, simd::F4 y, simd::F4 z, I32* pOutX, I32* pOutY)
+{
+    using namespace simd;
+    F4 one = splat(1.0f);
+    // Zero vectors encode as +z, instead of dividing by zero.
+    F4 l1 = max(add(add(abs(x), abs(y)), abs(z)), splat(1e-20f));
+    F4 inv = div(one, l1);
+    F4 px = mul(x, inv);
+    F4 py = mul(y, inv);
+    // Lower hemisphere folds over the diagonals.
+    F4 fx = copysign(sub(one, abs(py)), px);
+    F4 fy = copysign(sub(one, abs(px)), py);
+    F4 lower = cmplt(z, splat(0.0f));
+    F4 range = splat(kSnormRange);
+    storeRounded(pOutX, mul(select(lower, fx, px), range));
+    storeRounded(pOutY, mul(select(lower, fy, py), range));
+}
+
+
+static Vector3 decodeOctahedral(I16 ex, I16 ey)
+{
+    R32 x = fmaxf(static_cast<R32>(ex) / kSnormRange, -1.0f);
+    R32 y = fmaxf(static_cast<R32>(ey) / kSnormRange, -1.0f);
+    Vector3 v(x, y, 1.0f - fabsf(x) - fabsf(y));
+    R32 t = fmaxf(-v._z, 0.0f);
+    v._x += v._x >= 0.0f ? -t : t;
+    v._y += v._y >= 0.0f ? -t : t;
+    return v.normalize();
+}
+
+
+U32 getVertexStride(VertexFormat format)
+{
+    return format == VERTEX_FORMAT_PACKED ? sizeof(PackedVertex) : sizeof(Vertex);
+}
+
+
+void getVertexInputElements(VertexFormat format, gfx::InputElementInfo* pElements)
+{
+    static const CHAR* kSemantics[kVertexElementCount] = { "POSITION", "NORMAL", "TANGENT", "TEXCOORD" };
+    static const DXGI_FORMAT kPackedFormats[kVertexElementCount] = { DXGI_FORMAT_R16G16B16A16_UNORM,
+                                                                     DXGI_FORMAT_R16G16_SNORM,
+                                                                     DXGI_FORMAT_R16G16_SNORM,
+                                                                     DXGI_FORMAT_R16G16_FLOAT };
+    static const U32 kPackedOffsets[kVertexElementCount] = { offsetof(PackedVertex, _position),
+                                                             offsetof(PackedVertex, _normal),
+                                                             offsetof(PackedVertex, _tangent),
+                                                             offsetof(PackedVertex, _texcoords) };
+    for (U32 i = 0; i < kVertexElementCount; ++i) {
+        gfx::InputElementInfo& element = pElements[i];
+        element._classification = gfx::INPUT_CLASSIFICATION_PER_VERTEX;
+        element._instanceDataStepRate = 0;
+        element._semanticIndex = 0;
+        element._semanticName = kSemantics[i];
+        element._inputSlot = 0;
+        if (format == VERTEX_FORMAT_PACKED) {
+            element._format = kPackedFormats[i];
+            element._alignedByteOffset = kPackedOffsets[i];
+        } else {
+            element._format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+            element._alignedByteOffset = i * sizeof(Vector4);
+        }
+    }
+}
+
+
+std::string getVertexShaderPath(VertexFormat format, const std::string& floatShader)
+{
+    if (format != VERTEX_FORMAT_PACKED) return floatShader;
+    size_t ext = floatShader.find('.');
+    return floatShader.substr(0, ext) + "Packed" + floatShader.substr(ext);
+}
+
+
+void getPositionDequantization(const Bounds3D& bounds, Vector4* pScale, Vector4* pOffset)
+{
+    Vector3 extent = bounds.getExtent();
+    *pScale = Vector4(extent._x, extent._y, extent._z, 0.0f);
+    *pOffset = Vector4(bounds._min._x, bounds._min._y, bounds._min._z, 0.0f);
+}
+
+
+void packVertices(const Vertex* pVertices, U32 count, const Bounds3D& bounds, PackedVertex* pOut)
+{
+    using namespace simd;
+    Vector3 extent = bounds.getExtent();
+    F4 minimum = set(bounds._min._x, bounds._min._y, bounds._min._z, 0.0f);
+    F4 quantize = set(extent._x > 0.0f ? kPositionRange / extent._x : 0.0f,
+                      extent._y > 0.0f ? kPositionRange / extent._y : 0.0f,
+                      extent._z > 0.0f ? kPositionRange / extent._z : 0.0f,
+                      0.0f);
+    F4 zero = splat(0.0f);
+    F4 range = splat(kPositionRange);
+
+    Vertex tail[4];
+    for (U32 base = 0; base < count; base += 4) {
+        U32 batch = count - base < 4 ? count - base : 4;
+        const Vertex* pBatch = pVertices + base;
+        if (batch < 4) {
+            // Pad the last few vertices out to a full batch.
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, pBatch, sizeof(Vertex) * batch);
+            pBatch = tail;
+        }
+
+        I32 position[3][4];
+        {
+            F4 p0 = mul(sub(load(&pBatch[0]._position._x), minimum), quantize);
+            F4 p1 = mul(sub(load(&pBatch[1]._position._x), minimum), quantize);
+            F4 p2 = mul(sub(load(&pBatch[2]._position._x), minimum), quantize);
+            F4 p3 = mul(sub(load(&pBatch[3]._position._x), minimum), quantize);
+            transpose(p0, p1, p2, p3);
+            storeRounded(position[0], min(max(p0, zero), range));
+            storeRounded(position[1], min(max(p1, zero), range));
+            storeRounded(position[2], min(max(p2, zero), range));
+        }
+
+        I32 normal[2][4];
+        {
+            F4 n0 = load(&pBatch[0]._normal._x);
+            F4 n1 = load(&pBatch[1]._normal._x);
+            F4 n2 = load(&pBatch[2]._normal._x);
+            F4 n3 = load(&pBatch[3]._normal._x);
+            transpose(n0, n1, n2, n3);
+            encodeOctahedral(n0, n1, n2, normal[0], normal[1]);
+        }
+
+        I32 tangent[2][4];
+        R32 tangentSign[4];
+        {
+            F4 t0 = load(&pBatch[0]._tangent._x);
+            F4 t1 = load(&pBatch[1]._tangent._x);
+            F4 t2 = load(&pBatch[2]._tangent._x);
+            F4 t3 = load(&pBatch[3]._tangent._x);
+            transpose(t0, t1, t2, t3);
+            encodeOctahedral(t0, t1, t2, tangent[0], tangent[1]);
+            store(tangentSign, t3);
+        }
+
+        for (U32 i = 0; i < batch; ++i) {
+            PackedVertex& packed = pOut[base + i];
+            packed._position[0] = static_cast<U16>(position[0][i]);
+            packed._position[1] = static_cast<U16>(position[1][i]);
+            packed._position[2] = static_cast<U16>(position[2][i]);
+            packed._position[3] = tangentSign[i] < 0.0f ? 0 : 0xffff;
+            packed._normal[0] = static_cast<I16>(normal[0][i]);
+            packed._normal[1] = static_cast<I16>(normal[1][i]);
+            packed._tangent[0] = static_cast<I16>(tangent[0][i]);
+            packed._tangent[1] = static_cast<I16>(tangent[1][i]);
+            packed._texcoords[0] = floatToHalf(pBatch[i]._texcoords._x);
+            packed._texcoords[1] = floatToHalf(pBatch[i]._texcoords._y);
+        }
+    }
+}
+
+
+Vertex unpackVertex(const PackedVertex& packed, const Bounds3D& bounds)
+{
+    Vector4 scale, offset;
+    getPositionDequantization(bounds, &scale, &offset);
+    Vertex vert = { };
+    vert._position._x = static_cast<R32>(packed._position[0]) / kPositionRange * scale._x + offset._x;
+    vert._position._y = static_cast<R32>(packed._position[1]) / kPositionRange * scale._y + offset._y;
+    vert._position._z = static_cast<R32>(packed._position[2]) / kPositionRange * scale._z + offset._z;
+    vert._position._w = 1.0f;
+    Vector3 normal = decodeOctahedral(packed._normal[0], packed._normal[1]);
+    vert._normal._x = normal._x;
+    vert._normal._y = normal._y;
+    vert._normal._z = normal._z;
+    vert._normal._w = 1.0f;
+    Vector3 tangent = decodeOctahedral(packed._tangent[0], packed._tangent[1]);
+    vert._tangent._x = tangent._x;
+    vert._tangent._y = tangent._y;
+    vert._tangent._z = tangent._z;
+    vert._tangent._w = packed._position[3] ? 1.0f : -1.0f;
+    vert._texcoords._x = halfToFloat(packed._texcoords[0]);
+    vert._texcoords._y = halfToFloat(packed._texcoords[1]);
+    return vert;
+}
+} // jcl
@@ -0,0 +1,34 @@
+//
+#pragma once
+
+#include "GlobalDef.h"
+#include "BackendRenderer.h"
+
+#include <string>
+
+namespace jcl {
+
+
+// Input elements of every vertex format: position, normal, tangent and texcoord.
+static const U32 kVertexElementCount = 4;
+
+// Byte size of one vertex of the format.
+U32 getVertexStride(VertexFormat format);
+
+// Fill kVertexElementCount input elements describing the format, for the pipelines that draw it.
+void getVertexInputElements(VertexFormat format, gfx::InputElementInfo* pElements);
+
+// Compiled vertex shader to draw the format with, from the shader used for float vertices.
+// "Depth.vs.cso" becomes "DepthPacked.vs.cso" for packed vertices.
+std::string getVertexShaderPath(VertexFormat format, const std::string& floatShader);
+
+// Position dequantization that packVertices encodes against, for PerMeshDescriptor.
+void getPositionDequantization(const Bounds3D& bounds, Vector4* pScale, Vector4* pOffset);
+
+// Encode count vertices into the packed format, quantizing positions within bounds.
+// Four vertices are encoded at a time with the SIMD kernels.
+void packVertices(const Vertex* pVertices, U32 count, const Bounds3D& bounds, PackedVertex* pOut);
+
+// Decode one packed vertex, the same way the shaders do. Used to measure encoding error.
+Vertex unpackVertex(const PackedVertex& packed, const Bounds3D& bounds);
+} // jcl
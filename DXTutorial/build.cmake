@@ -0,0 +1,114 @@
+# Portable core of the renderer. Everything here builds headless against the null RHI,
+# so the cpu side of the frame can be compiled, run and profiled without Win32 or a gpu.
+# The windows application, along with the D3D11/D3D12 backends, still builds from DXTutorial.sln.
+
+set ( CMAKE_CXX_STANDARD 17 )
+set ( CMAKE_CXX_STANDARD_REQUIRED ON )
+
+if ( NOT CMAKE_BUILD_TYPE AND NOT CMAKE_CONFIGURATION_TYPES )
+  set ( CMAKE_BUILD_TYPE Release )
+endif ( )
+
+set ( TUTORIAL_DIR ${CMAKE_CURRENT_LIST_DIR} )
+set ( TUTORIAL_THIRDPARTY_DIR ${CMAKE_CURRENT_LIST_DIR}/../ThirdParty )
+
+find_package ( Threads REQUIRED )
+
+# Math kernels pick SSE/NEON from the target by default.
+option ( TUTORIAL_MATH_SCALAR "Build the math library without SIMD kernels." OFF )
+option ( TUTORIAL_MATH_AVX "Build the math library with AVX/FMA kernels (x86 only)." OFF )
+
+set ( TUTORIAL_CORE_SOURCES
+  ${TUTORIAL_DIR}/BackendRenderer.cpp
+  ${TUTORIAL_DIR}/ConstantBufferRing.cpp
+  ${TUTORIAL_DIR}/Culling.cpp
+  ${TUTORIAL_DIR}/OcclusionCuller.cpp
+  ${TUTORIAL_DIR}/FrontEndRenderer.cpp
+  ${TUTORIAL_DIR}/GeometryPass.cpp
+  ${TUTORIAL_DIR}/GraphicsResources.cpp
+  ${TUTORIAL_DIR}/JobSystem.cpp
+  ${TUTORIAL_DIR}/LightClusters.cpp
+  ${TUTORIAL_DIR}/LightRenderer.cpp
+  ${TUTORIAL_DIR}/MappedFile.cpp
+  ${TUTORIAL_DIR}/RecordingCommandList.cpp
+  ${TUTORIAL_DIR}/StateFilterCommandList.cpp
+  ${TUTORIAL_DIR}/PipelineCache.cpp
+  ${TUTORIAL_DIR}/RenderQueue.cpp
+  ${TUTORIAL_DIR}/RendererResources.cpp
+  ${TUTORIAL_DIR}/ShadowAtlas.cpp
+  ${TUTORIAL_DIR}/ShadowRenderer.cpp
+  ${TUTORIAL_DIR}/Time.cpp
+  ${TUTORIAL_DIR}/TransformBatch.cpp
+  ${TUTORIAL_DIR}/UploadQueue.cpp
+  ${TUTORIAL_DIR}/VelocityRenderer.cpp
+  ${TUTORIAL_DIR}/VertexFormat.cpp
+  ${TUTORIAL_DIR}/Math/Matrix44.cpp
+  ${TUTORIAL_DIR}/Model/MeshCache.cpp
+  ${TUTORIAL_DIR}/Model/MeshOptimizer.cpp
+  ${TUTORIAL_DIR}/Model/Model.cpp
+  ${TUTORIAL_DIR}/Model/ModelLoader.cpp
+  ${TUTORIAL_DIR}/Model/ModelOBJ.cpp
+  ${TUTORIAL_DIR}/Null/NullBackend.cpp
+)
+
+add_library ( TutorialCore STATIC ${TUTORIAL_CORE_SOURCES} )
+target_include_directories ( TutorialCore PUBLIC
+  ${TUTORIAL_DIR}
+  ${TUTORIAL_THIRDPARTY_DIR}/TinyGLTF
+  ${TUTORIAL_THIRDPARTY_DIR}/TinyOBJ
+)
+target_compile_definitions ( TutorialCore PUBLIC JCL_HEADLESS=1 )
+target_link_libraries ( TutorialCore PUBLIC Threads::Threads )
+if ( TUTORIAL_MATH_SCALAR )
+  target_compile_definitions ( TutorialCore PUBLIC JCL_MATH_SCALAR=1 )
+elseif ( TUTORIAL_MATH_AVX )
+  if ( MSVC )
+    target_compile_options ( TutorialCore PUBLIC /arch:AVX2 )
+  else ( )
+    target_compile_options ( TutorialCore PUBLIC -mavx2 -mfma )
+  endif ( )
+endif ( )
+
+# Headless frame driver, runs the front end over synthetic scenes with the null RHI.
+add_executable ( DXTutorialHeadless ${TUTORIAL_DIR}/Headless/HeadlessMain.cpp )
+target_link_libraries ( DXTutorialHeadless PRIVATE TutorialCore )
+
+# Micro-benchmarks, not registered as tests. Run them by hand from the build directory.
+add_executable ( MathBenchmark ${TUTORIAL_DIR}/Benchmarks/MathBenchmark.cpp )
+target_link_libraries ( MathBenchmark PRIVATE TutorialCore )
+
+add_executable ( ModelBenchmark ${TUTORIAL_DIR}/Benchmarks/ModelBenchmark.cpp )
+target_link_libraries ( ModelBenchmark PRIVATE TutorialCore )
+target_compile_definitions ( ModelBenchmark PRIVATE TUTORIAL_ASSET_DIR="${TUTORIAL_DIR}" )
+
+add_executable ( GLTFBenchmark ${TUTORIAL_DIR}/Benchmarks/GLTFBenchmark.cpp )
+target_link_libraries ( GLTFBenchmark PRIVATE TutorialCore )
+target_compile_definitions ( GLTFBenchmark PRIVATE TUTORIAL_ASSET_DIR="${TUTORIAL_DIR}" )
+
+add_executable ( LoadBenchmark ${TUTORIAL_DIR}/Benchmarks/LoadBenchmark.cpp )
+target_link_libraries ( LoadBenchmark PRIVATE TutorialCore )
+target_compile_definitions ( LoadBenchmark PRIVATE TUTORIAL_ASSET_DIR="${TUTORIAL_DIR}" )
+
+add_executable ( FrameBenchmark ${TUTORIAL_DIR}/Benchmarks/FrameBenchmark.cpp )
+target_link_libraries ( FrameBenchmark PRIVATE TutorialCore )
+
+add_executable ( CommandStreamBenchmark ${TUTORIAL_DIR}/Benchmarks/CommandStreamBenchmark.cpp )
+target_link_libraries ( CommandStreamBenchmark PRIVATE TutorialCore )
+
+add_executable ( LightClusterBenchmark ${TUTORIAL_DIR}/Benchmarks/LightClusterBenchmark.cpp )
+target_link_libraries ( LightClusterBenchmark PRIVATE TutorialCore )
+
+add_executable ( LightSystemBenchmark ${TUTORIAL_DIR}/Benchmarks/LightSystemBenchmark.cpp )
+target_link_libraries ( LightSystemBenchmark PRIVATE TutorialCore )
+
+add_executable ( ShadowCascadeBenchmark ${TUTORIAL_DIR}/Benchmarks/ShadowCascadeBenchmark.cpp )
+target_link_libraries ( ShadowCascadeBenchmark PRIVATE TutorialCore )
+
+add_executable ( ShadowAtlasBenchmark ${TUTORIAL_DIR}/Benchmarks/ShadowAtlasBenchmark.cpp )
+target_link_libraries ( ShadowAtlasBenchmark PRIVATE TutorialCore )
+
+add_executable ( OcclusionBenchmark ${TUTORIAL_DIR}/Benchmarks/OcclusionBenchmark.cpp )
+target_link_libraries ( OcclusionBenchmark PRIVATE TutorialCore )
+
+add_executable ( UploadBenchmark ${TUTORIAL_DIR}/Benchmarks/UploadBenchmark.cpp )
+target_link_libraries ( UploadBenchmark PRIVATE TutorialCore )